@@ -0,0 +1,767 @@
+// Headless benchmark suite for the core file system (no Qt). Builds a fresh
+// image, fills it to the requested level, runs the selected benchmarks and
+// prints one JSON document with per-operation latency percentiles.
+//
+//   fs_bench [options]
+//     --image PATH      Image to create (default fs_bench.img, removed afterwards)
+//     --size-mb N       Image size in MiB (default 128, at most 4095)
+//     --fill PCT        Fill the image to PCT% used before the runs (default 50)
+//     --backend NAME    stream | mmap (default stream)
+//     --cache BLOCKS    Block cache capacity (default: the file system's)
+//     --scale N         Multiplies every operation count (default 1)
+//     --seed N          Seed for sizes, offsets and orders (default 1)
+//     --only A,B,...    Run only these groups: seq, random, small, tiny, deep,
+//                       fanout, fsck, defrag
+//     --no-inline       Give every file data blocks, however small
+//     --output FILE     Write the JSON there instead of stdout
+//     --keep-image      Leave the image behind
+//     --metrics         Also report the file system's own histograms and counters
+//     --trace FILE      Record a Chrome trace of the runs there (implies --metrics)
+//
+// The file system's own console output goes to stderr so stdout stays JSON.
+
+#include "FileSystem.h"
+#include "RecoveryManager.h"
+#include "DefragManager.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace FileSystemTool;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t SEQ_CHUNK = 64 * 1024;             // Sequential transfer size
+constexpr uint64_t SEQ_FILE_BYTES = 32ull << 20;      // Per scale step, capped by free space
+constexpr uint32_t RANDOM_OPS = 2000;
+constexpr uint32_t SMALL_FILES = 1000;
+constexpr uint32_t TINY_FILES = 1000;
+constexpr uint32_t DEEP_LEVELS = 32;
+constexpr uint32_t DEEP_LOOKUPS = 2000;
+constexpr uint32_t FANOUT_FILES = 2000;
+constexpr uint32_t FANOUT_LISTS = 20;
+constexpr uint32_t FSCK_RUNS = 3;
+constexpr uint32_t DEFRAG_FILES = 200;
+constexpr uint32_t DEFRAG_BLOCKS_PER_FILE = 8;
+constexpr uint32_t FILL_BATCH_FILES = 32;
+
+const char* const SEQ_FILE = "/bench_seq";
+
+struct Options {
+    std::string image = "fs_bench.img";
+    uint32_t sizeMb = 128;
+    double fillPercent = 50;
+    DiskBackend backend = DiskBackend::STREAM;
+    size_t cacheBlocks = 0;
+    bool cacheSet = false;
+    uint32_t scale = 1;
+    uint32_t seed = 1;
+    std::vector<std::string> only;
+    std::string output;
+    bool keepImage = false;
+    bool inlineFiles = true;
+    bool metrics = false;
+    std::string trace;
+};
+
+// One benchmark's samples: a latency per operation, in microseconds
+struct Result {
+    std::string name;
+    std::vector<double> latenciesUs;
+    uint64_t bytes = 0;
+    double wallMs = 0;
+    bool ok = true;
+    std::string note;
+};
+
+struct Context {
+    FileSystem& fs;
+    const Options& options;
+    std::mt19937 rng;
+    std::vector<Result> results;
+};
+
+double elapsedUs(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// Times fn once per call and keeps the sample; false from fn marks the result failed
+class Recorder {
+public:
+    Recorder(Context& ctx, const std::string& name) : ctx_(ctx), start_(Clock::now()) {
+        result_.name = name;
+    }
+    
+    ~Recorder() {
+        result_.wallMs = elapsedUs(start_) / 1000.0;
+        ctx_.results.push_back(std::move(result_));
+    }
+    
+    bool time(const std::function<bool()>& fn, uint64_t bytes = 0) {
+        auto start = Clock::now();
+        bool ok = fn();
+        result_.latenciesUs.push_back(elapsedUs(start));
+        if (ok) {
+            result_.bytes += bytes;
+        } else {
+            result_.ok = false;
+        }
+        return ok;
+    }
+    
+    void note(const std::string& text) { result_.note = text; }
+    void fail(const std::string& text) {
+        result_.ok = false;
+        result_.note = text;
+    }
+
+private:
+    Context& ctx_;
+    Result result_;
+    Clock::time_point start_;
+};
+
+std::vector<uint8_t> randomData(std::mt19937& rng, size_t size) {
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+// Drops the block cache, so the next phase starts cold
+bool remount(FileSystem& fs) {
+    return fs.unmountFileSystem() && fs.mountFileSystem();
+}
+
+double usedPercent(FileSystem& fs) {
+    return 100.0 * fs.getUsedBlocks() / std::max<uint32_t>(1, fs.getTotalBlocks());
+}
+
+uint64_t freeBytes(FileSystem& fs) {
+    return static_cast<uint64_t>(fs.getFreeBlocks()) * BLOCK_SIZE;
+}
+
+// Small images run out of inodes before blocks; leave a few for directories
+uint32_t fileCount(FileSystem& fs, uint32_t wanted) {
+    uint32_t freeInodes = fs.getInodeManager()->getFreeInodeCount();
+    return std::min(wanted, freeInodes > 64 ? freeInodes - 64 : 0);
+}
+
+// Fill with 16-256 KiB files, punch holes by deleting every fourth one, then
+// top up again, so the runs see a used and fragmented free space
+bool fillImage(FileSystem& fs, double percent, std::mt19937& rng) {
+    if (percent <= 0) {
+        return true;
+    }
+    if (!fs.createDir("/fill")) {
+        return false;
+    }
+    
+    std::vector<std::string> paths;
+    auto fillTo = [&](double target) {
+        while (usedPercent(fs) < target) {
+            std::vector<BatchFile> batch;
+            for (uint32_t i = 0; i < FILL_BATCH_FILES; ++i) {
+                size_t size = (16 + rng() % 241) * 1024;
+                if (size + BLOCK_SIZE * 4 > freeBytes(fs)) {
+                    break;
+                }
+                batch.push_back({"/fill/f" + std::to_string(paths.size()), randomData(rng, size)});
+                paths.push_back(batch.back().path);
+            }
+            if (batch.empty() || !fs.writeBatch(batch)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    if (!fillTo(percent)) {
+        return false;
+    }
+    for (size_t i = 0; i < paths.size(); i += 4) {
+        fs.deleteFile(paths[i]);
+    }
+    return fillTo(percent);
+}
+
+// The file the sequential and random runs share; created when seq did not run
+bool ensureSeqFile(Context& ctx, uint64_t& size) {
+    Inode info;
+    if (ctx.fs.getFileInfo(SEQ_FILE, info)) {
+        size = info.fileSize;
+        return true;
+    }
+    
+    size = std::min<uint64_t>(SEQ_FILE_BYTES * ctx.options.scale, freeBytes(ctx.fs) / 4);
+    size -= size % SEQ_CHUNK;
+    FileHandle handle;
+    if (size == 0 || !ctx.fs.createFile(SEQ_FILE) || !ctx.fs.openFile(SEQ_FILE, handle)) {
+        return false;
+    }
+    auto chunk = randomData(ctx.rng, SEQ_CHUNK);
+    bool ok = true;
+    for (uint64_t offset = 0; ok && offset < size; offset += SEQ_CHUNK) {
+        ok = ctx.fs.write(handle, offset, chunk.data(), SEQ_CHUNK) == SEQ_CHUNK;
+    }
+    ctx.fs.closeFile(handle);
+    return ok;
+}
+
+void benchSequential(Context& ctx) {
+    FileSystem& fs = ctx.fs;
+    uint64_t size = std::min<uint64_t>(SEQ_FILE_BYTES * ctx.options.scale, freeBytes(fs) / 4);
+    size -= size % SEQ_CHUNK;
+    auto chunk = randomData(ctx.rng, SEQ_CHUNK);
+    
+    {
+        Recorder rec(ctx, "seq_write");
+        FileHandle handle;
+        if (size == 0 || !fs.createFile(SEQ_FILE) || !fs.openFile(SEQ_FILE, handle)) {
+            rec.fail("could not create " + std::string(SEQ_FILE));
+            return;
+        }
+        for (uint64_t offset = 0; offset < size; offset += SEQ_CHUNK) {
+            if (!rec.time([&]() { return fs.write(handle, offset, chunk.data(), SEQ_CHUNK) == SEQ_CHUNK; },
+                          SEQ_CHUNK)) {
+                break;
+            }
+        }
+        fs.closeFile(handle);
+        rec.note("64 KiB writes");
+    }
+    
+    {
+        Recorder rec(ctx, "seq_sync");
+        rec.time([&]() { return fs.sync(); });
+        rec.note("write-back of what seq_write left in the cache");
+    }
+    
+    if (!remount(fs)) {
+        return;
+    }
+    
+    Recorder rec(ctx, "seq_read");
+    FileHandle handle;
+    if (!fs.openFile(SEQ_FILE, handle)) {
+        rec.fail("could not open " + std::string(SEQ_FILE));
+        return;
+    }
+    std::vector<uint8_t> buffer(SEQ_CHUNK);
+    for (uint64_t offset = 0; offset < size; offset += SEQ_CHUNK) {
+        if (!rec.time([&]() { return fs.read(handle, offset, buffer.data(), SEQ_CHUNK) == SEQ_CHUNK; },
+                      SEQ_CHUNK)) {
+            break;
+        }
+    }
+    fs.closeFile(handle);
+    rec.note("64 KiB reads, cold cache");
+}
+
+void benchRandom(Context& ctx) {
+    FileSystem& fs = ctx.fs;
+    uint64_t size = 0;
+    if (!ensureSeqFile(ctx, size) || !remount(fs)) {
+        Recorder(ctx, "rand_read").fail("no data file");
+        return;
+    }
+    
+    uint32_t blocks = static_cast<uint32_t>(size / BLOCK_SIZE);
+    uint32_t ops = RANDOM_OPS * ctx.options.scale;
+    std::vector<uint8_t> buffer(BLOCK_SIZE);
+    FileHandle handle;
+    if (!fs.openFile(SEQ_FILE, handle)) {
+        Recorder(ctx, "rand_read").fail("could not open " + std::string(SEQ_FILE));
+        return;
+    }
+    
+    {
+        Recorder rec(ctx, "rand_read");
+        for (uint32_t i = 0; i < ops; ++i) {
+            uint64_t offset = static_cast<uint64_t>(ctx.rng() % blocks) * BLOCK_SIZE;
+            rec.time([&]() { return fs.read(handle, offset, buffer.data(), BLOCK_SIZE) == BLOCK_SIZE; },
+                     BLOCK_SIZE);
+        }
+        rec.note("4 KiB reads at random block offsets, starting cold");
+    }
+    
+    {
+        Recorder rec(ctx, "rand_write");
+        auto data = randomData(ctx.rng, BLOCK_SIZE);
+        for (uint32_t i = 0; i < ops; ++i) {
+            uint64_t offset = static_cast<uint64_t>(ctx.rng() % blocks) * BLOCK_SIZE;
+            rec.time([&]() { return fs.write(handle, offset, data.data(), BLOCK_SIZE) == BLOCK_SIZE; },
+                     BLOCK_SIZE);
+        }
+        rec.note("4 KiB overwrites at random block offsets");
+    }
+    fs.closeFile(handle);
+}
+
+void benchSmallFiles(Context& ctx) {
+    FileSystem& fs = ctx.fs;
+    uint32_t count = fileCount(fs, SMALL_FILES * ctx.options.scale);
+    if (!fs.createDir("/small")) {
+        Recorder(ctx, "small_create").fail("could not create /small");
+        return;
+    }
+    
+    std::vector<std::string> paths;
+    {
+        Recorder rec(ctx, "small_create");
+        for (uint32_t i = 0; i < count; ++i) {
+            std::string path = "/small/f" + std::to_string(i);
+            auto data = randomData(ctx.rng, 512 + ctx.rng() % (BLOCK_SIZE - 511));
+            if (rec.time([&]() { return fs.createFile(path) && fs.writeFile(path, data); }, data.size())) {
+                paths.push_back(path);
+            }
+        }
+        rec.note("createFile + writeFile of 512 B - 4 KiB");
+    }
+    
+    std::shuffle(paths.begin(), paths.end(), ctx.rng);
+    Recorder rec(ctx, "small_delete");
+    for (const auto& path : paths) {
+        rec.time([&]() { return fs.deleteFile(path); });
+    }
+    rec.note("random order");
+}
+
+void benchTinyFiles(Context& ctx) {
+    FileSystem& fs = ctx.fs;
+    uint32_t count = fileCount(fs, TINY_FILES * ctx.options.scale);
+    if (!fs.createDir("/tiny")) {
+        Recorder(ctx, "tiny_create").fail("could not create /tiny");
+        return;
+    }
+    
+    // Sizes that fit the inode, so with inline files on no data block is touched
+    std::vector<std::pair<std::string, size_t>> files;
+    uint32_t usedBefore = fs.getUsedBlocks();
+    {
+        Recorder rec(ctx, "tiny_create");
+        for (uint32_t i = 0; i < count; ++i) {
+            std::string path = "/tiny/f" + std::to_string(i);
+            auto data = randomData(ctx.rng, 1 + ctx.rng() % INLINE_DATA_SIZE);
+            if (rec.time([&]() { return fs.createFile(path) && fs.writeFile(path, data); }, data.size())) {
+                files.emplace_back(path, data.size());
+            }
+        }
+        rec.note("createFile + writeFile of 1 - " + std::to_string(INLINE_DATA_SIZE) + " B, " +
+                 std::to_string(fs.getUsedBlocks() - usedBefore) + " blocks used");
+    }
+    
+    std::shuffle(files.begin(), files.end(), ctx.rng);
+    {
+        Recorder rec(ctx, "tiny_read");
+        std::vector<uint8_t> data;
+        for (const auto& file : files) {
+            rec.time([&]() { return fs.readFile(file.first, data) && data.size() == file.second; }, file.second);
+        }
+        rec.note(fs.getInlineFiles() ? "readFile, data inline" : "readFile, one data block each");
+    }
+    
+    Recorder rec(ctx, "tiny_delete");
+    for (const auto& file : files) {
+        rec.time([&]() { return fs.deleteFile(file.first); });
+    }
+    rec.note("random order");
+}
+
+void benchDeepPath(Context& ctx) {
+    FileSystem& fs = ctx.fs;
+    std::string path = "/deep";
+    bool ok = fs.createDir(path);
+    for (uint32_t level = 0; ok && level < DEEP_LEVELS; ++level) {
+        path += "/l" + std::to_string(level);
+        ok = fs.createDir(path);
+    }
+    path += "/leaf";
+    ok = ok && fs.createFile(path) && fs.writeFile(path, randomData(ctx.rng, BLOCK_SIZE));
+    
+    Recorder rec(ctx, "deep_resolve");
+    if (!ok) {
+        rec.fail("could not build the directory chain");
+        return;
+    }
+    Inode info;
+    for (uint32_t i = 0; i < DEEP_LOOKUPS * ctx.options.scale; ++i) {
+        rec.time([&]() { return fs.getFileInfo(path, info); });
+    }
+    rec.note("getFileInfo " + std::to_string(DEEP_LEVELS + 2) + " components deep");
+}
+
+void benchFanout(Context& ctx) {
+    FileSystem& fs = ctx.fs;
+    uint32_t count = fileCount(fs, FANOUT_FILES * ctx.options.scale);
+    if (!fs.createDir("/fan")) {
+        Recorder(ctx, "fanout_create").fail("could not create /fan");
+        return;
+    }
+    
+    {
+        Recorder rec(ctx, "fanout_create");
+        for (uint32_t i = 0; i < count; ++i) {
+            rec.time([&]() { return fs.createFile("/fan/entry" + std::to_string(i)); });
+        }
+        rec.note("empty files in one directory");
+    }
+    
+    {
+        Recorder rec(ctx, "fanout_lookup");
+        for (uint32_t i = 0; i < count; ++i) {
+            std::string path = "/fan/entry" + std::to_string(ctx.rng() % count);
+            rec.time([&]() { return fs.fileExists(path); });
+        }
+        rec.note("fileExists on random entries");
+    }
+    
+    {
+        Recorder rec(ctx, "fanout_list");
+        std::vector<DirectoryEntry> entries;
+        for (uint32_t i = 0; i < FANOUT_LISTS; ++i) {
+            rec.time([&]() { return fs.listDir("/fan", entries) && entries.size() >= count; });
+        }
+        rec.note("listDir of " + std::to_string(count) + " entries");
+    }
+    
+    // Gives the inodes back for the groups after this one
+    Recorder rec(ctx, "fanout_delete");
+    for (uint32_t i = 0; i < count; ++i) {
+        rec.time([&]() { return fs.deleteFile("/fan/entry" + std::to_string(i)); });
+    }
+    rec.note("in creation order");
+}
+
+void benchFsck(Context& ctx) {
+    RecoveryManager recovery(&ctx.fs);
+    Recorder rec(ctx, "fsck");
+    bool consistent = true;
+    for (uint32_t i = 0; i < FSCK_RUNS; ++i) {
+        rec.time([&]() {
+            consistent = recovery.checkConsistency().isConsistent && consistent;
+            return true;
+        });
+    }
+    rec.note(consistent ? "consistent" : "INCONSISTENT");
+    if (!consistent) {
+        rec.fail("checkConsistency reported errors");
+    }
+}
+
+void benchDefrag(Context& ctx) {
+    FileSystem& fs = ctx.fs;
+    uint32_t files = fileCount(fs, DEFRAG_FILES * ctx.options.scale);
+    if (!fs.createDir("/frag")) {
+        Recorder(ctx, "defrag").fail("could not create /frag");
+        return;
+    }
+    
+    // Grow the files a block per round, so their blocks interleave
+    std::vector<FileHandle> handles(files);
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < files; ++i) {
+        std::string path = "/frag/f" + std::to_string(i);
+        ok = fs.createFile(path) && fs.openFile(path, handles[i]);
+    }
+    auto block = randomData(ctx.rng, BLOCK_SIZE);
+    for (uint32_t round = 0; ok && round < DEFRAG_BLOCKS_PER_FILE; ++round) {
+        for (uint32_t i = 0; ok && i < files; ++i) {
+            ok = fs.write(handles[i], static_cast<uint64_t>(round) * BLOCK_SIZE, block.data(), BLOCK_SIZE) == BLOCK_SIZE;
+        }
+    }
+    for (auto& handle : handles) {
+        fs.closeFile(handle);
+    }
+    
+    Recorder rec(ctx, "defrag");
+    if (!ok) {
+        rec.fail("could not build fragmented files");
+        return;
+    }
+    double before = fs.getFragmentationScore();
+    DefragManager defrag(&fs);
+    bool cancelled = false;
+    rec.time([&]() { return defrag.defragmentFileSystem(cancelled); });
+    
+    std::ostringstream note;
+    note << std::fixed << std::setprecision(1) << "fragmentation " << before << "% -> "
+         << fs.getFragmentationScore() << "%, includes the defrag's own before/after benchmarks";
+    rec.note(note.str());
+}
+
+// JSON output
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(1, rank)) - 1];
+}
+
+void writeResult(std::ostream& out, const Result& result) {
+    std::vector<double> sorted = result.latenciesUs;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for (double v : sorted) {
+        sum += v;
+    }
+    double seconds = result.wallMs / 1000.0;
+    
+    out << "    {\"name\": " << jsonString(result.name)
+        << ", \"ok\": " << (result.ok ? "true" : "false")
+        << ", \"count\": " << sorted.size()
+        << ", \"bytes\": " << result.bytes
+        << ", \"wall_ms\": " << result.wallMs
+        << ", \"ops_per_sec\": " << (seconds > 0 ? sorted.size() / seconds : 0)
+        << ", \"mib_per_sec\": " << (seconds > 0 ? result.bytes / seconds / (1 << 20) : 0)
+        << ",\n     \"latency_us\": {\"mean\": " << (sorted.empty() ? 0 : sum / sorted.size())
+        << ", \"min\": " << (sorted.empty() ? 0 : sorted.front())
+        << ", \"p50\": " << percentile(sorted, 50)
+        << ", \"p90\": " << percentile(sorted, 90)
+        << ", \"p99\": " << percentile(sorted, 99)
+        << ", \"p999\": " << percentile(sorted, 99.9)
+        << ", \"max\": " << (sorted.empty() ? 0 : sorted.back()) << "}"
+        << ",\n     \"note\": " << jsonString(result.note) << "}";
+}
+
+// FileSystem::getMetrics() as seen from inside: histograms and layer counters
+void writeMetrics(std::ostream& out, const MetricsReport& report) {
+    out << "  \"metrics\": {\"ops\": [\n";
+    for (size_t i = 0; i < METRIC_OP_COUNT; ++i) {
+        const LatencySummary& op = report.ops[i];
+        out << "    {\"name\": " << jsonString(metricOpName(static_cast<MetricOp>(i)))
+            << ", \"count\": " << op.count
+            << ", \"latency_us\": {\"mean\": " << op.meanUs
+            << ", \"p50\": " << op.p50Us
+            << ", \"p90\": " << op.p90Us
+            << ", \"p99\": " << op.p99Us
+            << ", \"p999\": " << op.p999Us
+            << ", \"max\": " << op.maxUs << "}}"
+            << (i + 1 < METRIC_OP_COUNT ? ",\n" : "\n");
+    }
+    out << "  ],\n   \"counters\": {";
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        out << (i > 0 ? ", " : "") << jsonString(metricCounterName(static_cast<MetricCounter>(i)))
+            << ": " << report.counters[i];
+    }
+    out << "},\n   \"trace_events\": " << report.traceEvents
+        << ", \"dropped_trace_events\": " << report.droppedTraceEvents << "},\n";
+}
+
+void printUsage() {
+    std::cerr << "usage: fs_bench [--image PATH] [--size-mb N] [--fill PCT] [--backend stream|mmap]\n"
+                 "                [--cache BLOCKS] [--scale N] [--seed N] [--only seq,random,small,tiny,deep,fanout,fsck,defrag]\n"
+                 "                [--no-inline] [--output FILE] [--keep-image] [--metrics] [--trace FILE]" << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument(arg + " needs a value");
+            }
+            return argv[++i];
+        };
+        
+        try {
+            if (arg == "--image") {
+                options.image = value();
+            } else if (arg == "--size-mb") {
+                options.sizeMb = static_cast<uint32_t>(std::stoul(value()));
+            } else if (arg == "--fill") {
+                options.fillPercent = std::stod(value());
+            } else if (arg == "--backend") {
+                std::string name = value();
+                if (name != "stream" && name != "mmap") {
+                    throw std::invalid_argument("unknown backend " + name);
+                }
+                options.backend = name == "mmap" ? DiskBackend::MMAP : DiskBackend::STREAM;
+            } else if (arg == "--cache") {
+                options.cacheBlocks = std::stoul(value());
+                options.cacheSet = true;
+            } else if (arg == "--scale") {
+                options.scale = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(value())));
+            } else if (arg == "--seed") {
+                options.seed = static_cast<uint32_t>(std::stoul(value()));
+            } else if (arg == "--only") {
+                std::stringstream list(value());
+                std::string name;
+                while (std::getline(list, name, ',')) {
+                    options.only.push_back(name);
+                }
+            } else if (arg == "--output") {
+                options.output = value();
+            } else if (arg == "--no-inline") {
+                options.inlineFiles = false;
+            } else if (arg == "--keep-image") {
+                options.keepImage = true;
+            } else if (arg == "--metrics") {
+                options.metrics = true;
+            } else if (arg == "--trace") {
+                options.trace = value();
+                options.metrics = true;
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "fs_bench: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    
+    if (options.sizeMb < 8 || options.sizeMb > 4095) {
+        std::cerr << "fs_bench: --size-mb must be between 8 and 4095" << std::endl;
+        return false;
+    }
+    if (options.fillPercent < 0 || options.fillPercent > 90) {
+        std::cerr << "fs_bench: --fill must be between 0 and 90" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    
+    struct Group {
+        const char* name;
+        void (*run)(Context&);
+    };
+    const std::vector<Group> groups = {
+        {"seq", benchSequential}, {"random", benchRandom}, {"small", benchSmallFiles}, {"tiny", benchTinyFiles},
+        {"deep", benchDeepPath}, {"fanout", benchFanout}, {"fsck", benchFsck}, {"defrag", benchDefrag},
+    };
+    for (const auto& name : options.only) {
+        if (std::none_of(groups.begin(), groups.end(), [&](const Group& g) { return name == g.name; })) {
+            std::cerr << "fs_bench: unknown benchmark group " << name << std::endl;
+            printUsage();
+            return 2;
+        }
+    }
+    
+    // The core logs progress on std::cout; keep stdout for the JSON
+    std::streambuf* stdoutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+    
+    FileSystem fs(options.image, options.backend);
+    if (options.cacheSet) {
+        fs.setCacheCapacity(options.cacheBlocks);
+    }
+    fs.setInlineFiles(options.inlineFiles);
+    // Measured from the start; resetStats() drops the fill's share
+    fs.getMetrics().setEnabled(options.metrics);
+    fs.getMetrics().setTracing(!options.trace.empty());
+    if (!fs.createFileSystem(options.sizeMb * 1024u * 1024u)) {
+        std::cout.rdbuf(stdoutBuf);
+        std::cerr << "fs_bench: could not create " << options.image << std::endl;
+        return 1;
+    }
+    
+    Context ctx{fs, options, std::mt19937(options.seed), {}};
+    auto fillStart = Clock::now();
+    bool filled = fillImage(fs, options.fillPercent, ctx.rng) && remount(fs);
+    double fillMs = elapsedUs(fillStart) / 1000.0;
+    double filledPercent = usedPercent(fs);
+    
+    if (filled) {
+        fs.resetStats();
+        for (const auto& group : groups) {
+            if (options.only.empty() ||
+                std::find(options.only.begin(), options.only.end(), group.name) != options.only.end()) {
+                std::cerr << "fs_bench: running " << group.name << std::endl;
+                group.run(ctx);
+            }
+        }
+    }
+    
+    FileSystem::PerformanceStats stats = fs.getStats();
+    fs.unmountFileSystem();
+    std::cout.rdbuf(stdoutBuf);
+    bool traced = options.trace.empty() || fs.getMetrics().writeChromeTrace(options.trace);
+    if (!options.keepImage) {
+        std::remove(options.image.c_str());
+    }
+    
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << "fs_bench: could not write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    out << std::setprecision(6);
+    
+    out << "{\n"
+        << "  \"tool\": \"fs_bench\",\n"
+        << "  \"config\": {\"image_mib\": " << options.sizeMb
+        << ", \"fill_pct\": " << options.fillPercent
+        << ", \"backend\": " << jsonString(options.backend == DiskBackend::MMAP ? "mmap" : "stream")
+        << ", \"cache_blocks\": " << fs.getCacheCapacity()
+        << ", \"inline_files\": " << (options.inlineFiles ? "true" : "false")
+        << ", \"scale\": " << options.scale
+        << ", \"seed\": " << options.seed << "},\n"
+        << "  \"image\": {\"filled\": " << (filled ? "true" : "false")
+        << ", \"used_pct\": " << filledPercent
+        << ", \"fill_ms\": " << fillMs << "},\n"
+        << "  \"cache\": {\"hits\": " << stats.cacheHits
+        << ", \"misses\": " << stats.cacheMisses
+        << ", \"evictions\": " << stats.cacheEvictions << "},\n";
+    if (options.metrics) {
+        writeMetrics(out, stats.metrics);
+    }
+    out << "  \"results\": [\n";
+    bool allOk = filled && traced;
+    for (size_t i = 0; i < ctx.results.size(); ++i) {
+        writeResult(out, ctx.results[i]);
+        out << (i + 1 < ctx.results.size() ? ",\n" : "\n");
+        allOk = allOk && ctx.results[i].ok;
+    }
+    out << "  ]\n}" << std::endl;
+    
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace FileSystemTool {
+
+class DiskStorage;
+
+// One positional transfer; result is the byte count or -errno once complete
+struct IORequest {
+    uint64_t offset;
+    uint8_t* buffer;
+    uint32_t length;
+    bool write;
+    int32_t result;
+};
+
+// Batched block I/O against a DiskStorage. submitRead/submitWrite only queue;
+// submit() hands everything queued to the engine in one go and reap() collects
+// finished requests. An engine serves one caller at a time (VirtualDisk guards
+// its engine with a lock), keeps at most getQueueDepth() requests in flight,
+// and leaves queued requests in place until they are reaped.
+class AsyncIO {
+public:
+    explicit AsyncIO(DiskStorage* storage) : storage_(storage) {}
+    virtual ~AsyncIO() = default;
+
+    virtual void submitRead(IORequest& request) = 0;
+    virtual void submitWrite(IORequest& request) = 0;
+    virtual bool submit() = 0;
+    // Wait for at least minComplete requests; returns the finished ones in out
+    virtual bool reap(size_t minComplete, std::vector<IORequest*>& out) = 0;
+    virtual size_t getQueueDepth() const = 0;  // Most requests in flight at once
+    virtual const char* getName() const = 0;
+
+    // Run a batch to completion in waves of getQueueDepth(). Short or failed
+    // transfers are finished with plain storage calls; false if any still fails.
+    bool runBatch(std::vector<IORequest>& requests);
+
+protected:
+    DiskStorage* storage_;
+};
+
+// io_uring when the kernel has it (and the storage exposes a descriptor),
+// otherwise a small worker pool over DiskStorage::read/write
+std::unique_ptr<AsyncIO> makeAsyncIO(DiskStorage* storage);
+
+class ThreadPoolIO : public AsyncIO {
+public:
+    ThreadPoolIO(DiskStorage* storage, uint32_t workers);
+    ~ThreadPoolIO() override;
+
+    void submitRead(IORequest& request) override;
+    void submitWrite(IORequest& request) override;
+    bool submit() override;
+    bool reap(size_t minComplete, std::vector<IORequest*>& out) override;
+    size_t getQueueDepth() const override { return 256; }
+    const char* getName() const override { return "threadpool"; }
+
+private:
+    std::vector<IORequest*> queued_;      // Caller side, not yet submitted
+    std::deque<IORequest*> pending_;      // Waiting for a worker
+    std::vector<IORequest*> completed_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;                    // pending_, completed_, stopping_
+    std::condition_variable workCv_;
+    std::condition_variable doneCv_;
+    bool stopping_;
+
+    void workerLoop();
+};
+
+#ifdef __linux__
+class UringIO : public AsyncIO {
+public:
+    // Check isReady() after construction; setup fails on old or restricted kernels
+    UringIO(DiskStorage* storage, int fd, uint32_t entries);
+    ~UringIO() override;
+
+    bool isReady() const { return ringFd_ >= 0; }
+
+    void submitRead(IORequest& request) override;
+    void submitWrite(IORequest& request) override;
+    bool submit() override;
+    bool reap(size_t minComplete, std::vector<IORequest*>& out) override;
+    size_t getQueueDepth() const override { return sqEntries_; }
+    const char* getName() const override { return "io_uring"; }
+
+private:
+    int fd_;
+    int ringFd_;
+    uint32_t sqEntries_;
+    void* sqRing_;
+    void* cqRing_;
+    size_t sqRingSize_;
+    size_t cqRingSize_;
+    ::io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    // Pointers into the shared rings
+    uint32_t* sqHead_;
+    uint32_t* sqTail_;
+    uint32_t* sqMask_;
+    uint32_t* sqArray_;
+    uint32_t* cqHead_;
+    uint32_t* cqTail_;
+    uint32_t* cqMask_;
+    ::io_uring_cqe* cqes_;
+    uint32_t toSubmit_;   // Written to the SQ ring but not yet entered
+    uint32_t inFlight_;   // Submitted, completion not reaped
+
+    void queue(IORequest& request, bool write);
+    void teardown();
+};
+#endif
+
+} // namespace FileSystemTool
+
+#endif // ASYNCIO_H
@@ -0,0 +1,94 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace FileSystemTool {
+
+constexpr size_t DEFAULT_CACHE_BLOCKS = 1024;  // 4MB of cached blocks
+constexpr size_t MAX_CACHE_SHARDS = 16;
+constexpr size_t MIN_BLOCKS_PER_SHARD = 64;
+
+// Cache statistics
+struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t writebacks;
+
+    CacheStats() : hits(0), misses(0), evictions(0), writebacks(0) {}
+};
+
+// Write-back block cache with CLOCK replacement.
+// Dirty blocks are only written to the backing store on eviction or flush().
+// Thread-safe: blocks are spread over up to MAX_CACHE_SHARDS shards by block
+// number, each with its own lock and CLOCK hand, so concurrent readers of
+// different blocks rarely contend.
+class BlockCache {
+public:
+    using WritebackFn = std::function<bool(uint32_t blockNum, const uint8_t* data)>;
+
+    BlockCache(uint32_t blockSize, size_t capacity, WritebackFn writeback);
+
+    // Copy a cached block into buffer (false on miss)
+    bool read(uint32_t blockNum, uint8_t* buffer);
+
+    // Insert or overwrite a block; may evict (and write back) a victim
+    bool insert(uint32_t blockNum, const uint8_t* data, bool dirty);
+
+    // Write back all dirty blocks in block order
+    bool flush();
+
+    // Drop a block without writing it back
+    void invalidate(uint32_t blockNum);
+    void clear();
+
+    // Configuration (setCapacity must not race with other calls)
+    bool setCapacity(size_t capacity);  // Flushes and clears the cache
+    size_t getCapacity() const { return capacity_; }
+    bool isEnabled() const { return capacity_ > 0; }
+    size_t getDirtyCount() const;
+
+    // Statistics (summed over shards)
+    CacheStats getStats() const;
+    void resetStats();
+
+private:
+    struct Slot {
+        uint32_t blockNum;
+        bool valid;
+        bool dirty;
+        bool referenced;
+    };
+    
+    struct Shard {
+        std::mutex mutex;
+        size_t capacity = 0;
+        std::vector<uint8_t> data;          // capacity * blockSize_ bytes
+        std::vector<Slot> slots;
+        std::unordered_map<uint32_t, size_t> index;  // blockNum -> slot
+        size_t hand = 0;                    // CLOCK hand
+        size_t dirtyCount = 0;
+        CacheStats stats;
+    };
+
+    uint32_t blockSize_;
+    size_t capacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    WritebackFn writeback_;
+
+    Shard& shardFor(uint32_t blockNum) { return *shards_[blockNum % shards_.size()]; }
+    bool acquireSlot(Shard& shard, size_t& slot);
+    void clearShard(Shard& shard);
+    uint8_t* slotData(Shard& shard, size_t slot) { return shard.data.data() + slot * blockSize_; }
+};
+
+} // namespace FileSystemTool
+
+#endif // BLOCKCACHE_H
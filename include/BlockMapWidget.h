@@ -4,8 +4,10 @@
 #include <QWidget>
 #include <QPainter>
 #include <QMouseEvent>
+#include <QImage>
 #include <vector>
 #include "FileSystem.h"
+#include "RefreshBus.h"
 
 namespace FileSystemTool {
 
@@ -20,6 +22,11 @@ enum class BlockState {
     JOURNAL
 };
 
+// Draws the disk from a cached QImage with one pixel per cell, scaled up to the
+// cell size. applyChanges() re-renders only the cells whose blocks the refresh
+// bus reports changed; refresh() redraws every cell. When the disk has more
+// blocks than cells fit in the widget, each cell covers a power-of-two number
+// of blocks and is shaded by how many of them are used.
 class BlockMapWidget : public QWidget {
     Q_OBJECT
 
@@ -28,6 +35,7 @@ public:
     
     void setFileSystem(FileSystem* fs);
     void refresh();
+    void applyChanges(const ChangeSet& changes);
     void setZoomLevel(double zoom);
     
     QSize sizeHint() const override;
@@ -43,20 +51,33 @@ protected:
     void resizeEvent(QResizeEvent *event) override;
 
 private:
-    QColor getBlockColor(BlockState state);
-    QColor getFileColor(uint32_t blockNum);
-    void updateBlockStates();
+    QColor getBlockColor(BlockState state) const;
     BlockState getBlockState(uint32_t blockNum);
     QString getBlockStateText(BlockState state);
     int getBlockSize() const;
     
+    // Cell layout and rendering
+    void clearImage();                                    // Nothing mounted
+    void rebuildImage();                                  // New layout, every cell rendered
+    void renderCells(uint32_t firstCell, uint32_t lastCell);  // [firstCell, lastCell)
+    void updateCellRows(uint32_t firstCell, uint32_t lastCell);  // Schedule a repaint of their rows
+    QRgb getCellColor(uint32_t cell, uint32_t usedBlocks) const;
+    uint32_t countMetadataBlocks(uint32_t start, uint32_t end) const;
+    bool hasCorruptedBlock(uint32_t start, uint32_t end) const;
+    int getCellPitch() const { return blockDisplaySize_ + blockSpacing_; }
+    
     FileSystem* fileSystem_;
-    std::vector<BlockState> blockStates_;
+    const VirtualDisk* renderedDisk_;  // Disk the image belongs to
+    QImage image_;                     // Pixel per cell, blocksPerRow_ wide
+    std::vector<Extent> metadata_;     // Group metadata extents, sorted by start
+    std::vector<uint32_t> corrupted_;  // Sorted corrupted blocks the image shows
     uint32_t totalBlocks_;
-    uint32_t hoveredBlock_;
+    uint32_t blocksPerCell_;           // Level of detail; 1 = one cell per block
+    uint32_t cellCount_;
+    uint32_t hoveredBlock_;            // First block of the hovered cell
     int blockDisplaySize_;
     double zoomLevel_;
-    int blocksPerRow_;  // Store calculated blocks per row for hover
+    int blocksPerRow_;  // Cells per row, for layout and hover
     int blockSpacing_;
 };
 
@@ -14,6 +14,7 @@ namespace FileSystemTool {
 class FileSystem;
 class RecoveryManager;
 class DefragManager;
+class OperationRunner;
 
 class ControlPanel : public QWidget {
     Q_OBJECT
@@ -24,6 +25,7 @@ public:
     void setFileSystem(FileSystem* fs);
     void setRecoveryManager(RecoveryManager* recoveryMgr);
     void setDefragManager(DefragManager* defragMgr);
+    void setOperationRunner(OperationRunner* runner);  // Long operations run on it
     
     void setDiskMounted(bool mounted);
     void appendLog(const QString& message);
@@ -47,6 +49,7 @@ signals:
     void runRecoveryRequested();
     void runDefragRequested();
     void operationCompleted();
+    void defragCompleted(bool success);
     void logMessage(const QString& message);  // Signal for logging to central console
 
 private slots:
@@ -63,11 +66,16 @@ private slots:
 private:
     void setupUI();
     void updateButtonStates();
+    bool beginOperation();  // False (and logged) while another operation runs
+    void endOperation();
     
     FileSystem* fileSystem_;
     RecoveryManager* recoveryMgr_;
     DefragManager* defragMgr_;
+    OperationRunner* runner_;
     bool diskMounted_;
+    bool operationActive_;  // One of our operations is on the runner
+    bool defragRunning_;  // The defrag button cancels while set
     
     // Disk operations
     QGroupBox* diskOpsGroup_;
@@ -2,11 +2,20 @@
 #define DEFRAGMANAGER_H
 
 #include "FileSystem.h"
+#include "SpscQueue.h"
 #include <vector>
 #include <string>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 
 namespace FileSystemTool {
 
+constexpr uint32_t DEFRAG_COPY_BLOCKS = 64;     // Blocks per copy buffer slot (256 KB)
+constexpr uint32_t DEFRAG_PIPELINE_DEPTH = 4;   // Slots, i.e. extents in flight (bounds defrag memory)
+
 // Fragmentation statistics
 struct FragmentationStats {
     double fragmentationScore;      // 0.0 (no fragmentation) to 1.0 (highly fragmented)
@@ -41,9 +50,17 @@ public:
     bool isFileFragmented(uint32_t inodeNum);
     uint32_t countFileFragments(const Inode& inode);
     
-    // Defragmentation
-    bool defragmentFileSystem(bool& cancelled);
+    // Defragmentation. Each fragmented file moves to one free run, an extent at a
+    // time. A read-ahead thread and a write-behind thread copy extents through the
+    // fixed slot pool while the calling thread commits finished moves, each its own
+    // journal transaction. The file system lock is only held to plan and commit, so
+    // foreground I/O keeps running; a file written meanwhile is left for later.
+    bool defragmentFileSystem(bool& cancelled);  // False if cancelled; polls cancelled between moves
     bool defragmentFile(uint32_t inodeNum);
+    void requestCancel() { cancelRequested_ = true; }  // Safe from any thread
+    
+    // Copy bandwidth budget shared by the read and write stages (0 = unlimited)
+    void setThrottle(double megabytesPerSecond, uint32_t iops = 0);
     
     // Performance benchmarking
     BenchmarkResults runBenchmark(uint32_t numFiles = 100);
@@ -68,7 +85,7 @@ public:
         double avgReadTimeAfter;
     };
     DefragResults getResults() const {
-        return {0, beforeBenchmark_.avgReadTimeMs, afterBenchmark_.avgReadTimeMs};
+        return {filesDefragged_, beforeBenchmark_.avgReadTimeMs, afterBenchmark_.avgReadTimeMs};
     }
     
     // Progress reporting
@@ -78,9 +95,53 @@ private:
     BenchmarkResults beforeBenchmark_;
     BenchmarkResults afterBenchmark_;
     ProgressCallback progressCallback_;
+    std::atomic<bool> cancelRequested_;
+    uint32_t filesDefragged_;
+    
+    enum class MoveResult { MOVED, SKIPPED, CANCELLED, FAILED };
+    
+    // One extent travelling read -> write -> commit
+    struct ExtentMove {
+        uint32_t slot = 0;          // Copy buffer slot
+        uint32_t fileIndex = 0;     // First file block of the extent
+        uint32_t source = 0;        // First source block (the run is contiguous)
+        uint32_t length = 0;
+        uint32_t target = 0;
+        bool ok = true;             // Every block read and written
+        bool stop = false;          // Shuts the stages down
+    };
+    
+    // Token bucket; the stages sleep off any debt after taking their tokens
+    class Throttle {
+    public:
+        void configure(double bytesPerSecond, double opsPerSecond);
+        void acquire(uint64_t bytes);  // One I/O of bytes
+    private:
+        std::mutex mutex_;
+        double bytesPerSecond_ = 0;
+        double opsPerSecond_ = 0;
+        double byteTokens_ = 0;
+        double opTokens_ = 0;
+        std::chrono::steady_clock::time_point last_ = std::chrono::steady_clock::now();
+    };
+    
+    // Pipeline (alive for one defragmentFileSystem/defragmentFile call)
+    VirtualDisk* pipelineDisk_;
+    std::vector<uint8_t> copyBuffers_;  // DEFRAG_PIPELINE_DEPTH slots
+    std::unique_ptr<SpscQueue<ExtentMove>> readQueue_;    // Caller -> reader
+    std::unique_ptr<SpscQueue<ExtentMove>> writeQueue_;   // Reader -> writer
+    std::unique_ptr<SpscQueue<ExtentMove>> commitQueue_;  // Writer -> caller
+    std::thread reader_;
+    std::thread writer_;
+    Throttle throttle_;
     
     // Helper functions
-    bool relocateFileBlocks(Inode& inode, const std::vector<uint32_t>& newBlocks);
+    void startPipeline();
+    void stopPipeline();
+    void readStage();
+    void writeStage();
+    MoveResult relocateFile(uint32_t inodeNum, const bool& cancelled);
+    bool commitMove(uint32_t inodeNum, const ExtentMove& move);
     std::vector<uint32_t> findContiguousBlocks(uint32_t count);
     uint32_t findFirstFreeBlock();
     void reportProgress(int progress, const std::string& message);
@@ -5,12 +5,15 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <shared_mutex>
 
 namespace FileSystemTool {
 
 // Directory entry structure
-constexpr uint32_t MAX_FILENAME_LENGTH = 56;
+constexpr uint32_t MAX_FILENAME_LENGTH = 52;
 constexpr uint32_t DIR_ENTRY_SIZE = 64;  // bytes
+constexpr uint32_t ENTRIES_PER_BLOCK = 4096 / DIR_ENTRY_SIZE;  // BLOCK_SIZE / DIR_ENTRY_SIZE
 
 struct DirectoryEntry {
     uint32_t inodeNumber;                       // Inode number
@@ -26,6 +29,11 @@ struct DirectoryEntry {
     std::string getName() const;
 };
 
+static_assert(sizeof(DirectoryEntry) == DIR_ENTRY_SIZE, "DirectoryEntry must fill exactly one slot");
+
+// The name index cache is internally locked: lookups share it, edits take it
+// exclusively. Callers serialize edits of any one directory (FileSystem holds
+// that directory's inode lock).
 class DirectoryManager {
 public:
     DirectoryManager(class VirtualDisk* disk, class InodeManager* inodeMgr);
@@ -36,11 +44,14 @@ public:
     
     // Entry management
     bool addEntry(uint32_t dirInodeNum, const std::string& name, uint32_t entryInodeNum, FileType type);
+    // Insert many entries with one write per touched directory block; all names must be new
+    bool addEntries(uint32_t dirInodeNum, const std::vector<DirectoryEntry>& newEntries);
     bool removeEntry(uint32_t dirInodeNum, const std::string& name);
     int32_t lookupEntry(uint32_t dirInodeNum, const std::string& name);
     
     // Directory listing
     std::vector<DirectoryEntry> listDirectory(uint32_t dirInodeNum);
+    bool listDirectory(uint32_t dirInodeNum, std::vector<DirectoryEntry>& entries);  // Reuses the caller's storage
     
     // Path resolution
     int32_t resolvePath(const std::string& path, uint32_t startInodeNum);
@@ -49,13 +60,35 @@ public:
     // Initialize root directory
     bool initializeRootDirectory();
     
+    // Name index cache (rebuilt lazily from disk on next lookup)
+    void invalidateIndex(uint32_t dirInodeNum);
+    void clearIndexCache();
+    
 private:
+    // In-memory name index for one directory
+    struct DirectoryIndex {
+        struct Location {
+            uint32_t inodeNumber;
+            uint32_t slot;                  // Entry index across the directory's blocks
+        };
+        std::unordered_map<std::string, Location> entries;  // name -> location
+        std::vector<uint32_t> freeSlots;    // back() is the lowest free slot
+        std::vector<uint32_t> blocks;       // Directory data blocks in slot order
+    };
+    
     VirtualDisk* disk_;
     InodeManager* inodeMgr_;
+    std::unordered_map<uint32_t, DirectoryIndex> indexCache_;  // dir inode -> index
+    std::shared_mutex indexMutex_;  // Guards indexCache_
+    
+    // Both need indexMutex_ held exclusively
+    DirectoryIndex* getIndex(uint32_t dirInodeNum, const Inode& dirInode);
+    void dropIndex(uint32_t dirInodeNum) { indexCache_.erase(dirInodeNum); }
     
     bool readDirectoryEntries(const Inode& dirInode, std::vector<DirectoryEntry>& entries);
     bool writeDirectoryEntries(Inode& dirInode, const std::vector<DirectoryEntry>& entries);
-    bool expandDirectory(Inode& dirInode);
+    bool expandDirectory(Inode& dirInode, DirectoryIndex& index);
+    bool writeSlot(const DirectoryIndex& index, uint32_t slot, const DirectoryEntry& entry);
 };
 
 } // namespace FileSystemTool
@@ -0,0 +1,107 @@
+#ifndef DISKSTORAGE_H
+#define DISKSTORAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace FileSystemTool {
+
+// Backing store used for the disk image
+enum class DiskBackend : uint8_t {
+    STREAM = 0,     // Positional pread/pwrite (std::fstream with seek + read/write on Windows)
+    MMAP = 1        // Memory-mapped image, msync at commit points
+};
+
+// Byte-addressed access to the disk image file
+class DiskStorage {
+public:
+    virtual ~DiskStorage() = default;
+
+    // Lifecycle
+    virtual bool create(const std::string& path, uint64_t sizeInBytes) = 0;  // Sparse file
+    virtual bool open(const std::string& path) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+
+    // I/O
+    virtual bool read(uint64_t offset, void* buffer, size_t length) = 0;
+    virtual bool write(uint64_t offset, const void* buffer, size_t length) = 0;
+    virtual bool sync() = 0;
+    // Deallocate a byte range so it reads back as zeros (false if unsupported)
+    virtual bool discard(uint64_t /*offset*/, uint64_t /*length*/) { return false; }
+
+    // Direct view of the image (nullptr unless memory-mapped)
+    virtual uint8_t* mappedData() { return nullptr; }
+    // POSIX descriptor for engines that issue their own I/O (-1 if none)
+    virtual int nativeHandle() const { return -1; }
+    virtual DiskBackend getBackend() const = 0;
+};
+
+// Create the storage implementation for a backend
+std::unique_ptr<DiskStorage> makeDiskStorage(DiskBackend backend);
+
+class StreamStorage : public DiskStorage {
+public:
+    StreamStorage();
+    ~StreamStorage() override;
+
+    bool create(const std::string& path, uint64_t sizeInBytes) override;
+    bool open(const std::string& path) override;
+    void close() override;
+    bool isOpen() const override;
+
+    // Safe to call from any number of threads at once
+    bool read(uint64_t offset, void* buffer, size_t length) override;
+    bool write(uint64_t offset, const void* buffer, size_t length) override;
+    bool sync() override;
+    bool discard(uint64_t offset, uint64_t length) override;
+
+#ifndef _WIN32
+    int nativeHandle() const override { return fd_; }
+#endif
+    DiskBackend getBackend() const override { return DiskBackend::STREAM; }
+
+private:
+#ifndef _WIN32
+    int fd_;            // pread/pwrite carry their own offset, so no lock is needed
+#else
+    std::fstream file_;
+    std::mutex mutex_;  // seek + read/write must not interleave
+#endif
+};
+
+#ifndef _WIN32
+class MmapStorage : public DiskStorage {
+public:
+    MmapStorage();
+    ~MmapStorage() override;
+
+    bool create(const std::string& path, uint64_t sizeInBytes) override;
+    bool open(const std::string& path) override;
+    void close() override;
+    bool isOpen() const override { return data_ != nullptr; }
+
+    bool read(uint64_t offset, void* buffer, size_t length) override;
+    bool write(uint64_t offset, const void* buffer, size_t length) override;
+    bool sync() override;
+    bool discard(uint64_t offset, uint64_t length) override;
+
+    uint8_t* mappedData() override { return data_; }
+    DiskBackend getBackend() const override { return DiskBackend::MMAP; }
+
+private:
+    int fd_;
+    uint8_t* data_;
+    size_t size_;
+
+    bool mapFile();
+};
+#endif
+
+} // namespace FileSystemTool
+
+#endif // DISKSTORAGE_H
@@ -9,7 +9,9 @@
 #include <QSplitter>
 #include <QMenu>
 #include <QMessageBox>
+#include <vector>
 #include "Directory.h"
+#include "RefreshBus.h"
 
 namespace FileSystemTool {
 
@@ -32,6 +34,8 @@ public:
     
     void setFileSystem(FileSystem* fs);
     void refresh();
+    // Re-lists the directory but only looks up the entries whose inodes changed
+    void applyChanges(const ChangeSet& changes);
     void navigateToPath(const QString& path);
     QStringList getSelectedFiles() const;  // Get list of selected file paths
     void triggerDelete();  // Public method to trigger delete operation
@@ -52,11 +56,16 @@ private slots:
 private:
     void setupUI();
     void loadDirectory(const QString& path);
-    void populateTable(const std::vector<DirectoryEntry>& entries);
-    uint32_t calculateFragments(const std::string& path);
+    // Entries reuse the row of the same inode unless it is in changed (ascending);
+    // without changed every entry is looked up again
+    void populateTable(const std::vector<DirectoryEntry>& entries,
+                       const std::vector<uint32_t>* changed = nullptr);
+    FileInfo describeEntry(const DirectoryEntry& entry);
+    void setRow(int row, const FileInfo& info);
     
     FileSystem* fileSystem_;
     QString currentPath_;
+    std::vector<FileInfo> rows_;  // What the table shows, row by row
     
     // UI components
     QTreeWidget* directoryTree_;
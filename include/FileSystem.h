@@ -4,9 +4,15 @@
 #include "VirtualDisk.h"
 #include "Inode.h"
 #include "Directory.h"
+#include "Journal.h"
+#include "ReentrantSharedMutex.h"
+#include "Metrics.h"
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
 
 namespace FileSystemTool {
 
@@ -16,20 +22,55 @@ struct FileHandle {
     Inode inode;
     std::string path;
     bool isOpen;
+    std::vector<uint32_t> blockMap;  // File block index -> disk block, resolved at open
+    uint32_t generation;             // Inode generation inode and blockMap were taken at
     
-    FileHandle() : inodeNumber(0), isOpen(false) {}
+    FileHandle() : inodeNumber(0), isOpen(false), generation(0) {}
 };
 
+// One file of a writeBatch call
+struct BatchFile {
+    std::string path;
+    std::vector<uint8_t> data;
+};
+
+// Safe for concurrent clients. File operations share the file-system lock and
+// then lock the inodes they touch (shared to read, exclusive to modify; a
+// create or delete also locks the parent directory's inode, directories before
+// files, several directories in ascending inode order). Lifecycle, directory
+// create/delete, recovery and the power-cut simulations take the lock
+// exclusively. A FileHandle belongs to one thread at a time; changes made to
+// its file by other handles or paths are picked up at the handle's next call.
 class FileSystem {
 public:
-    FileSystem(const std::string& diskPath);
+    FileSystem(const std::string& diskPath, DiskBackend backend = DiskBackend::STREAM);
     ~FileSystem();
     
     // File system lifecycle
     bool createFileSystem(uint32_t diskSize = DEFAULT_DISK_SIZE);
     bool mountFileSystem();
     bool unmountFileSystem();
-    bool isMounted() const { return mounted_; }
+    bool isMounted() const { return mounted_.load(); }
+    bool wasUncleanMount() const { return uncleanMount_; }  // Last mount found the clean flag unset
+    bool sync();  // Write back cached blocks without unmounting
+    
+    // Block cache sizing (in blocks, 0 disables); applies now and on next mount
+    void setCacheCapacity(size_t blocks);
+    size_t getCacheCapacity() const { return cacheCapacity_; }
+    
+    // Disk image backend; takes effect on the next create/mount
+    void setDiskBackend(DiskBackend backend) { backend_ = backend; }
+    DiskBackend getDiskBackend() const { return backend_; }
+    
+    // What freed blocks turn into (see FreePolicy); applies now and on next mount
+    void setFreePolicy(FreePolicy policy);
+    FreePolicy getFreePolicy() const { return freePolicy_; }
+    
+    // Keep files of up to INLINE_DATA_SIZE bytes inside their inode (no data
+    // block; a read costs the inode alone). On by default; applies to later
+    // writes, and files already inline stay readable either way
+    void setInlineFiles(bool enabled);
+    bool getInlineFiles() const { return inlineFiles_; }
     
     // File operations (CRUD)
     bool createFile(const std::string& path);
@@ -37,11 +78,26 @@ public:
     bool readFile(const std::string& path, std::vector<uint8_t>& data);
     bool writeFile(const std::string& path, const std::vector<uint8_t>& data);
     bool fileExists(const std::string& path);
+    // Create many files as one journal transaction: inodes and extents are
+    // allocated for the whole batch, each directory is updated once and data
+    // blocks are written in ascending block order. A failure undoes the whole
+    // batch. Files that already exist are then overwritten with writeFile, each
+    // in a transaction of its own.
+    bool writeBatch(const std::vector<BatchFile>& files);
+    
+    // Handle-based I/O on caller buffers (return bytes transferred, -1 on error)
+    bool openFile(const std::string& path, FileHandle& handle);
+    void closeFile(FileHandle& handle);
+    int64_t read(FileHandle& handle, uint64_t offset, uint8_t* buffer, size_t length);
+    int64_t read(const std::string& path, uint64_t offset, uint8_t* buffer, size_t length);
+    int64_t write(FileHandle& handle, uint64_t offset, const uint8_t* data, size_t length);  // Touches only covered blocks
+    bool truncate(FileHandle& handle, uint64_t size);  // Shrink only
     
     // Directory operations
     bool createDir(const std::string& path);
     bool deleteDir(const std::string& path);
     std::vector<DirectoryEntry> listDir(const std::string& path);
+    bool listDir(const std::string& path, std::vector<DirectoryEntry>& entries);  // Reuses the caller's storage
     
     // File information
     bool getFileInfo(const std::string& path, Inode& info);
@@ -54,11 +110,13 @@ public:
     double getFragmentationScore();  // Not const - calculates on demand
     std::string getFilenameFromInode(uint32_t inodeNum) const;
     
-    // Block ownership tracking (for visualization)
+    // Block ownership tracking (for visualization and recovery), one slot per block
     void setBlockOwner(uint32_t blockNum, uint32_t inodeNum);
-    uint32_t getBlockOwner(uint32_t blockNum) const;  // Returns inode num, or UINT32_MAX if unowned
+    uint32_t getBlockOwner(uint32_t blockNum) const {  // Returns inode num, or UINT32_MAX if unowned
+        return blockNum < blockOwners_.size() ? blockOwners_[blockNum].load(std::memory_order_relaxed) : UINT32_MAX;
+    }
     void clearBlockOwner(uint32_t blockNum);
-    void rebuildBlockOwnership();  // Rebuild ownership map from disk state
+    void rebuildBlockOwnership();  // Parallel scan of the inode table; runs at mount
     
     // Power cut simulation & recovery
     void simulatePowerCut();  // Old method - marks active write as corrupted
@@ -75,6 +133,12 @@ public:
     VirtualDisk* getDisk() { return disk_.get(); }
     InodeManager* getInodeManager() { return inodeMgr_.get(); }
     DirectoryManager* getDirectoryManager() { return dirMgr_.get(); }
+    Journal* getJournal() { return journal_.get(); }
+    
+    // File-system lock: public operations hold it shared or exclusive (see
+    // above). Direct callers of the components above (the scrub, defrag) take it
+    // exclusively, which also waits out every in-flight file operation.
+    ReentrantSharedMutex& getMutex() { return mutex_; }
     
     // Performance measurement
     struct PerformanceStats { // Renamed to FileStats in the instruction, but keeping original name for consistency with existing code
@@ -84,19 +148,49 @@ public:
         uint64_t totalBytesWritten;
         uint32_t totalReads;
         uint32_t totalWrites;
+        uint64_t cacheHits;
+        uint64_t cacheMisses;
+        uint64_t cacheEvictions;
+        double journalPressure;       // Fraction of journal space awaiting checkpoint
+        MetricsReport metrics;        // Latency percentiles and layer counters (if enabled)
     };
     
-    const PerformanceStats& getStats() const { return stats_; }
+    PerformanceStats getStats();  // Not const - pulls live cache counters
     void resetStats();
+    // Histograms, counters and tracing; off until enabled, kept across create/mount
+    Metrics& getMetrics() { return metrics_; }
+    
+    // What the widgets draw, read under one shared lock so it is consistent
+    struct Snapshot {
+        uint32_t totalBlocks;
+        uint32_t freeBlocks;
+        double fragmentationScore;
+        PerformanceStats stats;
+        bool hasCorruption;
+        std::vector<uint32_t> corruptedBlocks;  // Sorted
+    };
+    // False without waiting while an exclusive operation (recovery, a defrag
+    // commit) holds the lock, or when unmounted; the GUI then keeps what it drew
+    bool trySnapshot(Snapshot& snapshot);
     
 private:
     std::string diskPath_;
+    Metrics metrics_;  // Before disk_, which points at it
     std::unique_ptr<VirtualDisk> disk_;
     std::unique_ptr<InodeManager> inodeMgr_;
     std::unique_ptr<DirectoryManager> dirMgr_;
-    bool mounted_;
+    std::unique_ptr<Journal> journal_;
+    std::atomic<bool> mounted_;
+    bool uncleanMount_;
+    size_t cacheCapacity_;
+    DiskBackend backend_;
+    FreePolicy freePolicy_;
+    bool inlineFiles_;
     PerformanceStats stats_;
-    std::map<uint32_t, uint32_t> blockOwners_;  // blockNum -> inodeNum mapping
+    std::mutex statsMutex_;               // Guards stats_
+    std::vector<std::atomic<uint32_t>> blockOwners_;  // blockNum -> inodeNum, UINT32_MAX = unowned
+    ReentrantSharedMutex mutex_;
+    std::unique_ptr<std::shared_mutex[]> inodeLocks_;  // One per inode, sized at create/mount
     
     // Corruption tracking for power cut simulation
     bool hasCorruption_;
@@ -104,8 +198,22 @@ private:
     uint32_t activeWriteInodeNum_;
     
     // Helper functions
-    bool allocateFileBlocks(Inode& inode, uint32_t blocksNeeded, uint32_t inodeNum);
-    bool readFileData(const Inode& inode, std::vector<uint8_t>& data);
+    void initInodeLocks();
+    void resetBlockOwners(uint32_t totalBlocks);
+    // Resolve path and lock its inode, confirming the name still maps to it once locked
+    template <typename Lock>
+    int32_t lockPath(const std::string& path, Lock& lock);
+    // The caller holds the inode lock (shared to load and read, exclusive otherwise);
+    // a negative inodeNum reports the path as not found
+    bool loadHandle(int32_t inodeNum, const std::string& path, FileHandle& handle);
+    bool refreshHandle(FileHandle& handle);  // Reload if the inode changed since; closes it if gone
+    bool finishHandleUpdate(FileHandle& handle, bool success);  // Adopt the handle's own changes
+    int64_t readLocked(FileHandle& handle, uint64_t offset, uint8_t* buffer, size_t length);
+    int64_t writeLocked(FileHandle& handle, uint64_t offset, const uint8_t* data, size_t length);
+    bool truncateLocked(FileHandle& handle, uint64_t size);
+    bool moveInlineData(FileHandle& handle);  // Inline bytes to a first data block
+    bool allocateFileBlocks(FileHandle& handle, uint32_t blocksNeeded, uint32_t hint = 0);  // Appends to blockMap
+    bool releaseFileBlocks(FileHandle& handle, uint32_t keepBlocks);
     void updateStats(bool isRead, double timeMs, uint64_t bytes);
 };
 
@@ -0,0 +1,88 @@
+#ifndef FREEBITMAP_H
+#define FREEBITMAP_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace FileSystemTool {
+
+// Free-space bitmap packed into 64-bit words (bit set = block free).
+// A summary level keeps one bit per word that is set while the word has any
+// free block, so searches skip fully allocated regions 4096 blocks at a time.
+// With run tracking on, every free run is also kept as an interval so the
+// largest run and the run-length histogram are read without a scan.
+class FreeBitmap {
+public:
+    static constexpr uint32_t NPOS = UINT32_MAX;
+    static constexpr uint32_t RUN_BUCKETS = 32;  // Bucket b counts runs of length [2^b, 2^(b+1))
+
+    FreeBitmap() : size_(0), trackRuns_(false), runBuckets_{} {}
+    
+    void setRunTracking(bool enabled);  // Off by default (the inode map has no use for it)
+
+    void reset(uint32_t size, bool free);
+    uint32_t size() const { return size_; }
+
+    // Bit access
+    bool isFree(uint32_t index) const {
+        return (words_[index >> 6] >> (index & 63)) & 1;
+    }
+    bool operator[](uint32_t index) const { return isFree(index); }
+    void setFree(uint32_t index);
+    void setUsed(uint32_t index);
+    void setRange(uint32_t start, uint32_t count, bool free);
+
+    // Searches (return NPOS when nothing matches)
+    uint32_t findFirstFree(uint32_t from) const;
+    uint32_t findFirstUsed(uint32_t from) const;  // size() if the rest is free
+    uint32_t findFreeRun(uint32_t count, uint32_t from = 0) const;
+    uint32_t largestFreeRun(uint32_t from = 0, uint32_t* runStart = nullptr) const;
+    uint32_t countFree() const;
+    uint32_t countFree(uint32_t start, uint32_t count) const;  // Within [start, start + count)
+    
+    // Tracked runs (empty unless run tracking is on)
+    uint32_t largestRun(uint32_t* runStart = nullptr) const;  // Lowest-starting run of the largest size
+    uint32_t freeRunCount() const { return static_cast<uint32_t>(runsByStart_.size()); }
+    const std::array<uint32_t, RUN_BUCKETS>& runHistogram() const { return runBuckets_; }
+
+    // Raw words (little-endian bit order matches the on-disk bitmap bytes)
+    const std::vector<uint64_t>& words() const { return words_; }
+    uint64_t* wordData() { return words_.data(); }
+    size_t wordCount() const { return words_.size(); }
+    void rebuildSummary();  // Call after modifying words through wordData() (rebuilds runs too)
+
+private:
+    uint32_t size_;
+    std::vector<uint64_t> words_;
+    std::vector<uint64_t> summary_;  // Bit w set if words_[w] != 0
+    
+    bool trackRuns_;
+    std::map<uint32_t, uint32_t> runsByStart_;             // start -> end (exclusive)
+    std::set<std::pair<uint32_t, uint32_t>> runsByLength_;  // (length, start)
+    std::array<uint32_t, RUN_BUCKETS> runBuckets_;
+
+    void updateSummary(size_t word) {
+        uint64_t bit = 1ULL << (word & 63);
+        if (words_[word]) {
+            summary_[word >> 6] |= bit;
+        } else {
+            summary_[word >> 6] &= ~bit;
+        }
+    }
+    void clearTail();
+    
+    void addRun(uint32_t start, uint32_t end);
+    void removeRun(std::map<uint32_t, uint32_t>::iterator it);
+    void markRunsFree(uint32_t start, uint32_t end);  // Merge [start, end) with its neighbours
+    void markRunsUsed(uint32_t start, uint32_t end);  // Split runs overlapping [start, end)
+    void rebuildRuns();
+};
+
+} // namespace FileSystemTool
+
+#endif // FREEBITMAP_H
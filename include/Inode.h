@@ -1,10 +1,13 @@
 #ifndef INODE_H
 #define INODE_H
 
+#include <cstddef>
 #include <cstdint>
 #include <ctime>
 #include <string>
 #include <vector>
+#include <mutex>
+#include "FreeBitmap.h"
 
 namespace FileSystemTool {
 
@@ -18,6 +21,15 @@ enum class FileType : uint8_t {
 // Inode structure - stores file metadata
 constexpr uint32_t DIRECT_BLOCKS = 12;
 constexpr uint32_t INODE_SIZE = 128;  // bytes
+constexpr uint32_t POINTERS_PER_BLOCK = 4096 / sizeof(uint32_t);  // BLOCK_SIZE / pointer size
+constexpr uint32_t SINGLE_INDIRECT_LIMIT = DIRECT_BLOCKS + POINTERS_PER_BLOCK;
+constexpr uint64_t MAX_FILE_BLOCKS = SINGLE_INDIRECT_LIMIT +
+                                     static_cast<uint64_t>(POINTERS_PER_BLOCK) * POINTERS_PER_BLOCK;
+
+// Inode flags
+constexpr uint8_t INODE_INLINE_DATA = 0x01;  // File data lives in the inode, no blocks
+// Inline data takes the block pointers and the spare bytes after them
+constexpr uint32_t INLINE_DATA_SIZE = 71;
 
 struct Inode {
     uint32_t inodeNumber;           // Inode number
@@ -31,29 +43,98 @@ struct Inode {
     time_t   accessedTime;          // Last access timestamp
     uint32_t directBlocks[DIRECT_BLOCKS];  // Direct block pointers
     uint32_t indirectBlock;         // Single indirect block pointer
-    uint8_t  padding[20];           // Padding to make 128 bytes
+    uint32_t doubleIndirectBlock;   // Double indirect block pointer
+    uint8_t  inlineTail[15];        // Spare; end of the inline data area
+    uint8_t  flags;                 // INODE_* flags
     
     Inode();
     void reset();
     bool isValid() const;
     bool isFree() const;
+    
+    // Small regular files keep their bytes where the block pointers would be
+    // (INLINE_DATA_SIZE bytes from directBlocks on); fileSize is the length
+    bool hasInlineData() const { return (flags & INODE_INLINE_DATA) != 0; }
+    uint8_t* inlineData() { return reinterpret_cast<uint8_t*>(this) + offsetof(Inode, directBlocks); }
+    const uint8_t* inlineData() const { return reinterpret_cast<const uint8_t*>(this) + offsetof(Inode, directBlocks); }
+    // Switch to inline storage holding data; the inode must map no blocks
+    void setInlineData(const uint8_t* data, size_t length);
+    // Back to block pointers, all 0; the inline bytes are dropped
+    void clearInlineData();
+};
+
+// inlineTail and flags take over the old trailing padding, so the struct keeps
+// its 112 bytes in each INODE_SIZE slot. Older images have zeros there, which
+// reads back as "no inline data".
+static_assert(sizeof(Inode) == 112, "Inode layout is part of the on-disk format");
+static_assert(sizeof(Inode) <= INODE_SIZE, "Inode must fit its table slot");
+static_assert(offsetof(Inode, inlineTail) + sizeof(Inode::inlineTail) - offsetof(Inode, directBlocks) == INLINE_DATA_SIZE,
+              "Inline data area must be contiguous");
+
+// Fragmentation totals over regular files, kept current by writeInode
+struct FragmentCounts {
+    uint32_t files;             // Regular files
+    uint32_t filesWithBlocks;   // Regular files holding at least one data block
+    uint32_t fragmentedFiles;   // Files with more than one run of consecutive blocks
+    uint64_t totalFragments;    // Runs summed over all files
+    
+    FragmentCounts() : files(0), filesWithBlocks(0), fragmentedFiles(0), totalFragments(0) {}
 };
 
-// Inode Manager class
+// Inode Manager class. The pinned table is guarded by an internal lock, so
+// concurrent callers see whole inodes; keeping a read-modify-write of one
+// inode consistent is up to the caller (FileSystem's per-inode locks).
 class InodeManager {
 public:
     InodeManager(class VirtualDisk* disk);
     
-    // Inode operations
-    int32_t allocateInode(FileType type);
+    // Load the whole inode table into memory (call once the disk is open)
+    bool loadInodeTable();
+    uint32_t getFreeInodeCount() const;
+    // Bumped by every writeInode; lets unlocked work (defrag) notice racing writes
+    uint32_t getGeneration(uint32_t inodeNum) const;
+    
+    // Fragments (runs of consecutive data blocks in file order, indirect-mapped
+    // blocks included) per regular file, and their totals
+    uint32_t getFragmentCount(uint32_t inodeNum) const;
+    FragmentCounts getFragmentCounts() const;
+    static uint32_t countFragments(const std::vector<uint32_t>& blocks);
+    
+    // Inodes written since the last call, ascending, for one consumer (the GUI's
+    // refresh bus). True, with inodes left empty, when the table was (re)loaded.
+    bool takeChangedInodes(std::vector<uint32_t>& inodes);
+    
+    // Inode operations. Allocation takes the lowest free inode in goalGroup's
+    // slice of the table, then spills into later groups (VirtualDisk block groups)
+    int32_t allocateInode(FileType type, uint32_t goalGroup = 0);
+    // All-or-nothing; each touched table block is written once
+    bool allocateInodes(FileType type, uint32_t count, std::vector<uint32_t>& inodeNums,
+                        uint32_t goalGroup = 0);
     bool freeInode(uint32_t inodeNum);
     bool readInode(uint32_t inodeNum, Inode& inode);
     bool writeInode(uint32_t inodeNum, const Inode& inode);
     
-    // Block pointer management
+    // Block pointer management. An inode holding inline data maps no blocks;
+    // setBlockPointers refuses it until clearInlineData.
     bool addBlockToInode(Inode& inode, uint32_t blockNum);
     bool removeBlockFromInode(Inode& inode, uint32_t blockIndex);
-    std::vector<uint32_t> getInodeBlocks(const Inode& inode);
+    std::vector<uint32_t> getInodeBlocks(const Inode& inode);      // Data blocks in file order
+    void getInodeBlocks(const Inode& inode, std::vector<uint32_t>& blocks);  // Reuses the caller's storage
+    std::vector<uint32_t> getMetadataBlocks(const Inode& inode);   // Indirect pointer blocks
+    // Both lists in one walk via VirtualDisk::readBlockShared, so parallel scans may
+    // call it concurrently. scratch must hold BLOCK_SIZE bytes. False on a read error.
+    bool collectBlocks(const Inode& inode, std::vector<uint32_t>& dataBlocks,
+                       std::vector<uint32_t>& metaBlocks, uint8_t* scratch) const;
+    
+    // Map data blocks at file indices [firstIndex, firstIndex + n). New pointer
+    // blocks are taken from metaBlocks (size from metadataBlocksFor). Caller writes the inode.
+    bool setBlockPointers(Inode& inode, uint32_t firstIndex, const std::vector<uint32_t>& dataBlocks,
+                          const std::vector<uint32_t>& metaBlocks);
+    // Point already-mapped file indices at new data blocks; blockCount is unchanged
+    bool remapBlockPointers(Inode& inode, uint32_t firstIndex, const std::vector<uint32_t>& dataBlocks);
+    // Unmap everything past keepBlocks; data and pointer blocks to free go to released
+    bool clearBlockPointers(Inode& inode, uint32_t keepBlocks, std::vector<uint32_t>& released);
+    static uint32_t metadataBlocksFor(uint64_t dataBlocks);
     
     // Utilities
     uint32_t getMaxInodes() const;
@@ -61,8 +142,24 @@ public:
     
 private:
     VirtualDisk* disk_;
+    std::vector<Inode> table_;       // Pinned copy of every inode; writes go through to disk
+    FreeBitmap freeInodes_;          // Bit set = inode free
+    std::vector<uint32_t> generations_;
+    std::vector<uint32_t> fragments_;  // 0 for anything but a regular file with data
+    FragmentCounts fragmentCounts_;
+    std::vector<uint64_t> changedInodes_;  // Bit per inode written since takeChangedInodes
+    bool allInodesChanged_;
+    std::vector<uint8_t> blockBuffer_;
+    mutable std::recursive_mutex mutex_;  // Everything above except disk_
+    
+    bool writeInodeTableBlock(uint32_t tableBlock);
+    uint32_t findFreeInode(uint32_t goalGroup) const;
+    void accountFragments(const Inode& inode, uint32_t fragments, int sign);
+    bool isValidBlock(uint32_t blockNum) const;
     
     bool readIndirectBlock(uint32_t blockNum, std::vector<uint32_t>& pointers);
+    static void parsePointers(const uint8_t* block, std::vector<uint32_t>& pointers);  // Up to the first 0
+    void appendValidPointers(const uint8_t* block, std::vector<uint32_t>& blocks) const;
     bool writeIndirectBlock(uint32_t blockNum, const std::vector<uint32_t>& pointers);
 };
 
@@ -4,6 +4,12 @@
 #include "Inode.h"
 #include <cstdint>
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <ctime>
 
 namespace FileSystemTool {
@@ -15,11 +21,27 @@ enum class JournalOp : uint8_t {
     WRITE_DATA = 3,
     UPDATE_INODE = 4,
     CREATE_DIR = 5,
-    DELETE_DIR = 6
+    DELETE_DIR = 6,
+    COMMIT = 7,                     // Commit record for an earlier transaction
+    ABORT = 8,                      // Abort record for an earlier transaction
+    BLOCK_MAP = 9,                  // Home locations of logged block images
+    BLOCK_COMMIT = 10,              // Commit record for a group of block images
+    MOVE_EXTENT = 11,               // Defrag relocation of one extent of a file
+    WRITE_BATCH = 12                // Many files created and written as one operation
 };
 
 // Journal entry structure
 constexpr uint32_t JOURNAL_ENTRY_SIZE = 256;  // bytes
+constexpr uint32_t DEFAULT_GROUP_COMMIT = 8;  // Commits batched per journal flush
+constexpr uint32_t JOURNAL_RECORD_BLOCKS = 16;  // Record ring; the rest of the region after the header holds block images
+constexpr uint32_t JOURNAL_MAGIC = 0x4A524E4C;  // "JRNL"
+constexpr uint32_t DEFAULT_CHECKPOINT_INTERVAL_MS = 1000;
+
+// First block of the journal region
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t checkpointSequence;    // Block records below this sequence are already home
+};
 
 struct JournalEntry {
     uint32_t transactionId;         // Unique transaction ID
@@ -28,23 +50,32 @@ struct JournalEntry {
     uint8_t  padding[2];            // Padding
     time_t   timestamp;             // When transaction started
     uint32_t inodeNumber;           // Target inode
-    uint32_t parentInodeNumber;     // Parent directory inode (if applicable)
+    uint32_t parentInodeNumber;     // Parent directory inode; first image sequence for block records
     uint32_t blockCount;            // Number of blocks involved
-    uint32_t blocks[32];            // Block numbers involved (max 32)
-    char     filename[128];         // Filename (if applicable)
+    uint32_t sequence;              // Log sequence number (slot = sequence % capacity)
+    uint32_t blocks[32];            // Block numbers involved (max 32); checksum for BLOCK_COMMIT
+    char     filename[96];          // Filename (if applicable)
     
     JournalEntry();
     void reset();
     bool isValid() const;
 };
 
+static_assert(sizeof(JournalEntry) == JOURNAL_ENTRY_SIZE, "JournalEntry must fill exactly one slot");
+
+// Circular append-only log. Records are appended at the tail in memory and
+// written a block at a time; the head advances past resolved transactions.
+// Metadata blocks are redo-logged: new images are staged in memory, written to
+// the image ring at group commit, and copied home by checkpoint().
 class Journal {
 public:
-    Journal(class VirtualDisk* disk);
+    Journal(class VirtualDisk* disk, uint32_t groupCommitSize = DEFAULT_GROUP_COMMIT);
+    ~Journal();
     
     // Journal lifecycle
     bool initializeJournal();
-    bool openJournal();
+    bool openJournal();  // Also replays committed block images not yet checkpointed
+    uint32_t getReplayedBlockCount() const { return replayedBlocks_; }
     
     // Transaction management
     uint32_t beginTransaction(JournalOp op, uint32_t inodeNum, const std::string& filename = "");
@@ -59,18 +90,98 @@ public:
     bool replayTransaction(const JournalEntry& entry);
     bool clearJournal();
     
+    // Group commit: commit records are made durable together, one write per
+    // dirty journal block plus one flush, once groupCommitSize commits are pending
+    void setGroupCommitSize(uint32_t commits) { groupCommitSize_ = commits ? commits : 1; }
+    uint32_t getGroupCommitSize() const { return groupCommitSize_; }
+    bool flush();
+    bool hasPendingWrites() const;
+    
+    // Block images (called by VirtualDisk)
+    bool stageBlock(uint32_t blockNum, const uint8_t* data);
+    bool readPendingImage(uint32_t blockNum, uint8_t* buffer);  // false if not journaled
+    bool hasPendingImage(uint32_t blockNum);
+    bool revokeBlock(uint32_t blockNum);  // Checkpoint before the block is overwritten in place
+    // Freed blocks: a discard waits until everything staged before the free is durable
+    uint64_t getStagedGroupMark() const;  // Groups that must be durable to cover what is staged now
+    bool isGroupMarkDurable(uint64_t mark) const;
+    
+    // Checkpointing
+    bool checkpoint();  // Copy committed images home and release their log space
+    void startCheckpointThread();
+    void stopCheckpointThread();
+    void setCheckpointInterval(uint32_t ms);  // 0 = checkpoint only under log pressure
+    uint32_t getCheckpointInterval() const { return checkpointIntervalMs_; }
+    double getLogPressure() const;  // Fraction of record or image space in use (0.0 - 1.0)
+    
     // Journal statistics
-    uint32_t getTransactionCount() const { return nextTransactionId_; }
+    uint32_t getTransactionCount() const;
+    uint32_t getActiveTransactionCount() const;
+    uint32_t getUsedSlots() const;
+    uint32_t getCapacity() const { return static_cast<uint32_t>(slots_.size()); }
+    uint32_t getImageCapacity() const { return imageCapacity_; }
     
 private:
+    struct PendingImage {
+        std::vector<uint8_t> data;
+        uint32_t sequence;              // Commit sequence of its group (0 while staged)
+    };
+    
     VirtualDisk* disk_;
     uint32_t nextTransactionId_;
     uint32_t journalStartBlock_;
     uint32_t journalBlockCount_;
+    uint32_t recordBlockCount_;
+    uint32_t imageCapacity_;
+    uint32_t groupCommitSize_;
+    uint32_t pendingCommits_;
+    uint32_t replayedBlocks_;
+    
+    // In-memory mirror of every record slot; blocks are written straight from it
+    std::vector<JournalEntry> slots_;
+    std::vector<uint8_t> dirtyBlocks_;  // 1 = record block needs writing
+    uint32_t dirtyBlockCount_;
+    uint32_t headSequence_;             // Oldest record that may still be needed
+    uint32_t nextSequence_;             // Sequence of the next appended record
+    uint32_t committedSequence_;        // End of the last committed image group
+    uint32_t checkpointSequence_;       // Image groups below this are home
+    uint64_t sealedGroups_;             // Image groups committed so far
+    uint64_t durableGroups_;            // Of those, groups whose records reached stable storage
+    std::unordered_map<uint32_t, uint32_t> openTransactions_;  // txId -> begin sequence
+    
+    // Block images: staged for the running group, then committed until checkpoint
+    std::unordered_map<uint32_t, PendingImage> running_;
+    std::unordered_map<uint32_t, PendingImage> committed_;
+    std::atomic<size_t> pendingImages_;  // Fast path for readers of unjournaled blocks
+    uint32_t imageHead_;                 // Oldest image sequence not yet checkpointed
+    uint32_t imageNext_;
+    
+    mutable std::mutex mutex_;          // Guards all of the above
+    std::mutex checkpointMutex_;        // Serializes checkpoints; taken before mutex_
+    
+    // Background checkpointing
+    std::thread checkpointThread_;
+    std::mutex threadMutex_;
+    std::condition_variable threadCv_;
+    bool stopping_;
+    bool checkpointRequested_;
+    std::atomic<uint32_t> checkpointIntervalMs_;
     
-    bool readJournalEntry(uint32_t index, JournalEntry& entry);
-    bool writeJournalEntry(uint32_t index, const JournalEntry& entry);
-    uint32_t findFreeJournalSlot();
+    uint32_t slotFor(uint32_t sequence) const { return sequence % slots_.size(); }
+    uint32_t imageBlockFor(uint32_t imageSequence) const {
+        return journalStartBlock_ + 1 + recordBlockCount_ + imageSequence % imageCapacity_;
+    }
+    bool reserveRecords(std::unique_lock<std::mutex>& lock, uint32_t count);
+    bool appendEntry(std::unique_lock<std::mutex>& lock, JournalEntry& entry);
+    void advanceHead();
+    void markSlotDirty(uint32_t slot);
+    bool flushLocked(std::unique_lock<std::mutex>& lock);
+    bool commitGroupLocked(std::unique_lock<std::mutex>& lock);
+    bool writeRecordBlock(uint32_t index);
+    bool writeHeader(uint32_t checkpointSequence);
+    double logPressureLocked() const;
+    void requestCheckpoint();
+    void checkpointLoop();
 };
 
 } // namespace FileSystemTool
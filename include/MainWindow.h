@@ -28,6 +28,8 @@ class BlockMapWidget;
 class PerformanceWidget;
 class ControlPanel;
 class FileBrowserWidget;
+class OperationRunner;
+class RefreshBus;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -44,12 +46,14 @@ private slots:
     void onNewDisk();
     void onOpenDisk();
     void onCloseDisk();
+    void onRecordTrace(bool checked);  // Unchecking saves the trace
     void onExit();
     void onAbout();
     
     // Status updates
     void updateStatusBar();
     void updateAllWidgets();
+    void refreshDuringOperation();  // Timer tick while a long operation runs
     
     // Animated power cut write
     void animatedBlockWrite();
@@ -59,18 +63,26 @@ private:
     void setupMenuBar();
     void connectSignals();
     bool confirmDiskClose();
+    void updateOperationButtons();
     
     // Core components
     std::unique_ptr<FileSystem> fileSystem_;
     std::unique_ptr<RecoveryManager> recoveryMgr_;
     std::unique_ptr<DefragManager> defragMgr_;
     
+    // Long operations run here, one at a time, off the GUI thread
+    OperationRunner* runner_;
+    QTimer* refreshTimer_;
+    RefreshBus* refreshBus_;           // Coalesces widget refreshes to one per frame
+    QProgressBar* activeProgressBar_;  // Receives the running operation's progress
+    
     // UI components
     BlockMapWidget* blockMapWidget_;
     PerformanceWidget* performanceWidget_;
     ControlPanel* controlPanel_;
     FileBrowserWidget* fileBrowserWidget_;
     QTextEdit* logOutput_;
+    QAction* recordTraceAction_;
     
     // Inline operation widgets
     QLineEdit* filenameInput_;
@@ -89,6 +101,7 @@ private:
     QPushButton* crashBtn_;
     QPushButton* recoveryBtn_;
     QPushButton* defragBtn_;
+    QPushButton* benchmarkBtn_;
     QProgressBar* progressBar_;
     
     // Animated power cut state
@@ -0,0 +1,165 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace FileSystemTool {
+
+// Timed file system operations
+enum class MetricOp : uint8_t {
+    CREATE = 0,
+    REMOVE,     // File deletion (DELETE is a macro on Windows)
+    READ,
+    WRITE,
+    LOOKUP,     // Path resolution, also inside the other operations
+    COUNT
+};
+
+// Work done by the layers under an operation
+enum class MetricCounter : uint8_t {
+    BLOCK_READS = 0,        // VirtualDisk block reads, cache hits included
+    BLOCK_WRITES,
+    DEVICE_READS,           // Transfers that reached the disk image
+    DEVICE_WRITES,
+    BITMAP_WRITES,          // Bitmap blocks written
+    INODE_READS,
+    INODE_WRITES,
+    JOURNAL_RECORDS,        // Records appended to the log
+    JOURNAL_STAGED_BLOCKS,  // Metadata block images staged in the journal
+    JOURNAL_SLOT_SCANS,     // Log slots visited by scans (recovery, checkpoint, head advance)
+    COUNT
+};
+
+constexpr size_t METRIC_OP_COUNT = static_cast<size_t>(MetricOp::COUNT);
+constexpr size_t METRIC_COUNTER_COUNT = static_cast<size_t>(MetricCounter::COUNT);
+constexpr size_t MAX_TRACE_EVENTS = 1 << 20;  // Later events are counted as dropped
+
+const char* metricOpName(MetricOp op);
+const char* metricCounterName(MetricCounter counter);
+
+// Percentiles of one histogram, in microseconds
+struct LatencySummary {
+    uint64_t count;
+    double meanUs;
+    double p50Us;
+    double p90Us;
+    double p99Us;
+    double p999Us;
+    double maxUs;
+};
+
+// Everything Metrics has measured, as plain data (part of PerformanceStats)
+struct MetricsReport {
+    bool enabled;
+    LatencySummary ops[METRIC_OP_COUNT];
+    uint64_t counters[METRIC_COUNTER_COUNT];
+    uint64_t traceEvents;
+    uint64_t droppedTraceEvents;
+};
+
+// HDR-style log-linear histogram of nanosecond latencies: exact below 16 ns,
+// then 16 sub-buckets per power of two, so any value lands in a bucket within
+// about 6% of it. Recording is lock-free; percentiles are read from a copy.
+class LatencyHistogram {
+public:
+    static constexpr uint32_t SUB_BUCKET_BITS = 4;
+    static constexpr uint32_t MAX_EXPONENT = 40;  // ~18 minutes; longer values are clamped
+    static constexpr uint32_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) << SUB_BUCKET_BITS;
+    
+    LatencyHistogram();
+    
+    void record(uint64_t ns);
+    void reset();
+    LatencySummary summarize() const;
+    
+    static uint32_t bucketOf(uint64_t ns);
+    static uint64_t bucketMidpoint(uint32_t bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_;
+    std::atomic<uint64_t> sumNs_;
+    std::atomic<uint64_t> maxNs_;
+};
+
+// Latency histograms per operation, per-layer counters and an optional Chrome
+// trace (chrome://tracing or ui.perfetto.dev). Off by default: every hook is
+// then a relaxed load and a branch. A FileSystem owns one and hands it to its
+// components through VirtualDisk.
+class Metrics {
+public:
+    Metrics();
+    
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+    void setTracing(bool tracing);  // Records one event per timed operation; needs setEnabled
+    bool isTracing() const { return tracing_.load(std::memory_order_relaxed); }
+    void clearTrace();
+    void reset();
+    
+    void count(MetricCounter counter, uint64_t n = 1) {
+        if (isEnabled()) {
+            counters_[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+    // An operation that ran for durationNs and ended now
+    void record(MetricOp op, uint64_t durationNs);
+    
+    MetricsReport getReport() const;
+    bool writeChromeTrace(std::ostream& out) const;
+    bool writeChromeTrace(const std::string& path) const;
+
+private:
+    struct TraceEvent {
+        MetricOp op;
+        uint32_t thread;
+        uint64_t startNs;  // Since epoch_
+        uint64_t durationNs;
+    };
+    
+    std::atomic<bool> enabled_;
+    std::atomic<bool> tracing_;
+    std::array<LatencyHistogram, METRIC_OP_COUNT> histograms_;
+    std::array<std::atomic<uint64_t>, METRIC_COUNTER_COUNT> counters_;
+    std::chrono::steady_clock::time_point epoch_;
+    mutable std::mutex traceMutex_;  // trace_, droppedEvents_
+    std::vector<TraceEvent> trace_;
+    uint64_t droppedEvents_;
+};
+
+// Times the enclosing scope as one operation; skips the clock when metrics are off
+class ScopedLatency {
+public:
+    ScopedLatency(Metrics* metrics, MetricOp op)
+        : metrics_(metrics && metrics->isEnabled() ? metrics : nullptr), op_(op) {
+        if (metrics_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    
+    ~ScopedLatency() {
+        if (metrics_) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            metrics_->record(op_, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+    
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    Metrics* metrics_;
+    MetricOp op_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace FileSystemTool
+
+#endif // METRICS_H
@@ -0,0 +1,79 @@
+#ifndef OPERATIONRUNNER_H
+#define OPERATIONRUNNER_H
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "FileSystem.h"
+#include "RecoveryManager.h"
+#include "DefragManager.h"
+
+namespace FileSystemTool {
+
+constexpr uint32_t IMPORT_BATCH_FILES = 16;  // Files per writeBatch call in a bulk import
+
+// Set by the GUI thread, polled by the running operation between units of work
+using CancellationToken = std::atomic<bool>;
+
+// Runs one long operation at a time on a worker thread so the window keeps
+// painting. The operation reports through a ProgressCallback, which emits
+// progress() and so reaches GUI receivers as a queued signal. Widgets keep
+// refreshing meanwhile from FileSystem::trySnapshot(), which never waits on
+// the operation. Completions run on the GUI thread once the worker is done.
+class OperationRunner : public QObject {
+    Q_OBJECT
+
+public:
+    using ProgressCallback = DefragManager::ProgressCallback;
+    using Task = std::function<bool(const ProgressCallback& progress, const CancellationToken& cancelled)>;
+    using Completion = std::function<void(bool success, bool cancelled)>;
+    
+    explicit OperationRunner(QObject *parent = nullptr);
+    ~OperationRunner();  // Cancels and waits for a running operation
+    
+    // False (and nothing starts) while another operation runs. onCancel runs on
+    // the GUI thread from cancel(), for operations with their own cancel hook.
+    bool start(const QString& name, Task task, Completion done = nullptr,
+               std::function<void()> onCancel = nullptr);
+    void cancel();
+    void wait();  // Blocks until the running operation ends; its completion runs before returning
+    bool isRunning() const { return thread_ != nullptr; }
+    const QString& getCurrentName() const { return name_; }
+    
+    // The long operations. Recovery and the benchmark hold the file system
+    // exclusively, so they only check for cancellation before they begin.
+    bool startDefrag(DefragManager* defragMgr, Completion done = nullptr);
+    bool startRecovery(RecoveryManager* recoveryMgr, Completion done = nullptr);
+    bool startBenchmark(DefragManager* defragMgr, uint32_t numFiles,
+                        std::function<void(bool success, const BenchmarkResults& results)> done);
+    // Writes the files through FileSystem::writeBatch, filesPerBatch at a time,
+    // pausing pauseMs between batches (for a visible demo)
+    bool startImport(FileSystem* fs, std::vector<BatchFile> files, Completion done = nullptr,
+                     uint32_t filesPerBatch = IMPORT_BATCH_FILES, uint32_t pauseMs = 0);
+    
+    // For tasks: sleep that wakes early on cancellation; false if cancelled
+    static bool pause(const CancellationToken& cancelled, uint32_t ms);
+
+signals:
+    void started(const QString& name);
+    void progress(int percent, const QString& message);
+    void finished(const QString& name, bool success, bool cancelled);
+
+private:
+    QThread* thread_;
+    QString name_;
+    uint64_t generation_;       // Tells a stale queued finish apart from the current run
+    CancellationToken cancelled_;
+    std::atomic<bool> success_;
+    Completion done_;
+    std::function<void()> onCancel_;
+    
+    void finish();
+};
+
+} // namespace FileSystemTool
+
+#endif // OPERATIONRUNNER_H
@@ -16,6 +16,7 @@
 #include <QtCharts/QLineSeries>
 #include <QtCharts/QValueAxis>
 #include <QtCharts/QBarCategoryAxis>
+#include "RefreshBus.h"
 
 namespace FileSystemTool {
 
@@ -32,6 +33,7 @@ public:
     void setDefragManager(DefragManager* defragMgr);
     
     void updateMetrics();
+    void applyChanges(const ChangeSet& changes);  // Metrics from the refresh bus's snapshot
     void recordReadOperation(double latencyMs);
     void recordWriteOperation(double latencyMs);
     void updateFragmentationStats();
@@ -60,6 +62,9 @@ private:
     void setupLatencyChart();
     void setupThroughputChart();
     void setupFragmentationDisplay();
+    void showMetrics(const FileSystem::Snapshot& snapshot);
+    // With FileSystem metrics on, the latency chart shows read/write p50 and p99
+    void plotPercentiles(const MetricsReport& report);
     
     void setupPerformanceChart();
     void setupHealthChart();
@@ -73,6 +78,9 @@ private:
     QChart* latencyChart_;
     QLineSeries* readLatencySeries_;
     QLineSeries* writeLatencySeries_;
+    QLineSeries* readTailSeries_;   // p99, only while percentiles are shown
+    QLineSeries* writeTailSeries_;
+    bool showingPercentiles_;
     
     QChartView* throughputChartView_;
     QChart* throughputChart_;
@@ -97,6 +105,7 @@ private:
     QLabel* fragmentationLabel_;
     QLabel* latencyLabel_;
     QLabel* throughputLabel_;
+    QLabel* percentileLabel_;
     
     // Data storage
     std::vector<FilePerformance> perfData_;
@@ -106,6 +115,15 @@ private:
     std::deque<double> readLatencies_;
     std::deque<double> writeLatencies_;
     std::deque<qint64> timestamps_;
+    
+    struct PercentilePoint {
+        double readP50;
+        double readP99;
+        double writeP50;
+        double writeP99;
+    };
+    std::deque<PercentilePoint> percentiles_;  // In ms, one per refresh with new samples
+    uint64_t percentileSamples_;               // Read + write count at the last point
     static constexpr int MAX_DATA_POINTS = 100;
 };
 
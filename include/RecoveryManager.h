@@ -6,20 +6,41 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 namespace FileSystemTool {
 
+constexpr uint32_t DEFAULT_SCRUB_STEP = 256;           // Inodes checked per lock hold
+constexpr uint32_t DEFAULT_SCRUB_PAUSE_MS = 20;        // Sleep between steps
+constexpr uint32_t DEFAULT_SCRUB_INTERVAL_MS = 10000;  // Sleep between passes
+
 // Consistency check results
 struct ConsistencyReport {
     bool isConsistent;
-    uint32_t orphanBlocks;
+    uint32_t orphanBlocks;          // Marked used but referenced by no inode
     uint32_t invalidInodes;
-    uint32_t brokenDirectories;
+    uint32_t brokenDirectories;     // Corrupt root or entries naming free inodes
+    uint32_t duplicateBlocks;       // Referenced more than once
+    uint32_t unallocatedBlocks;     // Referenced but marked free
+    uint32_t unreachableInodes;     // In use but not reachable from the root
     std::vector<std::string> errors;
     std::vector<std::string> fixes;
     
     ConsistencyReport() : isConsistent(true), orphanBlocks(0), 
-                         invalidInodes(0), brokenDirectories(0) {}
+                         invalidInodes(0), brokenDirectories(0),
+                         duplicateBlocks(0), unallocatedBlocks(0), unreachableInodes(0) {}
+};
+
+// Background scrub progress
+struct ScrubStatus {
+    uint32_t passes = 0;            // Passes finished
+    uint32_t interruptedPasses = 0; // Passes whose cross-inode checks were skipped (disk changed)
+    uint32_t inodesScanned = 0;     // Progress through the current pass
+    uint32_t inodeCount = 0;
+    ConsistencyReport lastReport;   // From the last finished pass
 };
 
 class RecoveryManager {
@@ -35,7 +56,7 @@ public:
     // Journal-based recovery
     bool replayJournal();
     
-    // Consistency checks
+    // Consistency checks (each runs the full scan; checkConsistency shares one)
     bool checkBitmapConsistency(ConsistencyReport& report);
     bool checkInodeConsistency(ConsistencyReport& report);
     bool checkDirectoryConsistency(ConsistencyReport& report);
@@ -50,13 +71,86 @@ public:
                                   double crashAtPercent = 0.5);
     void simulateCrashDuringDelete(const std::string& filename);
     
+    // Verify only the regions the superblock marks dirty (call at mount after an
+    // unclean shutdown). Clears the maps when they check out.
+    ConsistencyReport checkDirtyRegions();
+    
+    // Low-priority background scrub of the whole disk while it stays mounted.
+    // Each step holds the file system lock for inodesPerStep inodes only.
+    void startScrub(uint32_t inodesPerStep = DEFAULT_SCRUB_STEP,
+                    uint32_t pauseMs = DEFAULT_SCRUB_PAUSE_MS,
+                    uint32_t passIntervalMs = DEFAULT_SCRUB_INTERVAL_MS);
+    void stopScrub();
+    bool isScrubbing() const { return scrubThread_.joinable(); }
+    ScrubStatus getScrubStatus();
+    
     // Get last recovery report
     const ConsistencyReport& getLastReport() const { return lastReport_; }
     
+    // Progress of performRecovery, called on the recovering thread at each phase
+    using ProgressCallback = std::function<void(int progress, const std::string& message)>;
+    void setProgressCallback(ProgressCallback callback) { progressCallback_ = callback; }
+    
 private:
+    // Limits a scan to dirty regions
+    struct ScanFilter {
+        std::vector<uint8_t> inodes;        // 1 = inode gets every check
+        std::vector<uint64_t> blocks;       // Bit per block whose claims are tracked
+        bool trackBlocks = false;           // Any bitmap region dirty
+    };
+    
+    // Per-worker (or per-scrub-pass) state; merged by mergeScan
+    struct ScanPartial {
+        std::vector<uint64_t> referenced;
+        std::vector<uint64_t> duplicates;
+        std::vector<uint32_t> invalidInodes;
+        std::vector<std::pair<uint32_t, uint32_t>> edges;  // directory inode -> entry inode
+        
+        void claim(uint32_t blockNum) {
+            uint64_t bit = 1ULL << (blockNum & 63);
+            uint64_t& word = referenced[blockNum >> 6];
+            if (word & bit) {
+                duplicates[blockNum >> 6] |= bit;
+            }
+            word |= bit;
+        }
+    };
+    
+    // Result of one parallel pass over the inode table
+    struct ScanResult {
+        std::vector<uint64_t> referenced;   // Bit per block claimed by an inode
+        std::vector<uint64_t> duplicates;   // Bit per block claimed more than once
+        std::vector<uint64_t> metadata;     // Bit per group metadata block (superblock, bitmaps, inode tables, journal)
+        std::vector<uint32_t> invalidInodes;
+        uint32_t brokenDirectories = 0;
+        uint32_t unreachableInodes = 0;
+        bool rootValid = false;
+    };
+    
     FileSystem* fs_;
-    std::unique_ptr<Journal> journal_;
     ConsistencyReport lastReport_;
+    ProgressCallback progressCallback_;
+    
+    // Scrub thread state
+    std::thread scrubThread_;
+    std::mutex scrubMutex_;
+    std::condition_variable scrubCv_;
+    bool scrubStopping_ = false;
+    ScrubStatus scrubStatus_;
+    
+    ScanResult scanFileSystem(const ScanFilter* filter = nullptr);
+    void scanInodes(ScanPartial& part, uint32_t first, uint32_t last,
+                    const ScanFilter* filter, std::vector<uint8_t>& inUse);
+    ScanResult mergeScan(std::vector<ScanPartial>& partials, const std::vector<uint8_t>& inUse,
+                         bool reachability);
+    void scrubLoop(uint32_t inodesPerStep, uint32_t pauseMs, uint32_t passIntervalMs);
+    bool scrubWait(uint32_t ms);  // False once stopScrub() was called
+    void reportBitmap(const ScanResult& scan, ConsistencyReport& report,
+                      const std::vector<uint64_t>* mask = nullptr);  // mask limits the blocks compared
+    void reportInodes(const ScanResult& scan, ConsistencyReport& report);
+    void reportDirectories(const ScanResult& scan, ConsistencyReport& report);
+    std::vector<uint32_t> collectOrphans(const ScanResult& scan);
+    void reportProgress(int progress, const std::string& message);
     
     // Helper functions
     std::vector<uint32_t> findOrphanBlocks();
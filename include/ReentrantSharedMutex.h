@@ -0,0 +1,112 @@
+#ifndef REENTRANTSHAREDMUTEX_H
+#define REENTRANTSHAREDMUTEX_H
+
+#include <atomic>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace FileSystemTool {
+
+// Reader/writer lock whose operations may nest on one thread: the exclusive
+// owner can lock() again and take shared locks freely, and a shared holder can
+// take further shared locks without touching the underlying mutex (so a queued
+// writer never deadlocks a nested reader). Upgrading shared to exclusive is not
+// supported and deadlocks. Satisfies Lockable and SharedLockable, so it works
+// with std::lock_guard, std::unique_lock and std::shared_lock (including
+// std::try_to_lock for shared locks).
+class ReentrantSharedMutex {
+public:
+    ReentrantSharedMutex() : depth_(0) {}
+
+    ReentrantSharedMutex(const ReentrantSharedMutex&) = delete;
+    ReentrantSharedMutex& operator=(const ReentrantSharedMutex&) = delete;
+
+    void lock() {
+        std::thread::id self = std::this_thread::get_id();
+        if (owner_.load(std::memory_order_relaxed) == self) {
+            depth_++;
+            return;
+        }
+        mutex_.lock();
+        owner_.store(self, std::memory_order_relaxed);
+        depth_ = 1;
+    }
+
+    void unlock() {
+        if (--depth_ == 0) {
+            owner_.store(std::thread::id(), std::memory_order_relaxed);
+            mutex_.unlock();
+        }
+    }
+
+    void lock_shared() {
+        SharedHold& hold = sharedHold();
+        if (hold.depth++ > 0) {
+            return;
+        }
+        // Under our own exclusive lock a shared lock is implied
+        hold.counted = owner_.load(std::memory_order_relaxed) != std::this_thread::get_id();
+        if (hold.counted) {
+            mutex_.lock_shared();
+        }
+    }
+
+    // False without waiting if a writer holds (or may spuriously seem to hold) the lock
+    bool try_lock_shared() {
+        SharedHold& hold = sharedHold();
+        if (hold.depth > 0) {
+            hold.depth++;
+            return true;
+        }
+        bool counted = owner_.load(std::memory_order_relaxed) != std::this_thread::get_id();
+        if (counted && !mutex_.try_lock_shared()) {
+            return false;
+        }
+        hold.counted = counted;
+        hold.depth = 1;
+        return true;
+    }
+
+    void unlock_shared() {
+        SharedHold& hold = sharedHold();
+        if (--hold.depth == 0 && hold.counted) {
+            mutex_.unlock_shared();
+        }
+    }
+
+private:
+    struct SharedHold {
+        const ReentrantSharedMutex* lock;
+        unsigned depth;
+        bool counted;     // Holds a real shared lock on mutex_
+    };
+
+    std::shared_mutex mutex_;
+    std::atomic<std::thread::id> owner_;  // Only ever equal to the reader's id while it owns the lock
+    unsigned depth_;                      // Exclusive nesting, touched by the owner only
+
+    // Per-thread shared nesting, keyed by lock (threads rarely hold more than one)
+    SharedHold& sharedHold() {
+        thread_local std::vector<SharedHold> holds;
+        SharedHold* idle = nullptr;
+        for (auto& hold : holds) {
+            if (hold.lock == this) {
+                return hold;
+            }
+            if (hold.depth == 0) {
+                idle = &hold;
+            }
+        }
+        if (idle) {
+            *idle = {this, 0, false};  // Reuse a slot no shared lock is using
+            return *idle;
+        }
+        holds.push_back({this, 0, false});
+        return holds.back();
+    }
+};
+
+} // namespace FileSystemTool
+
+#endif // REENTRANTSHAREDMUTEX_H
@@ -0,0 +1,58 @@
+#ifndef REFRESHBUS_H
+#define REFRESHBUS_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <vector>
+#include "FileSystem.h"
+
+namespace FileSystemTool {
+
+constexpr int REFRESH_FRAME_BUDGET_MS = 33;  // At most ~30 widget refreshes per second
+
+// Everything that changed between two flushes of the bus
+struct ChangeSet {
+    FileSystem::Snapshot snapshot;  // Taken at the flush, shared by every widget
+    std::vector<Extent> blocks;     // Bitmap ranges (VirtualDisk's change log)
+    std::vector<uint32_t> inodes;   // Inodes written, ascending (InodeManager's change log)
+    bool allInodes = false;         // Inode table (re)loaded: any inode may have changed
+    bool reset = false;             // Different file system, or none: redraw from scratch
+};
+
+// Coalesces change notifications into at most one widget refresh per frame.
+// Code that touched the file system calls post(); the first post of a frame
+// arms a timer for what is left of the frame budget and later ones only mark
+// the bus pending. The flush drains both core change logs, whose only consumer
+// the bus is, and emits changed() once with all of it. While an operation holds
+// the file system exclusively the flush is put off to the next frame.
+class RefreshBus : public QObject {
+    Q_OBJECT
+
+public:
+    explicit RefreshBus(QObject *parent = nullptr);
+    
+    void setFileSystem(FileSystem* fs);  // Posts a reset; nullptr drops anything pending
+    void setFrameBudget(int ms);
+    
+    void post();
+    void postReset();
+    void flushNow();  // Skips the frame wait, e.g. before a modal dialog
+
+signals:
+    void changed(const ChangeSet& changes);
+
+private:
+    void flush();
+    
+    FileSystem* fileSystem_;
+    QTimer* timer_;
+    QElapsedTimer sinceFlush_;
+    int frameBudgetMs_;
+    int lastFlushMs_;     // Receivers' time for the last flush; stretches the next wait
+    bool resetPending_;
+};
+
+} // namespace FileSystemTool
+
+#endif // REFRESHBUS_H
@@ -0,0 +1,62 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace FileSystemTool {
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// push() and pop() never block; each side owns one index and publishes it
+// with a release store, so slots are handed over without a mutex.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+        : slots_(roundUp(capacity + 1)), mask_(slots_.size() - 1), head_(0), tail_(0) {}
+    
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    bool push(const T& value) {  // Producer only; false when full
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) & mask_;
+        if (next == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots_[tail] = value;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+    
+    bool pop(T& value) {  // Consumer only; false when empty
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots_[head];
+        head_.store((head + 1) & mask_, std::memory_order_release);
+        return true;
+    }
+    
+    size_t capacity() const { return mask_; }
+    
+private:
+    static size_t roundUp(size_t n) {
+        size_t size = 1;
+        while (size < n) {
+            size <<= 1;
+        }
+        return size;
+    }
+    
+    std::vector<T> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_;  // Next slot to pop (consumer)
+    alignas(64) std::atomic<size_t> tail_;  // Next slot to fill (producer)
+};
+
+} // namespace FileSystemTool
+
+#endif // SPSCQUEUE_H
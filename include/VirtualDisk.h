@@ -4,7 +4,14 @@
 #include <string>
 #include <cstdint>
 #include <vector>
-#include <fstream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include "AsyncIO.h"
+#include "BlockCache.h"
+#include "DiskStorage.h"
+#include "FreeBitmap.h"
+#include "Metrics.h"
 
 namespace FileSystemTool {
 
@@ -12,6 +19,11 @@ namespace FileSystemTool {
 constexpr uint32_t BLOCK_SIZE = 4096;           // 4KB blocks
 constexpr uint32_t DEFAULT_DISK_SIZE = 104857600; // 100MB
 constexpr uint32_t MAGIC_NUMBER = 0xF5757357;   // Magic number for validation
+constexpr uint32_t DIRTY_REGION_COUNT = 128;    // Regions per dirty map (inode table, bitmap)
+constexpr uint32_t BLOCKS_PER_GROUP = BLOCK_SIZE * 8;        // One bitmap block covers a group
+constexpr uint32_t INODES_PER_GROUP = BLOCKS_PER_GROUP / 8;  // Same inode ratio as the flat layout
+constexpr uint32_t MIN_GROUP_BLOCKS = 64;       // A shorter tail past the last group is left unused
+constexpr uint32_t CHANGE_CHUNK_BLOCKS = 64;    // Granularity of the block change log
 
 // Superblock structure - stores disk metadata
 struct Superblock {
@@ -27,12 +39,59 @@ struct Superblock {
     uint32_t journalStart;       // Block number where journal starts
     uint32_t journalSize;        // Number of journal blocks
     uint8_t  cleanShutdown;      // 1 if clean shutdown, 0 if crashed
-    uint8_t  padding[43];        // Padding to align to 64 bytes
+    uint8_t  dirtyInodeRegions[DIRTY_REGION_COUNT / 8];   // Inode-table ranges changed since the last clean point
+    uint8_t  dirtyBitmapRegions[DIRTY_REGION_COUNT / 8];  // Bitmap-word ranges changed since the last clean point
+    uint8_t  padding[3];         // Padding
+    uint32_t blocksPerGroup;     // 0 on images from before block groups (one group spans the disk)
+    uint32_t inodesPerGroup;
+    uint32_t groupCount;
+    uint32_t groupTableStart;    // Block number where the group descriptor table starts
 };
 
+static_assert(sizeof(Superblock) == 96, "Group fields follow the dirty-region maps");
+
+// Block group descriptor. Group g spans [firstBlock, firstBlock + blockCount) and
+// starts with its own bitmap block and inode table slice (group 0 also holds the
+// superblock, the descriptor table and the journal ahead of its data).
+struct GroupDescriptor {
+    uint32_t firstBlock;
+    uint32_t blockCount;
+    uint32_t bitmapBlock;        // Bitmap slice covering this group's blocks
+    uint32_t inodeTableBlock;    // Inode table slice for inodes [g * inodesPerGroup, ...)
+    uint32_t dataStart;          // First block files may use
+    uint32_t freeBlocks;
+    uint32_t freeInodes;
+    uint32_t directories;
+};
+
+static_assert(sizeof(GroupDescriptor) == 32, "Descriptors pack evenly into a block");
+constexpr uint32_t GROUP_DESCRIPTORS_PER_BLOCK = BLOCK_SIZE / sizeof(GroupDescriptor);
+
+class Journal;
+
+// What happens to the contents of a freed block. Every allocation path writes
+// a block in full before anything references it, so only secure erase needs
+// the old contents gone at free time.
+enum class FreePolicy : uint8_t {
+    DISCARD = 0,       // Punch freed extents out of the image once their journal group is durable (zeros if unsupported)
+    DEFERRED = 1,      // Leave old contents until the block is reused
+    SECURE_ERASE = 2   // Zero every block as it is freed
+};
+
+// Contiguous run of blocks
+struct Extent {
+    uint32_t start;
+    uint32_t length;
+};
+
+// Thread-safe for concurrent callers: block I/O goes through the sharded cache,
+// the journal and positional storage I/O; allocation, the bitmap and the
+// superblock are guarded by one metadata lock. getBitmap() and getSuperblock()
+// callers must keep the file system quiet (its exclusive lock) while reading.
 class VirtualDisk {
 public:
-    VirtualDisk(const std::string& diskPath);
+    VirtualDisk(const std::string& diskPath, DiskBackend backend = DiskBackend::STREAM,
+                size_t cacheBlocks = DEFAULT_CACHE_BLOCKS);
     ~VirtualDisk();
 
     // Disk lifecycle
@@ -41,15 +100,85 @@ public:
     void closeDisk();
     bool formatDisk();
     
-    // Block operations
+    // Block operations (served from the write-back cache when enabled)
     bool readBlock(uint32_t blockNum, uint8_t* buffer);
     bool writeBlock(uint32_t blockNum, const uint8_t* buffer);
+    bool sync();  // Write back dirty cached blocks and flush (or msync) the image
+    // Cache-bypassing read that is safe to call from several threads at once;
+    // flushCache() first so the image holds everything the cache had
+    bool readBlockShared(uint32_t blockNum, uint8_t* buffer);
+    bool writeBlockThrough(uint32_t blockNum, const uint8_t* buffer);  // Bypass the cache (journal)
+    bool writeBlockDirect(uint32_t blockNum, const uint8_t* buffer);   // Caller guarantees the block is not cached
+    // Drop cached copies and journal images of blocks about to get writeBlockDirect
+    bool prepareDirectWrite(uint32_t start, uint32_t count);
+    // Batched forms for the async I/O engine. readBlocks puts block i at
+    // buffer + i * BLOCK_SIZE: cached and journaled blocks are copied, the rest go
+    // out in one submission with runs of consecutive blocks merged.
+    bool readBlocks(const uint32_t* blockNums, uint32_t count, uint8_t* buffer);
+    bool writeBlocksDirect(const std::vector<std::pair<uint32_t, const uint8_t*>>& blocks);
+    const char* getIOEngineName() const { return asyncIO_ ? asyncIO_->getName() : "sync"; }
+    bool flushCache();    // Write back dirty cached blocks only
+    bool flushStorage();  // Flush the image only; cached blocks stay dirty
+    
+    // Metadata blocks (bitmap, inode table, directories, pointer blocks) are
+    // staged in the attached journal and reach their home location at checkpoint
+    bool writeMetadataBlock(uint32_t blockNum, const uint8_t* buffer);
+    void attachJournal(Journal* journal) { journal_ = journal; }
+    
+    // Instrumentation shared with the layers above (not owned; nullptr counts nothing)
+    void attachMetrics(Metrics* metrics) { metrics_ = metrics; }
+    Metrics* getMetrics() const { return metrics_; }
+    void countMetric(MetricCounter counter, uint64_t n = 1) const {
+        if (metrics_) {
+            metrics_->count(counter, n);
+        }
+    }
+    
+    // Zero-copy view of a block (mmap backend only, nullptr otherwise, or while the
+    // journal holds a newer image). Valid until the disk is closed; writes must still
+    // go through writeBlock.
+    const uint8_t* blockPtr(uint32_t blockNum) const;
+    DiskBackend getBackend() const { return backend_; }
+    
+    // Block cache
+    void setCacheCapacity(size_t blocks);  // 0 disables caching (ignored for mmap)
+    size_t getCacheCapacity() const { return cache_.getCapacity(); }
+    CacheStats getCacheStats() const { return cache_.getStats(); }
+    void resetCacheStats() { cache_.resetStats(); }
     
     // Block allocation
     int32_t allocateBlock();  // First-fit allocation (fast)
     int32_t allocateBlockCompact();  // Allocate from lowest block (for defrag)
+    bool allocateBlockRange(uint32_t start, uint32_t count);  // Claim a known free run
+    // Allocate count blocks as few contiguous runs as possible (sorted by start).
+    // Next-fit from hint (or the end of the previous allocation), searching the
+    // hint's group first and then the groups after it; all-or-nothing.
+    std::vector<Extent> allocateExtent(uint32_t count, uint32_t hint = 0);
+    // Frees are batched: extents are released per the free policy once nothing
+    // durable can still point at them
     bool freeBlock(uint32_t blockNum);
     bool isBlockFree(uint32_t blockNum);
+    void setFreePolicy(FreePolicy policy) { freePolicy_ = policy; }
+    FreePolicy getFreePolicy() const { return freePolicy_; }
+    
+    // Block groups. Images made before groups existed load as a single group
+    // spanning the disk (with no descriptor table on disk).
+    uint32_t getGroupCount() const { return static_cast<uint32_t>(groups_.size()); }
+    GroupDescriptor getGroup(uint32_t group) const;
+    uint32_t getInodesPerGroup() const;
+    uint32_t groupOfBlock(uint32_t blockNum) const;
+    uint32_t groupOfInode(uint32_t inodeNum) const;
+    uint32_t inodeTableBlock(uint32_t index) const;  // Location of the index-th inode table block
+    bool isMetadataBlock(uint32_t blockNum) const;   // Superblock, descriptors, bitmap, inode tables, journal
+    std::vector<Extent> getMetadataExtents() const;
+    // Allocation hint for a group: the next-fit position if it lies in the group,
+    // else the group's first data block
+    uint32_t allocationGoal(uint32_t group) const;
+    // Group for a new directory: most free blocks among groups with free inodes
+    uint32_t pickDirectoryGroup() const;
+    // Inode bookkeeping for the descriptors (kept by InodeManager)
+    void accountInode(uint32_t inodeNum, bool directory, bool allocated);
+    void setGroupInodeCounts(uint32_t group, uint32_t freeInodes, uint32_t directories);
     
     // Superblock operations
     bool readSuperblock();
@@ -58,26 +187,85 @@ public:
     
     // Bitmap operations
     bool readBitmap();
-    bool writeBitmap();
-    std::vector<bool> getBitmap() const { return bitmap_; }
+    bool writeBitmap();  // Rewrite every bitmap block
+    bool flushBitmap();  // Write only bitmap blocks changed since the last flush, then release freed extents
+    bool releaseFreedExtents();  // Discard the freed extents whose journal group is durable
+    bool hasDirtyBitmap() const;
+    const FreeBitmap& getBitmap() const { return bitmap_; }
+    // Used blocks in each of cells consecutive cellBlocks-block cells from start
+    // (one lock for the lot; safe while the file system is busy)
+    void countUsedBlocks(uint32_t start, uint32_t cellBlocks, uint32_t cells, uint32_t* used) const;
+    
+    // Block change log for displays: the ranges whose allocation changed since the
+    // previous call, in CHANGE_CHUNK_BLOCKS units (the whole disk after a bitmap
+    // load). There is one consumer, which the call drains.
+    void takeChangedRanges(std::vector<Extent>& ranges);
     
     // Status
-    bool isOpen() const { return diskFile_.is_open(); }
+    bool isOpen() const { return storage_ && storage_->isOpen(); }
     uint32_t getTotalBlocks() const { return superblock_.totalBlocks; }
-    uint32_t getFreeBlocks() const { return superblock_.freeBlocks; }
+    uint32_t getFreeBlocks() const;
     
     // Mark clean/dirty shutdown
     void markClean();
     void markDirty();
     bool wasCleanShutdown() const { return superblock_.cleanShutdown == 1; }
+    
+    // Dirty-region maps. Setting a region's bit writes the superblock, so the bit is
+    // on disk before the metadata it covers; markClean() clears both maps.
+    void markInodeRegionDirty(uint32_t inodeNum);
+    bool isInodeRegionDirty(uint32_t region) const;
+    bool isBitmapRegionDirty(uint32_t region) const;
+    bool hasDirtyRegions() const;
+    void clearDirtyRegions();  // After the dirty regions verified clean
+    uint32_t getInodesPerRegion() const;
+    uint32_t getBitmapWordsPerRegion() const;
+    uint64_t getChangeCount() const { return changeCount_; }  // Bumped on every inode or bitmap change
 
 private:
     std::string diskPath_;
-    std::fstream diskFile_;
+    DiskBackend backend_;
+    std::unique_ptr<DiskStorage> storage_;
     Superblock superblock_;
-    std::vector<bool> bitmap_;  // In-memory bitmap for performance
+    FreeBitmap bitmap_;  // In-memory bitmap for performance
+    std::vector<uint8_t> dirtyBitmapBlocks_;  // 1 = bitmap block needs writing
+    uint32_t dirtyBitmapCount_;
+    uint32_t nextFitBlock_;  // Goal for the next allocation without a hint
+    BlockCache cache_;
+    std::unique_ptr<AsyncIO> asyncIO_;  // Stream backend only; mmap reads are copies
+    std::mutex ioMutex_;                // One batch on the engine at a time
+    Journal* journal_;  // Not owned; nullptr writes metadata in place
+    Metrics* metrics_;  // Not owned
+    std::atomic<uint64_t> changeCount_;
+    FreePolicy freePolicy_;
+    struct FreedExtent {
+        uint32_t start;
+        uint32_t length;
+        uint64_t groupMark;  // Journal groups that must be durable before the discard
+    };
+    std::vector<FreedExtent> freedExtents_;  // In free order, so marks never decrease
+    std::vector<GroupDescriptor> groups_;  // Layout fixed at create/open; counts change
+    std::vector<uint8_t> dirtyGroupBlocks_;  // 1 = descriptor table block needs writing
+    std::vector<uint64_t> changedChunks_;  // Bit per CHANGE_CHUNK_BLOCKS blocks
+    bool allChanged_;
+    mutable std::recursive_mutex metaMutex_;  // Bitmap, superblock, dirty maps, freed extents, group counts, change log
     
-    void initializeSuperblock(uint32_t diskSize);
+    bool readBlockRaw(uint32_t blockNum, uint8_t* buffer);
+    bool writeBlockRaw(uint32_t blockNum, const uint8_t* buffer);
+    bool runIOBatch(std::vector<IORequest>& requests);
+    void markBitmapDirty(uint32_t blockNum, uint32_t count = 1);
+    void markRegion(uint8_t* map, uint32_t region);
+    bool writeBitmapBlock(uint32_t index, uint8_t* buffer);
+    uint32_t bitmapBlockFor(uint32_t index) const;
+    void accountBlocks(uint32_t start, uint32_t count, bool used);  // Superblock and group free counts
+    void recountGroupBlocks();
+    uint32_t findRunInGroup(uint32_t group, uint32_t count, uint32_t from) const;
+    void markGroupDirty(uint32_t group);
+    bool readGroupTable();
+    bool writeGroupTable(bool dirtyOnly);
+    uint32_t groupTableBlocks() const;
+    bool discardRange(uint32_t start, uint32_t count);
+    void initializeSuperblock(uint32_t diskSize);  // Also lays out groups_
     uint32_t calculateBitmapBlocks() const;
     uint32_t calculateInodeBlocks() const;
 };
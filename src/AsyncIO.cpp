@@ -0,0 +1,352 @@
+#include "AsyncIO.h"
+#include "DiskStorage.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace FileSystemTool {
+
+constexpr uint32_t URING_ENTRIES = 128;
+constexpr uint32_t POOL_WORKERS = 4;
+
+std::unique_ptr<AsyncIO> makeAsyncIO(DiskStorage* storage) {
+#ifdef __linux__
+    int fd = storage->nativeHandle();
+    if (fd >= 0) {
+        auto uring = std::make_unique<UringIO>(storage, fd, URING_ENTRIES);
+        if (uring->isReady()) {
+            return uring;
+        }
+    }
+#endif
+    uint32_t workers = std::max(2u, std::min(std::thread::hardware_concurrency(), POOL_WORKERS));
+    return std::make_unique<ThreadPoolIO>(storage, workers);
+}
+
+bool AsyncIO::runBatch(std::vector<IORequest>& requests) {
+    size_t depth = std::max<size_t>(1, getQueueDepth());
+    size_t next = 0;
+    size_t inFlight = 0;
+    bool engineOk = true;
+    std::vector<IORequest*> done;
+    bool success = true;
+
+    for (auto& request : requests) {
+        request.result = 0;
+    }
+
+    while (engineOk && (next < requests.size() || inFlight > 0)) {
+        // Top the engine up, then wait for at least one completion
+        size_t first = next;
+        for (; next < requests.size() && inFlight + (next - first) < depth; ++next) {
+            if (requests[next].write) {
+                submitWrite(requests[next]);
+            } else {
+                submitRead(requests[next]);
+            }
+        }
+        if (next > first) {
+            if (submit()) {
+                inFlight += next - first;
+            } else {
+                engineOk = false;  // Not handed over; finished synchronously below
+            }
+        }
+
+        done.clear();
+        if (inFlight > 0) {
+            if (!reap(engineOk ? 1 : inFlight, done)) {
+                return false;  // Engine is broken with requests still outstanding
+            }
+            inFlight -= done.size();
+        }
+    }
+
+    // Anything short or failed is retried through storage, which loops and retries itself
+    for (auto& request : requests) {
+        if (request.result == static_cast<int32_t>(request.length)) {
+            continue;
+        }
+        uint32_t moved = request.result > 0 ? static_cast<uint32_t>(request.result) : 0;
+        bool ok = request.write
+            ? storage_->write(request.offset + moved, request.buffer + moved, request.length - moved)
+            : storage_->read(request.offset + moved, request.buffer + moved, request.length - moved);
+        request.result = ok ? static_cast<int32_t>(request.length) : -EIO;
+        success = ok && success;
+    }
+    return success;
+}
+
+// ThreadPoolIO
+
+ThreadPoolIO::ThreadPoolIO(DiskStorage* storage, uint32_t workers)
+    : AsyncIO(storage), stopping_(false) {
+    for (uint32_t i = 0; i < workers; ++i) {
+        workers_.emplace_back(&ThreadPoolIO::workerLoop, this);
+    }
+}
+
+ThreadPoolIO::~ThreadPoolIO() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    workCv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPoolIO::submitRead(IORequest& request) {
+    request.write = false;
+    queued_.push_back(&request);
+}
+
+void ThreadPoolIO::submitWrite(IORequest& request) {
+    request.write = true;
+    queued_.push_back(&request);
+}
+
+bool ThreadPoolIO::submit() {
+    if (queued_.empty()) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.insert(pending_.end(), queued_.begin(), queued_.end());
+    }
+    queued_.clear();
+    workCv_.notify_all();
+    return true;
+}
+
+bool ThreadPoolIO::reap(size_t minComplete, std::vector<IORequest*>& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCv_.wait(lock, [&] { return completed_.size() >= minComplete; });
+    out.insert(out.end(), completed_.begin(), completed_.end());
+    completed_.clear();
+    return true;
+}
+
+void ThreadPoolIO::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        workCv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (stopping_) {
+            return;
+        }
+
+        IORequest* request = pending_.front();
+        pending_.pop_front();
+        lock.unlock();
+
+        bool ok = request->write ? storage_->write(request->offset, request->buffer, request->length)
+                                 : storage_->read(request->offset, request->buffer, request->length);
+        request->result = ok ? static_cast<int32_t>(request->length) : -EIO;
+
+        lock.lock();
+        completed_.push_back(request);
+        doneCv_.notify_one();
+    }
+}
+
+// UringIO: the raw interface (no liburing dependency). The kernel reads the
+// SQ tail and writes the CQ tail, so those cross with acquire/release.
+
+#ifdef __linux__
+
+namespace {
+
+int uringSetup(uint32_t entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uringEnter(int ringFd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+template <typename T>
+T* ringField(void* ring, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(ring) + offset);
+}
+
+} // namespace
+
+UringIO::UringIO(DiskStorage* storage, int fd, uint32_t entries)
+    : AsyncIO(storage), fd_(fd), ringFd_(-1), sqEntries_(0),
+      sqRing_(MAP_FAILED), cqRing_(MAP_FAILED), sqRingSize_(0), cqRingSize_(0),
+      sqes_(nullptr), sqesSize_(0),
+      sqHead_(nullptr), sqTail_(nullptr), sqMask_(nullptr), sqArray_(nullptr),
+      cqHead_(nullptr), cqTail_(nullptr), cqMask_(nullptr), cqes_(nullptr),
+      toSubmit_(0), inFlight_(0) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd_ = uringSetup(entries, &params);
+    if (ringFd_ < 0) {
+        return;  // No io_uring (old kernel, seccomp, disabled by sysctl)
+    }
+
+    // IORING_OP_READ/WRITE arrived alongside RW_CUR_POS (5.6); one mapping serves
+    // both rings on kernels with SINGLE_MMAP
+#ifdef IORING_FEAT_RW_CUR_POS
+    bool usable = (params.features & IORING_FEAT_RW_CUR_POS) != 0;
+#else
+    bool usable = false;
+#endif
+    if (!usable) {
+        teardown();
+        return;
+    }
+
+    sqEntries_ = params.sq_entries;
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        teardown();
+        return;
+    }
+    cqRing_ = single ? sqRing_
+                     : ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ringFd_, IORING_OFF_CQ_RING);
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd_, IORING_OFF_SQES);
+    if (cqRing_ == MAP_FAILED || sqes == MAP_FAILED) {
+        teardown();
+        return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqHead_ = ringField<uint32_t>(sqRing_, params.sq_off.head);
+    sqTail_ = ringField<uint32_t>(sqRing_, params.sq_off.tail);
+    sqMask_ = ringField<uint32_t>(sqRing_, params.sq_off.ring_mask);
+    sqArray_ = ringField<uint32_t>(sqRing_, params.sq_off.array);
+    cqHead_ = ringField<uint32_t>(cqRing_, params.cq_off.head);
+    cqTail_ = ringField<uint32_t>(cqRing_, params.cq_off.tail);
+    cqMask_ = ringField<uint32_t>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = ringField<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+}
+
+UringIO::~UringIO() {
+    // Requests still in flight point at caller memory; let them land first
+    std::vector<IORequest*> done;
+    while (isReady() && inFlight_ > 0 && reap(1, done)) {
+        done.clear();
+    }
+    teardown();
+}
+
+void UringIO::teardown() {
+    if (sqes_) {
+        ::munmap(sqes_, sqesSize_);
+        sqes_ = nullptr;
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+        ::munmap(sqRing_, sqRingSize_);
+    }
+    sqRing_ = cqRing_ = MAP_FAILED;
+    if (ringFd_ >= 0) {
+        ::close(ringFd_);
+        ringFd_ = -1;
+    }
+}
+
+void UringIO::submitRead(IORequest& request) {
+    queue(request, false);
+}
+
+void UringIO::submitWrite(IORequest& request) {
+    queue(request, true);
+}
+
+void UringIO::queue(IORequest& request, bool write) {
+    request.write = write;
+
+    // Only this thread advances the SQ tail; the kernel only moves the head
+    uint32_t tail = *sqTail_;
+    uint32_t index = tail & *sqMask_;
+    io_uring_sqe& sqe = sqes_[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe.fd = fd_;
+    sqe.off = request.offset;
+    sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+    sqe.len = request.length;
+    sqe.user_data = reinterpret_cast<uint64_t>(&request);
+    sqArray_[index] = index;
+
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    toSubmit_++;
+}
+
+bool UringIO::submit() {
+    while (toSubmit_ > 0) {
+        int submitted = uringEnter(ringFd_, toSubmit_, 0, 0);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+
+            // Take back what the kernel has not consumed so it is never issued later
+            std::cerr << "io_uring submit failed: " << strerror(errno) << std::endl;
+            __atomic_store_n(sqTail_, *sqTail_ - toSubmit_, __ATOMIC_RELEASE);
+            toSubmit_ = 0;
+            return false;
+        }
+        toSubmit_ -= static_cast<uint32_t>(submitted);
+        inFlight_ += static_cast<uint32_t>(submitted);
+    }
+    return true;
+}
+
+bool UringIO::reap(size_t minComplete, std::vector<IORequest*>& out) {
+    size_t wanted = std::min<size_t>(minComplete, inFlight_);
+    size_t reaped = 0;
+
+    while (true) {
+        uint32_t head = *cqHead_;
+        uint32_t tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+            IORequest* request = reinterpret_cast<IORequest*>(cqe.user_data);
+            request->result = cqe.res;
+            out.push_back(request);
+            reaped++;
+            inFlight_--;
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+
+        if (reaped >= wanted) {
+            return true;
+        }
+
+        // Sleep in the kernel until the rest arrive
+        if (uringEnter(ringFd_, 0, static_cast<uint32_t>(wanted - reaped), IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR) {
+            std::cerr << "io_uring wait failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+}
+
+#endif
+
+} // namespace FileSystemTool
@@ -0,0 +1,127 @@
+#include "BlockBuffer.h"
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace FileSystemTool {
+
+namespace {
+
+uint8_t* allocateBlocks(size_t blocks) {
+    return static_cast<uint8_t*>(::operator new(blocks * BLOCK_SIZE, std::align_val_t(BLOCK_SIZE)));
+}
+
+void freeBlocks(uint8_t* data) {
+    ::operator delete(data, std::align_val_t(BLOCK_SIZE));
+}
+
+// Free buffers of the calling thread; the list never grows past its reserve
+struct BlockPool {
+    struct Entry {
+        uint8_t* data;
+        size_t capacity;
+    };
+    std::vector<Entry> free;
+    
+    BlockPool() { free.reserve(BLOCK_POOL_BUFFERS); }
+    ~BlockPool() {
+        for (const auto& entry : free) {
+            freeBlocks(entry.data);
+        }
+    }
+    
+    // Smallest cached buffer that fits, or a fresh one
+    Entry take(size_t blocks) {
+        size_t best = free.size();
+        for (size_t i = 0; i < free.size(); ++i) {
+            if (free[i].capacity >= blocks && (best == free.size() || free[i].capacity < free[best].capacity)) {
+                best = i;
+            }
+        }
+        if (best == free.size()) {
+            return {allocateBlocks(blocks), blocks};
+        }
+        Entry entry = free[best];
+        free[best] = free.back();
+        free.pop_back();
+        return entry;
+    }
+    
+    void give(Entry entry) {
+        if (entry.capacity > BLOCK_POOL_MAX_BLOCKS) {
+            freeBlocks(entry.data);
+            return;
+        }
+        if (free.size() < BLOCK_POOL_BUFFERS) {
+            free.push_back(entry);
+            return;
+        }
+        
+        // Full: keep the larger buffer, since it also serves the smaller requests
+        size_t smallest = 0;
+        for (size_t i = 1; i < free.size(); ++i) {
+            if (free[i].capacity < free[smallest].capacity) {
+                smallest = i;
+            }
+        }
+        if (free[smallest].capacity < entry.capacity) {
+            std::swap(free[smallest], entry);
+        }
+        freeBlocks(entry.data);
+    }
+};
+
+BlockPool& threadPool() {
+    thread_local BlockPool pool;
+    return pool;
+}
+
+} // namespace
+
+BlockBuffer::BlockBuffer(size_t blocks) : data_(nullptr), blocks_(blocks), capacity_(0) {
+    if (blocks > 0) {
+        BlockPool::Entry entry = threadPool().take(blocks);
+        data_ = entry.data;
+        capacity_ = entry.capacity;
+    }
+}
+
+BlockBuffer::~BlockBuffer() {
+    release();
+}
+
+BlockBuffer::BlockBuffer(BlockBuffer&& other) noexcept
+    : data_(other.data_), blocks_(other.blocks_), capacity_(other.capacity_) {
+    other.data_ = nullptr;
+    other.blocks_ = 0;
+    other.capacity_ = 0;
+}
+
+BlockBuffer& BlockBuffer::operator=(BlockBuffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = other.data_;
+        blocks_ = other.blocks_;
+        capacity_ = other.capacity_;
+        other.data_ = nullptr;
+        other.blocks_ = 0;
+        other.capacity_ = 0;
+    }
+    return *this;
+}
+
+void BlockBuffer::zero() {
+    if (data_) {
+        memset(data_, 0, size());
+    }
+}
+
+void BlockBuffer::release() {
+    if (data_) {
+        threadPool().give({data_, capacity_});
+        data_ = nullptr;
+    }
+}
+
+} // namespace FileSystemTool
@@ -0,0 +1,236 @@
+#include "BlockCache.h"
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+
+namespace FileSystemTool {
+
+BlockCache::BlockCache(uint32_t blockSize, size_t capacity, WritebackFn writeback)
+    : blockSize_(blockSize), capacity_(0), writeback_(std::move(writeback)) {
+    setCapacity(capacity);
+}
+
+bool BlockCache::read(uint32_t blockNum, uint8_t* buffer) {
+    if (capacity_ == 0) {
+        return false;
+    }
+
+    Shard& shard = shardFor(blockNum);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(blockNum);
+    if (it == shard.index.end()) {
+        shard.stats.misses++;
+        return false;
+    }
+
+    shard.stats.hits++;
+    shard.slots[it->second].referenced = true;
+    memcpy(buffer, slotData(shard, it->second), blockSize_);
+    return true;
+}
+
+bool BlockCache::insert(uint32_t blockNum, const uint8_t* data, bool dirty) {
+    if (capacity_ == 0) {
+        return false;
+    }
+
+    Shard& shard = shardFor(blockNum);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size_t slot;
+    auto it = shard.index.find(blockNum);
+    if (it != shard.index.end()) {
+        slot = it->second;
+    } else {
+        if (!acquireSlot(shard, slot)) {
+            return false;
+        }
+        shard.slots[slot].blockNum = blockNum;
+        shard.slots[slot].valid = true;
+        shard.slots[slot].dirty = false;
+        shard.index[blockNum] = slot;
+    }
+
+    memcpy(slotData(shard, slot), data, blockSize_);
+    shard.slots[slot].referenced = true;
+
+    if (dirty && !shard.slots[slot].dirty) {
+        shard.slots[slot].dirty = true;
+        shard.dirtyCount++;
+    }
+
+    return true;
+}
+
+bool BlockCache::flush() {
+    // Every shard stays locked so the write-back is one ordered pass
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(shards_.size());
+    std::vector<std::tuple<uint32_t, Shard*, size_t>> dirtySlots;  // (block, shard, slot)
+    for (auto& shard : shards_) {
+        locks.emplace_back(shard->mutex);
+        if (shard->dirtyCount == 0) {
+            continue;
+        }
+        for (size_t i = 0; i < shard->slots.size(); ++i) {
+            if (shard->slots[i].valid && shard->slots[i].dirty) {
+                dirtySlots.emplace_back(shard->slots[i].blockNum, shard.get(), i);
+            }
+        }
+    }
+
+    // Write back in block order so the image is updated sequentially
+    std::sort(dirtySlots.begin(), dirtySlots.end(), [](const auto& a, const auto& b) {
+        return std::get<0>(a) < std::get<0>(b);
+    });
+
+    bool success = true;
+    for (const auto& dirty : dirtySlots) {
+        Shard& shard = *std::get<1>(dirty);
+        size_t slot = std::get<2>(dirty);
+        if (!writeback_(std::get<0>(dirty), slotData(shard, slot))) {
+            success = false;
+            continue;
+        }
+        shard.slots[slot].dirty = false;
+        shard.dirtyCount--;
+        shard.stats.writebacks++;
+    }
+
+    return success;
+}
+
+void BlockCache::invalidate(uint32_t blockNum) {
+    if (capacity_ == 0) {
+        return;
+    }
+
+    Shard& shard = shardFor(blockNum);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(blockNum);
+    if (it == shard.index.end()) {
+        return;
+    }
+
+    Slot& slot = shard.slots[it->second];
+    if (slot.dirty) {
+        shard.dirtyCount--;
+    }
+    slot.valid = false;
+    slot.dirty = false;
+    slot.referenced = false;
+    shard.index.erase(it);
+}
+
+void BlockCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        clearShard(*shard);
+    }
+}
+
+void BlockCache::clearShard(Shard& shard) {
+    for (auto& slot : shard.slots) {
+        slot.valid = false;
+        slot.dirty = false;
+        slot.referenced = false;
+    }
+    shard.index.clear();
+    shard.hand = 0;
+    shard.dirtyCount = 0;
+}
+
+bool BlockCache::setCapacity(size_t capacity) {
+    bool flushed = flush();
+    
+    // Statistics survive resizing
+    CacheStats stats = getStats();
+    
+    // Small caches keep one shard so CLOCK still sees the whole working set
+    size_t shardCount = std::max<size_t>(1, std::min(MAX_CACHE_SHARDS, capacity / MIN_BLOCKS_PER_SHARD));
+    capacity_ = capacity;
+    shards_.clear();
+    for (size_t i = 0; i < shardCount; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->capacity = capacity / shardCount + (i < capacity % shardCount ? 1 : 0);
+        shard->data.assign(shard->capacity * blockSize_, 0);
+        shard->slots.assign(shard->capacity, Slot{0, false, false, false});
+        shard->index.reserve(shard->capacity);
+        shards_.push_back(std::move(shard));
+    }
+    shards_.front()->stats = stats;
+
+    return flushed;
+}
+
+size_t BlockCache::getDirtyCount() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->dirtyCount;
+    }
+    return total;
+}
+
+CacheStats BlockCache::getStats() const {
+    CacheStats total;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total.hits += shard->stats.hits;
+        total.misses += shard->stats.misses;
+        total.evictions += shard->stats.evictions;
+        total.writebacks += shard->stats.writebacks;
+    }
+    return total;
+}
+
+void BlockCache::resetStats() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->stats = CacheStats();
+    }
+}
+
+bool BlockCache::acquireSlot(Shard& shard, size_t& slot) {
+    if (shard.capacity == 0) {
+        return false;
+    }
+    
+    // CLOCK sweep: free slots first, then the first unreferenced block.
+    // Two full passes are enough since the first pass clears reference bits.
+    for (size_t step = 0; step < shard.capacity * 2 + 1; ++step) {
+        size_t candidate = shard.hand;
+        shard.hand = (shard.hand + 1) % shard.capacity;
+
+        Slot& s = shard.slots[candidate];
+        if (!s.valid) {
+            slot = candidate;
+            return true;
+        }
+
+        if (s.referenced) {
+            s.referenced = false;
+            continue;
+        }
+
+        if (s.dirty) {
+            if (!writeback_(s.blockNum, slotData(shard, candidate))) {
+                std::cerr << "Cache writeback failed for block " << s.blockNum << std::endl;
+                return false;
+            }
+            s.dirty = false;
+            shard.dirtyCount--;
+            shard.stats.writebacks++;
+        }
+
+        shard.index.erase(s.blockNum);
+        s.valid = false;
+        shard.stats.evictions++;
+        slot = candidate;
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace FileSystemTool
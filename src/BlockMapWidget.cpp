@@ -3,38 +3,105 @@
 #include <QPainter>
 #include <QMouseEvent>
 #include <QToolTip>
+#include <algorithm>
 #include <cmath>
 
 namespace FileSystemTool {
 
+namespace {
+
+const QColor BACKGROUND(30, 30, 30);
+
+QRgb blend(QColor from, QColor to, double t) {
+    return qRgb(static_cast<int>(from.red() + (to.red() - from.red()) * t),
+                static_cast<int>(from.green() + (to.green() - from.green()) * t),
+                static_cast<int>(from.blue() + (to.blue() - from.blue()) * t));
+}
+
+} // namespace
+
 BlockMapWidget::BlockMapWidget(QWidget *parent) 
-    : QWidget(parent), fileSystem_(nullptr), totalBlocks_(0), 
-      hoveredBlock_(UINT32_MAX), blockDisplaySize_(10), zoomLevel_(1.0), blocksPerRow_(0),
-      blockSpacing_(1) {
+    : QWidget(parent), fileSystem_(nullptr), renderedDisk_(nullptr), totalBlocks_(0),
+      blocksPerCell_(1), cellCount_(0), hoveredBlock_(UINT32_MAX), blockDisplaySize_(10),
+      zoomLevel_(1.0), blocksPerRow_(0), blockSpacing_(1) {
     setMouseTracking(true);
     setMinimumSize(600, 400);
 }
 
 void BlockMapWidget::setFileSystem(FileSystem* fs) {
     fileSystem_ = fs;
+    renderedDisk_ = nullptr;  // Force a full rebuild
     refresh();
 }
 
 void BlockMapWidget::refresh() {
     if (!fileSystem_ || !fileSystem_->isMounted()) {
-        blockStates_.clear();
-        totalBlocks_ = 0;
+        clearImage();
+        return;
+    }
+    
+    // Corruption marks come from a snapshot; none while an exclusive operation
+    // holds the file system, so keep what is drawn and catch up next time
+    FileSystem::Snapshot snapshot;
+    if (!fileSystem_->trySnapshot(snapshot)) {
+        return;
+    }
+    corrupted_ = std::move(snapshot.corruptedBlocks);
+    rebuildImage();
+    update();
+}
+
+void BlockMapWidget::applyChanges(const ChangeSet& changes) {
+    if (!fileSystem_ || !fileSystem_->isMounted()) {
+        clearImage();
+        return;
+    }
+    
+    VirtualDisk* disk = fileSystem_->getDisk();
+    if (changes.reset || disk != renderedDisk_ || disk->getTotalBlocks() != totalBlocks_ || image_.isNull()) {
+        corrupted_ = changes.snapshot.corruptedBlocks;
+        rebuildImage();
         update();
         return;
     }
     
-    updateBlockStates();
+    std::vector<Extent> changed = changes.blocks;
+    
+    // Corruption is not in the bitmap: diff against what is drawn
+    if (changes.snapshot.corruptedBlocks != corrupted_) {
+        for (const auto* list : {&corrupted_, &changes.snapshot.corruptedBlocks}) {
+            for (uint32_t blockNum : *list) {
+                if (blockNum < totalBlocks_) {
+                    changed.push_back({blockNum, 1});
+                }
+            }
+        }
+        corrupted_ = changes.snapshot.corruptedBlocks;
+    }
+    
+    for (const auto& range : changed) {
+        uint32_t firstCell = range.start / blocksPerCell_;
+        uint32_t lastCell = std::min(cellCount_, (range.start + range.length - 1) / blocksPerCell_ + 1);
+        renderCells(firstCell, lastCell);
+        updateCellRows(firstCell, lastCell);
+    }
+}
+
+void BlockMapWidget::clearImage() {
+    image_ = QImage();
+    corrupted_.clear();
+    renderedDisk_ = nullptr;
+    totalBlocks_ = 0;
+    cellCount_ = 0;
     update();
 }
 
 void BlockMapWidget::setZoomLevel(double zoom) {
     zoomLevel_ = std::max(0.5, std::min(3.0, zoom));
     blockDisplaySize_ = static_cast<int>(10 * zoomLevel_);
+    if (renderedDisk_) {
+        rebuildImage();
+    }
     update();
 }
 
@@ -42,118 +109,207 @@ QSize BlockMapWidget::sizeHint() const {
     return QSize(800, 600);
 }
 
+void BlockMapWidget::rebuildImage() {
+    VirtualDisk* disk = fileSystem_->getDisk();
+    renderedDisk_ = disk;
+    totalBlocks_ = disk->getTotalBlocks();
+    metadata_ = disk->getMetadataExtents();
+    std::sort(metadata_.begin(), metadata_.end(),
+              [](const Extent& a, const Extent& b) { return a.start < b.start; });
+    
+    // Coarsen until every cell fits in the widget at the current cell size
+    int pitch = getCellPitch();
+    blocksPerRow_ = std::max(1, width() / pitch);
+    uint64_t visibleCells = static_cast<uint64_t>(blocksPerRow_) * std::max(1, height() / pitch);
+    blocksPerCell_ = 1;
+    while ((totalBlocks_ + blocksPerCell_ - 1) / blocksPerCell_ > visibleCells && blocksPerCell_ < (1u << 30)) {
+        blocksPerCell_ *= 2;
+    }
+    cellCount_ = (totalBlocks_ + blocksPerCell_ - 1) / blocksPerCell_;
+    
+    int rows = static_cast<int>((cellCount_ + blocksPerRow_ - 1) / blocksPerRow_);
+    image_ = QImage(blocksPerRow_, std::max(1, rows), QImage::Format_RGB32);
+    image_.fill(BACKGROUND);
+    renderCells(0, cellCount_);
+}
+
+void BlockMapWidget::renderCells(uint32_t firstCell, uint32_t lastCell) {
+    if (firstCell >= lastCell) {
+        return;
+    }
+    
+    // Occupancy for the whole span in one pass over the bitmap
+    std::vector<uint32_t> used(lastCell - firstCell);
+    fileSystem_->getDisk()->countUsedBlocks(firstCell * blocksPerCell_, blocksPerCell_,
+                                            lastCell - firstCell, used.data());
+    
+    for (uint32_t cell = firstCell; cell < lastCell; ++cell) {
+        QRgb* line = reinterpret_cast<QRgb*>(image_.scanLine(static_cast<int>(cell / blocksPerRow_)));
+        line[cell % blocksPerRow_] = getCellColor(cell, used[cell - firstCell]);
+    }
+}
+
+void BlockMapWidget::updateCellRows(uint32_t firstCell, uint32_t lastCell) {
+    int pitch = getCellPitch();
+    int firstRow = static_cast<int>(firstCell / blocksPerRow_);
+    int lastRow = static_cast<int>((lastCell - 1) / blocksPerRow_);
+    update(QRect(0, firstRow * pitch, width(), (lastRow - firstRow + 1) * pitch));
+}
+
+QRgb BlockMapWidget::getCellColor(uint32_t cell, uint32_t usedBlocks) const {
+    uint32_t start = cell * blocksPerCell_;
+    uint32_t end = std::min(totalBlocks_, start + blocksPerCell_);
+    
+    if (hasCorruptedBlock(start, end)) {
+        return getBlockColor(BlockState::CORRUPTED).rgb();
+    }
+    if (blocksPerCell_ == 1 && start == 0) {
+        return getBlockColor(BlockState::SUPERBLOCK).rgb();
+    }
+    
+    // Metadata dominates a cell once it is at least half of it; otherwise shade
+    // the data blocks from free (green) to used (red)
+    uint32_t metadata = countMetadataBlocks(start, end);
+    uint32_t blocks = end - start;
+    if (metadata * 2 >= blocks) {
+        return getBlockColor(BlockState::INODE_TABLE).rgb();
+    }
+    uint32_t usedData = usedBlocks > metadata ? usedBlocks - metadata : 0;
+    double fraction = std::min(1.0, static_cast<double>(usedData) / (blocks - metadata));
+    return blend(getBlockColor(BlockState::FREE), getBlockColor(BlockState::USED), fraction);
+}
+
+uint32_t BlockMapWidget::countMetadataBlocks(uint32_t start, uint32_t end) const {
+    auto it = std::upper_bound(metadata_.begin(), metadata_.end(), start,
+                               [](uint32_t block, const Extent& e) { return block < e.start; });
+    if (it != metadata_.begin()) {
+        --it;
+    }
+    
+    uint32_t count = 0;
+    for (; it != metadata_.end() && it->start < end; ++it) {
+        uint32_t lo = std::max(start, it->start);
+        uint32_t hi = std::min(end, it->start + it->length);
+        count += hi > lo ? hi - lo : 0;
+    }
+    return count;
+}
+
+bool BlockMapWidget::hasCorruptedBlock(uint32_t start, uint32_t end) const {
+    auto it = std::lower_bound(corrupted_.begin(), corrupted_.end(), start);
+    return it != corrupted_.end() && *it < end;
+}
+
 void BlockMapWidget::paintEvent(QPaintEvent *event) {
     QPainter painter(this);
-    painter.fillRect(rect(), QColor(30, 30, 30));
+    painter.fillRect(event->rect(), BACKGROUND);
     
-    if (blockStates_.empty()) {
+    if (image_.isNull()) {
         painter.setPen(Qt::white);
         painter.drawText(rect(), Qt::AlignCenter, "No disk mounted");
         return;
     }
     
-    int blockSize = blockDisplaySize_;
-    int spacing = blockSpacing_;
-    blocksPerRow_ = std::max(1, width() / (blockSize + spacing));
+    // One image pixel per cell, scaled up without smoothing
+    int pitch = getCellPitch();
+    QRect target(0, 0, image_.width() * pitch, image_.height() * pitch);
+    painter.drawImage(target, image_);
     
-    for (size_t i = 0; i < blockStates_.size(); ++i) {
-        int row = i / blocksPerRow_;
-        int col = i % blocksPerRow_;
-        
-        int x = col * (blockSize + spacing);
-        int y = row * (blockSize + spacing);
-        
-        QColor color = getFileColor(i);
-        painter.fillRect(x, y, blockSize, blockSize, color);
-        
-        // Highlight hovered block
-        if (i == hoveredBlock_) {
-            painter.setPen(QPen(Qt::yellow, 2));
-            painter.drawRect(x, y, blockSize, blockSize);
+    // Gaps between cells, only where this paint reaches
+    if (blockSpacing_ > 0 && pitch >= 4) {
+        QRect area = event->rect().intersected(target);
+        for (int x = (area.left() / pitch) * pitch + blockDisplaySize_; x <= area.right(); x += pitch) {
+            painter.fillRect(x, area.top(), blockSpacing_, area.height(), BACKGROUND);
+        }
+        for (int y = (area.top() / pitch) * pitch + blockDisplaySize_; y <= area.bottom(); y += pitch) {
+            painter.fillRect(area.left(), y, area.width(), blockSpacing_, BACKGROUND);
         }
     }
+    
+    // Highlight hovered cell
+    if (hoveredBlock_ < totalBlocks_) {
+        uint32_t cell = hoveredBlock_ / blocksPerCell_;
+        int x = static_cast<int>(cell % blocksPerRow_) * pitch;
+        int y = static_cast<int>(cell / blocksPerRow_) * pitch;
+        painter.setPen(QPen(Qt::yellow, 2));
+        painter.drawRect(x, y, blockDisplaySize_, blockDisplaySize_);
+    }
 }
 
 void BlockMapWidget::mouseMoveEvent(QMouseEvent *event) {
-    if (blockStates_.empty()) {
+    if (image_.isNull() || blocksPerRow_ <= 0) {
         return;
     }
     
     QPoint pos = event->pos();
-    int blockSize = blockDisplaySize_;
-    int spacing = 1;
+    int pitch = getCellPitch();
+    int col = pos.x() / pitch;
+    int row = pos.y() / pitch;
+    uint32_t cell = static_cast<uint32_t>(row) * blocksPerRow_ + col;
+    
+    if (col >= blocksPerRow_ || cell >= cellCount_) {
+        if (hoveredBlock_ != UINT32_MAX) {
+            uint32_t oldCell = hoveredBlock_ / blocksPerCell_;
+            hoveredBlock_ = UINT32_MAX;
+            updateCellRows(oldCell, oldCell + 1);
+        }
+        return;
+    }
+    
+    uint32_t blockNum = cell * blocksPerCell_;
+    if (hoveredBlock_ != UINT32_MAX) {
+        uint32_t oldCell = hoveredBlock_ / blocksPerCell_;
+        updateCellRows(oldCell, oldCell + 1);
+    }
+    hoveredBlock_ = blockNum;
+    updateCellRows(cell, cell + 1);
     
-    if (blocksPerRow_ > 0) {
-        int col = pos.x() / (blockSize + spacing);
-        int row = pos.y() / (blockSize + spacing);
-        uint32_t blockNum = row * blocksPerRow_ + col;
+    BlockState state = getBlockState(blockNum);
+    QString tooltip;
+    if (blocksPerCell_ == 1) {
+        tooltip = QString("Block: %1 | State: %2").arg(blockNum).arg(getBlockStateText(state));
         
-        if (blockNum < blockStates_.size()) {
-            hoveredBlock_ = blockNum;
-            
-            // Build tooltip with block info
-            BlockState state = blockStates_[blockNum];
-            QString stateStr;
-            switch (state) {
-                case BlockState::FREE: stateStr = "Free"; break;
-                case BlockState::USED: stateStr = "Used"; break;
-                case BlockState::SUPERBLOCK: stateStr = "Superblock"; break;
-                case BlockState::INODE_TABLE: stateStr = "Inode Table"; break;
-                case BlockState::CORRUPTED: stateStr = "Corrupted"; break; // Added for corrupted block visualization
-                case BlockState::JOURNAL: stateStr = "Journal"; break; // Added for journal block visualization
-                default: stateStr = "Unknown"; break;
-            }
-            
-            QString tooltip = QString("Block: %1 | State: %2").arg(blockNum).arg(stateStr);
-            
-            // If block is used, try to find owner and filename
-            if (state == BlockState::USED && fileSystem_) {
-                uint32_t inodeNum = fileSystem_->getBlockOwner(blockNum);
-                if (inodeNum != UINT32_MAX) {
-                    QString filename = QString::fromStdString(
-                        fileSystem_->getFilenameFromInode(inodeNum));
-                    
-                    if (!filename.isEmpty()) {
-                        tooltip += QString(" | Inode: %1 | File: %2")
-                                  .arg(inodeNum)
-                                  .arg(filename);
-                    } else {
-                        tooltip += QString(" | Inode: %1").arg(inodeNum);
-                    }
+        // If block is used, try to find owner and filename
+        if (state == BlockState::USED) {
+            uint32_t inodeNum = fileSystem_->getBlockOwner(blockNum);
+            if (inodeNum != UINT32_MAX) {
+                QString filename = QString::fromStdString(
+                    fileSystem_->getFilenameFromInode(inodeNum));
+                
+                if (!filename.isEmpty()) {
+                    tooltip += QString(" | Inode: %1 | File: %2")
+                              .arg(inodeNum)
+                              .arg(filename);
+                } else {
+                    tooltip += QString(" | Inode: %1").arg(inodeNum);
                 }
             }
-            
-            QToolTip::showText(event->globalPosition().toPoint(), tooltip);
-            
-            emit blockHovered(blockNum, state);
-            update();
         }
     } else {
-        hoveredBlock_ = UINT32_MAX;
-        update();
+        // Aggregated cell: report its occupancy instead of one block
+        uint32_t last = std::min(totalBlocks_, blockNum + blocksPerCell_) - 1;
+        uint32_t used = 0;
+        fileSystem_->getDisk()->countUsedBlocks(blockNum, last - blockNum + 1, 1, &used);
+        tooltip = QString("Blocks: %1-%2 | Used: %3/%4")
+                  .arg(blockNum).arg(last).arg(used).arg(last - blockNum + 1);
     }
+    
+    QToolTip::showText(event->globalPosition().toPoint(), tooltip);
+    emit blockHovered(blockNum, state);
 }
 
 void BlockMapWidget::mousePressEvent(QMouseEvent *event) {
-    if (hoveredBlock_ != UINT32_MAX && hoveredBlock_ < blockStates_.size()) {
-        emit blockSelected(hoveredBlock_, blockStates_[hoveredBlock_]);
+    if (hoveredBlock_ < totalBlocks_) {
+        emit blockSelected(hoveredBlock_, getBlockState(hoveredBlock_));
     }
 }
 
 void BlockMapWidget::resizeEvent(QResizeEvent *event) {
     QWidget::resizeEvent(event);
-    update();
-}
-
-void BlockMapWidget::updateBlockStates() {
-    totalBlocks_ = fileSystem_->getTotalBlocks();
-    blockStates_.clear();
-    blockStates_.reserve(totalBlocks_);
-    
-    // Query block states - only query valid blocks
-    for (uint32_t i = 0; i < totalBlocks_; ++i) {
-        blockStates_.push_back(getBlockState(i));
+    if (renderedDisk_) {
+        rebuildImage();  // Cells per row (and maybe the level of detail) changed
     }
+    update();
 }
 
 BlockState BlockMapWidget::getBlockState(uint32_t blockNum) {
@@ -161,14 +317,9 @@ BlockState BlockMapWidget::getBlockState(uint32_t blockNum) {
         return BlockState::FREE;
     }
     
-    const auto& sb = fileSystem_->getDisk()->getSuperblock();
-    
-    // Check if block is corrupted (from power cut simulation)
-    if (fileSystem_->hasCorruption()) {
-        const auto& corruptedBlocks = fileSystem_->getCorruptedBlocks();
-        if (std::find(corruptedBlocks.begin(), corruptedBlocks.end(), blockNum) != corruptedBlocks.end()) {
-            return BlockState::CORRUPTED;
-        }
+    // Check if block is corrupted (from power cut simulation, as of the last refresh)
+    if (std::binary_search(corrupted_.begin(), corrupted_.end(), blockNum)) {
+        return BlockState::CORRUPTED;
     }
     
     // Superblock
@@ -176,26 +327,18 @@ BlockState BlockMapWidget::getBlockState(uint32_t blockNum) {
         return BlockState::SUPERBLOCK;
     }
     
-    // Bitmap blocks
-    if (blockNum >= sb.bitmapStart && blockNum < sb.inodeTableStart) {
-        return BlockState::INODE_TABLE;  // Use same coloras inode for bitmap
-    }
-    
-    // Inode table blocks
-    if (blockNum >= sb.inodeTableStart && blockNum < sb.dataBlocksStart) {
+    // Group metadata: descriptors, bitmap and inode table slices, journal
+    // (same colour as the inode table)
+    if (fileSystem_->getDisk()->isMetadataBlock(blockNum)) {
         return BlockState::INODE_TABLE;
     }
     
     // Data blocks
-    if (blockNum >= sb.dataBlocksStart) {
-        bool isFree = fileSystem_->getDisk()->isBlockFree(blockNum);
-        return isFree ? BlockState::FREE : BlockState::USED;
-    }
-    
-    return BlockState::FREE;
+    bool isFree = fileSystem_->getDisk()->isBlockFree(blockNum);
+    return isFree ? BlockState::FREE : BlockState::USED;
 }
 
-QColor BlockMapWidget::getBlockColor(BlockState state) {
+QColor BlockMapWidget::getBlockColor(BlockState state) const {
     switch (state) {
         case BlockState::FREE:
             return QColor(40, 180, 99);  // Green
@@ -216,16 +359,6 @@ QColor BlockMapWidget::getBlockColor(BlockState state) {
     }
 }
 
-QColor BlockMapWidget::getFileColor(uint32_t blockNum) {
-    if (blockNum >= blockStates_.size()) {
-        return Qt::gray;
-    }
-    
-    // Use the block state to determine color
-    BlockState state = blockStates_[blockNum];
-    return getBlockColor(state);
-}
-
 QString BlockMapWidget::getBlockStateText(BlockState state) {
     switch (state) {
         case BlockState::FREE: return "Free";
@@ -2,19 +2,20 @@
 #include "FileSystem.h"
 #include "RecoveryManager.h"
 #include "DefragManager.h"
+#include "OperationRunner.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QMessageBox>
 #include <QDateTime>
-#include <QApplication>
 #include <random>
 
 namespace FileSystemTool {
 
 ControlPanel::ControlPanel(QWidget *parent) 
     : QWidget(parent), fileSystem_(nullptr), recoveryMgr_(nullptr), 
-      defragMgr_(nullptr), diskMounted_(false) {
+      defragMgr_(nullptr), runner_(nullptr), diskMounted_(false), operationActive_(false),
+      defragRunning_(false) {
     setupUI();
 }
 
@@ -31,6 +32,23 @@ void ControlPanel::setDefragManager(DefragManager* defragMgr) {
     defragMgr_ = defragMgr;
 }
 
+void ControlPanel::setOperationRunner(OperationRunner* runner) {
+    runner_ = runner;
+    
+    // Progress arrives queued from the worker; only ours drives the bar
+    connect(runner_, &OperationRunner::progress, this, [this](int percent, const QString& message) {
+        if (!operationActive_) {
+            return;
+        }
+        progressBar_->setValue(percent);
+        if (!message.isEmpty()) {
+            appendLog(message);
+        }
+    });
+    connect(runner_, &OperationRunner::started, this, &ControlPanel::updateButtonStates);
+    connect(runner_, &OperationRunner::finished, this, &ControlPanel::updateButtonStates);
+}
+
 void ControlPanel::setDiskMounted(bool mounted) {
     diskMounted_ = mounted;
     updateButtonStates();
@@ -162,13 +180,33 @@ void ControlPanel::setupUI() {
 
 void ControlPanel::updateButtonStates() {
     bool mounted = diskMounted_ && fileSystem_ && fileSystem_->isMounted();
+    bool idle = mounted && !(runner_ && runner_->isRunning());
+    
+    createFileBtn_->setEnabled(idle);
+    deleteFileBtn_->setEnabled(idle);
+    writeRandomBtn_->setEnabled(idle);
+    crashBtn_->setEnabled(idle);
+    recoveryBtn_->setEnabled(idle);
+    defragBtn_->setEnabled(idle || (mounted && defragRunning_));  // Cancels while running
+}
+
+bool ControlPanel::beginOperation() {
+    if (!runner_ || runner_->isRunning()) {
+        appendLog("Error: Another operation is still running");
+        return false;
+    }
     
-    createFileBtn_->setEnabled(mounted);
-    deleteFileBtn_->setEnabled(mounted);
-    writeRandomBtn_->setEnabled(mounted);
-    crashBtn_->setEnabled(mounted);
-    recoveryBtn_->setEnabled(mounted);
-    defragBtn_->setEnabled(mounted);
+    operationActive_ = true;
+    progressBar_->setVisible(true);
+    progressBar_->setRange(0, 100);
+    progressBar_->setValue(0);
+    return true;
+}
+
+void ControlPanel::endOperation() {
+    operationActive_ = false;
+    progressBar_->setVisible(false);
+    updateButtonStates();
 }
 
 void ControlPanel::onCreateFileClicked() {
@@ -225,9 +263,10 @@ void ControlPanel::onWriteRandomDataClicked() {
         }
     }
     
+    if (!beginOperation()) {
+        return;
+    }
     appendLog(QString("Writing %1 random files...").arg(numFiles));
-    progressBar_->setVisible(true);
-    progressBar_->setRange(0, numFiles);
     
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -236,65 +275,25 @@ void ControlPanel::onWriteRandomDataClicked() {
     // Use timestamp to ensure unique filenames across multiple clicks
     qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
     
-    int successCount = 0;
-    int failCount = 0;
-    
+    std::vector<BatchFile> files(numFiles);
     for (int i = 0; i < numFiles; ++i) {
-        // Check if we still have space (check every 10 files)
-        if (i % 10 == 0 && fileSystem_->getFreeBlocks() < 10) {
-            appendLog(QString("Disk full after %1 files. Stopping.").arg(i));
-            break;
-        }
-        
-        // Create unique filename with timestamp
-        QString filename = QString("/random_%1_%2.dat").arg(timestamp).arg(i);
-        
-        if (!fileSystem_->createFile(filename.toStdString())) {
-            appendLog(QString("Failed to create: %1").arg(filename));
-            failCount++;
-            // Stop if we get too many consecutive failures
-            if (failCount > 5) {
-                appendLog("Too many failures. Stopping.");
-                break;
-            }
-            continue;
-        }
-        
-        // Generate random data
-        size_t size = sizeDist(gen);
-        std::vector<uint8_t> data(size);
-        for (auto& byte : data) {
+        files[i].path = QString("/random_%1_%2.dat").arg(timestamp).arg(i).toStdString();
+        files[i].data.resize(sizeDist(gen));
+        for (auto& byte : files[i].data) {
             byte = static_cast<uint8_t>(gen());
         }
-        
-        // Write data with error checking
-        if (!fileSystem_->writeFile(filename.toStdString(), data)) {
-            appendLog(QString("Failed to write: %1").arg(filename));
-            failCount++;
-            // Clean up the empty file
-            fileSystem_->deleteFile(filename.toStdString());
-            
-            if (failCount > 5) {
-                appendLog("Too many write failures. Stopping.");
-                break;
-            }
-            continue;
-        }
-        
-        successCount++;
-        failCount = 0; // Reset consecutive fail counter
-        progressBar_->setValue(i + 1);
-        
-        // Process events periodically to keep UI responsive
-        if (i % 10 == 0) {
-            QApplication::processEvents();
-        }
     }
     
-    progressBar_->setVisible(false);
-    appendLog(QString("Completed: %1 files written, %2 failed")
-        .arg(successCount).arg(failCount));
-    emit operationCompleted();
+    // Written a batch at a time on the worker; the import logs its own summary
+    runner_->startImport(fileSystem_, std::move(files), [this](bool success, bool cancelled) {
+        if (cancelled) {
+            appendLog("Writing random files cancelled");
+        } else if (!success) {
+            appendLog("Error: Some random files could not be written (disk full?)");
+        }
+        endOperation();
+        emit operationCompleted();
+    });
 }
 
 void ControlPanel::onSimulateCrashClicked() {
@@ -332,66 +331,78 @@ void ControlPanel::onSimulateCrashClicked() {
 }
 
 void ControlPanel::onRunRecoveryClicked() {
-    appendLog("Running recovery checks...");
-    
     if (!recoveryMgr_) {
         appendLog("Error: Recovery manager not available");
         return;
     }
     
-    if (recoveryMgr_->performRecovery()) {
-        appendLog("Recovery completed successfully");
-        
-        const auto& report = recoveryMgr_->getLastReport();
-        appendLog(QString("Orphan blocks found: %1").arg(report.orphanBlocks));
-        appendLog(QString("Invalid inodes found: %1").arg(report.invalidInodes));
-        
-        for (const auto& fix : report.fixes) {
-            appendLog("Fix: " + QString::fromStdString(fix));
-        }
-    } else {
-        appendLog("Error: Recovery failed");
+    if (!beginOperation()) {
+        return;
     }
+    appendLog("Running recovery checks...");
     
-    emit operationCompleted();
+    runner_->startRecovery(recoveryMgr_, [this](bool success, bool) {
+        if (success) {
+            appendLog("Recovery completed successfully");
+            
+            const auto& report = recoveryMgr_->getLastReport();
+            appendLog(QString("Orphan blocks found: %1").arg(report.orphanBlocks));
+            appendLog(QString("Invalid inodes found: %1").arg(report.invalidInodes));
+            
+            for (const auto& fix : report.fixes) {
+                appendLog("Fix: " + QString::fromStdString(fix));
+            }
+        } else {
+            appendLog("Error: Recovery failed");
+        }
+        
+        endOperation();
+        emit operationCompleted();
+    });
 }
 
 void ControlPanel::onRunDefragClicked() {
-    appendLog("Starting defragmentation...");
-    
     if (!defragMgr_) {
         appendLog("Error: Defragmentation manager not available");
         return;
     }
     
-    progressBar_->setVisible(true);
-    progressBar_->setRange(0, 100);
-    
-    // Set progress callback
-    defragMgr_->setProgressCallback([this](int progress, const std::string& message) {
-        progressBar_->setValue(progress);
-        if (!message.empty()) {
-            appendLog(QString::fromStdString(message));
-        }
-    });
+    // A second click cancels; the defrag stops after the extent it is moving
+    if (defragRunning_) {
+        runner_->cancel();
+        appendLog("Cancelling defragmentation...");
+        return;
+    }
     
-    bool cancelled = false;
-    if (defragMgr_->defragmentFileSystem(cancelled)) {
-        appendLog("Defragmentation completed");
-        
-        const auto& before = defragMgr_->getBeforeDefragBenchmark();
-        const auto& after = defragMgr_->getAfterDefragBenchmark();
-        
-        double improvement = ((before.avgReadTimeMs - after.avgReadTimeMs) / 
-                             before.avgReadTimeMs) * 100;
-        
-        appendLog(QString("Performance improvement: %1%").arg(improvement, 0, 'f', 1));
-    } else {
-        appendLog("Defragmentation cancelled or failed");
+    if (!beginOperation()) {
+        return;
     }
+    appendLog("Starting defragmentation...");
+    defragRunning_ = true;
+    defragBtn_->setText("Cancel Defragmentation");
     
-    progressBar_->setVisible(false);
-    emit operationCompleted();
+    // Runs on the worker; progress messages are logged as they arrive
+    runner_->startDefrag(defragMgr_, [this](bool success, bool cancelled) {
+        if (success) {
+            appendLog("Defragmentation completed");
+            
+            const auto& before = defragMgr_->getBeforeDefragBenchmark();
+            const auto& after = defragMgr_->getAfterDefragBenchmark();
+            
+            double improvement = ((before.avgReadTimeMs - after.avgReadTimeMs) / 
+                                 before.avgReadTimeMs) * 100;
+            
+            appendLog(QString("Performance improvement: %1%").arg(improvement, 0, 'f', 1));
+        } else {
+            appendLog(cancelled ? "Defragmentation cancelled" : "Defragmentation failed");
+        }
+        
+        defragRunning_ = false;
+        defragBtn_->setText("Run Defragmentation");
+        endOperation();
+        emit defragCompleted(success);
+        emit operationCompleted();
+    });
 }
 
 void ControlPanel::onMountClicked() {
@@ -1,4 +1,5 @@
 #include "DefragManager.h"
+#include "BlockBuffer.h"
 #include <iostream>
 #include <algorithm>
 #include <chrono>
@@ -6,325 +7,425 @@
 
 namespace FileSystemTool {
 
-DefragManager::DefragManager(FileSystem* fs) : fs_(fs) {}
+namespace {
+
+// Pipeline stages wait on each other without a mutex: yield first, then nap
+void backoff(uint32_t& spins) {
+    if (++spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+inline uint8_t* slotBuffer(std::vector<uint8_t>& buffers, uint32_t slot) {
+    return buffers.data() + static_cast<size_t>(slot) * DEFRAG_COPY_BLOCKS * BLOCK_SIZE;
+}
+
+} // namespace
+
+DefragManager::DefragManager(FileSystem* fs)
+    : fs_(fs), cancelRequested_(false), filesDefragged_(0), pipelineDisk_(nullptr) {}
 
 FragmentationStats DefragManager::analyzeFragmentation() {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     FragmentationStats stats;
-    const auto& sb = fs_->getDisk()->getSuperblock();
     
-    uint32_t totalFragments = 0;
-    
-    // Analyze each file
-    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
-        Inode inode;
-        if (!fs_->getInodeManager()->readInode(i, inode)) {
-            continue;
-        }
-        
-        if (inode.isValid() && inode.fileType == FileType::REGULAR_FILE) {
-            stats.totalFiles++;
-            
-            uint32_t fragments = countFileFragments(inode);
-            if (fragments > 1) {
-                stats.fragmentedFiles++;
-                totalFragments += fragments;
-            }
-        }
-    }
+    // Both sources are maintained incrementally; nothing here walks the inode table
+    FragmentCounts counts = fs_->getInodeManager()->getFragmentCounts();
+    stats.totalFiles = counts.files;
+    stats.fragmentedFiles = counts.fragmentedFiles;
     
     if (stats.totalFiles > 0) {
-        stats.totalFragments = totalFragments;
-        stats.averageFragmentsPerFile = static_cast<double>(totalFragments) / stats.totalFiles;
+        // Only fragmented files contribute; contiguous ones hold exactly one fragment each
+        uint64_t contiguousFiles = counts.filesWithBlocks - counts.fragmentedFiles;
+        stats.totalFragments = static_cast<uint32_t>(counts.totalFragments - contiguousFiles);
+        stats.averageFragmentsPerFile = static_cast<double>(stats.totalFragments) / stats.totalFiles;
         stats.fragmentationScore = static_cast<double>(stats.fragmentedFiles) / stats.totalFiles;
     }
     
     // Find largest contiguous region
-    auto bitmap = fs_->getDisk()->getBitmap();
-    uint32_t currentRegion = 0;
-    stats.largestContiguousRegion = 0;
-    
-    for (size_t i = sb.dataBlocksStart; i < bitmap.size(); ++i) {
-        if (bitmap[i]) {  // Free block
-            currentRegion++;
-            stats.largestContiguousRegion = std::max(stats.largestContiguousRegion, currentRegion);
-        } else {
-            currentRegion = 0;
-        }
-    }
+    stats.largestContiguousRegion = fs_->getDisk()->getBitmap().largestRun();
     
     lastStats_ = stats;
     return stats;
 }
 
 bool DefragManager::isFileFragmented(uint32_t inodeNum) {
-    Inode inode;
-    if (!fs_->getInodeManager()->readInode(inodeNum, inode)) {
-        return false;
-    }
-    
-    return countFileFragments(inode) > 1;
+    return fs_->getInodeManager()->getFragmentCount(inodeNum) > 1;
 }
 
 uint32_t DefragManager::countFileFragments(const Inode& inode) {
-    const auto& sb = fs_->getDisk()->getSuperblock();
-    std::vector<uint32_t> blocks;
-    
-    // Collect VALID direct blocks only (skip -1, 0, out of range)
-    for (int i = 0; i < 12; ++i) {
-        if (inode.directBlocks[i] > 0 &&
-            inode.directBlocks[i] != -1 &&
-            inode.directBlocks[i] < (int32_t)sb.totalBlocks) {
-            blocks.push_back(static_cast<uint32_t>(inode.directBlocks[i]));
-        }
-    }
+    // Same count InodeManager keeps per inode, for inodes not (yet) in the table
+    return InodeManager::countFragments(fs_->getInodeManager()->getInodeBlocks(inode));
+}
+
+bool DefragManager::defragmentFileSystem(bool& cancelled) {
+    std::cout << "Starting defragmentation..." << std::endl;
+    cancelRequested_ = false;
+    filesDefragged_ = 0;
     
-    // TODO: Add indirect blocks if needed (with validation)
+    // Run benchmark before
+    beforeBenchmark_ = runBenchmark(50);
     
-    if (blocks.size() <= 1) {
-        return blocks.size();
+    // Plan: only fragmented files move; contiguous ones are skipped outright
+    std::vector<uint32_t> candidates;
+    {
+        std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+        const auto& sb = fs_->getDisk()->getSuperblock();
+        for (uint32_t i = 0; i < sb.inodeCount; ++i) {
+            Inode inode;
+            if (fs_->getInodeManager()->readInode(i, inode) && inode.isValid() &&
+                inode.fileType == FileType::REGULAR_FILE && isFileFragmented(i)) {
+                candidates.push_back(i);
+            }
+        }
     }
     
-    // Sort to find contiguous sequences
-    std::sort(blocks.begin(), blocks.end());
+    reportProgress(0, "Defragmenting " + std::to_string(candidates.size()) + " fragmented files");
+    startPipeline();
     
-    // Count fragments (non-contiguous sequences)
-    uint32_t fragments = 1;
-    for (size_t i = 1; i < blocks.size(); ++i) {
-        if (blocks[i] != blocks[i-1] + 1) {
-            fragments++;
+    bool stopped = false;
+    for (size_t k = 0; k < candidates.size() && !stopped; ++k) {
+        switch (relocateFile(candidates[k], cancelled)) {
+            case MoveResult::MOVED:
+                filesDefragged_++;
+                break;
+            case MoveResult::CANCELLED:
+                stopped = true;
+                break;
+            case MoveResult::FAILED:
+                std::cerr << "Failed to defragment inode " << candidates[k] << std::endl;
+                break;
+            case MoveResult::SKIPPED:
+                break;
         }
+        reportProgress(static_cast<int>((k + 1) * 100 / candidates.size()), "");
     }
+    stopPipeline();
     
-    return fragments;
-}
-
-bool DefragManager::defragmentFileSystem(bool& cancelled) {
-    std::cout << "Starting defragmentation..." << std::endl;
-    
-    // Run benchmark before
-    beforeBenchmark_ = runBenchmark(50);
+    if (stopped) {
+        std::cout << "Defragmentation cancelled after " << filesDefragged_ << " files" << std::endl;
+        reportProgress(100, "Cancelled after " + std::to_string(filesDefragged_) + " files");
+        return false;
+    }
     
-    const auto& sb = fs_->getDisk()->getSuperblock();
+    // Run benchmark after
+    afterBenchmark_ = runBenchmark(50);
     
-    // STEP 1: Collect ALL files and their data
-    struct FileData {
-        uint32_t inodeNum;
-        Inode inode;
-        std::vector<uint8_t> data;
-        std::vector<uint32_t> oldBlocks;
-    };
+    std::cout << "Defragmentation complete!" << std::endl;
+    std::cout << "Files defragmented: " << filesDefragged_ << std::endl;
+    std::cout << "Read latency improvement: " 
+              << (beforeBenchmark_.avgReadTimeMs - afterBenchmark_.avgReadTimeMs) << " ms" << std::endl;
     
-    std::vector<FileData> allFiles;
+    return true;
+}
+
+bool DefragManager::defragmentFile(uint32_t inodeNum) {
+    bool cancelled = false;
+    cancelRequested_ = false;
     
-    for (uint32_t i = 0; i < sb.inodeCount && !cancelled; ++i) {
-        Inode inode;
-        if (!fs_->getInodeManager()->readInode(i, inode)) {
-            continue;
+    startPipeline();
+    MoveResult result = relocateFile(inodeNum, cancelled);
+    stopPipeline();
+    return result == MoveResult::MOVED || result == MoveResult::SKIPPED;
+}
+
+void DefragManager::setThrottle(double megabytesPerSecond, uint32_t iops) {
+    throttle_.configure(megabytesPerSecond * 1024 * 1024, iops);
+}
+
+void DefragManager::Throttle::configure(double bytesPerSecond, double opsPerSecond) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytesPerSecond_ = std::max(0.0, bytesPerSecond);
+    opsPerSecond_ = std::max(0.0, opsPerSecond);
+    byteTokens_ = 0;
+    opTokens_ = 0;
+    last_ = std::chrono::steady_clock::now();
+}
+
+void DefragManager::Throttle::acquire(uint64_t bytes) {
+    double wait = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bytesPerSecond_ <= 0 && opsPerSecond_ <= 0) {
+            return;
         }
         
-        if (inode.isValid() && inode.fileType == FileType::REGULAR_FILE && inode.fileSize > 0) {
-            FileData fd;
-            fd.inodeNum = i;
-            fd.inode = inode;
-            fd.data.resize(inode.fileSize);
-            
-            // Collect old blocks
-            for (int j = 0; j < 12; ++j) {
-                if (inode.directBlocks[j] > 0 &&
-                    inode.directBlocks[j] != -1 &&
-                    inode.directBlocks[j] < (int32_t)sb.totalBlocks) {
-                    fd.oldBlocks.push_back(static_cast<uint32_t>(inode.directBlocks[j]));
-                }
-            }
-            
-            // Read file data from old blocks
-            size_t bytesRead = 0;
-            for (uint32_t blockNum : fd.oldBlocks) {
-                std::vector<uint8_t> blockData(BLOCK_SIZE);
-                if (fs_->getDisk()->readBlock(blockNum, blockData.data())) {
-                    size_t bytesToCopy = std::min((size_t)BLOCK_SIZE, fd.data.size() - bytesRead);
-                    std::copy(blockData.begin(), blockData.begin() + bytesToCopy,
-                             fd.data.begin() + bytesRead);
-                    bytesRead += bytesToCopy;
-                }
-            }
-            
-            allFiles.push_back(fd);
+        // Refill, capping the burst at 50ms worth of budget
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+        if (bytesPerSecond_ > 0) {
+            byteTokens_ = std::min(byteTokens_ + elapsed * bytesPerSecond_, bytesPerSecond_ * 0.05);
+            byteTokens_ -= static_cast<double>(bytes);
+            if (byteTokens_ < 0) wait = std::max(wait, -byteTokens_ / bytesPerSecond_);
+        }
+        if (opsPerSecond_ > 0) {
+            opTokens_ = std::min(opTokens_ + elapsed * opsPerSecond_, std::max(1.0, opsPerSecond_ * 0.05));
+            opTokens_ -= 1;
+            if (opTokens_ < 0) wait = std::max(wait, -opTokens_ / opsPerSecond_);
         }
     }
     
-    // STEP 2: FREE ALL old blocks
-    for (auto& fd : allFiles) {
-        for (uint32_t blockNum : fd.oldBlocks) {
-            fs_->getDisk()->freeBlock(blockNum);
-            fs_->clearBlockOwner(blockNum);
+    if (wait > 0) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+}
+
+void DefragManager::startPipeline() {
+    pipelineDisk_ = fs_->getDisk();
+    copyBuffers_.assign(static_cast<size_t>(DEFRAG_PIPELINE_DEPTH) * DEFRAG_COPY_BLOCKS * BLOCK_SIZE, 0);
+    
+    // One spare entry per queue for the stop marker
+    readQueue_ = std::make_unique<SpscQueue<ExtentMove>>(DEFRAG_PIPELINE_DEPTH + 1);
+    writeQueue_ = std::make_unique<SpscQueue<ExtentMove>>(DEFRAG_PIPELINE_DEPTH + 1);
+    commitQueue_ = std::make_unique<SpscQueue<ExtentMove>>(DEFRAG_PIPELINE_DEPTH + 1);
+    reader_ = std::thread(&DefragManager::readStage, this);
+    writer_ = std::thread(&DefragManager::writeStage, this);
+}
+
+void DefragManager::stopPipeline() {
+    ExtentMove stop;
+    stop.stop = true;
+    readQueue_->push(stop);  // Only happens with nothing in flight, so there is room
+    reader_.join();
+    writer_.join();
+    
+    readQueue_.reset();
+    writeQueue_.reset();
+    commitQueue_.reset();
+    std::vector<uint8_t>().swap(copyBuffers_);
+}
+
+void DefragManager::readStage() {
+    uint32_t spins = 0;
+    ExtentMove move;
+    while (true) {
+        if (!readQueue_->pop(move)) {
+            backoff(spins);
+            continue;
         }
+        spins = 0;
         
-        // Clear inode blocks
-        for (int i = 0; i < 12; ++i) {
-            fd.inode.directBlocks[i] = -1;
+        if (!move.stop) {
+            // Sources were flushed from the cache when the file was planned
+            throttle_.acquire(static_cast<uint64_t>(move.length) * BLOCK_SIZE);
+            uint8_t* buffer = slotBuffer(copyBuffers_, move.slot);
+            for (uint32_t i = 0; i < move.length && move.ok; ++i) {
+                move.ok = pipelineDisk_->readBlockShared(move.source + i, buffer + static_cast<size_t>(i) * BLOCK_SIZE);
+            }
+        }
+        
+        while (!writeQueue_->push(move)) {
+            backoff(spins);
+        }
+        if (move.stop) {
+            return;
         }
-        fd.inode.indirectBlock = -1;
-        fd.inode.blockCount = 0;
     }
-    
-    // STEP 3: Reallocate ALL files from scratch (guarantees contiguous allocation)
-    uint32_t filesDefragged = 0;
-    for (auto& fd : allFiles) {
-        uint32_t blocksNeeded = (fd.data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
-        std::vector<uint32_t> newBlocks;
+}
+
+void DefragManager::writeStage() {
+    uint32_t spins = 0;
+    ExtentMove move;
+    while (true) {
+        if (!writeQueue_->pop(move)) {
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+        if (move.stop) {
+            return;
+        }
         
-        // Allocate blocks - should be contiguous since we freed everything
-        for (uint32_t i = 0; i < blocksNeeded; ++i) {
-            int32_t blockNum = fs_->getDisk()->allocateBlockCompact();
-            if (blockNum < 0) {
-                std::cerr << "ERROR: Failed to allocate block during defrag!" << std::endl;
-                break;
+        // Targets are reserved and dropped from the cache, so nobody else touches them
+        if (move.ok) {
+            throttle_.acquire(static_cast<uint64_t>(move.length) * BLOCK_SIZE);
+            const uint8_t* buffer = slotBuffer(copyBuffers_, move.slot);
+            for (uint32_t i = 0; i < move.length && move.ok; ++i) {
+                move.ok = pipelineDisk_->writeBlockDirect(move.target + i, buffer + static_cast<size_t>(i) * BLOCK_SIZE);
             }
-            newBlocks.push_back(static_cast<uint32_t>(blockNum));
-            fs_->setBlockOwner(static_cast<uint32_t>(blockNum), fd.inodeNum);
         }
         
-        // Write data to new blocks
-        for (size_t i = 0; i < newBlocks.size(); ++i) {
-            size_t offset = i * BLOCK_SIZE;
-            size_t copySize = std::min((size_t)BLOCK_SIZE, fd.data.size() - offset);
-            
-            std::vector<uint8_t> blockBuffer(BLOCK_SIZE, 0);
-            std::copy(fd.data.begin() + offset, fd.data.begin() + offset + copySize, blockBuffer.begin());
-            
-            fs_->getDisk()->writeBlock(newBlocks[i], blockBuffer.data());
+        while (!commitQueue_->push(move)) {
+            backoff(spins);
+        }
+    }
+}
+
+DefragManager::MoveResult DefragManager::relocateFile(uint32_t inodeNum, const bool& cancelled) {
+    InodeManager* inodeMgr = fs_->getInodeManager();
+    VirtualDisk* disk = fs_->getDisk();
+    
+    // Plan under the lock: reserve the whole target run up front so foreground
+    // allocations cannot take it while extents are in flight
+    std::vector<ExtentMove> moves;
+    uint32_t count = 0;
+    uint32_t generation = 0;
+    {
+        std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+        Inode inode;
+        if (!inodeMgr->readInode(inodeNum, inode) || !inode.isValid() ||
+            inode.fileType != FileType::REGULAR_FILE) {
+            return MoveResult::SKIPPED;
         }
         
-        // Update inode
-        for (size_t i = 0; i < newBlocks.size() && i < 12; ++i) {
-            fd.inode.directBlocks[i] = newBlocks[i];
-            fd.inode.blockCount++;
+        std::vector<uint32_t> blocks = inodeMgr->getInodeBlocks(inode);
+        if (blocks.size() != inode.blockCount) {
+            std::cerr << "Inode " << inodeNum << " has unmapped blocks, not moving it" << std::endl;
+            return MoveResult::SKIPPED;
+        }
+        if (InodeManager::countFragments(blocks) <= 1) {
+            return MoveResult::SKIPPED;
         }
         
-        fs_->getInodeManager()->writeInode(fd.inodeNum, fd.inode);
-        filesDefragged++;
+        // The whole file goes to the lowest free run that holds it
+        count = static_cast<uint32_t>(blocks.size());
+        uint32_t target = disk->getBitmap().findFreeRun(count, disk->getSuperblock().dataBlocksStart);
+        if (target == FreeBitmap::NPOS || !disk->allocateBlockRange(target, count)) {
+            std::cerr << "No free run of " << count << " blocks for inode " << inodeNum << std::endl;
+            return MoveResult::SKIPPED;
+        }
         
-        std::cout << "Defragmented file inode " << fd.inodeNum 
-                  << " (" << newBlocks.size() << " blocks)" << std::endl;
+        // The stages bypass the cache and journal: sources must be on the image,
+        // and nothing may later overwrite the targets
+        if (!disk->flushCache() || !disk->prepareDirectWrite(target, count)) {
+            for (uint32_t b = 0; b < count; ++b) {
+                disk->freeBlock(target + b);
+            }
+            return MoveResult::FAILED;
+        }
+        generation = inodeMgr->getGeneration(inodeNum);
+        
+        // One source extent (capped at a slot) per move
+        for (uint32_t index = 0; index < count; ) {
+            ExtentMove move;
+            move.fileIndex = index;
+            move.source = blocks[index];
+            move.target = target + index;
+            move.length = 1;
+            while (index + move.length < count && move.length < DEFRAG_COPY_BLOCKS &&
+                   blocks[index + move.length] == blocks[index + move.length - 1] + 1) {
+                move.length++;
+            }
+            index += move.length;
+            moves.push_back(move);
+        }
     }
     
-    // STEP 4: Write changes to disk
-    fs_->getDisk()->writeBitmap();
-    fs_->getDisk()->writeSuperblock();
-    
-    // Run benchmark after
-    afterBenchmark_ = runBenchmark(50);
-    
-    std::cout << "Defragmentation complete!" << std::endl;
-    std::cout << "Files defragmented: " << filesDefragged << std::endl;
-    std::cout << "Read latency improvement: " 
-              << (beforeBenchmark_.avgReadTimeMs - afterBenchmark_.avgReadTimeMs) << " ms" << std::endl;
-    
-    return true;
-}
-
-bool DefragManager::defragmentFile(uint32_t inodeNum) {
-    Inode inode;
-    if (!fs_->getInodeManager()->readInode(inodeNum, inode)) {
-        return false;
+    std::vector<uint32_t> freeSlots;
+    for (uint32_t slot = DEFRAG_PIPELINE_DEPTH; slot > 0; --slot) {
+        freeSlots.push_back(slot - 1);
     }
     
-    // Read file data first
-    std::vector<uint8_t> fileData(inode.fileSize);
-    const auto& sb = fs_->getDisk()->getSuperblock();
-    
-    // Collect valid blocks and read data
-    std::vector<uint32_t> oldBlocks;
-    for (int i = 0; i < 12; ++i) {
-        if (inode.directBlocks[i] > 0 &&
-            inode.directBlocks[i] != -1 &&
-            inode.directBlocks[i] < (int32_t)sb.totalBlocks) {
-            oldBlocks.push_back(static_cast<uint32_t>(inode.directBlocks[i]));
+    // Feed the stages and commit what comes back, in order
+    MoveResult result = MoveResult::MOVED;
+    std::vector<uint8_t> committed(moves.size(), 0);
+    size_t next = 0;
+    size_t done = 0;
+    uint32_t inFlight = 0;
+    uint32_t spins = 0;
+    while (true) {
+        while (result == MoveResult::MOVED && next < moves.size() && !freeSlots.empty()) {
+            if (cancelled || cancelRequested_) {
+                result = MoveResult::CANCELLED;
+                break;
+            }
+            moves[next].slot = freeSlots.back();
+            freeSlots.pop_back();
+            readQueue_->push(moves[next++]);  // Never full: at most DEPTH in flight
+            inFlight++;
+        }
+        if (inFlight == 0) {
+            break;
+        }
+        
+        ExtentMove move;
+        while (!commitQueue_->pop(move)) {
+            backoff(spins);
+        }
+        spins = 0;
+        inFlight--;
+        freeSlots.push_back(move.slot);
+        if (result != MoveResult::MOVED) {
+            continue;  // Drain only once something went wrong
+        }
+        
+        std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+        if (!move.ok) {
+            result = MoveResult::FAILED;
+        } else if (inodeMgr->getGeneration(inodeNum) != generation) {
+            // Written while the copy was in flight; the copy may be stale
+            std::cout << "Inode " << inodeNum << " changed during defrag, leaving the rest in place" << std::endl;
+            result = MoveResult::SKIPPED;
+        } else if (!commitMove(inodeNum, move)) {
+            result = MoveResult::FAILED;
+        } else {
+            committed[done] = 1;
+            generation = inodeMgr->getGeneration(inodeNum);
         }
+        done++;
     }
     
-    // Read  file data from old blocks
-    size_t bytesRead = 0;
-    for (uint32_t blockNum : oldBlocks) {
-        std::vector<uint8_t> blockData(BLOCK_SIZE);
-        if (fs_->getDisk()->readBlock(blockNum, blockData.data())) {
-            size_t bytesToCopy = std::min((size_t)BLOCK_SIZE, fileData.size() - bytesRead);
-            std::copy(blockData.begin(), blockData.begin() + bytesToCopy,
-                     fileData.begin() + bytesRead);
-            bytesRead += bytesToCopy;
+    // Give back the part of the reservation no committed move used, then make the
+    // moves durable before a later file may reuse the blocks they freed
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+    for (size_t i = 0; i < moves.size(); ++i) {
+        if (!committed[i]) {
+            for (uint32_t b = 0; b < moves[i].length; ++b) {
+                disk->freeBlock(moves[i].target + b);
+            }
         }
     }
-    
-    // Free old blocks
-    for (uint32_t blockNum : oldBlocks) {
-        fs_->getDisk()->freeBlock(blockNum);
-        fs_->clearBlockOwner(blockNum);
+    disk->flushBitmap();
+    if (fs_->getJournal() && !fs_->getJournal()->flush()) {
+        return MoveResult::FAILED;
     }
     
-    // Clear inode blocks
-    for (int i = 0; i < 12; ++i) {
-        inode.directBlocks[i] = -1;
+    if (result == MoveResult::MOVED) {
+        std::cout << "Defragmented file inode " << inodeNum << " (" << count << " blocks)" << std::endl;
     }
-    inode.indirectBlock = -1;
+    return result;
+}
 
-    inode.blockCount = 0;
-    
-    // Allocate new CONTIGUOUS blocks starting from lowest available
-    std::vector<uint32_t> newBlocks;
-    uint32_t blocksNeeded = oldBlocks.size();
+bool DefragManager::commitMove(uint32_t inodeNum, const ExtentMove& move) {
+    VirtualDisk* disk = fs_->getDisk();
+    InodeManager* inodeMgr = fs_->getInodeManager();
+    Journal* journal = fs_->getJournal();
     
-    for (uint32_t i = 0; i < blocksNeeded; ++i) {
-        int32_t blockNum = fs_->getDisk()->allocateBlockCompact();
-        if (blockNum < 0) {
-            // Allocation failed - skip this file
-            return false;
-        }
-        newBlocks.push_back(static_cast<uint32_t>(blockNum));
-        fs_->setBlockOwner(static_cast<uint32_t>(blockNum), inodeNum);
+    Inode inode;
+    if (!inodeMgr->readInode(inodeNum, inode)) {
+        return false;
     }
     
-    // VERIFY blocks are contiguous
-    bool isContiguous = true;
-    for (size_t i = 1; i < newBlocks.size(); ++i) {
-        if (newBlocks[i] != newBlocks[i-1] + 1) {
-            isContiguous = false;
-            std::cerr << "WARNING: Allocated blocks not contiguous for inode " << inodeNum << std::endl;
-            break;
-        }
+    // Repoint and free in one transaction; the copy is already on the image
+    uint32_t txId = journal ? journal->beginTransaction(JournalOp::MOVE_EXTENT, inodeNum) : 0;
+    std::vector<uint32_t> newBlocks(move.length);
+    for (uint32_t i = 0; i < move.length; ++i) {
+        newBlocks[i] = move.target + i;
     }
     
-    // Write data to new sequential blocks
-    std::vector<uint8_t> blockBuffer(BLOCK_SIZE);
-    for (size_t i = 0; i < newBlocks.size(); ++i) {
-        size_t offset = i * BLOCK_SIZE;
-        size_t copySize = std::min(static_cast<size_t>(BLOCK_SIZE), fileData.size() - offset);
-        
-        blockBuffer.assign(BLOCK_SIZE, 0);
-        std::copy(fileData.begin() + offset, fileData.begin() + offset + copySize, blockBuffer.begin());
-        
-        if (!fs_->getDisk()->writeBlock(newBlocks[i], blockBuffer.data())) {
-            return false;
-        }
+    if (!inodeMgr->remapBlockPointers(inode, move.fileIndex, newBlocks) ||
+        !inodeMgr->writeInode(inodeNum, inode)) {
+        if (txId) journal->abortTransaction(txId);
+        return false;
     }
     
-    // Update inode with new CONTIGUOUS blocks
-    for (size_t i = 0; i < newBlocks.size() && i < 12; ++i) {
-        inode.directBlocks[i] = newBlocks[i];
-        inode.blockCount++;
+    for (uint32_t i = 0; i < move.length; ++i) {
+        disk->freeBlock(move.source + i);
+        fs_->clearBlockOwner(move.source + i);
+        fs_->setBlockOwner(move.target + i, inodeNum);
     }
     
-    // Handle indirect blocks if file is large (>12 blocks)
-    if (newBlocks.size() > 12) {
-        // TODO: Handle indirect blocks
-        std::cerr << "WARNING: File larger than 12 blocks not fully supported in defrag" << std::endl;
+    if (!disk->flushBitmap()) {
+        return false;
     }
-    
-    // Write updated inode
-    return fs_->getInodeManager()->writeInode(inodeNum, inode);
+    return !txId || journal->commitTransaction(txId);
 }
 
 BenchmarkResults DefragManager::runBenchmark(uint32_t numFiles) {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     BenchmarkResults results;
     std::vector<uint32_t> testInodes;
     
@@ -356,26 +457,25 @@ BenchmarkResults DefragManager::runBenchmark(uint32_t numFiles) {
 }
 
 void DefragManager::simulateFragmentation(uint32_t numFiles) {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     std::cout << "Simulating fragmentation with " << numFiles << " files..." << std::endl;
     
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_int_distribution<> sizeDist(1024, 16384);  // 1KB to 16KB files
     
-    // Create files
+    // Create files (one batch: they land back to back, like sequential writes)
+    std::vector<BatchFile> batch(numFiles);
     for (uint32_t i = 0; i < numFiles; ++i) {
-        std::string filename = "/testfile_" + std::to_string(i) + ".dat";
-        fs_->createFile(filename);
+        batch[i].path = "/testfile_" + std::to_string(i) + ".dat";
         
         // Generate random data
-        size_t size = sizeDist(gen);
-        std::vector<uint8_t> data(size);
-        for (auto& byte : data) {
+        batch[i].data.resize(sizeDist(gen));
+        for (auto& byte : batch[i].data) {
             byte = static_cast<uint8_t>(gen());
         }
-        
-        fs_->writeFile(filename, data);
     }
+    fs_->writeBatch(batch);
     
     // Delete every other file to create gaps
     for (uint32_t i = 0; i < numFiles; i += 2) {
@@ -383,7 +483,8 @@ void DefragManager::simulateFragmentation(uint32_t numFiles) {
         fs_->deleteFile(filename);
     }
     
-    // Create more files that will fragment
+    // Create more files that will fragment (one at a time; a batch would get one
+    // contiguous extent)
     for (uint32_t i = numFiles; i < numFiles * 1.5; ++i) {
         std::string filename = "/fragmented_" + std::to_string(i) + ".dat";
         fs_->createFile(filename);
@@ -401,28 +502,24 @@ void DefragManager::simulateFragmentation(uint32_t numFiles) {
 }
 
 std::vector<uint32_t> DefragManager::findContiguousBlocks(uint32_t count) {
-    auto bitmap = fs_->getDisk()->getBitmap();
+    const auto& bitmap = fs_->getDisk()->getBitmap();
     const auto& sb = fs_->getDisk()->getSuperblock();
     
-    std::vector<uint32_t> blocks;
-    
-    for (size_t i = sb.dataBlocksStart; i < bitmap.size(); ++i) {
-        if (bitmap[i]) {  // Free block
-            blocks.push_back(i);
-            
-            if (blocks.size() == count) {
-                // Allocate all blocks
-                for (uint32_t blockNum : blocks) {
-                    fs_->getDisk()->allocateBlock();  // Will find these same blocks
-                }
-                return blocks;
-            }
-        } else {
-            blocks.clear();  // Not contiguous, restart
-        }
+    uint32_t start = bitmap.findFreeRun(count, sb.dataBlocksStart);
+    if (start == FreeBitmap::NPOS) {
+        return {};  // Couldn't find enough contiguous blocks
+    }
+    
+    // Allocate exactly the run that was found
+    if (!fs_->getDisk()->allocateBlockRange(start, count)) {
+        return {};
     }
     
-    return {};  // Couldn't find enough contiguous blocks
+    std::vector<uint32_t> blocks(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        blocks[i] = start + i;
+    }
+    return blocks;
 }
 
 double DefragManager::measureReadLatency(uint32_t inodeNum) {
@@ -434,7 +531,7 @@ double DefragManager::measureReadLatency(uint32_t inodeNum) {
     }
     
     auto blocks = fs_->getInodeManager()->getInodeBlocks(inode);
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
+    BlockBuffer buffer;
     
     for (uint32_t blockNum : blocks) {
         fs_->getDisk()->readBlock(blockNum, buffer.data());
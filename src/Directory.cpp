@@ -1,11 +1,14 @@
 #include "Directory.h"
 #include "VirtualDisk.h"
+#include "BlockBuffer.h"
 #include <cstring>
 #include <iostream>
-#include <sstream>
+#include <algorithm>
 
 namespace FileSystemTool {
 
+static_assert(ENTRIES_PER_BLOCK * DIR_ENTRY_SIZE == BLOCK_SIZE, "Directory slots must tile a block");
+
 DirectoryEntry::DirectoryEntry() {
     reset();
 }
@@ -40,12 +43,13 @@ DirectoryManager::DirectoryManager(VirtualDisk* disk, InodeManager* inodeMgr)
 
 bool DirectoryManager::createDirectory(const std::string& name, uint32_t parentInodeNum, uint32_t& newInodeNum) {
     // Allocate inode for new directory
-    int32_t inodeNum = inodeMgr_->allocateInode(FileType::DIRECTORY);
+    int32_t inodeNum = inodeMgr_->allocateInode(FileType::DIRECTORY, disk_->pickDirectoryGroup());
     if (inodeNum < 0) {
         return false;
     }
     
     newInodeNum = static_cast<uint32_t>(inodeNum);
+    invalidateIndex(newInodeNum);  // Inode may have been a directory before
     
     // Create . and .. entries
     std::vector<DirectoryEntry> entries;
@@ -79,76 +83,265 @@ bool DirectoryManager::addEntry(uint32_t dirInodeNum, const std::string& name,
         return false;
     }
     
-    // Read existing entries
-    std::vector<DirectoryEntry> entries;
-    readDirectoryEntries(dirInode, entries);
+    std::unique_lock<std::shared_mutex> lock(indexMutex_);
+    DirectoryIndex* index = getIndex(dirInodeNum, dirInode);
+    if (!index) {
+        return false;
+    }
     
     // Check if entry already exists
-    for (const auto& entry : entries) {
-        if (entry.getName() == name) {
-            std::cerr << "Entry already exists: " << name << std::endl;
+    DirectoryEntry entry(entryInodeNum, name, type);
+    std::string storedName = entry.getName();
+    if (index->entries.count(storedName)) {
+        std::cerr << "Entry already exists: " << name << std::endl;
+        return false;
+    }
+    
+    // Only grow the directory when every slot is taken
+    if (index->freeSlots.empty() && !expandDirectory(dirInode, *index)) {
+        return false;
+    }
+    
+    uint32_t slot = index->freeSlots.back();
+    if (!writeSlot(*index, slot, entry)) {
+        dropIndex(dirInodeNum);
+        return false;
+    }
+    index->freeSlots.pop_back();
+    index->entries[storedName] = {entryInodeNum, slot};
+    
+    // Update inode
+    dirInode.fileSize = static_cast<uint32_t>(index->entries.size()) * DIR_ENTRY_SIZE;
+    dirInode.modifiedTime = time(nullptr);
+    return inodeMgr_->writeInode(dirInodeNum, dirInode);
+}
+
+bool DirectoryManager::addEntries(uint32_t dirInodeNum, const std::vector<DirectoryEntry>& newEntries) {
+    Inode dirInode;
+    if (!inodeMgr_->readInode(dirInodeNum, dirInode)) {
+        return false;
+    }
+    
+    if (dirInode.fileType != FileType::DIRECTORY) {
+        std::cerr << "Inode is not a directory" << std::endl;
+        return false;
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(indexMutex_);
+    DirectoryIndex* index = getIndex(dirInodeNum, dirInode);
+    if (!index) {
+        return false;
+    }
+    
+    for (const auto& entry : newEntries) {
+        if (index->entries.count(entry.getName())) {
+            std::cerr << "Entry already exists: " << entry.getName() << std::endl;
             return false;
         }
     }
     
-    // Add new entry
-    entries.push_back(DirectoryEntry(entryInodeNum, name, type));
+    // Grow once up front for every slot the batch still needs
+    while (index->freeSlots.size() < newEntries.size()) {
+        if (!expandDirectory(dirInode, *index)) {
+            return false;
+        }
+    }
+    
+    // Fill slots lowest first, then write each touched block once
+    std::map<uint32_t, BlockBuffer> blocks;  // block index -> contents
+    for (const auto& entry : newEntries) {
+        uint32_t slot = index->freeSlots.back();
+        index->freeSlots.pop_back();
+        index->entries[entry.getName()] = {entry.inodeNumber, slot};
+        
+        uint32_t blockIndex = slot / ENTRIES_PER_BLOCK;
+        auto it = blocks.find(blockIndex);
+        if (it == blocks.end()) {
+            it = blocks.emplace(blockIndex, BlockBuffer()).first;
+            if (!disk_->readBlock(index->blocks[blockIndex], it->second.data())) {
+                dropIndex(dirInodeNum);
+                return false;
+            }
+        }
+        memcpy(it->second.data() + (slot % ENTRIES_PER_BLOCK) * DIR_ENTRY_SIZE, &entry, sizeof(DirectoryEntry));
+    }
+    
+    for (const auto& block : blocks) {
+        if (!disk_->writeMetadataBlock(index->blocks[block.first], block.second.data())) {
+            dropIndex(dirInodeNum);
+            return false;
+        }
+    }
     
-    // Write back
-    return writeDirectoryEntries(dirInode, entries);
+    // Update inode
+    dirInode.fileSize = static_cast<uint32_t>(index->entries.size()) * DIR_ENTRY_SIZE;
+    dirInode.modifiedTime = time(nullptr);
+    return inodeMgr_->writeInode(dirInodeNum, dirInode);
 }
 
 bool DirectoryManager::removeEntry(uint32_t dirInodeNum, const std::string& name) {
     Inode dirInode;
-    if (!inodeMgr_->readInode(dirInodeNum, dirInode)) {
+    if (!inodeMgr_->readInode(dirInodeNum, dirInode) ||
+        dirInode.fileType != FileType::DIRECTORY) {
         return false;
     }
     
-    std::vector<DirectoryEntry> entries;
-    readDirectoryEntries(dirInode, entries);
-    
-    // Find and remove entry
-    auto it = std::remove_if(entries.begin(), entries.end(),
-        [&name](const DirectoryEntry& e) { return e.getName() == name; });
+    std::unique_lock<std::shared_mutex> lock(indexMutex_);
+    DirectoryIndex* index = getIndex(dirInodeNum, dirInode);
+    if (!index) {
+        return false;
+    }
     
-    if (it == entries.end()) {
+    // Find entry
+    auto it = index->entries.find(name);
+    if (it == index->entries.end()) {
         return false;  // Entry not found
     }
     
-    entries.erase(it, entries.end());
-    return writeDirectoryEntries(dirInode, entries);
+    // Clear just the one slot
+    uint32_t slot = it->second.slot;
+    if (!writeSlot(*index, slot, DirectoryEntry())) {
+        dropIndex(dirInodeNum);
+        return false;
+    }
+    index->entries.erase(it);
+    index->freeSlots.push_back(slot);
+    
+    // Update inode
+    dirInode.fileSize = static_cast<uint32_t>(index->entries.size()) * DIR_ENTRY_SIZE;
+    dirInode.modifiedTime = time(nullptr);
+    return inodeMgr_->writeInode(dirInodeNum, dirInode);
 }
 
 int32_t DirectoryManager::lookupEntry(uint32_t dirInodeNum, const std::string& name) {
     Inode dirInode;
-    if (!inodeMgr_->readInode(dirInodeNum, dirInode)) {
+    if (!inodeMgr_->readInode(dirInodeNum, dirInode) ||
+        dirInode.fileType != FileType::DIRECTORY) {
         return -1;
     }
     
-    std::vector<DirectoryEntry> entries;
-    readDirectoryEntries(dirInode, entries);
+    // Most lookups hit a built index and only need to share it
+    {
+        std::shared_lock<std::shared_mutex> lock(indexMutex_);
+        auto cached = indexCache_.find(dirInodeNum);
+        if (cached != indexCache_.end()) {
+            auto it = cached->second.entries.find(name);
+            return it == cached->second.entries.end() ? -1 : static_cast<int32_t>(it->second.inodeNumber);
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(indexMutex_);
+    DirectoryIndex* index = getIndex(dirInodeNum, dirInode);
+    if (!index) {
+        return -1;
+    }
+    
+    auto it = index->entries.find(name);
+    if (it == index->entries.end()) {
+        return -1;  // Not found
+    }
+    return static_cast<int32_t>(it->second.inodeNumber);
+}
+
+void DirectoryManager::invalidateIndex(uint32_t dirInodeNum) {
+    std::unique_lock<std::shared_mutex> lock(indexMutex_);
+    dropIndex(dirInodeNum);
+}
+
+void DirectoryManager::clearIndexCache() {
+    std::unique_lock<std::shared_mutex> lock(indexMutex_);
+    indexCache_.clear();
+}
+
+DirectoryManager::DirectoryIndex* DirectoryManager::getIndex(uint32_t dirInodeNum, const Inode& dirInode) {
+    auto it = indexCache_.find(dirInodeNum);
+    if (it != indexCache_.end()) {
+        return &it->second;
+    }
     
-    for (const auto& entry : entries) {
-        if (entry.getName() == name) {
-            return static_cast<int32_t>(entry.inodeNumber);
+    // Build from disk once; later lookups and updates stay in memory
+    DirectoryIndex index;
+    index.blocks = inodeMgr_->getInodeBlocks(dirInode);
+    
+    BlockBuffer buffer(index.blocks.size());
+    if (!disk_->readBlocks(index.blocks.data(), static_cast<uint32_t>(index.blocks.size()), buffer.data())) {
+        return nullptr;
+    }
+    for (size_t b = 0; b < index.blocks.size(); ++b) {
+        const uint8_t* block = buffer.block(b);
+        for (uint32_t i = 0; i < ENTRIES_PER_BLOCK; ++i) {
+            DirectoryEntry entry;
+            memcpy(&entry, block + (i * DIR_ENTRY_SIZE), sizeof(DirectoryEntry));
+            
+            uint32_t slot = static_cast<uint32_t>(b) * ENTRIES_PER_BLOCK + i;
+            if (entry.isValid()) {
+                index.entries.emplace(entry.getName(), DirectoryIndex::Location{entry.inodeNumber, slot});
+            } else {
+                index.freeSlots.push_back(slot);
+            }
         }
     }
+    std::reverse(index.freeSlots.begin(), index.freeSlots.end());
     
-    return -1;  // Not found
+    return &(indexCache_[dirInodeNum] = std::move(index));
 }
 
-std::vector<DirectoryEntry> DirectoryManager::listDirectory(uint32_t dirInodeNum) {
-    Inode dirInode;
-    std::vector<DirectoryEntry> entries;
+bool DirectoryManager::expandDirectory(Inode& dirInode, DirectoryIndex& index) {
+    uint32_t hint = index.blocks.empty() ? disk_->allocationGoal(disk_->groupOfInode(dirInode.inodeNumber))
+                                         : index.blocks.back() + 1;
+    auto extents = disk_->allocateExtent(1, hint);
+    if (extents.empty()) {
+        return false;
+    }
     
-    if (inodeMgr_->readInode(dirInodeNum, dirInode)) {
-        readDirectoryEntries(dirInode, entries);
+    uint32_t newBlock = extents.front().start;
+    BlockBuffer zeros;
+    zeros.zero();
+    if (!disk_->writeMetadataBlock(newBlock, zeros.data()) ||
+        !inodeMgr_->addBlockToInode(dirInode, newBlock)) {
+        disk_->freeBlock(newBlock);
+        return false;
     }
     
+    // New slots, lowest on top
+    uint32_t firstSlot = static_cast<uint32_t>(index.blocks.size()) * ENTRIES_PER_BLOCK;
+    index.blocks.push_back(newBlock);
+    for (uint32_t i = ENTRIES_PER_BLOCK; i > 0; --i) {
+        index.freeSlots.push_back(firstSlot + i - 1);
+    }
+    return true;
+}
+
+bool DirectoryManager::writeSlot(const DirectoryIndex& index, uint32_t slot, const DirectoryEntry& entry) {
+    uint32_t blockNum = index.blocks[slot / ENTRIES_PER_BLOCK];
+    uint32_t offset = (slot % ENTRIES_PER_BLOCK) * DIR_ENTRY_SIZE;
+    
+    BlockBuffer buffer;
+    if (!disk_->readBlock(blockNum, buffer.data())) {
+        return false;
+    }
+    
+    memcpy(buffer.data() + offset, &entry, sizeof(DirectoryEntry));
+    return disk_->writeMetadataBlock(blockNum, buffer.data());
+}
+
+std::vector<DirectoryEntry> DirectoryManager::listDirectory(uint32_t dirInodeNum) {
+    std::vector<DirectoryEntry> entries;
+    listDirectory(dirInodeNum, entries);
     return entries;
 }
 
+bool DirectoryManager::listDirectory(uint32_t dirInodeNum, std::vector<DirectoryEntry>& entries) {
+    Inode dirInode;
+    if (!inodeMgr_->readInode(dirInodeNum, dirInode)) {
+        entries.clear();
+        return false;
+    }
+    return readDirectoryEntries(dirInode, entries);
+}
+
 int32_t DirectoryManager::resolvePath(const std::string& path, uint32_t startInodeNum) {
+    ScopedLatency timer(disk_->getMetrics(), MetricOp::LOOKUP);
     if (path.empty() || path == "/") {
         return 0;  // Root inode
     }
@@ -171,13 +364,17 @@ int32_t DirectoryManager::resolvePath(const std::string& path, uint32_t startIno
 
 std::vector<std::string> DirectoryManager::splitPath(const std::string& path) {
     std::vector<std::string> components;
-    std::istringstream iss(path);
-    std::string component;
     
-    while (std::getline(iss, component, '/')) {
-        if (!component.empty()) {
-            components.push_back(component);
+    size_t start = 0;
+    while (start < path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
         }
+        if (end > start) {
+            components.emplace_back(path, start, end - start);
+        }
+        start = end + 1;
     }
     
     return components;
@@ -202,6 +399,7 @@ bool DirectoryManager::initializeRootDirectory() {
     if (!inodeMgr_->writeInode(0, rootInode)) {
         return false;
     }
+    invalidateIndex(0);
     
     // Create . and .. entries (both point to root)
     std::vector<DirectoryEntry> entries;
@@ -214,19 +412,20 @@ bool DirectoryManager::initializeRootDirectory() {
 bool DirectoryManager::readDirectoryEntries(const Inode& dirInode, std::vector<DirectoryEntry>& entries) {
     entries.clear();
     
-    auto blocks = inodeMgr_->getInodeBlocks(dirInode);
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
+    thread_local std::vector<uint32_t> blocks;
+    inodeMgr_->getInodeBlocks(dirInode, blocks);
+    BlockBuffer buffer(blocks.size());
+    if (!disk_->readBlocks(blocks.data(), static_cast<uint32_t>(blocks.size()), buffer.data())) {
+        return false;
+    }
     
-    for (uint32_t blockNum : blocks) {
-        if (!disk_->readBlock(blockNum, buffer.data())) {
-            return false;
-        }
-        
+    // fileSize tracks the live entry count, so this is usually the only allocation
+    entries.reserve(std::min<size_t>(dirInode.fileSize / DIR_ENTRY_SIZE, blocks.size() * ENTRIES_PER_BLOCK));
+    for (size_t b = 0; b < blocks.size(); ++b) {
         // Parse directory entries from block
-        uint32_t entriesPerBlock = BLOCK_SIZE / DIR_ENTRY_SIZE;
-        for (uint32_t i = 0; i < entriesPerBlock; ++i) {
+        for (uint32_t i = 0; i < ENTRIES_PER_BLOCK; ++i) {
             DirectoryEntry entry;
-            memcpy(&entry, buffer.data() + (i * DIR_ENTRY_SIZE), sizeof(DirectoryEntry));
+            memcpy(&entry, buffer.block(b) + (i * DIR_ENTRY_SIZE), sizeof(DirectoryEntry));
             
             if (entry.isValid()) {
                 entries.push_back(entry);
@@ -238,41 +437,53 @@ bool DirectoryManager::readDirectoryEntries(const Inode& dirInode, std::vector<D
 }
 
 bool DirectoryManager::writeDirectoryEntries(Inode& dirInode, const std::vector<DirectoryEntry>& entries) {
-    uint32_t entriesPerBlock = BLOCK_SIZE / DIR_ENTRY_SIZE;
+    uint32_t entriesPerBlock = ENTRIES_PER_BLOCK;
     uint32_t blocksNeeded = entries.empty() ? 1 : (entries.size() + entriesPerBlock - 1) / entriesPerBlock;
     
     // Get current blocks
     auto blocks = inodeMgr_->getInodeBlocks(dirInode);
     
-    // Allocate more blocks if needed
-    while (blocks.size() < blocksNeeded) {
-        int32_t newBlock = disk_->allocateBlock();
-        if (newBlock < 0) {
+    // Allocate more blocks if needed, contiguous with the directory's last block
+    if (blocks.size() < blocksNeeded) {
+        uint32_t hint = blocks.empty() ? disk_->allocationGoal(disk_->groupOfInode(dirInode.inodeNumber))
+                                       : blocks.back() + 1;
+        auto extents = disk_->allocateExtent(blocksNeeded - static_cast<uint32_t>(blocks.size()), hint);
+        if (extents.empty()) {
             return false;
         }
         
-        if (!inodeMgr_->addBlockToInode(dirInode, static_cast<uint32_t>(newBlock))) {
-            disk_->freeBlock(static_cast<uint32_t>(newBlock));
-            return false;
+        std::vector<uint32_t> newBlocks;
+        for (const auto& extent : extents) {
+            for (uint32_t i = 0; i < extent.length; ++i) {
+                newBlocks.push_back(extent.start + i);
+            }
         }
         
-        blocks.push_back(static_cast<uint32_t>(newBlock));
+        for (size_t i = 0; i < newBlocks.size(); ++i) {
+            if (!inodeMgr_->addBlockToInode(dirInode, newBlocks[i])) {
+                for (size_t j = i; j < newBlocks.size(); ++j) {
+                    disk_->freeBlock(newBlocks[j]);
+                }
+                return false;
+            }
+            blocks.push_back(newBlocks[i]);
+        }
     }
     
     // Write entries to blocks
-    std::vector<uint8_t> buffer(BLOCK_SIZE, 0);
+    BlockBuffer buffer;
     size_t entryIndex = 0;
     
     // Write blocks with entries
     for (size_t blockIdx = 0; blockIdx < blocksNeeded && blockIdx < blocks.size(); ++blockIdx) {
-        buffer.assign(BLOCK_SIZE, 0);  // Zero the entire block
+        buffer.zero();  // Zero the entire block
         
         for (uint32_t i = 0; i < entriesPerBlock && entryIndex < entries.size(); ++i) {
             memcpy(buffer.data() + (i * DIR_ENTRY_SIZE), &entries[entryIndex], sizeof(DirectoryEntry));
             entryIndex++;
         }
         
-        if (!disk_->writeBlock(blocks[blockIdx], buffer.data())) {
+        if (!disk_->writeMetadataBlock(blocks[blockIdx], buffer.data())) {
             return false;
         }
     }
@@ -280,8 +491,8 @@ bool DirectoryManager::writeDirectoryEntries(Inode& dirInode, const std::vector<
     // IMPORTANT: Zero out any remaining blocks that are no longer needed
     // This fixes the bug where deleted entries persist on refresh
     for (size_t blockIdx = blocksNeeded; blockIdx < blocks.size(); ++blockIdx) {
-        buffer.assign(BLOCK_SIZE, 0);
-        if (!disk_->writeBlock(blocks[blockIdx], buffer.data())) {
+        buffer.zero();
+        if (!disk_->writeMetadataBlock(blocks[blockIdx], buffer.data())) {
             return false;
         }
     }
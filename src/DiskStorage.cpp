@@ -0,0 +1,313 @@
+#include "DiskStorage.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace FileSystemTool {
+
+namespace {
+
+#ifdef __linux__
+bool punchHole(int fd, uint64_t offset, uint64_t length) {
+    return ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                       static_cast<off_t>(offset), static_cast<off_t>(length)) == 0;
+}
+#endif
+
+} // namespace
+
+std::unique_ptr<DiskStorage> makeDiskStorage(DiskBackend backend) {
+#ifndef _WIN32
+    if (backend == DiskBackend::MMAP) {
+        return std::make_unique<MmapStorage>();
+    }
+#else
+    if (backend == DiskBackend::MMAP) {
+        std::cerr << "mmap backend not available on this platform, using stream" << std::endl;
+    }
+#endif
+    return std::make_unique<StreamStorage>();
+}
+
+// StreamStorage
+
+#ifndef _WIN32
+
+StreamStorage::StreamStorage() : fd_(-1) {}
+
+StreamStorage::~StreamStorage() {
+    close();
+}
+
+bool StreamStorage::create(const std::string& path, uint64_t sizeInBytes) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    // Extend to full size without writing data (sparse where supported)
+    if (::ftruncate(fd_, static_cast<off_t>(sizeInBytes)) != 0) {
+        std::cerr << "Failed to size disk file: " << strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool StreamStorage::open(const std::string& path) {
+    fd_ = ::open(path.c_str(), O_RDWR);
+    return fd_ >= 0;
+}
+
+void StreamStorage::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool StreamStorage::isOpen() const {
+    return fd_ >= 0;
+}
+
+bool StreamStorage::read(uint64_t offset, void* buffer, size_t length) {
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    while (length > 0) {
+        ssize_t n = ::pread(fd_, out, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;  // Error, or a read past the end of the image
+        }
+        out += n;
+        offset += static_cast<uint64_t>(n);
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool StreamStorage::write(uint64_t offset, const void* buffer, size_t length) {
+    const uint8_t* in = static_cast<const uint8_t*>(buffer);
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd_, in, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        in += n;
+        offset += static_cast<uint64_t>(n);
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool StreamStorage::sync() {
+    if (fd_ < 0) {
+        return false;
+    }
+    
+    // Writes go straight to the kernel; the journal's barrier needs them on stable storage
+#ifdef __APPLE__
+    int rc = ::fsync(fd_);
+#else
+    int rc = ::fdatasync(fd_);
+#endif
+    if (rc != 0) {
+        std::cerr << "Failed to sync disk file: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+bool StreamStorage::discard(uint64_t offset, uint64_t length) {
+    return fd_ >= 0 && punchHole(fd_, offset, length);
+}
+#else
+bool StreamStorage::discard(uint64_t /*offset*/, uint64_t /*length*/) {
+    return false;
+}
+#endif
+
+#else // _WIN32
+
+StreamStorage::StreamStorage() {}
+
+StreamStorage::~StreamStorage() {
+    close();
+}
+
+bool StreamStorage::create(const std::string& path, uint64_t sizeInBytes) {
+    file_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        return false;
+    }
+    file_.close();
+
+    // Extend to full size without writing data (sparse where supported)
+    std::error_code ec;
+    std::filesystem::resize_file(path, sizeInBytes, ec);
+    if (ec) {
+        std::cerr << "Failed to size disk file: " << ec.message() << std::endl;
+        return false;
+    }
+
+    return open(path);
+}
+
+bool StreamStorage::open(const std::string& path) {
+    file_.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    return file_.is_open();
+}
+
+void StreamStorage::close() {
+    if (file_.is_open()) {
+        file_.flush();
+        file_.close();
+    }
+}
+
+bool StreamStorage::isOpen() const {
+    return file_.is_open();
+}
+
+bool StreamStorage::read(uint64_t offset, void* buffer, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    file_.read(reinterpret_cast<char*>(buffer), length);
+    return file_.good();
+}
+
+bool StreamStorage::write(uint64_t offset, const void* buffer, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+    file_.write(reinterpret_cast<const char*>(buffer), length);
+    return file_.good();
+}
+
+bool StreamStorage::sync() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.flush();
+    return file_.good();
+}
+
+bool StreamStorage::discard(uint64_t /*offset*/, uint64_t /*length*/) {
+    return false;
+}
+
+#endif // _WIN32
+
+#ifndef _WIN32
+// MmapStorage
+
+MmapStorage::MmapStorage() : fd_(-1), data_(nullptr), size_(0) {}
+
+MmapStorage::~MmapStorage() {
+    close();
+}
+
+bool MmapStorage::create(const std::string& path, uint64_t sizeInBytes) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    // ftruncate leaves the file sparse; blocks are materialized on first write
+    if (::ftruncate(fd_, static_cast<off_t>(sizeInBytes)) != 0) {
+        std::cerr << "ftruncate failed: " << strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    return mapFile();
+}
+
+bool MmapStorage::open(const std::string& path) {
+    fd_ = ::open(path.c_str(), O_RDWR);
+    if (fd_ < 0) {
+        return false;
+    }
+    return mapFile();
+}
+
+void MmapStorage::close() {
+    if (data_) {
+        ::msync(data_, size_, MS_SYNC);
+        ::munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool MmapStorage::read(uint64_t offset, void* buffer, size_t length) {
+    if (!data_ || offset + length > size_) {
+        return false;
+    }
+    memcpy(buffer, data_ + offset, length);
+    return true;
+}
+
+bool MmapStorage::write(uint64_t offset, const void* buffer, size_t length) {
+    if (!data_ || offset + length > size_) {
+        return false;
+    }
+    memcpy(data_ + offset, buffer, length);
+    return true;
+}
+
+bool MmapStorage::sync() {
+    if (!data_) {
+        return false;
+    }
+    return ::msync(data_, size_, MS_SYNC) == 0;
+}
+
+bool MmapStorage::discard(uint64_t offset, uint64_t length) {
+    if (!data_ || offset + length > size_) {
+        return false;
+    }
+#ifdef __linux__
+    // Shared mappings see the hole immediately
+    return punchHole(fd_, offset, length);
+#else
+    return false;
+#endif
+}
+
+bool MmapStorage::mapFile() {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0 || st.st_size <= 0) {
+        close();
+        return false;
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    void* mapped = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "mmap failed: " << strerror(errno) << std::endl;
+        size_ = 0;
+        close();
+        return false;
+    }
+
+    data_ = static_cast<uint8_t*>(mapped);
+    return true;
+}
+#endif
+
+} // namespace FileSystemTool
@@ -7,6 +7,8 @@
 #include <QLabel>
 #include <QFrame>
 #include <QSet>
+#include <algorithm>
+#include <unordered_map>
 
 namespace FileSystemTool {
 
@@ -23,12 +25,44 @@ void FileBrowserWidget::setFileSystem(FileSystem* fs) {
 void FileBrowserWidget::refresh() {
     if (!fileSystem_ || !fileSystem_->isMounted()) {
         fileTable_->setRowCount(0);
+        rows_.clear();
         return;
     }
     
     loadDirectory(currentPath_);
 }
 
+void FileBrowserWidget::applyChanges(const ChangeSet& changes) {
+    if (changes.reset || changes.allInodes || !fileSystem_ || !fileSystem_->isMounted()) {
+        refresh();
+        return;
+    }
+    
+    // Creating, writing and deleting a file all write its inode, so with no
+    // inode written the listing and every row still hold
+    if (changes.inodes.empty()) {
+        return;
+    }
+    
+    auto entries = fileSystem_->listDir(currentPath_.toStdString());
+    bool sameEntries = entries.size() == rows_.size();
+    for (size_t i = 0; sameEntries && i < entries.size(); ++i) {
+        sameEntries = entries[i].inodeNumber == rows_[i].inodeNum &&
+                      QString::fromStdString(entries[i].getName()) == rows_[i].name;
+    }
+    if (!sameEntries) {
+        populateTable(entries, &changes.inodes);
+        return;
+    }
+    
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (std::binary_search(changes.inodes.begin(), changes.inodes.end(), entries[i].inodeNumber)) {
+            rows_[i] = describeEntry(entries[i]);
+            setRow(static_cast<int>(i), rows_[i]);
+        }
+    }
+}
+
 void FileBrowserWidget::navigateToPath(const QString& path) {
     loadDirectory(path);
 }
@@ -110,100 +144,62 @@ void FileBrowserWidget::loadDirectory(const QString& path) {
     populateTable(entries);
 }
 
-uint32_t FileBrowserWidget::calculateFragments(const std::string& path) {
-    if (!fileSystem_) return 0;
-    
-    // Get inode for the file
-    Inode inode;
-    if (!fileSystem_->getFileInfo(path, inode)) {
-        return 0;
-    }
-    
-    if (inode.fileSize == 0) return 0;
-    
-    // Collect all ALLOCATED block numbers (skip -1 and 0)
-    std::vector<uint32_t> blocks;
-    
-    const auto& sb = fileSystem_->getDisk()->getSuperblock();
-    
-    // Add direct blocks - ONLY if they're valid (not -1, not 0, within range)
-    for (int i = 0; i < 12; ++i) {
-        if (inode.directBlocks[i] > 0 &&
-            inode.directBlocks[i] != -1 &&
-            inode.directBlocks[i] < (int32_t)sb.totalBlocks) {
-            blocks.push_back(static_cast<uint32_t>(inode.directBlocks[i]));
+void FileBrowserWidget::populateTable(const std::vector<DirectoryEntry>& entries,
+                                      const std::vector<uint32_t>* changed) {
+    std::unordered_map<uint32_t, size_t> oldRows;
+    if (changed) {
+        for (size_t i = 0; i < rows_.size(); ++i) {
+            oldRows[rows_[i].inodeNum] = i;
         }
     }
     
-    // Add indirect blocks if valid
-    if (inode.indirectBlock > 0 &&
-        inode.indirectBlock != -1 &&
-        inode.indirectBlock < (int32_t)sb.totalBlocks) {
-        // Would need to read indirect block here for complete accuracy
-        // For now, we'll just use direct blocks
+    std::vector<FileInfo> rows;
+    rows.reserve(entries.size());
+    for (const auto& entry : entries) {
+        auto it = oldRows.find(entry.inodeNumber);
+        bool reuse = it != oldRows.end() &&
+                     rows_[it->second].name == QString::fromStdString(entry.getName()) &&
+                     !std::binary_search(changed->begin(), changed->end(), entry.inodeNumber);
+        rows.push_back(reuse ? rows_[it->second] : describeEntry(entry));
     }
+    rows_ = std::move(rows);
     
-    if (blocks.empty()) return 0;
-    if (blocks.size() == 1) return 1;  // Single block = 1 fragment (perfect)
-    
-    // Sort blocks to find contiguous sequences
-    std::sort(blocks.begin(), blocks.end());
-    
-    // Count fragments (number of non-contiguous sequences)
-    int fragments = 1;  // Start with 1 fragment
-    for (size_t i = 1; i < blocks.size(); ++i) {
-        if (blocks[i] != blocks[i-1] + 1) {
-            fragments++;  // Non-contiguous = new fragment
-        }
+    fileTable_->setRowCount(0); // Clear existing rows
+    fileTable_->setRowCount(rows_.size());
+    for (size_t i = 0; i < rows_.size(); ++i) {
+        setRow(static_cast<int>(i), rows_[i]);
     }
-    
-    return fragments;
 }
 
-void FileBrowserWidget::populateTable(const std::vector<DirectoryEntry>& entries) {
-    fileTable_->setRowCount(0); // Clear existing rows
-    fileTable_->setRowCount(entries.size());
+FileInfo FileBrowserWidget::describeEntry(const DirectoryEntry& entry) {
+    FileInfo info;
+    info.name = QString::fromStdString(entry.getName());
+    info.isDirectory = entry.fileType == static_cast<uint8_t>(FileType::DIRECTORY);
+    info.type = info.isDirectory ? "Directory" : "File";
+    info.inodeNum = entry.inodeNumber;
+    info.size = 0;
+    info.fragmentCount = -1;  // Shown as "-"
     
-    for (size_t i = 0; i < entries.size(); ++i) {
-        const auto& entry = entries[i];
-        
-        // Name
-        QTableWidgetItem* nameItem = new QTableWidgetItem(
-            QString::fromStdString(entry.getName()));
-        fileTable_->setItem(i, COL_NAME, nameItem);
-        
-        // Type
-        QString type = (entry.fileType == static_cast<uint8_t>(FileType::DIRECTORY)) ? 
-                       "Directory" : "File";
-        QTableWidgetItem* typeItem = new QTableWidgetItem(type);
-        fileTable_->setItem(i, COL_TYPE, typeItem);
-        
-        // Size
-        Inode inode;
-        if (fileSystem_->getInodeManager()->readInode(entry.inodeNumber, inode)) {
-            QTableWidgetItem* sizeItem = new QTableWidgetItem(
-                QString::number(inode.fileSize));
-            fileTable_->setItem(i, COL_SIZE, sizeItem);
-        }
+    Inode inode;
+    if (fileSystem_->getInodeManager()->readInode(entry.inodeNumber, inode)) {
+        info.size = inode.fileSize;
         
-        // Fragments - calculate for files
-        QString fragStr = "-";
+        // Kept per inode by InodeManager (file order, indirect-mapped blocks included)
         if (entry.fileType == static_cast<uint8_t>(FileType::REGULAR_FILE)) {
-            std::string fullPath = currentPath_.toStdString();
-            if (!fullPath.empty() && fullPath.back() != '/') fullPath += "/";
-            fullPath += entry.getName();
-            
-            uint32_t frags = calculateFragments(fullPath);
-            fragStr = QString::number(frags);
+            info.fragmentCount = inode.fileSize == 0 ? 0 :
+                static_cast<int>(fileSystem_->getInodeManager()->getFragmentCount(entry.inodeNumber));
         }
-        QTableWidgetItem* fragItem = new QTableWidgetItem(fragStr);
-        fileTable_->setItem(i, COL_FRAGMENTS, fragItem);
-        
-        // Inode
-        QTableWidgetItem* inodeItem = new QTableWidgetItem(
-            QString::number(entry.inodeNumber));
-        fileTable_->setItem(i, COL_INODE, inodeItem);
     }
+    return info;
+}
+
+void FileBrowserWidget::setRow(int row, const FileInfo& info) {
+    fileTable_->setItem(row, COL_NAME, new QTableWidgetItem(info.name));
+    fileTable_->setItem(row, COL_TYPE, new QTableWidgetItem(info.type));
+    fileTable_->setItem(row, COL_SIZE, new QTableWidgetItem(QString::number(info.size)));
+    QString fragStr = info.fragmentCount < 0 ? "-" : QString::number(info.fragmentCount);
+    fileTable_->setItem(row, COL_FRAGMENTS, new QTableWidgetItem(fragStr));
+    fileTable_->setItem(row, COL_INODE, new QTableWidgetItem(QString::number(info.inodeNum)));
 }
 
 void FileBrowserWidget::onTreeItemClicked(QTreeWidgetItem* item, int column) {
@@ -316,8 +312,7 @@ void FileBrowserWidget::onDeleteClicked() {
     } else if (failCount > 0) {
         QMessageBox::critical(this, "Error", "Failed to delete file");
     }
-    
-    refresh();
+    // The rows catch up through the refresh bus, which fileDeleted posts to
 }
 
 void FileBrowserWidget::onContextMenu(const QPoint& pos) {
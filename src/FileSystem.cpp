@@ -1,14 +1,25 @@
 #include "FileSystem.h"
+#include "BlockBuffer.h"
 #include <iostream>
 #include <cstring>
 #include <chrono>
 #include <algorithm>
+#include <map>
 #include <set>
+#include <thread>
 
 namespace FileSystemTool {
 
-FileSystem::FileSystem(const std::string& diskPath)
-    : diskPath_(diskPath), mounted_(false), hasCorruption_(false), activeWriteInodeNum_(UINT32_MAX) {
+namespace {
+
+constexpr uint32_t MAX_OWNER_SCAN_WORKERS = 8;
+
+} // namespace
+
+FileSystem::FileSystem(const std::string& diskPath, DiskBackend backend)
+    : diskPath_(diskPath), mounted_(false), uncleanMount_(false), cacheCapacity_(DEFAULT_CACHE_BLOCKS), backend_(backend),
+      freePolicy_(FreePolicy::DISCARD), inlineFiles_(true),
+      hasCorruption_(false), activeWriteInodeNum_(UINT32_MAX) {
     memset(&stats_, 0, sizeof(PerformanceStats));
 }
 
@@ -18,8 +29,40 @@ FileSystem::~FileSystem() {
     }
 }
 
+void FileSystem::initInodeLocks() {
+    inodeLocks_ = std::make_unique<std::shared_mutex[]>(disk_->getSuperblock().inodeCount);
+}
+
+void FileSystem::resetBlockOwners(uint32_t totalBlocks) {
+    // Atomics can't be copied, so the array is rebuilt rather than assigned
+    blockOwners_ = std::vector<std::atomic<uint32_t>>(totalBlocks);
+    for (auto& owner : blockOwners_) {
+        owner.store(UINT32_MAX, std::memory_order_relaxed);
+    }
+}
+
+template <typename Lock>
+int32_t FileSystem::lockPath(const std::string& path, Lock& lock) {
+    // Directories only change under the exclusive lock, but a file can be deleted
+    // and its inode reused between the lookup and the lock
+    int32_t inodeNum = dirMgr_->resolvePath(path, 0);
+    while (inodeNum >= 0) {
+        lock = Lock(inodeLocks_[inodeNum]);
+        int32_t current = dirMgr_->resolvePath(path, 0);
+        if (current == inodeNum) {
+            return inodeNum;
+        }
+        lock.unlock();
+        inodeNum = current;
+    }
+    return -1;
+}
+
 bool FileSystem::createFileSystem(uint32_t diskSize) {
-    disk_ = std::make_unique<VirtualDisk>(diskPath_);
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
+    disk_ = std::make_unique<VirtualDisk>(diskPath_, backend_, cacheCapacity_);
+    disk_->setFreePolicy(freePolicy_);
+    disk_->attachMetrics(&metrics_);
     
     if (!disk_->createDisk(diskSize)) {
         std::cerr << "Failed to create virtual disk" << std::endl;
@@ -28,6 +71,9 @@ bool FileSystem::createFileSystem(uint32_t diskSize) {
     
     // Create managers
     inodeMgr_ = std::make_unique<InodeManager>(disk_.get());
+    if (!inodeMgr_->loadInodeTable()) {
+        return false;
+    }
     dirMgr_ = std::make_unique<DirectoryManager>(disk_.get(), inodeMgr_.get());
     
     // Initialize root directory
@@ -36,7 +82,18 @@ bool FileSystem::createFileSystem(uint32_t diskSize) {
         return false;
     }
     
+    // From here on metadata writes are redo-logged
+    journal_ = std::make_unique<Journal>(disk_.get());
+    if (!journal_->initializeJournal()) {
+        std::cerr << "Failed to initialize journal" << std::endl;
+        return false;
+    }
+    disk_->attachJournal(journal_.get());
+    journal_->startCheckpointThread();
+    
     disk_->markClean();
+    resetBlockOwners(disk_->getSuperblock().totalBlocks);
+    initInodeLocks();
     mounted_ = true;
     
     std::cout << "File system created successfully" << std::endl;
@@ -44,48 +101,88 @@ bool FileSystem::createFileSystem(uint32_t diskSize) {
 }
 
 bool FileSystem::mountFileSystem() {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
     if (mounted_) {
         std::cerr << "File system already mounted" << std::endl;
         return false;
     }
     
-    disk_ = std::make_unique<VirtualDisk>(diskPath_);
+    disk_ = std::make_unique<VirtualDisk>(diskPath_, backend_, cacheCapacity_);
+    disk_->setFreePolicy(freePolicy_);
+    disk_->attachMetrics(&metrics_);
     
     if (!disk_->openDisk()) {
         std::cerr << "Failed to open virtual disk" << std::endl;
         return false;
     }
     
+    // Redo committed metadata before anything reads it
+    journal_ = std::make_unique<Journal>(disk_.get());
+    if (!journal_->openJournal()) {
+        std::cerr << "Failed to open journal" << std::endl;
+        disk_->closeDisk();
+        return false;
+    }
+    if (journal_->getReplayedBlockCount() > 0 && !disk_->readBitmap()) {
+        std::cerr << "Failed to reload bitmap after journal replay" << std::endl;
+        disk_->closeDisk();
+        return false;
+    }
+    
     // Create managers
     inodeMgr_ = std::make_unique<InodeManager>(disk_.get());
+    if (!inodeMgr_->loadInodeTable()) {
+        std::cerr << "Failed to load inode table" << std::endl;
+        disk_->closeDisk();
+        return false;
+    }
     dirMgr_ = std::make_unique<DirectoryManager>(disk_.get(), inodeMgr_.get());
     
-    // Check for unclean shutdown
-    if (!disk_->wasCleanShutdown()) {
+    disk_->attachJournal(journal_.get());
+    journal_->startCheckpointThread();
+    
+    // Check for unclean shutdown (metadata is consistent once the journal replayed;
+    // RecoveryManager::checkDirtyRegions verifies what the crash may have touched)
+    uncleanMount_ = !disk_->wasCleanShutdown();
+    if (uncleanMount_) {
         std::cout << "Warning: File system was not cleanly unmounted" << std::endl;
-        std::cout << "Recovery may be needed" << std::endl;
+        std::cout << "Journal replayed " << journal_->getReplayedBlockCount()
+                  << " metadata blocks; only dirty regions need checking" << std::endl;
     }
     
     disk_->markDirty();  // Mark as mounted
+    initInodeLocks();
     mounted_ = true;
     
-    // DO NOT rebuild block ownership - causes crashes from uninitialized blocks
+    rebuildBlockOwnership();
     
     std::cout << "File system mounted successfully" << std::endl;
     return true;
 }
 
 bool FileSystem::unmountFileSystem() {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) {
         return false;
     }
     
+    // Commit and checkpoint the journal, then flush cached blocks before the
+    // clean flag reaches the superblock
+    journal_->stopCheckpointThread();
+    disk_->flushBitmap();
+    journal_->flush();
+    journal_->checkpoint();
+    disk_->attachJournal(nullptr);
+    disk_->sync();
     disk_->markClean();
     disk_->closeDisk();
     
+    journal_.reset();
     disk_.reset();
     inodeMgr_.reset();
     dirMgr_.reset();
+    blockOwners_.clear();
+    inodeLocks_.reset();
     
     mounted_ = false;
     
@@ -93,73 +190,45 @@ bool FileSystem::unmountFileSystem() {
     return true;
 }
 
+bool FileSystem::sync() {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_) return false;
+    bool success = disk_->flushBitmap();
+    success = journal_->flush() && success;
+    return disk_->sync() && success;
+}
+
+void FileSystem::setCacheCapacity(size_t blocks) {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
+    cacheCapacity_ = blocks;
+    if (disk_) {
+        disk_->setCacheCapacity(blocks);
+    }
+}
+
+void FileSystem::setFreePolicy(FreePolicy policy) {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
+    freePolicy_ = policy;
+    if (disk_) {
+        disk_->setFreePolicy(policy);
+    }
+}
+
+void FileSystem::setInlineFiles(bool enabled) {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
+    inlineFiles_ = enabled;
+}
+
 double FileSystem::getFragmentationScore() {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return 0.0;
     
-    int totalFragments = 0;
-    int totalFiles = 0;
-    
-    const auto& sb = disk_->getSuperblock();
-    
-    // Iterate through all inodes
-    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
-        Inode inode;
-        if (!inodeMgr_->readInode(i, inode)) continue;
-        
-        if (!inode.isValid() || inode.fileType != FileType::REGULAR_FILE) continue;
-        if (inode.fileSize == 0) continue;
-        
-        totalFiles++;
-        
-        // Get blocks for this file
-        std::vector<uint32_t> blocks;
-        
-        // Collect direct blocks
-        for (int j = 0; j < 12; ++j) {
-            if (inode.directBlocks[j] > 0 &&
-                inode.directBlocks[j] < (int32_t)sb.totalBlocks) {
-                blocks.push_back(static_cast<uint32_t>(inode.directBlocks[j]));
-            }
-        }
-        
-        // Collect indirect blocks
-        if (inode.indirectBlock > 0 &&
-            inode.indirectBlock < (int32_t)sb.totalBlocks) {
-            std::vector<uint8_t> indirectData(BLOCK_SIZE);
-            if (disk_->readBlock(inode.indirectBlock, indirectData.data())) {
-                const int32_t* pointers = reinterpret_cast<const int32_t*>(indirectData.data());
-                int maxIndirect = BLOCK_SIZE / sizeof(int32_t);
-                
-                for (int j = 0; j < maxIndirect; ++j) {
-                    if (pointers[j] > 0 &&
-                        pointers[j] < (int32_t)sb.totalBlocks) {
-                        blocks.push_back(static_cast<uint32_t>(pointers[j]));
-                    }
-                }
-            }
-        }
-        
-        // Count fragments (number of non-contiguous sequences)
-        if (blocks.size() > 1) {
-            std::sort(blocks.begin(), blocks.end());
-            int fragments = 1;  // At least 1 fragment
-            
-            for (size_t j = 1; j < blocks.size(); ++j) {
-                if (blocks[j] != blocks[j-1] + 1) {
-                    fragments++;  // New fragment when blocks aren't contiguous
-                }
-            }
-            
-            totalFragments += fragments;
-        } else if (blocks.size() == 1) {
-            totalFragments += 1;  // Single block = 1 fragment
-        }
-    }
-    
-    if (totalFiles == 0) return 0.0;
+    // Counters are maintained by InodeManager::writeInode, so this is a constant-time read
+    FragmentCounts counts = inodeMgr_->getFragmentCounts();
+    if (counts.filesWithBlocks == 0) return 0.0;
     
     // Average fragments per file
-    double avgFragments = static_cast<double>(totalFragments) / totalFiles;
+    double avgFragments = static_cast<double>(counts.totalFragments) / counts.filesWithBlocks;
     
     // Fragmentation score: 0% = 1 fragment/file (perfect), 100% = highly fragmented
     // Score = (avgFragments - 1) * 20, capped at 100%
@@ -169,6 +238,8 @@ double FileSystem::getFragmentationScore() {
 }
 
 bool FileSystem::createFile(const std::string& path) {
+    ScopedLatency timer(&metrics_, MetricOp::CREATE);
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return false;
     
     // Split path into directory and filename
@@ -181,8 +252,9 @@ bool FileSystem::createFile(const std::string& path) {
         return false;
     }
     
-    // Resolve directory path
-    int32_t dirInode = dirMgr_->resolvePath(dirPath, 0);
+    // Resolve and lock the directory; the name check and the insert both happen under it
+    std::unique_lock<std::shared_mutex> dirLock;
+    int32_t dirInode = lockPath(dirPath, dirLock);
     if (dirInode < 0) {
         std::cerr << "Directory not found: " << dirPath << std::endl;
         return false;
@@ -194,18 +266,32 @@ bool FileSystem::createFile(const std::string& path) {
         return false;
     }
     
-    // Allocate inode for file
-    int32_t fileInode = inodeMgr_->allocateInode(FileType::REGULAR_FILE);
+    // Allocate inode for file, in its directory's block group
+    int32_t fileInode = inodeMgr_->allocateInode(FileType::REGULAR_FILE,
+                                                 disk_->groupOfInode(static_cast<uint32_t>(dirInode)));
     if (fileInode < 0) {
         return false;
     }
     
+    uint32_t txId = journal_->beginTransaction(JournalOp::CREATE_FILE, static_cast<uint32_t>(fileInode), filename);
+    
     // Add to directory
-    return dirMgr_->addEntry(static_cast<uint32_t>(dirInode), filename, 
-                            static_cast<uint32_t>(fileInode), FileType::REGULAR_FILE);
+    if (!dirMgr_->addEntry(static_cast<uint32_t>(dirInode), filename, 
+                           static_cast<uint32_t>(fileInode), FileType::REGULAR_FILE)) {
+        if (txId) journal_->abortTransaction(txId);
+        return false;
+    }
+    
+    // Persist bitmap blocks touched by a new directory block
+    if (!disk_->flushBitmap()) {
+        return false;
+    }
+    return !txId || journal_->commitTransaction(txId);
 }
 
 bool FileSystem::deleteFile(const std::string& path) {
+    ScopedLatency timer(&metrics_, MetricOp::REMOVE);
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return false;
     
     // Split path
@@ -213,8 +299,9 @@ bool FileSystem::deleteFile(const std::string& path) {
     std::string dirPath = (lastSlash != std::string::npos) ? path.substr(0, lastSlash) : "/";
     std::string filename = (lastSlash != std::string::npos) ? path.substr(lastSlash + 1) : path;
     
-    // Resolve directory
-    int32_t dirInode = dirMgr_->resolvePath(dirPath, 0);
+    // Resolve and lock the directory, then the file
+    std::unique_lock<std::shared_mutex> dirLock;
+    int32_t dirInode = lockPath(dirPath, dirLock);
     if (dirInode < 0) {
         return false;
     }
@@ -225,29 +312,336 @@ bool FileSystem::deleteFile(const std::string& path) {
         std::cerr << "File not found: " << path << std::endl;
         return false;
     }
+    std::unique_lock<std::shared_mutex> fileLock(inodeLocks_[fileInode]);
+    
+    uint32_t txId = journal_->beginTransaction(JournalOp::DELETE_FILE, static_cast<uint32_t>(fileInode), filename);
+    
+    // Blocks leave the owner map with the inode
+    Inode inode;
+    if (inodeMgr_->readInode(static_cast<uint32_t>(fileInode), inode)) {
+        for (uint32_t blockNum : inodeMgr_->getInodeBlocks(inode)) clearBlockOwner(blockNum);
+        for (uint32_t blockNum : inodeMgr_->getMetadataBlocks(inode)) clearBlockOwner(blockNum);
+    }
     
     // Free inode (and its blocks)
     if (!inodeMgr_->freeInode(static_cast<uint32_t>(fileInode))) {
+        if (txId) journal_->abortTransaction(txId);
         return false;
     }
     
     // Remove from directory
-    return dirMgr_->removeEntry(static_cast<uint32_t>(dirInode), filename);
+    if (!dirMgr_->removeEntry(static_cast<uint32_t>(dirInode), filename)) {
+        return false;  // Left open: recovery sees the half-finished delete
+    }
+    
+    // Frees reach the bitmap only after the inode is cleared (a crash leaks, never double-allocates)
+    if (!disk_->flushBitmap()) {
+        return false;
+    }
+    return !txId || journal_->commitTransaction(txId);
 }
 
 bool FileSystem::readFile(const std::string& path, std::vector<uint8_t>& data) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_) return false;
+    
+    std::shared_lock<std::shared_mutex> inodeLock;
+    int32_t inodeNum = lockPath(path, inodeLock);
+    FileHandle handle;
+    if (!loadHandle(inodeNum, path, handle)) {
+        return false;
+    }
+    
+    // Read straight into the caller's vector
+    data.resize(handle.inode.fileSize);
+    int64_t bytesRead = readLocked(handle, 0, data.data(), data.size());
+    closeFile(handle);
+    
+    if (bytesRead < 0) {
+        data.clear();
+        return false;
+    }
+    data.resize(static_cast<size_t>(bytesRead));
+    return true;
+}
+
+bool FileSystem::writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return false;
     
+    std::unique_lock<std::shared_mutex> inodeLock;
+    int32_t inodeNum = lockPath(path, inodeLock);
+    FileHandle handle;
+    if (!loadHandle(inodeNum, path, handle)) {
+        return false;
+    }
+    
+    // Overwrite in place, then drop anything past the new end. New contents that
+    // fit the inode replace the old blocks instead.
+    bool success;
+    if (inlineFiles_ && data.size() <= INLINE_DATA_SIZE && !handle.blockMap.empty()) {
+        success = truncateLocked(handle, 0) &&
+                  writeLocked(handle, 0, data.data(), data.size()) == static_cast<int64_t>(data.size());
+    } else {
+        success = writeLocked(handle, 0, data.data(), data.size()) == static_cast<int64_t>(data.size()) &&
+                  truncateLocked(handle, data.size());
+    }
+    closeFile(handle);
+    return success;
+}
+
+bool FileSystem::writeBatch(const std::vector<BatchFile>& files) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_) return false;
+    if (files.empty()) return true;
+    
     auto start = std::chrono::high_resolution_clock::now();
     
-    // Resolve file path
-    int32_t inodeNum = dirMgr_->resolvePath(path, 0);
+    struct NewFile {
+        const BatchFile* source;
+        uint32_t dirInode;
+        std::string name;
+        uint32_t dataBlocks;
+        uint32_t metaBlocks;
+        bool inlined;  // Data goes into the inode
+    };
+    
+    // Each directory is resolved once and locked once, in ascending inode order
+    std::map<std::string, int32_t> dirInodes;
+    std::set<uint32_t> dirSet;
+    for (const auto& file : files) {
+        size_t lastSlash = file.path.find_last_of('/');
+        std::string dirPath = (lastSlash != std::string::npos) ? file.path.substr(0, lastSlash) : "/";
+        if (!dirInodes.count(dirPath)) {
+            int32_t dirInode = dirMgr_->resolvePath(dirPath, 0);
+            dirInodes.emplace(dirPath, dirInode);
+            if (dirInode >= 0) {
+                dirSet.insert(static_cast<uint32_t>(dirInode));
+            }
+        }
+    }
+    std::vector<std::unique_lock<std::shared_mutex>> dirLocks;
+    for (uint32_t dirInode : dirSet) {
+        dirLocks.emplace_back(inodeLocks_[dirInode]);
+    }
+    
+    // Validate everything before touching the disk
+    std::set<std::pair<uint32_t, std::string>> seen;
+    std::vector<NewFile> created;
+    std::vector<const BatchFile*> existing;
+    uint64_t totalBlocks = 0;
+    uint64_t totalBytes = 0;
+    
+    for (const auto& file : files) {
+        size_t lastSlash = file.path.find_last_of('/');
+        std::string dirPath = (lastSlash != std::string::npos) ? file.path.substr(0, lastSlash) : "/";
+        std::string filename = (lastSlash != std::string::npos) ? file.path.substr(lastSlash + 1) : file.path;
+        if (filename.empty()) {
+            std::cerr << "Invalid filename: " << file.path << std::endl;
+            return false;
+        }
+        
+        auto dir = dirInodes.find(dirPath);
+        if (dir->second < 0) {
+            std::cerr << "Directory not found: " << dirPath << std::endl;
+            return false;
+        }
+        
+        uint32_t dirInode = static_cast<uint32_t>(dir->second);
+        std::string storedName = DirectoryEntry(0, filename, FileType::REGULAR_FILE).getName();
+        if (!seen.emplace(dirInode, storedName).second) {
+            std::cerr << "Duplicate path in batch: " << file.path << std::endl;
+            return false;
+        }
+        
+        if (dirMgr_->lookupEntry(dirInode, storedName) >= 0) {
+            existing.push_back(&file);
+            continue;
+        }
+        totalBytes += file.data.size();
+        
+        bool inlined = inlineFiles_ && file.data.size() <= INLINE_DATA_SIZE;
+        uint64_t dataBlocks = inlined ? 0 : (file.data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (dataBlocks > MAX_FILE_BLOCKS) {
+            std::cerr << "File too large: " << file.path << std::endl;
+            return false;
+        }
+        uint32_t metaBlocks = InodeManager::metadataBlocksFor(dataBlocks);
+        created.push_back({&file, dirInode, storedName, static_cast<uint32_t>(dataBlocks), metaBlocks, inlined});
+        totalBlocks += dataBlocks + metaBlocks;
+    }
+    
+    if (totalBlocks > disk_->getFreeBlocks()) {
+        std::cerr << "Not enough free blocks for batch of " << totalBlocks << std::endl;
+        return false;
+    }
+    
+    // The batch is placed as a unit, in the block group of the first new file's directory
+    uint32_t group = created.empty() ? 0 : disk_->groupOfInode(created.front().dirInode);
+    std::vector<uint32_t> inodeNums;
+    if (!inodeMgr_->allocateInodes(FileType::REGULAR_FILE, static_cast<uint32_t>(created.size()), inodeNums, group)) {
+        return false;
+    }
+    
+    uint32_t txId = journal_->beginTransaction(JournalOp::WRITE_BATCH, inodeNums.empty() ? 0 : inodeNums.front(),
+                                               files.front().path);
+    std::vector<Extent> extents;
+    std::vector<std::pair<uint32_t, std::string>> linked;  // Entries that may already be in a directory
+    
+    // Undo the batch in unlink order: entries, then inodes, then every block it
+    // claimed. The inodes are cleared without freeInode so each block is freed
+    // exactly once, here, while the batch still owns it.
+    auto fail = [&]() {
+        for (const auto& entry : linked) {
+            dirMgr_->removeEntry(entry.first, entry.second);
+        }
+        for (uint32_t inodeNum : inodeNums) {
+            inodeMgr_->writeInode(inodeNum, Inode());
+        }
+        for (const Extent& extent : extents) {
+            for (uint32_t b = 0; b < extent.length; ++b) {
+                clearBlockOwner(extent.start + b);  // Before the free, so a new owner is never cleared
+                disk_->freeBlock(extent.start + b);
+            }
+        }
+        disk_->flushBitmap();
+        if (txId) journal_->abortTransaction(txId);
+        return false;
+    };
+    
+    // One extent request for the whole batch; each file takes its data blocks
+    // followed by its pointer blocks, so the layout is back to back
+    if (totalBlocks > 0) {
+        extents = disk_->allocateExtent(static_cast<uint32_t>(totalBlocks), disk_->allocationGoal(group));
+        if (extents.empty()) {
+            return fail();
+        }
+    }
+    
+    size_t extentIndex = 0;
+    uint32_t extentOffset = 0;
+    auto take = [&](uint32_t count, std::vector<uint32_t>& out) {
+        out.clear();
+        while (out.size() < count) {
+            const Extent& extent = extents[extentIndex];
+            out.push_back(extent.start + extentOffset);
+            if (++extentOffset == extent.length) {
+                extentIndex++;
+                extentOffset = 0;
+            }
+        }
+    };
+    
+    struct DataWrite {
+        uint32_t block;
+        const uint8_t* source;
+        size_t length;  // Short for the last block of a file
+        bool operator<(const DataWrite& other) const { return block < other.block; }
+    };
+    
+    std::vector<Inode> inodes(created.size());
+    std::vector<DataWrite> dataWrites;
+    std::vector<uint32_t> dataBlocks, metaBlocks;
+    for (size_t i = 0; i < created.size(); ++i) {
+        const NewFile& file = created[i];
+        const std::vector<uint8_t>& data = file.source->data;
+        Inode& inode = inodes[i];
+        if (!inodeMgr_->readInode(inodeNums[i], inode)) {
+            return fail();
+        }
+        
+        take(file.dataBlocks, dataBlocks);
+        take(file.metaBlocks, metaBlocks);
+        for (uint32_t blockNum : dataBlocks) setBlockOwner(blockNum, inodeNums[i]);
+        for (uint32_t blockNum : metaBlocks) setBlockOwner(blockNum, inodeNums[i]);
+        
+        if (file.inlined && !data.empty()) {
+            inode.setInlineData(data.data(), data.size());
+        }
+        if (!dataBlocks.empty() && !inodeMgr_->setBlockPointers(inode, 0, dataBlocks, metaBlocks)) {
+            return fail();
+        }
+        for (uint32_t b = 0; b < file.dataBlocks; ++b) {
+            size_t offset = static_cast<size_t>(b) * BLOCK_SIZE;
+            dataWrites.push_back({dataBlocks[b], data.data() + offset, std::min<size_t>(BLOCK_SIZE, data.size() - offset)});
+        }
+        inode.fileSize = static_cast<uint32_t>(data.size());
+    }
+    
+    // Data in ascending block order; the last block of a file is zero-padded
+    std::sort(dataWrites.begin(), dataWrites.end());
+    BlockBuffer tail;
+    for (const auto& write : dataWrites) {
+        const uint8_t* block = write.source;
+        if (write.length < BLOCK_SIZE) {
+            tail.zero();
+            memcpy(tail.data(), write.source, write.length);
+            block = tail.data();
+        }
+        if (!disk_->writeBlock(write.block, block)) {
+            return fail();
+        }
+    }
+    
+    // Persist allocations before the inodes point at the blocks
+    if (!disk_->flushBitmap()) {
+        return fail();
+    }
+    for (size_t i = 0; i < created.size(); ++i) {
+        if (!inodeMgr_->writeInode(inodeNums[i], inodes[i])) {
+            return fail();
+        }
+    }
+    
+    // One directory update per parent
+    std::map<uint32_t, std::vector<DirectoryEntry>> newEntries;
+    for (size_t i = 0; i < created.size(); ++i) {
+        newEntries[created[i].dirInode].emplace_back(inodeNums[i], created[i].name, FileType::REGULAR_FILE);
+    }
+    for (const auto& dir : newEntries) {
+        for (const auto& entry : dir.second) {
+            linked.emplace_back(dir.first, entry.getName());
+        }
+        if (!dirMgr_->addEntries(dir.first, dir.second)) {
+            return fail();
+        }
+    }
+    
+    // Blocks the directories grew by
+    if (!disk_->flushBitmap()) {
+        return fail();
+    }
+    if (txId && !journal_->commitTransaction(txId)) {
+        return false;
+    }
+    
+    auto end = std::chrono::high_resolution_clock::now();
+    updateStats(false, std::chrono::duration<double, std::milli>(end - start).count(), totalBytes);  // New files only
+    
+    // Files that already existed are overwritten afterwards, each in its own transaction
+    for (const BatchFile* file : existing) {
+        if (!writeFile(file->path, file->data)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileSystem::openFile(const std::string& path, FileHandle& handle) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_) return false;
+    
+    std::shared_lock<std::shared_mutex> inodeLock;
+    int32_t inodeNum = lockPath(path, inodeLock);
+    return loadHandle(inodeNum, path, handle);
+}
+
+bool FileSystem::loadHandle(int32_t inodeNum, const std::string& path, FileHandle& handle) {
     if (inodeNum < 0) {
         std::cerr << "File not found: " << path << std::endl;
         return false;
     }
     
-    // Read inode
     Inode inode;
     if (!inodeMgr_->readInode(static_cast<uint32_t>(inodeNum), inode)) {
         return false;
@@ -258,82 +652,325 @@ bool FileSystem::readFile(const std::string& path, std::vector<uint8_t>& data) {
         return false;
     }
     
-    // Read file data
-    bool result = readFileData(inode, data);
+    handle.inodeNumber = static_cast<uint32_t>(inodeNum);
+    handle.generation = inodeMgr_->getGeneration(handle.inodeNumber);
+    handle.inode = inode;
+    handle.path = path;
+    handle.isOpen = true;
+    handle.blockMap = inodeMgr_->getInodeBlocks(inode);  // Resolved once, kept in sync by write/truncate
+    return true;
+}
+
+bool FileSystem::refreshHandle(FileHandle& handle) {
+    // Another writer, a truncate or a defrag move may have repointed the inode;
+    // the handle's copies would write to blocks it no longer owns
+    if (inodeMgr_->getGeneration(handle.inodeNumber) == handle.generation) {
+        return true;
+    }
+    if (!loadHandle(static_cast<int32_t>(handle.inodeNumber), handle.path, handle)) {
+        closeFile(handle);
+        return false;
+    }
+    return true;
+}
+
+bool FileSystem::finishHandleUpdate(FileHandle& handle, bool success) {
+    // Still under the exclusive inode lock, so every change since refreshHandle was ours
+    if (success) {
+        handle.generation = inodeMgr_->getGeneration(handle.inodeNumber);
+        return true;
+    }
+    
+    // A failed update can leave the copies ahead of the inode on disk
+    if (!loadHandle(static_cast<int32_t>(handle.inodeNumber), handle.path, handle)) {
+        closeFile(handle);
+    }
+    return false;
+}
+
+void FileSystem::closeFile(FileHandle& handle) {
+    handle.isOpen = false;
+    handle.blockMap.clear();
+}
+
+int64_t FileSystem::read(FileHandle& handle, uint64_t offset, uint8_t* buffer, size_t length) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_ || !handle.isOpen) return -1;
+    
+    std::shared_lock<std::shared_mutex> inodeLock(inodeLocks_[handle.inodeNumber]);
+    if (!refreshHandle(handle)) return -1;
+    return readLocked(handle, offset, buffer, length);
+}
+
+int64_t FileSystem::readLocked(FileHandle& handle, uint64_t offset, uint8_t* buffer, size_t length) {
+    auto start = std::chrono::high_resolution_clock::now();
+    
+    const Inode& inode = handle.inode;
+    if (offset >= inode.fileSize || length == 0) {
+        return 0;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, inode.fileSize - offset));
+    
+    size_t done = 0;
+    if (inode.hasInlineData() && offset < INLINE_DATA_SIZE) {
+        // Already in the handle: no block reads
+        done = std::min<size_t>(length, INLINE_DATA_SIZE - offset);
+        memcpy(buffer, inode.inlineData() + offset, done);
+    }
+    
+    const auto& blocks = handle.blockMap;  // Empty for inline data
+    BlockBuffer blockBuffer(0);  // Taken only for a partial block
+    
+    while (done < length) {
+        uint64_t pos = offset + done;
+        uint32_t blockIndex = static_cast<uint32_t>(pos / BLOCK_SIZE);
+        uint32_t blockOffset = static_cast<uint32_t>(pos % BLOCK_SIZE);
+        size_t chunk = std::min<size_t>(BLOCK_SIZE - blockOffset, length - done);
+        
+        if (blockIndex >= blocks.size()) {
+            break;  // Size claims more than the inode maps
+        }
+        
+        if (chunk == BLOCK_SIZE) {
+            // Whole blocks: every one up to the last full block in one submission,
+            // straight into the caller's buffer
+            uint32_t run = static_cast<uint32_t>(std::min<size_t>((length - done) / BLOCK_SIZE,
+                                                                  blocks.size() - blockIndex));
+            if (!disk_->readBlocks(&blocks[blockIndex], run, buffer + done)) {
+                return -1;
+            }
+            chunk = static_cast<size_t>(run) * BLOCK_SIZE;
+        } else {
+            if (!blockBuffer.data()) {
+                blockBuffer = BlockBuffer();
+            }
+            if (!disk_->readBlock(blocks[blockIndex], blockBuffer.data())) {
+                return -1;
+            }
+            memcpy(buffer + done, blockBuffer.data() + blockOffset, chunk);
+        }
+        done += chunk;
+    }
     
     auto end = std::chrono::high_resolution_clock::now();
     double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
-    updateStats(true, elapsed, data.size());
+    updateStats(true, elapsed, done);
     
-    return result;
+    return static_cast<int64_t>(done);
 }
 
-bool FileSystem::writeFile(const std::string& path, const std::vector<uint8_t>& data) {
-    if (!mounted_) return false;
+int64_t FileSystem::read(const std::string& path, uint64_t offset, uint8_t* buffer, size_t length) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_) return -1;
+    
+    std::shared_lock<std::shared_mutex> inodeLock;
+    int32_t inodeNum = lockPath(path, inodeLock);
+    FileHandle handle;
+    if (!loadHandle(inodeNum, path, handle)) {
+        return -1;
+    }
     
+    int64_t result = readLocked(handle, offset, buffer, length);
+    closeFile(handle);
+    return result;
+}
+
+int64_t FileSystem::write(FileHandle& handle, uint64_t offset, const uint8_t* data, size_t length) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_ || !handle.isOpen) return -1;
+    
+    std::unique_lock<std::shared_mutex> inodeLock(inodeLocks_[handle.inodeNumber]);
+    if (!refreshHandle(handle)) return -1;
+    int64_t result = writeLocked(handle, offset, data, length);
+    return finishHandleUpdate(handle, result >= 0) ? result : -1;
+}
+
+int64_t FileSystem::writeLocked(FileHandle& handle, uint64_t offset, const uint8_t* data, size_t length) {
     auto start = std::chrono::high_resolution_clock::now();
     
-    // Resolve path
-    std::string dirPath = "/";
-    std::string fileName = path;
-    if (path.find('/') != std::string::npos) {
-        size_t lastSlash = path.rfind('/');
-        dirPath = path.substr(0, lastSlash);
-        if (dirPath.empty()) dirPath = "/";
-        fileName = path.substr(lastSlash + 1);
+    Inode& inode = handle.inode;
+    uint64_t endOffset = offset + length;
+    uint64_t maxSize = std::min<uint64_t>(MAX_FILE_BLOCKS * BLOCK_SIZE, UINT32_MAX);
+    if (endOffset > maxSize) {
+        std::cerr << "Write exceeds maximum file size" << std::endl;
+        return -1;
     }
     
-    int32_t dirInode = 0; // Root
-    int32_t fileInode = dirMgr_->lookupEntry(dirInode, fileName);
-    
-    if (fileInode < 0) {
-        return false;
+    // Small files stay in the inode while they fit; one that outgrows it moves to a block
+    bool moved = false;
+    bool empty = inode.fileSize == 0 && handle.blockMap.empty();
+    if (inode.hasInlineData() || (inlineFiles_ && empty && endOffset > 0)) {
+        if (endOffset <= INLINE_DATA_SIZE) {
+            if (!inode.hasInlineData()) {
+                inode.setInlineData(nullptr, 0);
+            }
+            if (offset > inode.fileSize) {
+                memset(inode.inlineData() + inode.fileSize, 0, offset - inode.fileSize);  // Hole
+            }
+            memcpy(inode.inlineData() + offset, data, length);
+            inode.fileSize = static_cast<uint32_t>(std::max<uint64_t>(inode.fileSize, endOffset));
+            inode.modifiedTime = time(nullptr);
+            if (!inodeMgr_->writeInode(handle.inodeNumber, inode)) {
+                return -1;
+            }
+            
+            auto end = std::chrono::high_resolution_clock::now();
+            updateStats(false, std::chrono::duration<double, std::milli>(end - start).count(), length);
+            return static_cast<int64_t>(length);
+        }
+        if (inode.hasInlineData()) {
+            if (!moveInlineData(handle)) {
+                return -1;
+            }
+            moved = true;
+        }
     }
     
-    // Read existing inode
-    Inode inode;
-    if (!inodeMgr_->readInode(static_cast<uint32_t>(fileInode), inode)) {
-        return false;
+    // Extend the block map to cover the write; existing blocks are reused in place
+    const auto& blocks = handle.blockMap;
+    uint32_t oldBlockCount = static_cast<uint32_t>(blocks.size());
+    uint32_t blocksNeeded = static_cast<uint32_t>((endOffset + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    
+    if (blocksNeeded > oldBlockCount) {
+        if (!allocateFileBlocks(handle, blocksNeeded - oldBlockCount)) {
+            return -1;
+        }
     }
     
-    // Clear ownership of old blocks before freeing them
-    auto oldBlocks = inodeMgr_->getInodeBlocks(inode);
-    for (uint32_t blockNum : oldBlocks) {
-        clearBlockOwner(blockNum);
-        disk_->freeBlock(blockNum);
+    BlockBuffer blockBuffer;
+    
+    // New blocks before the write offset (a hole) must read back as zeros
+    uint32_t firstWritten = static_cast<uint32_t>(offset / BLOCK_SIZE);
+    for (uint32_t i = oldBlockCount; i < firstWritten && i < blocks.size(); ++i) {
+        blockBuffer.zero();
+        if (!disk_->writeBlock(blocks[i], blockBuffer.data())) {
+            return -1;
+        }
     }
     
-    // Reset inode block pointers
-    for (int i = 0; i < 12; ++i) {
-        inode.directBlocks[i] = -1;
+    size_t done = 0;
+    while (done < length) {
+        uint64_t pos = offset + done;
+        uint32_t blockIndex = static_cast<uint32_t>(pos / BLOCK_SIZE);
+        uint32_t blockOffset = static_cast<uint32_t>(pos % BLOCK_SIZE);
+        size_t chunk = std::min<size_t>(BLOCK_SIZE - blockOffset, length - done);
+        
+        bool ok;
+        if (chunk == BLOCK_SIZE) {
+            ok = disk_->writeBlock(blocks[blockIndex], data + done);
+        } else {
+            // Partial block: merge with existing contents (new blocks start zeroed)
+            if (blockIndex < oldBlockCount) {
+                if (!disk_->readBlock(blocks[blockIndex], blockBuffer.data())) {
+                    return -1;
+                }
+            } else {
+                blockBuffer.zero();
+            }
+            memcpy(blockBuffer.data() + blockOffset, data + done, chunk);
+            ok = disk_->writeBlock(blocks[blockIndex], blockBuffer.data());
+        }
+        
+        if (!ok) {
+            return -1;
+        }
+        done += chunk;
     }
-    inode.indirectBlock = -1;
     
-    //  Allocate and write new blocks, tracking ownership
-    uint32_t blocksNeeded = (data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
-    if (!allocateFileBlocks(inode, blocksNeeded, static_cast<uint32_t>(fileInode))) {
-        return false;
+    // Persist allocations before the inode points at the blocks
+    if ((moved || blocksNeeded > oldBlockCount) && !disk_->flushBitmap()) {
+        return -1;
     }
     
-    // Update file size and write inode
-    inode.fileSize = data.size();
-    if (!inodeMgr_->writeInode(static_cast<uint32_t>(fileInode), inode)) {
-        return false;
+    inode.fileSize = static_cast<uint32_t>(std::max<uint64_t>(inode.fileSize, endOffset));
+    inode.modifiedTime = time(nullptr);
+    if (!inodeMgr_->writeInode(handle.inodeNumber, inode)) {
+        return -1;
     }
     
     auto end = std::chrono::high_resolution_clock::now();
     double timeMs = std::chrono::duration<double, std::milli>(end - start).count();
-    updateStats(false, timeMs, data.size());
+    updateStats(false, timeMs, length);
     
-    return true;
+    return static_cast<int64_t>(length);
+}
+
+bool FileSystem::truncate(FileHandle& handle, uint64_t size) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_ || !handle.isOpen) return false;
+    
+    std::unique_lock<std::shared_mutex> inodeLock(inodeLocks_[handle.inodeNumber]);
+    if (!refreshHandle(handle)) return false;
+    return finishHandleUpdate(handle, truncateLocked(handle, size));
+}
+
+bool FileSystem::truncateLocked(FileHandle& handle, uint64_t size) {
+    Inode& inode = handle.inode;
+    if (size >= inode.fileSize) {
+        return true;  // Growing is done by write()
+    }
+    
+    if (inode.hasInlineData()) {
+        if (size < INLINE_DATA_SIZE) {
+            memset(inode.inlineData() + size, 0, INLINE_DATA_SIZE - size);
+        }
+        inode.fileSize = static_cast<uint32_t>(size);
+        if (size == 0) {
+            inode.clearInlineData();
+        }
+        inode.modifiedTime = time(nullptr);
+        return inodeMgr_->writeInode(handle.inodeNumber, inode);
+    }
+    
+    // Zero the rest of the last kept block: a later write past the end must not
+    // bring the old bytes back into the hole
+    uint32_t keepBlocks = static_cast<uint32_t>((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    uint32_t tail = static_cast<uint32_t>(size % BLOCK_SIZE);
+    if (tail != 0 && keepBlocks <= handle.blockMap.size()) {
+        BlockBuffer block;
+        uint32_t blockNum = handle.blockMap[keepBlocks - 1];
+        if (!disk_->readBlock(blockNum, block.data())) {
+            return false;
+        }
+        memset(block.data() + tail, 0, BLOCK_SIZE - tail);
+        if (!disk_->writeBlock(blockNum, block.data())) {
+            return false;
+        }
+    }
+    
+    inode.fileSize = static_cast<uint32_t>(size);
+    inode.modifiedTime = time(nullptr);
+    return releaseFileBlocks(handle, keepBlocks);
+}
+
+bool FileSystem::moveInlineData(FileHandle& handle) {
+    Inode& inode = handle.inode;
+    Inode inlined = inode;
+    BlockBuffer block;
+    block.zero();
+    memcpy(block.data(), inode.inlineData(), std::min<uint32_t>(inode.fileSize, INLINE_DATA_SIZE));
+    
+    // The caller flushes the bitmap and writes the inode, so until then the
+    // image still has the inline copy
+    inode.clearInlineData();
+    if (inode.fileSize == 0) {
+        return true;
+    }
+    if (!allocateFileBlocks(handle, 1)) {
+        inode = inlined;
+        return false;
+    }
+    return disk_->writeBlock(handle.blockMap[0], block.data());
 }
 
 bool FileSystem::fileExists(const std::string& path) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return false;
     return dirMgr_->resolvePath(path, 0) >= 0;
 }
 
 bool FileSystem::createDir(const std::string& path) {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return false;
     
     size_t lastSlash = path.find_last_of('/');
@@ -346,25 +983,46 @@ bool FileSystem::createDir(const std::string& path) {
         return false;
     }
     
+    uint32_t txId = journal_->beginTransaction(JournalOp::CREATE_DIR, static_cast<uint32_t>(parentInode), dirname);
+    
     uint32_t newInode;
-    return dirMgr_->createDirectory(dirname, static_cast<uint32_t>(parentInode), newInode);
+    if (!dirMgr_->createDirectory(dirname, static_cast<uint32_t>(parentInode), newInode)) {
+        if (txId) journal_->abortTransaction(txId);
+        return false;
+    }
+    
+    if (!disk_->flushBitmap()) {
+        return false;
+    }
+    return !txId || journal_->commitTransaction(txId);
 }
 
 std::vector<DirectoryEntry> FileSystem::listDir(const std::string& path) {
-    if (!mounted_) return {};
+    std::vector<DirectoryEntry> entries;
+    listDir(path, entries);
+    return entries;
+}
+
+bool FileSystem::listDir(const std::string& path, std::vector<DirectoryEntry>& entries) {
+    entries.clear();
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    if (!mounted_) return false;
     
-    int32_t inodeNum = dirMgr_->resolvePath(path, 0);
+    std::shared_lock<std::shared_mutex> inodeLock;
+    int32_t inodeNum = lockPath(path, inodeLock);
     if (inodeNum < 0) {
-        return {};
+        return false;
     }
     
-    return dirMgr_->listDirectory(static_cast<uint32_t>(inodeNum));
+    return dirMgr_->listDirectory(static_cast<uint32_t>(inodeNum), entries);
 }
 
 bool FileSystem::getFileInfo(const std::string& path, Inode& info) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return false;
     
-    int32_t inodeNum = dirMgr_->resolvePath(path, 0);
+    std::shared_lock<std::shared_mutex> inodeLock;
+    int32_t inodeNum = lockPath(path, inodeLock);
     if (inodeNum < 0) {
         return false;
     }
@@ -385,85 +1043,122 @@ uint32_t FileSystem::getUsedBlocks() const {
     return disk_->getTotalBlocks() - disk_->getFreeBlocks();
 }
 
+FileSystem::PerformanceStats FileSystem::getStats() {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_);
+    std::lock_guard<std::mutex> statsLock(statsMutex_);
+    if (disk_) {
+        CacheStats cacheStats = disk_->getCacheStats();
+        stats_.cacheHits = cacheStats.hits;
+        stats_.cacheMisses = cacheStats.misses;
+        stats_.cacheEvictions = cacheStats.evictions;
+    }
+    stats_.journalPressure = journal_ ? journal_->getLogPressure() : 0.0;
+    stats_.metrics = metrics_.getReport();
+    return stats_;
+}
+
+bool FileSystem::trySnapshot(Snapshot& snapshot) {
+    std::shared_lock<ReentrantSharedMutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || !mounted_) {
+        return false;
+    }
+    
+    snapshot.totalBlocks = disk_->getTotalBlocks();
+    snapshot.freeBlocks = disk_->getFreeBlocks();
+    snapshot.fragmentationScore = getFragmentationScore();
+    snapshot.stats = getStats();
+    
+    // Corruption state only changes under the exclusive lock
+    snapshot.hasCorruption = hasCorruption_;
+    snapshot.corruptedBlocks = corruptedBlocks_;
+    std::sort(snapshot.corruptedBlocks.begin(), snapshot.corruptedBlocks.end());
+    return true;
+}
+
 void FileSystem::resetStats() {
+    std::lock_guard<std::mutex> statsLock(statsMutex_);
     memset(&stats_, 0, sizeof(PerformanceStats));
+    metrics_.reset();
+    if (disk_) {
+        disk_->resetCacheStats();
+    }
 }
 
 
-bool FileSystem::allocateFileBlocks(Inode& inode, uint32_t blocksNeeded, uint32_t inodeNum) {
+bool FileSystem::allocateFileBlocks(FileHandle& handle, uint32_t blocksNeeded, uint32_t hint) {
     if (blocksNeeded == 0) return true;
     
-    // Allocate direct blocks
-    uint32_t directBlocksToUse = std::min(blocksNeeded, 12u);
-    for (uint32_t i = 0; i < directBlocksToUse; ++i) {
-        int32_t blockNum = disk_->allocateBlock();
-        if (blockNum < 0) {
-            return false;
-        }
-        
-        inode.directBlocks[i] = blockNum;
-        inode.blockCount++;
-        
-        // Track ownership
-        setBlockOwner(static_cast<uint32_t>(blockNum), inodeNum);
+    // Append after the blocks the inode already maps
+    Inode& inode = handle.inode;
+    uint32_t firstIndex = static_cast<uint32_t>(handle.blockMap.size());
+    uint64_t finalCount = static_cast<uint64_t>(firstIndex) + blocksNeeded;
+    if (finalCount > MAX_FILE_BLOCKS) {
+        std::cerr << "File too large: " << finalCount << " blocks" << std::endl;
+        return false;
     }
     
-    // Handle indirect blocks if needed (files > 48KB)
-    if (blocksNeeded > 12) {
-        // Allocate indirect block
-        int32_t indirectBlockNum = disk_->allocateBlock();
-        if (indirectBlockNum < 0) {
-            return false;
-        }
-        inode.indirectBlock = indirectBlockNum;
-        
-        // CRITICAL FIX: Set ownership for indirect block itself
-        setBlockOwner(static_cast<uint32_t>(indirectBlockNum), inodeNum);
-        
-        // Allocate data blocks referenced by indirect block
-        std::vector<uint8_t> indirectData(BLOCK_SIZE, 0);
-        int32_t* pointers = reinterpret_cast<int32_t*>(indirectData.data());
-        
-        uint32_t indirectBlocksNeeded = blocksNeeded - 12;
-        for (uint32_t i = 0; i < indirectBlocksNeeded; ++i) {
-            int32_t blockNum = disk_->allocateBlock();
-            if (blockNum < 0) {
-                return false;
-            }
-            pointers[i] = blockNum;
-            inode.blockCount++;
-            setBlockOwner(static_cast<uint32_t>(blockNum), inodeNum);
+    if (hint == 0 && !handle.blockMap.empty()) {
+        hint = handle.blockMap.back() + 1;  // Keep growing the last extent
+    } else if (hint == 0) {
+        hint = disk_->allocationGoal(disk_->groupOfInode(handle.inodeNumber));  // Near the inode
+    }
+    
+    // One extent request for data plus any new pointer blocks (placed after the data)
+    uint32_t metaNeeded = InodeManager::metadataBlocksFor(finalCount) - InodeManager::metadataBlocksFor(firstIndex);
+    uint32_t totalBlocks = blocksNeeded + metaNeeded;
+    auto extents = disk_->allocateExtent(totalBlocks, hint);
+    if (extents.empty()) {
+        return false;
+    }
+    
+    std::vector<uint32_t> blocks;
+    blocks.reserve(totalBlocks);
+    for (const auto& extent : extents) {
+        for (uint32_t i = 0; i < extent.length; ++i) {
+            blocks.push_back(extent.start + i);
         }
-        
-        // Write indirect block
-        disk_->writeBlock(indirectBlockNum, indirectData.data());
     }
     
+    // Track ownership
+    for (uint32_t blockNum : blocks) {
+        setBlockOwner(blockNum, handle.inodeNumber);
+    }
+    
+    std::vector<uint32_t> metaBlocks(blocks.end() - metaNeeded, blocks.end());
+    blocks.resize(blocksNeeded);
+    
+    if (!inodeMgr_->setBlockPointers(inode, firstIndex, blocks, metaBlocks)) {
+        return false;
+    }
+    
+    handle.blockMap.insert(handle.blockMap.end(), blocks.begin(), blocks.end());
     return true;
 }
 
-bool FileSystem::readFileData(const Inode& inode, std::vector<uint8_t>& data) {
-    data.clear();
-    data.reserve(inode.fileSize);
+bool FileSystem::releaseFileBlocks(FileHandle& handle, uint32_t keepBlocks) {
+    Inode& inode = handle.inode;
     
-    auto blocks = inodeMgr_->getInodeBlocks(inode);
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
+    // Unlink from the inode first so a crash can only leak blocks
+    std::vector<uint32_t> released;
+    if (!inodeMgr_->clearBlockPointers(inode, keepBlocks, released) ||
+        !inodeMgr_->writeInode(handle.inodeNumber, inode)) {
+        return false;
+    }
     
-    for (size_t i = 0; i < blocks.size(); ++i) {
-        if (!disk_->readBlock(blocks[i], buffer.data())) {
-            return false;
-        }
-        
-        // Copy relevant bytes
-        size_t bytesToCopy = std::min(static_cast<size_t>(BLOCK_SIZE), 
-                                      static_cast<size_t>(inode.fileSize) - data.size());
-        data.insert(data.end(), buffer.begin(), buffer.begin() + bytesToCopy);
+    if (keepBlocks < handle.blockMap.size()) {
+        handle.blockMap.resize(keepBlocks);
     }
     
-    return true;
+    for (uint32_t blockNum : released) {
+        clearBlockOwner(blockNum);
+        disk_->freeBlock(blockNum);
+    }
+    return disk_->flushBitmap();
 }
 
 void FileSystem::updateStats(bool isRead, double timeMs, uint64_t bytes) {
+    metrics_.record(isRead ? MetricOp::READ : MetricOp::WRITE, static_cast<uint64_t>(timeMs * 1e6));
+    std::lock_guard<std::mutex> statsLock(statsMutex_);
     if (isRead) {
         stats_.lastReadTimeMs = timeMs;
         stats_.totalBytesRead += bytes;
@@ -477,19 +1172,15 @@ void FileSystem::updateStats(bool isRead, double timeMs, uint64_t bytes) {
 
 // Block ownership tracking implementation
 void FileSystem::setBlockOwner(uint32_t blockNum, uint32_t inodeNum) {
-    blockOwners_[blockNum] = inodeNum;
+    if (blockNum < blockOwners_.size()) {
+        blockOwners_[blockNum].store(inodeNum, std::memory_order_relaxed);
+    }
 }
 
 void FileSystem::clearBlockOwner(uint32_t blockNum) {
-    blockOwners_.erase(blockNum);
-}
-
-uint32_t FileSystem::getBlockOwner(uint32_t blockNum) const {
-    auto it = blockOwners_.find(blockNum);
-    if (it != blockOwners_.end()) {
-        return it->second;
+    if (blockNum < blockOwners_.size()) {
+        blockOwners_[blockNum].store(UINT32_MAX, std::memory_order_relaxed);
     }
-    return UINT32_MAX;  // No owner
 }
 
 std::string FileSystem::getFilenameFromInode(uint32_t inodeNum) const {
@@ -506,54 +1197,59 @@ std::string FileSystem::getFilenameFromInode(uint32_t inodeNum) const {
 }
 
 void FileSystem::rebuildBlockOwnership() {
-    blockOwners_.clear();
-    
-    if (!mounted_) return;
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
+    if (!disk_ || !inodeMgr_) return;
     
     const auto& sb = disk_->getSuperblock();
+    resetBlockOwners(sb.totalBlocks);
     
-    // Iterate through all inodes
-    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
-        Inode inode;
-        if (!inodeMgr_->readInode(i, inode)) continue;
-        
-        if (!inode.isValid() || inode.fileType != FileType::REGULAR_FILE) continue;
-        
-        // Manually get blocks to avoid invalid block access
-        // Process direct blocks
-        for (int j = 0; j < 12; ++j) {
-            // CRITICAL: Skip uninitialized blocks (-1 casts to UINT32_MAX)
-            if (inode.directBlocks[j] > 0 && 
-                inode.directBlocks[j] != -1 &&
-                inode.directBlocks[j] < (int32_t)sb.totalBlocks) {
-                setBlockOwner(static_cast<uint32_t>(inode.directBlocks[j]), i);
+    // Workers walk pointer blocks through the image (collectBlocks validates every
+    // pointer, so garbage in never-written blocks is skipped)
+    disk_->flushCache();
+    
+    uint32_t inodeCount = sb.inodeCount;
+    uint32_t workers = std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_OWNER_SCAN_WORKERS));
+    workers = std::max(1u, std::min(workers, inodeCount / 64));
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> found(workers);  // (block, inode)
+    
+    auto scanRange = [&](std::vector<std::pair<uint32_t, uint32_t>>& out, uint32_t first, uint32_t last) {
+        std::vector<uint32_t> dataBlocks, metaBlocks;
+        BlockBuffer scratch;  // Each worker has its own pool
+        for (uint32_t i = first; i < last; ++i) {
+            Inode inode;
+            if (!inodeMgr_->readInode(i, inode) || !inode.isValid() ||
+                inode.fileType != FileType::REGULAR_FILE) {
+                continue;
             }
-        }
-        
-        // Process indirect block if valid
-        if (inode.indirectBlock > 0 && 
-            inode.indirectBlock != -1 &&
-            inode.indirectBlock < (int32_t)sb.totalBlocks) {
             
-            std::vector<uint8_t> indirectData(BLOCK_SIZE);
-            if (disk_->readBlock(inode.indirectBlock, indirectData.data())) {
-                const int32_t* pointers = reinterpret_cast<const int32_t*>(indirectData.data());
-                int maxIndirect = BLOCK_SIZE / sizeof(int32_t);
-                
-                for (int j = 0; j < maxIndirect; ++j) {
-                    // CRITICAL: Skip uninitialized blocks
-                    if (pointers[j] > 0 && 
-                        pointers[j] != -1 &&
-                        pointers[j] < (int32_t)sb.totalBlocks) {
-                        setBlockOwner(static_cast<uint32_t>(pointers[j]), i);
-                    }
-                }
-            }
+            // Data blocks plus the pointer blocks that map them
+            inodeMgr_->collectBlocks(inode, dataBlocks, metaBlocks, scratch.data());
+            for (uint32_t blockNum : dataBlocks) out.emplace_back(blockNum, i);
+            for (uint32_t blockNum : metaBlocks) out.emplace_back(blockNum, i);
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    uint32_t chunk = (inodeCount + workers - 1) / workers;
+    for (uint32_t w = 1; w < workers; ++w) {
+        uint32_t first = std::min(inodeCount, w * chunk);
+        uint32_t last = std::min(inodeCount, first + chunk);
+        threads.emplace_back(scanRange, std::ref(found[w]), first, last);
+    }
+    scanRange(found[0], 0, std::min(inodeCount, chunk));
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    for (const auto& list : found) {
+        for (const auto& owner : list) {
+            setBlockOwner(owner.first, owner.second);
         }
     }
 }
 
 void FileSystem::simulatePowerCut() {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
     std::cout << "[POWER CUT] Simulating power failure!" << std::endl;
     
     hasCorruption_ = true;
@@ -579,8 +1275,8 @@ void FileSystem::simulatePowerCut() {
     if (lastModifiedInode != UINT32_MAX) {
         Inode inode;
         if (inodeMgr_->readInode(lastModifiedInode, inode)) {
-            // Collect blocks from this file
-            for (int i = 0; i < 12; ++i) {
+            // Collect blocks from this file (inline data has none)
+            for (int i = 0; i < 12 && !inode.hasInlineData(); ++i) {
                 if (inode.directBlocks[i] > 0 &&
                     inode.directBlocks[i] != -1 &&
                     inode.directBlocks[i] < (int32_t)sb.totalBlocks) {
@@ -609,6 +1305,7 @@ void FileSystem::simulatePowerCut() {
 bool FileSystem::simulatePowerCutDuringWrite(const std::string& filename,
                                                const std::vector<uint8_t>& fullData,
                                                double crashPercent) {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
     if (!mounted_) return false;
     
     std::cout << "[POWER CUT] Starting file write simulation..." << std::endl;
@@ -673,7 +1370,7 @@ bool FileSystem::simulatePowerCutDuringWrite(const std::string& filename,
     inodeMgr_->writeInode(static_cast<uint32_t>(inodeNum), inode);
     
     // 5. Write bitmap to persist allocated blocks
-    disk_->writeBitmap();
+    disk_->flushBitmap();
     
     // 6. SIMULATE CRASH: Mark all written blocks as corrupted
     std::cout << "[POWER CUT] ⚡ CRASH! Marking " << allocatedBlocks.size() << " blocks as corrupted..." << std::endl;
@@ -693,12 +1390,14 @@ bool FileSystem::simulatePowerCutDuringWrite(const std::string& filename,
 }
 
 void FileSystem::setCorruptionState(const std::vector<uint32_t>& corruptedBlocks, uint32_t inodeNum) {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
     corruptedBlocks_ = corruptedBlocks;
     hasCorruption_ = true;
     activeWriteInodeNum_ = inodeNum;
 }
 
 bool FileSystem::runRecovery() {
+    std::lock_guard<ReentrantSharedMutex> lock(mutex_);
     if (!hasCorruption_) {
         std::cout << "[RECOVERY] No corruption detected" << std::endl;
         return true;
@@ -717,19 +1416,11 @@ bool FileSystem::runRecovery() {
     std::set<uint32_t> affectedInodes;
     
     for (uint32_t blockNum : corruptedBlocks_) {
-        // Check all inodes to see which one references this block
-        for (uint32_t inodeNum = 1; inodeNum < 128; ++inodeNum) {  // Start from 1, skip inode 0 (root dir)
-            Inode inode;
-            if (inodeMgr_->readInode(inodeNum, inode) && inode.isValid()) {
-                // Check if this inode references the corrupted block
-                for (int i = 0; i < 12 && inode.directBlocks[i] != 0; ++i) {
-                    if (inode.directBlocks[i] == blockNum) {
-                        affectedInodes.insert(inodeNum);
-                        break;
-                    }
-                }
-            }
+        uint32_t owner = getBlockOwner(blockNum);
+        if (owner != UINT32_MAX) {
+            affectedInodes.insert(owner);
         }
+        clearBlockOwner(blockNum);
     }
     
     // Step 4: Clear only the affected inodes (corrupted files)
@@ -759,6 +1450,7 @@ bool FileSystem::runRecovery() {
                 if (!alreadyFreed) {
                     disk_->freeBlock(inode.directBlocks[i]);
                 }
+                clearBlockOwner(inode.directBlocks[i]);
             }
             
             // Clear the inode
@@ -768,7 +1460,7 @@ bool FileSystem::runRecovery() {
     }
     
     // Persist changes
-    disk_->writeBitmap();
+    disk_->flushBitmap();
     disk_->writeSuperblock();
     
     // Clear the corruption state
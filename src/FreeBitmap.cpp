@@ -0,0 +1,320 @@
+#include "FreeBitmap.h"
+#include <algorithm>
+#include <iterator>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace FileSystemTool {
+
+namespace {
+
+inline uint32_t ctz64(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+inline uint32_t popcount64(uint64_t value) {
+#if defined(_MSC_VER)
+    return static_cast<uint32_t>(__popcnt64(value));
+#else
+    return static_cast<uint32_t>(__builtin_popcountll(value));
+#endif
+}
+
+inline uint32_t runBucket(uint32_t length) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, length);
+    return static_cast<uint32_t>(index);
+#else
+    return 31 - static_cast<uint32_t>(__builtin_clz(length));
+#endif
+}
+
+} // namespace
+
+void FreeBitmap::reset(uint32_t size, bool free) {
+    size_ = size;
+    words_.assign((static_cast<size_t>(size) + 63) / 64, free ? ~0ULL : 0ULL);
+    summary_.assign((words_.size() + 63) / 64, 0);
+    rebuildSummary();
+}
+
+void FreeBitmap::setRunTracking(bool enabled) {
+    trackRuns_ = enabled;
+    rebuildRuns();
+}
+
+void FreeBitmap::setFree(uint32_t index) {
+    size_t word = index >> 6;
+    words_[word] |= 1ULL << (index & 63);
+    summary_[word >> 6] |= 1ULL << (word & 63);
+    if (trackRuns_) {
+        markRunsFree(index, index + 1);
+    }
+}
+
+void FreeBitmap::setUsed(uint32_t index) {
+    size_t word = index >> 6;
+    words_[word] &= ~(1ULL << (index & 63));
+    updateSummary(word);
+    if (trackRuns_) {
+        markRunsUsed(index, index + 1);
+    }
+}
+
+void FreeBitmap::setRange(uint32_t start, uint32_t count, bool free) {
+    uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(start) + count, size_));
+
+    for (uint32_t i = start; i < end; ) {
+        size_t word = i >> 6;
+        uint32_t bit = i & 63;
+        uint32_t n = std::min(64 - bit, end - i);
+        uint64_t mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << bit;
+
+        if (free) {
+            words_[word] |= mask;
+        } else {
+            words_[word] &= ~mask;
+        }
+        updateSummary(word);
+        i += n;
+    }
+    
+    if (trackRuns_ && start < end) {
+        if (free) {
+            markRunsFree(start, end);
+        } else {
+            markRunsUsed(start, end);
+        }
+    }
+}
+
+uint32_t FreeBitmap::findFirstFree(uint32_t from) const {
+    if (from >= size_) {
+        return NPOS;
+    }
+
+    // Rest of the starting word (bits past size_ are always clear)
+    size_t word = from >> 6;
+    uint64_t bits = words_[word] & (~0ULL << (from & 63));
+    if (bits) {
+        return static_cast<uint32_t>(word * 64 + ctz64(bits));
+    }
+
+    // Use the summary to jump to the next word with a free block
+    size_t next = word + 1;
+    if (next >= words_.size()) {
+        return NPOS;
+    }
+
+    size_t s = next >> 6;
+    uint64_t summaryBits = summary_[s] & (~0ULL << (next & 63));
+    while (!summaryBits) {
+        if (++s >= summary_.size()) {
+            return NPOS;
+        }
+        summaryBits = summary_[s];
+    }
+
+    size_t found = s * 64 + ctz64(summaryBits);
+    return static_cast<uint32_t>(found * 64 + ctz64(words_[found]));
+}
+
+uint32_t FreeBitmap::findFirstUsed(uint32_t from) const {
+    if (from >= size_) {
+        return size_;
+    }
+
+    size_t word = from >> 6;
+    uint64_t bits = ~words_[word] & (~0ULL << (from & 63));
+    while (!bits) {
+        if (++word >= words_.size()) {
+            return size_;
+        }
+        bits = ~words_[word];
+    }
+
+    return std::min(static_cast<uint32_t>(word * 64 + ctz64(bits)), size_);
+}
+
+uint32_t FreeBitmap::findFreeRun(uint32_t count, uint32_t from) const {
+    if (count == 0) {
+        return NPOS;
+    }
+
+    uint32_t pos = from;
+    while (true) {
+        uint32_t start = findFirstFree(pos);
+        if (start == NPOS || size_ - start < count) {
+            return NPOS;
+        }
+
+        uint32_t end = findFirstUsed(start);
+        if (end - start >= count) {
+            return start;
+        }
+        pos = end;
+    }
+}
+
+uint32_t FreeBitmap::largestFreeRun(uint32_t from, uint32_t* runStart) const {
+    uint32_t best = 0;
+    uint32_t bestStart = NPOS;
+
+    uint32_t pos = from;
+    while (true) {
+        uint32_t start = findFirstFree(pos);
+        if (start == NPOS || size_ - start <= best) {
+            break;
+        }
+
+        uint32_t end = findFirstUsed(start);
+        if (end - start > best) {
+            best = end - start;
+            bestStart = start;
+        }
+        pos = end;
+    }
+
+    if (runStart) {
+        *runStart = bestStart;
+    }
+    return best;
+}
+
+uint32_t FreeBitmap::countFree() const {
+    uint32_t total = 0;
+    for (uint64_t word : words_) {
+        total += popcount64(word);
+    }
+    return total;
+}
+
+uint32_t FreeBitmap::countFree(uint32_t start, uint32_t count) const {
+    uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(start) + count, size_));
+    uint32_t total = 0;
+    for (uint32_t i = start; i < end; ) {
+        uint32_t bit = i & 63;
+        uint32_t n = std::min(64 - bit, end - i);
+        uint64_t mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << bit;
+        total += popcount64(words_[i >> 6] & mask);
+        i += n;
+    }
+    return total;
+}
+
+uint32_t FreeBitmap::largestRun(uint32_t* runStart) const {
+    if (runsByLength_.empty()) {
+        if (runStart) {
+            *runStart = NPOS;
+        }
+        return 0;
+    }
+    
+    uint32_t length = runsByLength_.rbegin()->first;
+    if (runStart) {
+        *runStart = runsByLength_.lower_bound({length, 0})->second;
+    }
+    return length;
+}
+
+void FreeBitmap::rebuildSummary() {
+    clearTail();
+    std::fill(summary_.begin(), summary_.end(), 0);
+    for (size_t w = 0; w < words_.size(); ++w) {
+        if (words_[w]) {
+            summary_[w >> 6] |= 1ULL << (w & 63);
+        }
+    }
+    rebuildRuns();
+}
+
+void FreeBitmap::addRun(uint32_t start, uint32_t end) {
+    runsByStart_.emplace(start, end);
+    runsByLength_.emplace(end - start, start);
+    runBuckets_[runBucket(end - start)]++;
+}
+
+void FreeBitmap::removeRun(std::map<uint32_t, uint32_t>::iterator it) {
+    uint32_t length = it->second - it->first;
+    runsByLength_.erase({length, it->first});
+    runBuckets_[runBucket(length)]--;
+    runsByStart_.erase(it);
+}
+
+void FreeBitmap::markRunsFree(uint32_t start, uint32_t end) {
+    // Absorb a run that overlaps or touches the range on the left, then any to the right
+    auto it = runsByStart_.upper_bound(start);
+    if (it != runsByStart_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= start) {
+            start = prev->first;
+            end = std::max(end, prev->second);
+            removeRun(prev);
+        }
+    }
+    
+    while (it != runsByStart_.end() && it->first <= end) {
+        end = std::max(end, it->second);
+        auto next = std::next(it);
+        removeRun(it);
+        it = next;
+    }
+    
+    addRun(start, end);
+}
+
+void FreeBitmap::markRunsUsed(uint32_t start, uint32_t end) {
+    auto it = runsByStart_.upper_bound(start);
+    if (it != runsByStart_.begin() && std::prev(it)->second > start) {
+        --it;
+    }
+    
+    // Each overlapping run keeps whatever lies outside [start, end)
+    while (it != runsByStart_.end() && it->first < end) {
+        uint32_t runStart = it->first;
+        uint32_t runEnd = it->second;
+        auto next = std::next(it);
+        removeRun(it);
+        if (runStart < start) {
+            addRun(runStart, start);
+        }
+        if (runEnd > end) {
+            addRun(end, runEnd);
+        }
+        it = next;
+    }
+}
+
+void FreeBitmap::rebuildRuns() {
+    runsByStart_.clear();
+    runsByLength_.clear();
+    runBuckets_.fill(0);
+    if (!trackRuns_) {
+        return;
+    }
+    
+    uint32_t start = findFirstFree(0);
+    while (start != NPOS) {
+        uint32_t end = findFirstUsed(start);
+        addRun(start, end);
+        start = findFirstFree(end);
+    }
+}
+
+void FreeBitmap::clearTail() {
+    // Bits past the last block read as "used" so searches never return them
+    if ((size_ & 63) && !words_.empty()) {
+        words_.back() &= (1ULL << (size_ & 63)) - 1;
+    }
+}
+
+} // namespace FileSystemTool
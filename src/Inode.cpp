@@ -1,10 +1,28 @@
 #include "Inode.h"
 #include "VirtualDisk.h"
+#include "BlockBuffer.h"
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 
 namespace FileSystemTool {
 
+namespace {
+
+// Fields of a newly allocated inode, shared by the single and batch paths
+void initializeInode(Inode& inode, uint32_t inodeNum, FileType type, time_t now) {
+    inode.reset();
+    inode.inodeNumber = inodeNum;
+    inode.fileType = type;
+    inode.permissions = 0xA4;  // Low byte of 0644 (rw-r--r--); the field is 8 bits wide
+    inode.linkCount = 1;
+    inode.createdTime = now;
+    inode.modifiedTime = now;
+    inode.accessedTime = now;
+}
+
+} // namespace
+
 Inode::Inode() {
     reset();
 }
@@ -20,8 +38,10 @@ void Inode::reset() {
     modifiedTime = 0;
     accessedTime = 0;
     indirectBlock = 0;
+    doubleIndirectBlock = 0;
     memset(directBlocks, 0, sizeof(directBlocks));
-    memset(padding, 0, sizeof(padding));
+    memset(inlineTail, 0, sizeof(inlineTail));
+    flags = 0;
 }
 
 bool Inode::isValid() const {
@@ -32,147 +52,402 @@ bool Inode::isFree() const {
     return fileType == FileType::FREE;
 }
 
-InodeManager::InodeManager(VirtualDisk* disk) : disk_(disk) {}
+void Inode::setInlineData(const uint8_t* data, size_t length) {
+    length = std::min<size_t>(length, INLINE_DATA_SIZE);
+    memset(inlineData(), 0, INLINE_DATA_SIZE);
+    if (length > 0) {
+        memcpy(inlineData(), data, length);
+    }
+    flags |= INODE_INLINE_DATA;
+    fileSize = static_cast<uint32_t>(length);
+    blockCount = 0;
+}
 
-int32_t InodeManager::allocateInode(FileType type) {
+void Inode::clearInlineData() {
+    memset(inlineData(), 0, INLINE_DATA_SIZE);
+    flags &= ~INODE_INLINE_DATA;
+}
+
+InodeManager::InodeManager(VirtualDisk* disk)
+    : disk_(disk), allInodesChanged_(true), blockBuffer_(BLOCK_SIZE) {}
+
+bool InodeManager::loadInodeTable() {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
     const auto& sb = disk_->getSuperblock();
+    uint32_t inodesPerBlock = BLOCK_SIZE / INODE_SIZE;
+    uint32_t tableBlocks = (sb.inodeCount + inodesPerBlock - 1) / inodesPerBlock;
     
-    // Find first free inode
-    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
-        Inode inode;
-        if (readInode(i, inode) && inode.isFree()) {
-            // Initialize inode
-            inode.inodeNumber = i;
-            inode.fileType = type;
-            inode.permissions = 0x1A4;  // rw-r--r-- (644 octal)
-            inode.linkCount = 1;
-            inode.fileSize = 0;
-            inode.blockCount = 0;
-            inode.createdTime = time(nullptr);
-            inode.modifiedTime = inode.createdTime;
-            inode.accessedTime = inode.createdTime;
+    table_.assign(sb.inodeCount, Inode());
+    generations_.assign(sb.inodeCount, 0);
+    fragments_.assign(sb.inodeCount, 0);
+    fragmentCounts_ = FragmentCounts();
+    changedInodes_.assign((sb.inodeCount + 63) / 64, 0);
+    allInodesChanged_ = true;
+    freeInodes_.reset(sb.inodeCount, false);
+    
+    for (uint32_t b = 0; b < tableBlocks; ++b) {
+        if (!disk_->readBlock(disk_->inodeTableBlock(b), blockBuffer_.data())) {
+            std::cerr << "Failed to read inode table block " << b << std::endl;
+            table_.clear();
+            return false;
+        }
+        
+        for (uint32_t i = 0; i < inodesPerBlock; ++i) {
+            uint32_t inodeNum = b * inodesPerBlock + i;
+            if (inodeNum >= sb.inodeCount) {
+                break;
+            }
             
-            if (writeInode(i, inode)) {
-                return static_cast<int32_t>(i);
+            memcpy(&table_[inodeNum], blockBuffer_.data() + i * INODE_SIZE, sizeof(Inode));
+            if (table_[inodeNum].isFree()) {
+                freeInodes_.setFree(inodeNum);
             }
         }
     }
     
+    // Seed the fragmentation counters; from here writeInode keeps them current
+    std::vector<uint32_t> blocks;
+    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
+        if (table_[i].fileType == FileType::REGULAR_FILE) {
+            getInodeBlocks(table_[i], blocks);
+            fragments_[i] = countFragments(blocks);
+            accountFragments(table_[i], fragments_[i], 1);
+        }
+    }
+    
+    // The table is the truth for the group inode counts (they may lag after a crash)
+    uint32_t inodesPerGroup = disk_->getInodesPerGroup();
+    for (uint32_t g = 0; g < disk_->getGroupCount(); ++g) {
+        uint32_t first = g * inodesPerGroup;
+        uint32_t last = std::min(sb.inodeCount, first + inodesPerGroup);
+        uint32_t free = 0;
+        uint32_t directories = 0;
+        for (uint32_t i = first; i < last; ++i) {
+            free += table_[i].isFree() ? 1 : 0;
+            directories += table_[i].fileType == FileType::DIRECTORY ? 1 : 0;
+        }
+        disk_->setGroupInodeCounts(g, free, directories);
+    }
+    
+    return true;
+}
+
+int32_t InodeManager::allocateInode(FileType type, uint32_t goalGroup) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    // First free inode in the goal group or after it, wrapping to the start
+    uint32_t i = findFreeInode(goalGroup);
+    if (i != FreeBitmap::NPOS) {
+        Inode inode;
+        initializeInode(inode, i, type, time(nullptr));
+        if (writeInode(i, inode)) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    
     std::cerr << "No free inodes available" << std::endl;
     return -1;
 }
 
+bool InodeManager::allocateInodes(FileType type, uint32_t count, std::vector<uint32_t>& inodeNums,
+                                  uint32_t goalGroup) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    inodeNums.clear();
+    if (count > freeInodes_.countFree()) {
+        std::cerr << "Not enough free inodes for " << count << " files" << std::endl;
+        return false;
+    }
+    
+    uint32_t inodesPerBlock = BLOCK_SIZE / INODE_SIZE;
+    time_t now = time(nullptr);
+    std::vector<uint32_t> tableBlocks;
+    
+    uint32_t i = findFreeInode(goalGroup);
+    while (inodeNums.size() < count && i != FreeBitmap::NPOS) {
+        Inode& inode = table_[i];
+        initializeInode(inode, i, type, now);
+        
+        generations_[i]++;
+        changedInodes_[i / 64] |= 1ULL << (i % 64);
+        fragments_[i] = 0;
+        accountFragments(inode, 0, 1);
+        freeInodes_.setUsed(i);
+        disk_->accountInode(i, type == FileType::DIRECTORY, true);
+        disk_->markInodeRegionDirty(i);
+        if (tableBlocks.empty() || tableBlocks.back() != i / inodesPerBlock) {
+            tableBlocks.push_back(i / inodesPerBlock);
+        }
+        
+        inodeNums.push_back(i);
+        i = freeInodes_.findFirstFree(i + 1);
+        if (i == FreeBitmap::NPOS) {
+            i = freeInodes_.findFirstFree(0);  // Wrapped; the goal group's own are taken by now
+        }
+    }
+    
+    std::sort(tableBlocks.begin(), tableBlocks.end());
+    tableBlocks.erase(std::unique(tableBlocks.begin(), tableBlocks.end()), tableBlocks.end());
+    for (uint32_t tableBlock : tableBlocks) {
+        if (!writeInodeTableBlock(tableBlock)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool InodeManager::freeInode(uint32_t inodeNum) {
     Inode inode;
     if (!readInode(inodeNum, inode)) {
         return false;
     }
     
-    // Free all blocks used by this inode
+    // Free all blocks used by this inode, including the pointer blocks
     auto blocks = getInodeBlocks(inode);
+    auto metadata = getMetadataBlocks(inode);
+    blocks.insert(blocks.end(), metadata.begin(), metadata.end());
+    
+    // Reset the inode first: a freed block may be discarded once the reset is durable
+    inode.reset();
+    if (!writeInode(inodeNum, inode)) {
+        return false;
+    }
     for (uint32_t blockNum : blocks) {
         disk_->freeBlock(blockNum);
     }
-    
-    // Reset inode
-    inode.reset();
-    return writeInode(inodeNum, inode);
+    return true;
 }
 
 bool InodeManager::readInode(uint32_t inodeNum, Inode& inode) {
-    const auto& sb = disk_->getSuperblock();
-    if (inodeNum >= sb.inodeCount) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (inodeNum >= table_.size()) {
         return false;
     }
     
-    uint32_t inodesPerBlock = BLOCK_SIZE / INODE_SIZE;
-    uint32_t blockNum = sb.inodeTableStart + (inodeNum / inodesPerBlock);
-    uint32_t offset = (inodeNum % inodesPerBlock) * INODE_SIZE;
+    disk_->countMetric(MetricCounter::INODE_READS);
+    inode = table_[inodeNum];
+    return true;
+}
+
+bool InodeManager::writeInode(uint32_t inodeNum, const Inode& inode) {
+    // Pointer blocks are written before the inode, so the new block list is readable
+    // here; walk it before taking the lock
+    uint32_t fragments = 0;
+    if (inode.fileType == FileType::REGULAR_FILE) {
+        thread_local std::vector<uint32_t> blocks;  // Kept across calls: no allocation per write
+        getInodeBlocks(inode, blocks);
+        fragments = countFragments(blocks);
+    }
     
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
-    if (!disk_->readBlock(blockNum, buffer.data())) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (inodeNum >= table_.size()) {
         return false;
     }
     
-    memcpy(&inode, buffer.data() + offset, sizeof(Inode));
-    return true;
+    accountFragments(table_[inodeNum], fragments_[inodeNum], -1);
+    fragments_[inodeNum] = fragments;
+    accountFragments(inode, fragments, 1);
+    
+    const Inode& old = table_[inodeNum];
+    if (old.isFree() != inode.isFree()) {
+        const Inode& live = inode.isFree() ? old : inode;
+        disk_->accountInode(inodeNum, live.fileType == FileType::DIRECTORY, !inode.isFree());
+    }
+    
+    table_[inodeNum] = inode;
+    generations_[inodeNum]++;
+    disk_->countMetric(MetricCounter::INODE_WRITES);
+    changedInodes_[inodeNum / 64] |= 1ULL << (inodeNum % 64);
+    disk_->markInodeRegionDirty(inodeNum);
+    if (inode.isFree()) {
+        freeInodes_.setFree(inodeNum);
+    } else {
+        freeInodes_.setUsed(inodeNum);
+    }
+    
+    // Write through: re-encode the whole table block from memory, no read needed
+    uint32_t inodesPerBlock = BLOCK_SIZE / INODE_SIZE;
+    return writeInodeTableBlock(inodeNum / inodesPerBlock);
 }
 
-bool InodeManager::writeInode(uint32_t inodeNum, const Inode& inode) {
-    const auto& sb = disk_->getSuperblock();
-    if (inodeNum >= sb.inodeCount) {
-        return false;
+uint32_t InodeManager::findFreeInode(uint32_t goalGroup) const {
+    uint32_t from = goalGroup * disk_->getInodesPerGroup();
+    uint32_t i = freeInodes_.findFirstFree(from);
+    if (i == FreeBitmap::NPOS && from > 0) {
+        i = freeInodes_.findFirstFree(0);
+    }
+    return i;
+}
+
+uint32_t InodeManager::getFreeInodeCount() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return freeInodes_.countFree();
+}
+
+uint32_t InodeManager::getGeneration(uint32_t inodeNum) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return inodeNum < generations_.size() ? generations_[inodeNum] : 0;
+}
+
+bool InodeManager::takeChangedInodes(std::vector<uint32_t>& inodes) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    inodes.clear();
+    if (allInodesChanged_) {
+        allInodesChanged_ = false;
+        std::fill(changedInodes_.begin(), changedInodes_.end(), 0);
+        return true;
+    }
+    
+    for (size_t w = 0; w < changedInodes_.size(); ++w) {
+        uint64_t bits = changedInodes_[w];
+        for (uint32_t b = 0; bits && b < 64; ++b) {
+            if ((bits >> b) & 1) {
+                inodes.push_back(static_cast<uint32_t>(w * 64 + b));
+            }
+        }
+        changedInodes_[w] = 0;
+    }
+    return false;
+}
+
+uint32_t InodeManager::getFragmentCount(uint32_t inodeNum) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return inodeNum < fragments_.size() ? fragments_[inodeNum] : 0;
+}
+
+FragmentCounts InodeManager::getFragmentCounts() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return fragmentCounts_;
+}
+
+void InodeManager::accountFragments(const Inode& inode, uint32_t fragments, int sign) {
+    if (inode.fileType != FileType::REGULAR_FILE) {
+        return;
     }
     
+    fragmentCounts_.files += sign;
+    fragmentCounts_.filesWithBlocks += fragments > 0 ? sign : 0;
+    fragmentCounts_.fragmentedFiles += fragments > 1 ? sign : 0;
+    fragmentCounts_.totalFragments += static_cast<int64_t>(fragments) * sign;
+}
+
+uint32_t InodeManager::countFragments(const std::vector<uint32_t>& blocks) {
+    if (blocks.empty()) {
+        return 0;
+    }
+    
+    uint32_t fragments = 1;
+    for (size_t i = 1; i < blocks.size(); ++i) {
+        if (blocks[i] != blocks[i-1] + 1) {
+            fragments++;
+        }
+    }
+    return fragments;
+}
+
+bool InodeManager::writeInodeTableBlock(uint32_t tableBlock) {
     uint32_t inodesPerBlock = BLOCK_SIZE / INODE_SIZE;
-    uint32_t blockNum = sb.inodeTableStart + (inodeNum / inodesPerBlock);
-    uint32_t offset = (inodeNum % inodesPerBlock) * INODE_SIZE;
+    uint32_t first = tableBlock * inodesPerBlock;
     
-    // Read block, modify inode, write back
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
-    if (!disk_->readBlock(blockNum, buffer.data())) {
-        return false;
+    std::fill(blockBuffer_.begin(), blockBuffer_.end(), 0);
+    for (uint32_t i = 0; i < inodesPerBlock && first + i < table_.size(); ++i) {
+        memcpy(blockBuffer_.data() + i * INODE_SIZE, &table_[first + i], sizeof(Inode));
     }
     
-    memcpy(buffer.data() + offset, &inode, sizeof(Inode));
-    return disk_->writeBlock(blockNum, buffer.data());
+    return disk_->writeMetadataBlock(disk_->inodeTableBlock(tableBlock), blockBuffer_.data());
 }
 
 bool InodeManager::addBlockToInode(Inode& inode, uint32_t blockNum) {
-    // Try direct blocks first
-    for (uint32_t i = 0; i < DIRECT_BLOCKS; ++i) {
-        if (inode.directBlocks[i] == 0) {
-            inode.directBlocks[i] = blockNum;
-            inode.blockCount++;
-            return true;
-        }
+    thread_local std::vector<uint32_t> blocks;
+    getInodeBlocks(inode, blocks);
+    uint32_t index = static_cast<uint32_t>(blocks.size());
+    if (index >= MAX_FILE_BLOCKS) {
+        return false;
     }
     
-    // Use indirect block
-    std::vector<uint32_t> indirectPointers;
-    if (inode.indirectBlock == 0) {
-        // Allocate indirect block
-        int32_t indBlock = disk_->allocateBlock();
-        if (indBlock < 0) return false;
-        inode.indirectBlock = static_cast<uint32_t>(indBlock);
-    } else {
-        readIndirectBlock(inode.indirectBlock, indirectPointers);
+    // Allocate whatever pointer blocks the new index needs
+    uint32_t metaNeeded = metadataBlocksFor(index + 1) - metadataBlocksFor(index);
+    std::vector<uint32_t> metaBlocks;
+    if (metaNeeded > 0) {
+        for (const auto& extent : disk_->allocateExtent(metaNeeded, blockNum + 1)) {
+            for (uint32_t i = 0; i < extent.length; ++i) {
+                metaBlocks.push_back(extent.start + i);
+            }
+        }
+        if (metaBlocks.size() != metaNeeded) {
+            return false;
+        }
     }
     
-    indirectPointers.push_back(blockNum);
-    inode.blockCount++;
-    return writeIndirectBlock(inode.indirectBlock, indirectPointers);
+    return setBlockPointers(inode, index, {blockNum}, metaBlocks);
 }
 
 std::vector<uint32_t> InodeManager::getInodeBlocks(const Inode& inode) {
     std::vector<uint32_t> blocks;
-    const auto& sb = disk_->getSuperblock();
+    getInodeBlocks(inode, blocks);
+    return blocks;
+}
+
+void InodeManager::getInodeBlocks(const Inode& inode, std::vector<uint32_t>& blocks) {
+    blocks.clear();
+    if (inode.hasInlineData()) {
+        return;  // The pointer area holds file bytes
+    }
+    blocks.reserve(std::min<uint64_t>(inode.blockCount, MAX_FILE_BLOCKS));
     
     // CRITICAL FIX: Only add VALID direct blocks (skip -1, 0, out of range)
-    for (int i = 0; i < 12; ++i) {
-        if (inode.directBlocks[i] > 0 &&
-            inode.directBlocks[i] != -1 &&
-            inode.directBlocks[i] < (int32_t)sb.totalBlocks) {
-            blocks.push_back(static_cast<uint32_t>(inode.directBlocks[i]));
+    for (uint32_t i = 0; i < DIRECT_BLOCKS; ++i) {
+        if (isValidBlock(inode.directBlocks[i])) {
+            blocks.push_back(inode.directBlocks[i]);
         }
     }
     
-    // Handle indirect block if valid
-    if (inode.indirectBlock > 0 &&
-        inode.indirectBlock != -1 &&
-        inode.indirectBlock < (int32_t)sb.totalBlocks) {
+    // Pointer blocks are parsed in place from pooled buffers
+    BlockBuffer buffer;
+    if (isValidBlock(inode.indirectBlock) && disk_->readBlock(inode.indirectBlock, buffer.data())) {
+        appendValidPointers(buffer.data(), blocks);
+    }
+    
+    // Double indirect: one level of pointer blocks, each mapping POINTERS_PER_BLOCK data blocks.
+    // The level-1 blocks are fetched as one batch; if that fails each is tried alone.
+    BlockBuffer level1Block;
+    if (isValidBlock(inode.doubleIndirectBlock) && disk_->readBlock(inode.doubleIndirectBlock, level1Block.data())) {
+        // Compact the valid level-1 pointers to the front of their own block
+        uint32_t* level1 = reinterpret_cast<uint32_t*>(level1Block.data());
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < POINTERS_PER_BLOCK && level1[i] != 0; ++i) {
+            if (isValidBlock(level1[i])) {
+                level1[count++] = level1[i];
+            }
+        }
         
-        std::vector<uint8_t> indirectData(BLOCK_SIZE);
-        if (disk_->readBlock(inode.indirectBlock, indirectData.data())) {
-            const int32_t* pointers = reinterpret_cast<const int32_t*>(indirectData.data());
-            int maxIndirect = BLOCK_SIZE / sizeof(int32_t);
-            
-            for (int i = 0; i < maxIndirect; ++i) {
-                // CRITICAL: Skip invalid indirect pointers
-                if (pointers[i] > 0 &&
-                    pointers[i] != -1 &&
-                    pointers[i] < (int32_t)sb.totalBlocks) {
-                    blocks.push_back(static_cast<uint32_t>(pointers[i]));
+        BlockBuffer batch(count);
+        bool batched = disk_->readBlocks(level1, count, batch.data());
+        for (uint32_t i = 0; i < count; ++i) {
+            if (batched) {
+                appendValidPointers(batch.block(i), blocks);
+            } else if (disk_->readBlock(level1[i], buffer.data())) {
+                appendValidPointers(buffer.data(), blocks);
+            }
+        }
+    }
+}
+
+std::vector<uint32_t> InodeManager::getMetadataBlocks(const Inode& inode) {
+    std::vector<uint32_t> blocks;
+    if (inode.hasInlineData()) {
+        return blocks;
+    }
+    
+    if (isValidBlock(inode.indirectBlock)) {
+        blocks.push_back(inode.indirectBlock);
+    }
+    
+    std::vector<uint32_t> level1;
+    if (isValidBlock(inode.doubleIndirectBlock)) {
+        blocks.push_back(inode.doubleIndirectBlock);
+        if (readIndirectBlock(inode.doubleIndirectBlock, level1)) {
+            for (uint32_t l1 : level1) {
+                if (isValidBlock(l1)) {
+                    blocks.push_back(l1);
                 }
             }
         }
@@ -181,32 +456,276 @@ std::vector<uint32_t> InodeManager::getInodeBlocks(const Inode& inode) {
     return blocks;
 }
 
+uint32_t InodeManager::metadataBlocksFor(uint64_t dataBlocks) {
+    if (dataBlocks <= DIRECT_BLOCKS) {
+        return 0;
+    }
+    if (dataBlocks <= SINGLE_INDIRECT_LIMIT) {
+        return 1;
+    }
+    
+    // Single indirect + double indirect + one second-level block per POINTERS_PER_BLOCK
+    uint64_t rest = dataBlocks - SINGLE_INDIRECT_LIMIT;
+    return 2 + static_cast<uint32_t>((rest + POINTERS_PER_BLOCK - 1) / POINTERS_PER_BLOCK);
+}
+
+bool InodeManager::setBlockPointers(Inode& inode, uint32_t firstIndex, const std::vector<uint32_t>& dataBlocks,
+                                    const std::vector<uint32_t>& metaBlocks) {
+    if (firstIndex + static_cast<uint64_t>(dataBlocks.size()) > MAX_FILE_BLOCKS || inode.hasInlineData()) {
+        return false;  // Inline data is moved out (clearInlineData) before blocks are mapped
+    }
+    
+    size_t next = 0;
+    size_t metaNext = 0;
+    uint64_t index = firstIndex;
+    BlockBuffer buffer;
+    BlockBuffer level1;
+    
+    // Load an existing pointer block, or start a fresh one from metaBlocks
+    auto loadOrCreate = [&](uint32_t& pointer, BlockBuffer& data) {
+        if (isValidBlock(pointer)) {
+            return disk_->readBlock(pointer, data.data());
+        }
+        if (metaNext >= metaBlocks.size()) {
+            std::cerr << "Missing pointer block for inode " << inode.inodeNumber << std::endl;
+            return false;
+        }
+        pointer = metaBlocks[metaNext++];
+        data.zero();
+        return true;
+    };
+    
+    // Direct blocks
+    for (; index < DIRECT_BLOCKS && next < dataBlocks.size(); ++index) {
+        inode.directBlocks[index] = dataBlocks[next++];
+    }
+    
+    // Single indirect
+    if (next < dataBlocks.size() && index < SINGLE_INDIRECT_LIMIT) {
+        if (!loadOrCreate(inode.indirectBlock, buffer)) {
+            return false;
+        }
+        uint32_t* pointers = reinterpret_cast<uint32_t*>(buffer.data());
+        for (; index < SINGLE_INDIRECT_LIMIT && next < dataBlocks.size(); ++index) {
+            pointers[index - DIRECT_BLOCKS] = dataBlocks[next++];
+        }
+        if (!disk_->writeMetadataBlock(inode.indirectBlock, buffer.data())) {
+            return false;
+        }
+    }
+    
+    // Double indirect
+    if (next < dataBlocks.size()) {
+        if (!loadOrCreate(inode.doubleIndirectBlock, level1)) {
+            return false;
+        }
+        uint32_t* l1 = reinterpret_cast<uint32_t*>(level1.data());
+        
+        while (next < dataBlocks.size()) {
+            uint64_t rel = index - SINGLE_INDIRECT_LIMIT;
+            uint32_t i1 = static_cast<uint32_t>(rel / POINTERS_PER_BLOCK);
+            uint32_t i2 = static_cast<uint32_t>(rel % POINTERS_PER_BLOCK);
+            
+            if (!loadOrCreate(l1[i1], buffer)) {
+                return false;
+            }
+            uint32_t* l2 = reinterpret_cast<uint32_t*>(buffer.data());
+            for (; i2 < POINTERS_PER_BLOCK && next < dataBlocks.size(); ++i2, ++index) {
+                l2[i2] = dataBlocks[next++];
+            }
+            if (!disk_->writeMetadataBlock(l1[i1], buffer.data())) {
+                return false;
+            }
+        }
+        
+        if (!disk_->writeMetadataBlock(inode.doubleIndirectBlock, level1.data())) {
+            return false;
+        }
+    }
+    
+    inode.blockCount += static_cast<uint32_t>(dataBlocks.size());
+    return true;
+}
+
+bool InodeManager::remapBlockPointers(Inode& inode, uint32_t firstIndex, const std::vector<uint32_t>& dataBlocks) {
+    // Every index is mapped already, so no new pointer block is needed
+    if (firstIndex + static_cast<uint64_t>(dataBlocks.size()) > inode.blockCount) {
+        return false;
+    }
+    
+    uint32_t blockCount = inode.blockCount;
+    bool success = setBlockPointers(inode, firstIndex, dataBlocks, {});
+    inode.blockCount = blockCount;
+    return success;
+}
+
+bool InodeManager::clearBlockPointers(Inode& inode, uint32_t keepBlocks, std::vector<uint32_t>& released) {
+    if (inode.hasInlineData()) {
+        return true;  // Nothing mapped
+    }
+    
+    auto blocks = getInodeBlocks(inode);
+    if (keepBlocks < blocks.size()) {
+        released.insert(released.end(), blocks.begin() + keepBlocks, blocks.end());
+    }
+    
+    // Direct blocks
+    for (uint32_t i = keepBlocks; i < DIRECT_BLOCKS; ++i) {
+        inode.directBlocks[i] = 0;
+    }
+    
+    BlockBuffer buffer;
+    
+    // Single indirect
+    if (isValidBlock(inode.indirectBlock)) {
+        if (keepBlocks <= DIRECT_BLOCKS) {
+            released.push_back(inode.indirectBlock);
+            inode.indirectBlock = 0;
+        } else if (keepBlocks < SINGLE_INDIRECT_LIMIT) {
+            if (!disk_->readBlock(inode.indirectBlock, buffer.data())) {
+                return false;
+            }
+            uint32_t* pointers = reinterpret_cast<uint32_t*>(buffer.data());
+            std::fill(pointers + (keepBlocks - DIRECT_BLOCKS), pointers + POINTERS_PER_BLOCK, 0);
+            if (!disk_->writeMetadataBlock(inode.indirectBlock, buffer.data())) {
+                return false;
+            }
+        }
+    }
+    
+    // Double indirect
+    if (isValidBlock(inode.doubleIndirectBlock)) {
+        BlockBuffer level1;
+        if (!disk_->readBlock(inode.doubleIndirectBlock, level1.data())) {
+            return false;
+        }
+        uint32_t* l1 = reinterpret_cast<uint32_t*>(level1.data());
+        uint64_t keepRel = keepBlocks > SINGLE_INDIRECT_LIMIT ? keepBlocks - SINGLE_INDIRECT_LIMIT : 0;
+        
+        for (uint32_t i1 = 0; i1 < POINTERS_PER_BLOCK; ++i1) {
+            if (!isValidBlock(l1[i1])) {
+                continue;
+            }
+            uint64_t first = static_cast<uint64_t>(i1) * POINTERS_PER_BLOCK;
+            if (first >= keepRel) {
+                released.push_back(l1[i1]);
+                l1[i1] = 0;
+            } else if (first + POINTERS_PER_BLOCK > keepRel) {
+                if (!disk_->readBlock(l1[i1], buffer.data())) {
+                    return false;
+                }
+                uint32_t* l2 = reinterpret_cast<uint32_t*>(buffer.data());
+                std::fill(l2 + (keepRel - first), l2 + POINTERS_PER_BLOCK, 0);
+                if (!disk_->writeMetadataBlock(l1[i1], buffer.data())) {
+                    return false;
+                }
+            }
+        }
+        
+        if (keepRel == 0) {
+            released.push_back(inode.doubleIndirectBlock);
+            inode.doubleIndirectBlock = 0;
+        } else if (!disk_->writeMetadataBlock(inode.doubleIndirectBlock, level1.data())) {
+            return false;
+        }
+    }
+    
+    inode.blockCount = std::min<uint32_t>(inode.blockCount, keepBlocks);
+    return true;
+}
+
+bool InodeManager::collectBlocks(const Inode& inode, std::vector<uint32_t>& dataBlocks,
+                                 std::vector<uint32_t>& metaBlocks, uint8_t* scratch) const {
+    dataBlocks.clear();
+    metaBlocks.clear();
+    if (inode.hasInlineData()) {
+        return true;
+    }
+    
+    for (uint32_t i = 0; i < DIRECT_BLOCKS; ++i) {
+        if (isValidBlock(inode.directBlocks[i])) {
+            dataBlocks.push_back(inode.directBlocks[i]);
+        }
+    }
+    
+    // Same rules as getInodeBlocks: stop at the first 0 pointer, skip invalid ones
+    auto appendPointers = [&](uint32_t blockNum, std::vector<uint32_t>& out) {
+        if (!disk_->readBlockShared(blockNum, scratch)) {
+            return false;
+        }
+        appendValidPointers(scratch, out);
+        return true;
+    };
+    
+    if (isValidBlock(inode.indirectBlock)) {
+        metaBlocks.push_back(inode.indirectBlock);
+        if (!appendPointers(inode.indirectBlock, dataBlocks)) {
+            return false;
+        }
+    }
+    
+    if (isValidBlock(inode.doubleIndirectBlock)) {
+        metaBlocks.push_back(inode.doubleIndirectBlock);
+        size_t firstLevel1 = metaBlocks.size();
+        if (!appendPointers(inode.doubleIndirectBlock, metaBlocks)) {
+            return false;
+        }
+        size_t lastLevel1 = metaBlocks.size();
+        for (size_t i = firstLevel1; i < lastLevel1; ++i) {
+            if (!appendPointers(metaBlocks[i], dataBlocks)) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
 bool InodeManager::readIndirectBlock(uint32_t blockNum, std::vector<uint32_t>& pointers) {
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
+    BlockBuffer buffer;
     if (!disk_->readBlock(blockNum, buffer.data())) {
         return false;
     }
     
+    parsePointers(buffer.data(), pointers);
+    return true;
+}
+
+void InodeManager::parsePointers(const uint8_t* block, std::vector<uint32_t>& pointers) {
     pointers.clear();
-    uint32_t* ptr = reinterpret_cast<uint32_t*>(buffer.data());
+    const uint32_t* ptr = reinterpret_cast<const uint32_t*>(block);
     uint32_t maxPointers = BLOCK_SIZE / sizeof(uint32_t);
     
     for (uint32_t i = 0; i < maxPointers && ptr[i] != 0; ++i) {
         pointers.push_back(ptr[i]);
     }
-    
-    return true;
+}
+
+void InodeManager::appendValidPointers(const uint8_t* block, std::vector<uint32_t>& blocks) const {
+    const uint32_t* ptr = reinterpret_cast<const uint32_t*>(block);
+    for (uint32_t i = 0; i < POINTERS_PER_BLOCK && ptr[i] != 0; ++i) {
+        // CRITICAL: Skip invalid indirect pointers
+        if (isValidBlock(ptr[i])) {
+            blocks.push_back(ptr[i]);
+        }
+    }
 }
 
 bool InodeManager::writeIndirectBlock(uint32_t blockNum, const std::vector<uint32_t>& pointers) {
-    std::vector<uint8_t> buffer(BLOCK_SIZE, 0);
+    BlockBuffer buffer;
+    buffer.zero();
     uint32_t* ptr = reinterpret_cast<uint32_t*>(buffer.data());
     
     for (size_t i = 0; i < pointers.size(); ++i) {
         ptr[i] = pointers[i];
     }
     
-    return disk_->writeBlock(blockNum, buffer.data());
+    return disk_->writeMetadataBlock(blockNum, buffer.data());
+}
+
+bool InodeManager::isValidBlock(uint32_t blockNum) const {
+    // Treat 0, -1 and out-of-range pointers as "no block"
+    return blockNum > 0 && blockNum != UINT32_MAX && blockNum < disk_->getSuperblock().totalBlocks;
 }
 
 uint32_t InodeManager::getMaxInodes() const {
@@ -1,10 +1,41 @@
 #include "Journal.h"
 #include "VirtualDisk.h"
+#include "BlockBuffer.h"
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 
 namespace FileSystemTool {
 
+namespace {
+
+constexpr uint32_t ENTRIES_PER_JOURNAL_BLOCK = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
+constexpr uint32_t BLOCKS_PER_DESCRIPTOR = 32;  // JournalEntry::blocks
+
+// FNV-1a; lets replay reject a group whose images were torn by a crash
+uint32_t checksum(uint32_t hash, const void* data, size_t length) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr uint32_t CHECKSUM_SEED = 2166136261u;
+
+// Begin records of per-operation transactions
+bool isBeginRecord(JournalOp op) {
+    return op != JournalOp::COMMIT && op != JournalOp::ABORT &&
+           op != JournalOp::BLOCK_MAP && op != JournalOp::BLOCK_COMMIT;
+}
+
+bool isBlockRecord(JournalOp op) {
+    return op == JournalOp::BLOCK_MAP || op == JournalOp::BLOCK_COMMIT;
+}
+
+} // namespace
+
 JournalEntry::JournalEntry() {
     reset();
 }
@@ -17,6 +48,7 @@ void JournalEntry::reset() {
     inodeNumber = 0;
     parentInodeNumber = 0;
     blockCount = 0;
+    sequence = 0;
     memset(padding, 0, sizeof(padding));
     memset(blocks, 0, sizeof(blocks));
     memset(filename, 0, sizeof(filename));
@@ -26,52 +58,182 @@ bool JournalEntry::isValid() const {
     return transactionId != 0;
 }
 
-Journal::Journal(VirtualDisk* disk) : disk_(disk), nextTransactionId_(1) {
+Journal::Journal(VirtualDisk* disk, uint32_t groupCommitSize)
+    : disk_(disk), nextTransactionId_(1), recordBlockCount_(0), imageCapacity_(0),
+      groupCommitSize_(groupCommitSize ? groupCommitSize : 1), pendingCommits_(0), replayedBlocks_(0),
+      dirtyBlockCount_(0), headSequence_(0), nextSequence_(0), committedSequence_(0),
+      checkpointSequence_(0), sealedGroups_(0), durableGroups_(0), pendingImages_(0),
+      imageHead_(0), imageNext_(0),
+      stopping_(false), checkpointRequested_(false), checkpointIntervalMs_(DEFAULT_CHECKPOINT_INTERVAL_MS) {
     const auto& sb = disk_->getSuperblock();
     journalStartBlock_ = sb.journalStart;
     journalBlockCount_ = sb.journalSize;
+    
+    // Header, then the record ring, then the image ring
+    if (journalBlockCount_ > 1) {
+        recordBlockCount_ = std::min(JOURNAL_RECORD_BLOCKS, journalBlockCount_ - 1);
+        imageCapacity_ = journalBlockCount_ - 1 - recordBlockCount_;
+    }
+    slots_.resize(static_cast<size_t>(recordBlockCount_) * ENTRIES_PER_JOURNAL_BLOCK);
+    dirtyBlocks_.assign(recordBlockCount_, 0);
+}
+
+Journal::~Journal() {
+    stopCheckpointThread();
 }
 
 bool Journal::initializeJournal() {
+    std::lock_guard<std::mutex> checkpointGuard(checkpointMutex_);
+    std::lock_guard<std::mutex> guard(mutex_);
+    
     // Clear journal
-    std::vector<uint8_t> zeros(BLOCK_SIZE, 0);
-    for (uint32_t i = 0; i < journalBlockCount_; ++i) {
-        if (!disk_->writeBlock(journalStartBlock_ + i, zeros.data())) {
+    for (auto& entry : slots_) {
+        entry.reset();
+    }
+    for (uint32_t i = 0; i < recordBlockCount_; ++i) {
+        if (!writeRecordBlock(i)) {
             return false;
         }
     }
+    
+    std::fill(dirtyBlocks_.begin(), dirtyBlocks_.end(), 0);
+    dirtyBlockCount_ = 0;
+    pendingCommits_ = 0;
+    openTransactions_.clear();
+    running_.clear();
+    committed_.clear();
+    pendingImages_ = 0;
+    headSequence_ = nextSequence_ = committedSequence_ = checkpointSequence_ = 0;
+    imageHead_ = imageNext_ = 0;
     nextTransactionId_ = 1;
-    return true;
+    return writeHeader(0) && disk_->flushStorage();
 }
 
 bool Journal::openJournal() {
-    // Scan for highest transaction ID
-    JournalEntry entry;
+    replayedBlocks_ = 0;
+    if (recordBlockCount_ == 0) {
+        return true;
+    }
+    
+    BlockBuffer buffer;
+    if (!disk_->readBlock(journalStartBlock_, buffer.data())) {
+        return false;
+    }
+    JournalHeader header;
+    memcpy(&header, buffer.data(), sizeof(JournalHeader));
+    if (header.magic != JOURNAL_MAGIC) {
+        // Freshly zeroed or older layout: nothing to replay
+        return initializeJournal();
+    }
+    
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::fill(dirtyBlocks_.begin(), dirtyBlocks_.end(), 0);
+    dirtyBlockCount_ = 0;
+    pendingCommits_ = 0;
+    openTransactions_.clear();
+    running_.clear();
+    committed_.clear();
+    pendingImages_ = 0;
+    imageHead_ = imageNext_ = 0;
     nextTransactionId_ = 1;
     
-    uint32_t entriesPerBlock = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
-    uint32_t maxEntries = journalBlockCount_ * entriesPerBlock;
+    // One sequential pass loads the whole record ring into the mirror
+    for (uint32_t i = 0; i < recordBlockCount_; ++i) {
+        auto* block = reinterpret_cast<uint8_t*>(&slots_[static_cast<size_t>(i) * ENTRIES_PER_JOURNAL_BLOCK]);
+        if (!disk_->readBlock(journalStartBlock_ + 1 + i, block)) {
+            return false;
+        }
+    }
+    
+    // The newest record marks the tail
+    bool found = false;
+    uint32_t lastSequence = 0;
+    for (uint32_t i = 0; i < slots_.size(); ++i) {
+        const auto& entry = slots_[i];
+        if (!entry.isValid() || slotFor(entry.sequence) != i) continue;
+        if (!found || entry.sequence > lastSequence) {
+            lastSequence = entry.sequence;
+            found = true;
+        }
+        if (entry.transactionId >= nextTransactionId_) {
+            nextTransactionId_ = entry.transactionId + 1;
+        }
+    }
     
-    for (uint32_t i = 0; i < maxEntries; ++i) {
-        if (readJournalEntry(i, entry) && entry.isValid()) {
-            if (entry.transactionId >= nextTransactionId_) {
-                nextTransactionId_ = entry.transactionId + 1;
+    nextSequence_ = found ? lastSequence + 1 : 0;
+    disk_->countMetric(MetricCounter::JOURNAL_SLOT_SCANS, slots_.size());
+    
+    // Replay the last lap in order: a begin opens a transaction, commit/abort resolves it,
+    // and a block group whose commit record checks out is redone
+    uint32_t capacity = static_cast<uint32_t>(slots_.size());
+    uint32_t firstSequence = nextSequence_ > capacity ? nextSequence_ - capacity : 0;
+    std::unordered_map<uint32_t, std::vector<JournalEntry>> groups;  // groupId -> descriptors
+    bool success = true;
+    disk_->countMetric(MetricCounter::JOURNAL_SLOT_SCANS, nextSequence_ - firstSequence);
+    
+    for (uint32_t seq = firstSequence; seq != nextSequence_; ++seq) {
+        const auto& entry = slots_[slotFor(seq)];
+        if (!entry.isValid() || entry.sequence != seq) continue;
+        
+        if (entry.operation == JournalOp::COMMIT || entry.operation == JournalOp::ABORT) {
+            openTransactions_.erase(entry.transactionId);
+        } else if (isBeginRecord(entry.operation)) {
+            openTransactions_[entry.transactionId] = seq;
+        } else if (seq < header.checkpointSequence) {
+            continue;  // Already home
+        } else if (entry.operation == JournalOp::BLOCK_MAP) {
+            groups[entry.transactionId].push_back(entry);
+        } else {
+            // BLOCK_COMMIT: load the group's images and verify them before writing home
+            auto it = groups.find(entry.transactionId);
+            if (it == groups.end() || imageCapacity_ == 0) continue;
+            
+            std::vector<std::pair<uint32_t, std::vector<uint8_t>>> images;
+            uint32_t hash = CHECKSUM_SEED;
+            for (const auto& descriptor : it->second) {
+                for (uint32_t i = 0; i < descriptor.blockCount && i < BLOCKS_PER_DESCRIPTOR; ++i) {
+                    std::vector<uint8_t> image(BLOCK_SIZE);
+                    if (!disk_->readBlock(imageBlockFor(descriptor.parentInodeNumber + i), image.data())) {
+                        return false;
+                    }
+                    hash = checksum(hash, &descriptor.blocks[i], sizeof(uint32_t));
+                    hash = checksum(hash, image.data(), BLOCK_SIZE);
+                    images.emplace_back(descriptor.blocks[i], std::move(image));
+                }
+            }
+            groups.erase(it);
+            
+            if (images.size() != entry.blockCount || hash != entry.blocks[0]) {
+                std::cerr << "Journal group " << entry.transactionId << " is torn, skipping" << std::endl;
+                continue;
             }
+            for (const auto& [blockNum, image] : images) {
+                success = disk_->writeBlockThrough(blockNum, image.data()) && success;
+            }
+            replayedBlocks_ += static_cast<uint32_t>(images.size());
         }
     }
     
-    return true;
+    // Everything logged so far is now home
+    committedSequence_ = checkpointSequence_ = nextSequence_;
+    headSequence_ = firstSequence;
+    advanceHead();
+    
+    if (replayedBlocks_ > 0) {
+        std::cout << "Journal replayed " << replayedBlocks_ << " metadata blocks" << std::endl;
+        success = disk_->flushStorage() && success;
+    }
+    return writeHeader(checkpointSequence_) && disk_->flushStorage() && success;
 }
 
 uint32_t Journal::beginTransaction(JournalOp op, uint32_t inodeNum, const std::string& filename) {
-    uint32_t slot = findFreeJournalSlot();
-    if (slot == UINT32_MAX) {
-        std::cerr << "Journal full" << std::endl;
-        return 0;
-    }
+    std::unique_lock<std::mutex> lock(mutex_);
     
+    // Taken up front: reserving log space may drop the lock, and the id must
+    // not be handed out again meanwhile
+    uint32_t transactionId = nextTransactionId_++;
     JournalEntry entry;
-    entry.transactionId = nextTransactionId_++;
+    entry.transactionId = transactionId;
     entry.operation = op;
     entry.committed = 0;
     entry.timestamp = time(nullptr);
@@ -82,114 +244,529 @@ uint32_t Journal::beginTransaction(JournalOp op, uint32_t inodeNum, const std::s
         strncpy(entry.filename, filename.c_str(), sizeof(entry.filename) - 1);
     }
     
-    if (!writeJournalEntry(slot, entry)) {
+    if (!appendEntry(lock, entry)) {
         return 0;
     }
     
-    return entry.transactionId;
+    openTransactions_[transactionId] = entry.sequence;
+    return transactionId;
 }
 
 bool Journal::commitTransaction(uint32_t transactionId) {
-    // Find transaction
-    JournalEntry entry;
-    uint32_t entriesPerBlock = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
-    uint32_t maxEntries = journalBlockCount_ * entriesPerBlock;
+    std::unique_lock<std::mutex> lock(mutex_);
     
-    for (uint32_t i = 0; i < maxEntries; ++i) {
-        if (readJournalEntry(i, entry) && entry.transactionId == transactionId) {
-            entry.committed = 1;
-            return writeJournalEntry(i, entry);
-        }
+    auto it = openTransactions_.find(transactionId);
+    if (it == openTransactions_.end()) {
+        return false;
+    }
+    
+    JournalEntry record;
+    record.transactionId = transactionId;
+    record.operation = JournalOp::COMMIT;
+    record.committed = 1;
+    record.timestamp = time(nullptr);
+    record.inodeNumber = slots_[slotFor(it->second)].inodeNumber;
+    
+    // Resolve first so the head can move past our own begin record if the log is full
+    openTransactions_.erase(it);
+    if (!appendEntry(lock, record)) {
+        return false;
     }
+    advanceHead();
     
-    return false;
+    // A group only closes once no other transaction is midway through staging into it
+    if (++pendingCommits_ >= groupCommitSize_ && openTransactions_.empty()) {
+        bool success = flushLocked(lock);
+        lock.unlock();
+        return disk_->releaseFreedExtents() && success;  // Blocks the group unlinked
+    }
+    return true;
 }
 
 bool Journal::abortTransaction(uint32_t transactionId) {
-    // Mark transaction as invalid
-    JournalEntry entry;
-    uint32_t entriesPerBlock = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
-    uint32_t maxEntries = journalBlockCount_ * entriesPerBlock;
+    std::unique_lock<std::mutex> lock(mutex_);
     
-    for (uint32_t i = 0; i < maxEntries; ++i) {
-        if (readJournalEntry(i, entry) && entry.transactionId == transactionId) {
-            entry.reset();
-            return writeJournalEntry(i, entry);
-        }
+    auto it = openTransactions_.find(transactionId);
+    if (it == openTransactions_.end()) {
+        return false;
+    }
+    
+    JournalEntry record;
+    record.transactionId = transactionId;
+    record.operation = JournalOp::ABORT;
+    record.timestamp = time(nullptr);
+    record.inodeNumber = slots_[slotFor(it->second)].inodeNumber;
+    
+    // Abort records ride along with the next flush
+    openTransactions_.erase(it);
+    if (!appendEntry(lock, record)) {
+        return false;
+    }
+    advanceHead();
+    return true;
+}
+
+bool Journal::addBlockToTransaction(uint32_t transactionId, uint32_t blockNum) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    
+    auto it = openTransactions_.find(transactionId);
+    if (it == openTransactions_.end()) {
+        return false;
+    }
+    
+    uint32_t slot = slotFor(it->second);
+    JournalEntry& entry = slots_[slot];
+    if (entry.blockCount >= BLOCKS_PER_DESCRIPTOR) {
+        return false;
     }
     
-    return false;
+    entry.blocks[entry.blockCount++] = blockNum;
+    markSlotDirty(slot);
+    return true;
 }
 
 std::vector<JournalEntry> Journal::getUncommittedTransactions() {
-    std::vector<JournalEntry> uncommitted;
-    JournalEntry entry;
+    std::lock_guard<std::mutex> guard(mutex_);
     
-    uint32_t entriesPerBlock = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
-    uint32_t maxEntries = journalBlockCount_ * entriesPerBlock;
+    std::vector<JournalEntry> uncommitted;
+    uncommitted.reserve(openTransactions_.size());
     
-    for (uint32_t i = 0; i < maxEntries; ++i) {
-        if (readJournalEntry(i, entry) && entry.isValid() && entry.committed == 0) {
-            uncommitted.push_back(entry);
-        }
+    for (const auto& [transactionId, sequence] : openTransactions_) {
+        uncommitted.push_back(slots_[slotFor(sequence)]);
     }
+    disk_->countMetric(MetricCounter::JOURNAL_SLOT_SCANS, uncommitted.size());
     
+    std::sort(uncommitted.begin(), uncommitted.end(),
+              [](const JournalEntry& a, const JournalEntry& b) { return a.sequence < b.sequence; });
     return uncommitted;
 }
 
 bool Journal::clearJournal() {
-    return initializeJournal();
+    // Pending images must reach home before the log is wiped
+    bool success = flush() && checkpoint();
+    return initializeJournal() && success;
+}
+
+bool Journal::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool success = flushLocked(lock);
+    lock.unlock();
+    return disk_->releaseFreedExtents() && success;
 }
 
-bool Journal::readJournalEntry(uint32_t index, JournalEntry& entry) {
-    uint32_t entriesPerBlock = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
-    uint32_t blockNum = journalStartBlock_ + (index / entriesPerBlock);
-    uint32_t offset = (index % entriesPerBlock) * JOURNAL_ENTRY_SIZE;
+bool Journal::hasPendingWrites() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return dirtyBlockCount_ > 0 || !running_.empty();
+}
+
+bool Journal::stageBlock(uint32_t blockNum, const uint8_t* data) {
+    if (imageCapacity_ == 0) {
+        return disk_->writeBlockThrough(blockNum, data);
+    }
     
-    if (blockNum >= journalStartBlock_ + journalBlockCount_) {
-        return false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    disk_->countMetric(MetricCounter::JOURNAL_STAGED_BLOCKS);
+    
+    // Keep a group small enough to fit the image ring alongside the previous one
+    auto it = running_.find(blockNum);
+    if (it == running_.end() && running_.size() >= imageCapacity_ / 2) {
+        if (!flushLocked(lock)) {
+            return false;
+        }
     }
     
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
-    if (!disk_->readBlock(blockNum, buffer.data())) {
+    PendingImage& image = running_[blockNum];
+    image.data.assign(data, data + BLOCK_SIZE);
+    image.sequence = 0;
+    pendingImages_ = running_.size() + committed_.size();
+    return true;
+}
+
+bool Journal::readPendingImage(uint32_t blockNum, uint8_t* buffer) {
+    if (pendingImages_ == 0) {
         return false;
     }
     
-    memcpy(&entry, buffer.data() + offset, sizeof(JournalEntry));
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = running_.find(blockNum);
+    if (it == running_.end()) {
+        it = committed_.find(blockNum);
+        if (it == committed_.end()) {
+            return false;
+        }
+    }
+    memcpy(buffer, it->second.data.data(), BLOCK_SIZE);
     return true;
 }
 
-bool Journal::writeJournalEntry(uint32_t index, const JournalEntry& entry) {
-    uint32_t entriesPerBlock = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
-    uint32_t blockNum = journalStartBlock_ + (index / entriesPerBlock);
-    uint32_t offset = (index % entriesPerBlock) * JOURNAL_ENTRY_SIZE;
+bool Journal::hasPendingImage(uint32_t blockNum) {
+    if (pendingImages_ == 0) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> guard(mutex_);
+    return running_.count(blockNum) || committed_.count(blockNum);
+}
+
+bool Journal::revokeBlock(uint32_t blockNum) {
+    if (pendingImages_ == 0) {
+        return true;
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_.count(blockNum) && !committed_.count(blockNum)) {
+        return true;
+    }
+    
+    // A freed metadata block is being reused: put its last image home first so
+    // neither a checkpoint nor a replay can overwrite the new contents later
+    if (!flushLocked(lock)) {
+        return false;
+    }
+    lock.unlock();
+    return checkpoint();
+}
+
+uint64_t Journal::getStagedGroupMark() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return running_.empty() ? sealedGroups_ : sealedGroups_ + 1;
+}
+
+bool Journal::isGroupMarkDurable(uint64_t mark) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return durableGroups_ >= mark;
+}
+
+bool Journal::checkpoint() {
+    std::lock_guard<std::mutex> checkpointGuard(checkpointMutex_);
+    
+    std::vector<std::pair<uint32_t, PendingImage>> snapshot;
+    uint32_t targetSequence;
+    uint32_t targetImage;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (checkpointSequence_ == committedSequence_) {
+            return true;
+        }
+        targetSequence = committedSequence_;
+        targetImage = imageNext_;
+        snapshot.reserve(committed_.size());
+        for (const auto& [blockNum, image] : committed_) {
+            snapshot.emplace_back(blockNum, image);
+        }
+    }
     
-    if (blockNum >= journalStartBlock_ + journalBlockCount_) {
+    // Home writes need no lock: readers keep using the journal copy until it is dropped
+    std::sort(snapshot.begin(), snapshot.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::vector<std::pair<uint32_t, const uint8_t*>> homeWrites;
+    homeWrites.reserve(snapshot.size());
+    for (const auto& [blockNum, image] : snapshot) {
+        homeWrites.emplace_back(blockNum, image.data.data());
+    }
+    bool success = disk_->writeBlocksDirect(homeWrites);  // One submission for the whole checkpoint
+    if (!success || !disk_->flushStorage() || !writeHeader(targetSequence) || !disk_->flushStorage()) {
+        std::cerr << "Journal checkpoint failed" << std::endl;
         return false;
     }
     
-    // Read-modify-write
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
-    if (!disk_->readBlock(blockNum, buffer.data())) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (const auto& [blockNum, image] : snapshot) {
+        auto it = committed_.find(blockNum);
+        if (it != committed_.end() && it->second.sequence == image.sequence) {
+            committed_.erase(it);
+        }
+    }
+    pendingImages_ = running_.size() + committed_.size();
+    checkpointSequence_ = targetSequence;
+    imageHead_ = targetImage;
+    advanceHead();
+    return true;
+}
+
+void Journal::startCheckpointThread() {
+    if (checkpointThread_.joinable() || imageCapacity_ == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(threadMutex_);
+        stopping_ = false;
+        checkpointRequested_ = false;
+    }
+    checkpointThread_ = std::thread(&Journal::checkpointLoop, this);
+}
+
+void Journal::stopCheckpointThread() {
+    if (!checkpointThread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(threadMutex_);
+        stopping_ = true;
+    }
+    threadCv_.notify_all();
+    checkpointThread_.join();
+}
+
+void Journal::setCheckpointInterval(uint32_t ms) {
+    checkpointIntervalMs_ = ms;  // Takes effect after the current wait
+}
+
+double Journal::getLogPressure() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return logPressureLocked();
+}
+
+uint32_t Journal::getTransactionCount() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return nextTransactionId_;
+}
+
+uint32_t Journal::getActiveTransactionCount() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return static_cast<uint32_t>(openTransactions_.size());
+}
+
+uint32_t Journal::getUsedSlots() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return nextSequence_ - headSequence_;
+}
+
+bool Journal::reserveRecords(std::unique_lock<std::mutex>& lock, uint32_t count) {
+    if (slots_.empty()) {
         return false;
     }
     
-    memcpy(buffer.data() + offset, &entry, sizeof(JournalEntry));
-    return disk_->writeBlock(blockNum, buffer.data());
+    advanceHead();
+    if (nextSequence_ - headSequence_ + count > slots_.size() && checkpointSequence_ != committedSequence_) {
+        // Block records pin the head until their images are home
+        lock.unlock();
+        bool success = checkpoint();
+        lock.lock();
+        if (!success) {
+            return false;
+        }
+        advanceHead();
+    }
+    
+    if (nextSequence_ - headSequence_ + count > slots_.size()) {
+        std::cerr << "Journal full" << std::endl;
+        return false;
+    }
+    return true;
 }
 
-uint32_t Journal::findFreeJournalSlot() {
-    JournalEntry entry;
-    uint32_t entriesPerBlock = BLOCK_SIZE / JOURNAL_ENTRY_SIZE;
-    uint32_t maxEntries = journalBlockCount_ * entriesPerBlock;
+bool Journal::appendEntry(std::unique_lock<std::mutex>& lock, JournalEntry& entry) {
+    if (!reserveRecords(lock, 1)) {
+        return false;
+    }
     
-    for (uint32_t i = 0; i < maxEntries; ++i) {
-        if (readJournalEntry(i, entry) && !entry.isValid()) {
-            return i;
+    entry.sequence = nextSequence_++;
+    uint32_t slot = slotFor(entry.sequence);
+    slots_[slot] = entry;
+    markSlotDirty(slot);
+    disk_->countMetric(MetricCounter::JOURNAL_RECORDS);
+    return true;
+}
+
+void Journal::advanceHead() {
+    // Stop at the oldest begin record still open, or the oldest block record not yet home
+    uint32_t startSequence = headSequence_;
+    while (headSequence_ != nextSequence_) {
+        const auto& entry = slots_[slotFor(headSequence_)];
+        if (entry.isValid() && entry.sequence == headSequence_) {
+            if (isBlockRecord(entry.operation)) {
+                if (headSequence_ >= checkpointSequence_) {
+                    break;
+                }
+            } else {
+                auto it = openTransactions_.find(entry.transactionId);
+                if (it != openTransactions_.end() && it->second == headSequence_) {
+                    break;
+                }
+            }
+        }
+        ++headSequence_;
+    }
+    disk_->countMetric(MetricCounter::JOURNAL_SLOT_SCANS, headSequence_ - startSequence);
+}
+
+void Journal::markSlotDirty(uint32_t slot) {
+    uint32_t block = slot / ENTRIES_PER_JOURNAL_BLOCK;
+    if (!dirtyBlocks_[block]) {
+        dirtyBlocks_[block] = 1;
+        dirtyBlockCount_++;
+    }
+}
+
+bool Journal::flushLocked(std::unique_lock<std::mutex>& lock) {
+    pendingCommits_ = 0;
+    bool success = running_.empty() || commitGroupLocked(lock);
+    if (dirtyBlockCount_ == 0) {
+        return success;
+    }
+    
+    bool written = true;
+    for (uint32_t i = 0; i < recordBlockCount_; ++i) {
+        if (dirtyBlocks_[i]) {
+            written = writeRecordBlock(i) && written;
+            dirtyBlocks_[i] = 0;
+        }
+    }
+    dirtyBlockCount_ = 0;
+    
+    // Every group sealed so far now has its commit record on stable storage
+    if (written && disk_->flushStorage()) {
+        durableGroups_ = sealedGroups_;
+    } else {
+        success = false;
+    }
+    
+    if (logPressureLocked() >= 0.5) {
+        requestCheckpoint();
+    }
+    return success;
+}
+
+bool Journal::commitGroupLocked(std::unique_lock<std::mutex>& lock) {
+    // Checkpointing drops the lock, and other threads may stage into (or commit)
+    // the group meanwhile, so it is sized again after every wait
+    uint32_t count = 0;
+    uint32_t descriptors = 0;
+    do {
+        count = static_cast<uint32_t>(running_.size());
+        if (count == 0) {
+            return true;
+        }
+        descriptors = (count + BLOCKS_PER_DESCRIPTOR - 1) / BLOCKS_PER_DESCRIPTOR;
+        
+        // Make room in the image ring by checkpointing older groups
+        if (imageNext_ - imageHead_ + count > imageCapacity_) {
+            lock.unlock();
+            bool success = checkpoint();
+            lock.lock();
+            if (!success) {
+                return false;
+            }
+            if (running_.size() != count) {
+                continue;
+            }
+        }
+        if (imageNext_ - imageHead_ + count > imageCapacity_ || !reserveRecords(lock, descriptors + 1)) {
+            std::cerr << "Journal full" << std::endl;
+            return false;
+        }
+    } while (running_.size() != count);
+    
+    // Ordered mode: data blocks are written before the metadata that refers to them
+    bool success = disk_->flushCache();
+    
+    std::vector<uint32_t> blocks;
+    blocks.reserve(count);
+    for (const auto& [blockNum, image] : running_) {
+        blocks.push_back(blockNum);
+    }
+    std::sort(blocks.begin(), blocks.end());
+    
+    uint32_t groupId = nextTransactionId_++;
+    uint32_t firstImage = imageNext_;
+    uint32_t hash = CHECKSUM_SEED;
+    JournalEntry descriptor;
+    
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t blockNum = blocks[i];
+        const auto& data = running_[blockNum].data;
+        success = disk_->writeBlockThrough(imageBlockFor(imageNext_), data.data()) && success;
+        hash = checksum(hash, &blockNum, sizeof(uint32_t));
+        hash = checksum(hash, data.data(), BLOCK_SIZE);
+        
+        if (descriptor.blockCount == 0) {
+            descriptor.reset();
+            descriptor.transactionId = groupId;
+            descriptor.operation = JournalOp::BLOCK_MAP;
+            descriptor.timestamp = time(nullptr);
+            descriptor.parentInodeNumber = imageNext_;
+        }
+        descriptor.blocks[descriptor.blockCount++] = blockNum;
+        imageNext_++;
+        
+        if (descriptor.blockCount == BLOCKS_PER_DESCRIPTOR || i + 1 == count) {
+            appendEntry(lock, descriptor);  // Space reserved above
+            descriptor.blockCount = 0;
         }
     }
     
-    return UINT32_MAX;
+    JournalEntry record;
+    record.transactionId = groupId;
+    record.operation = JournalOp::BLOCK_COMMIT;
+    record.committed = 1;
+    record.timestamp = time(nullptr);
+    record.parentInodeNumber = firstImage;
+    record.blockCount = count;
+    record.blocks[0] = hash;
+    appendEntry(lock, record);
+    
+    // Committed images stay readable from memory until checkpoint puts them home
+    committedSequence_ = nextSequence_;
+    for (auto& [blockNum, image] : running_) {
+        image.sequence = committedSequence_;
+        committed_[blockNum] = std::move(image);
+    }
+    running_.clear();
+    sealedGroups_++;
+    pendingImages_ = committed_.size();
+    return success;
+}
+
+bool Journal::writeRecordBlock(uint32_t index) {
+    // Slots are laid out exactly as on disk, so the block is written from the mirror
+    const auto* buffer = reinterpret_cast<const uint8_t*>(&slots_[static_cast<size_t>(index) * ENTRIES_PER_JOURNAL_BLOCK]);
+    return disk_->writeBlockThrough(journalStartBlock_ + 1 + index, buffer);
+}
+
+bool Journal::writeHeader(uint32_t checkpointSequence) {
+    // Also written by the checkpoint thread, so it bypasses the cache
+    BlockBuffer buffer;
+    buffer.zero();
+    JournalHeader header;
+    header.magic = JOURNAL_MAGIC;
+    header.checkpointSequence = checkpointSequence;
+    memcpy(buffer.data(), &header, sizeof(JournalHeader));
+    return disk_->writeBlockDirect(journalStartBlock_, buffer.data());
+}
+
+double Journal::logPressureLocked() const {
+    double records = slots_.empty() ? 0.0 : static_cast<double>(nextSequence_ - headSequence_) / slots_.size();
+    double images = imageCapacity_ == 0 ? 0.0 :
+        static_cast<double>(imageNext_ - imageHead_ + running_.size()) / imageCapacity_;
+    return std::min(1.0, std::max(records, images));
+}
+
+void Journal::requestCheckpoint() {
+    {
+        std::lock_guard<std::mutex> guard(threadMutex_);
+        checkpointRequested_ = true;
+    }
+    threadCv_.notify_all();
+}
+
+void Journal::checkpointLoop() {
+    std::unique_lock<std::mutex> lock(threadMutex_);
+    while (!stopping_) {
+        uint32_t interval = checkpointIntervalMs_;
+        auto ready = [this] { return stopping_ || checkpointRequested_; };
+        if (interval == 0) {
+            threadCv_.wait(lock, ready);
+        } else {
+            threadCv_.wait_for(lock, std::chrono::milliseconds(interval), ready);
+        }
+        if (stopping_) break;
+        
+        checkpointRequested_ = false;
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+    }
 }
 
 } // namespace FileSystemTool
@@ -3,6 +3,8 @@
 #include "PerformanceWidget.h"
 #include "ControlPanel.h"
 #include "FileBrowserWidget.h"
+#include "OperationRunner.h"
+#include "RefreshBus.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QSplitter>
@@ -14,9 +16,8 @@
 #include <QFileInfo>
 #include <QFile>
 #include <QDir>
-#include <QThread>
-#include <QApplication>
 #include <chrono>
+#include <memory>
 #include <cstdlib>  // for rand()
 #include <ctime>    // for time()
 #include <QCloseEvent>
@@ -25,10 +26,17 @@
 
 namespace FileSystemTool {
 
+constexpr int OPERATION_REFRESH_MS = 250;     // Widget refresh period while an operation runs
+constexpr uint32_t BENCHMARK_FILES = 50;      // Same size as the defrag's before/after runs
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
       fileSystem_(nullptr),
       defragMgr_(nullptr),
+      runner_(new OperationRunner(this)),
+      refreshTimer_(new QTimer(this)),
+      refreshBus_(new RefreshBus(this)),
+      activeProgressBar_(nullptr),
       writeTimer_(new QTimer(this)),
       blocksWritten_(0),
       totalBlocksToWrite_(0),
@@ -54,6 +62,8 @@ MainWindow::MainWindow(QWidget *parent)
 }
 
 MainWindow::~MainWindow() {
+    runner_->cancel();
+    runner_->wait();
     if (fileSystem_ && fileSystem_->isMounted()) {
         fileSystem_->unmountFileSystem();
     }
@@ -84,6 +94,7 @@ void MainWindow::setupUI() {
     
     controlPanel_ = new ControlPanel(this);  // Still create it for functionality
     controlPanel_->hide();  // Hide the actual widget, we'll use its logic
+    controlPanel_->setOperationRunner(runner_);
     
     // Action buttons: Read, Delete (with space-between layout)
     readFileBtn_ = new QPushButton("Read", this);
@@ -255,12 +266,18 @@ void MainWindow::setupUI() {
     defragBtn_->setStyleSheet("background-color: #3498db; color: white; font-weight: bold;");
     defragBtn_->setMinimumHeight(40);
     
+    // Benchmark button
+    benchmarkBtn_ = new QPushButton("Run Benchmark", this);
+    benchmarkBtn_->setStyleSheet("background-color: #8e44ad; color: white; font-weight: bold;");
+    benchmarkBtn_->setMinimumHeight(40);
+    
     progressBar_ = new QProgressBar(this);
     progressBar_->setVisible(false);
     
     recoveryLayout->addWidget(crashBtn_);
     recoveryLayout->addWidget(recoveryBtn_);
     recoveryLayout->addWidget(defragBtn_);
+    recoveryLayout->addWidget(benchmarkBtn_);
     recoveryLayout->addWidget(progressBar_);
     recoveryLayout->addStretch();
     
@@ -304,6 +321,14 @@ void MainWindow::setupMenuBar() {
     
     fileMenu->addSeparator();
     
+    // triggered, not toggled: unchecking it from code must not prompt for a save
+    recordTraceAction_ = fileMenu->addAction("Record &Trace");
+    recordTraceAction_->setCheckable(true);
+    recordTraceAction_->setToolTip("Record file operations for chrome://tracing or ui.perfetto.dev");
+    connect(recordTraceAction_, &QAction::triggered, this, &MainWindow::onRecordTrace);
+    
+    fileMenu->addSeparator();
+    
     QAction* exitAction = fileMenu->addAction("E&xit");
     connect(exitAction, &QAction::triggered, this, &MainWindow::onExit);
     
@@ -350,7 +375,6 @@ void MainWindow::connectSignals() {
         }
         
         QString filename = selectedFiles.first();
-        std::vector<uint8_t> data;
         
         // Get file size first to calculate blocks
         auto entries = fileSystem_->listDir("/");
@@ -385,42 +409,53 @@ void MainWindow::connectSignals() {
         int blocksToRead = (fileSizeBytes + 4095) / 4096;
         
         // Configure progress for reading
-        writeProgressBar_->setMaximum(blocksToRead);
+        writeProgressBar_->setMaximum(100);
         writeProgressBar_->setValue(0);
         writeProgressBar_->setFormat(QString("Reading %1: %p%").arg(filename));
-        
-        // Simulate incremental read (1 block/sec)
-        for (int i = 0; i < blocksToRead; ++i) {
-            writeProgressBar_->setValue(i + 1);
-            QApplication::processEvents();
-            
-            if (i < blocksToRead - 1) {
-                QThread::msleep(1000);  // 1 second per block
+        activeProgressBar_ = writeProgressBar_;
+        
+        FileSystem* fs = fileSystem_.get();
+        std::string path = filename.toStdString();
+        auto data = std::make_shared<std::vector<uint8_t>>();
+        auto latencyMs = std::make_shared<double>(0.0);
+        
+        runner_->start("Read", [fs, path, blocksToRead, data, latencyMs](
+                const OperationRunner::ProgressCallback& progress, const CancellationToken& cancelled) {
+            // Simulate incremental read (1 block/sec)
+            for (int i = 0; i < blocksToRead; ++i) {
+                progress((i + 1) * 100 / blocksToRead, "");
+                if (i < blocksToRead - 1 && !OperationRunner::pause(cancelled, 1000)) {
+                    return false;  // 1 second per block
+                }
             }
-        }
-        
-        // Actual read
-        auto startTime = std::chrono::high_resolution_clock::now();
-        if (fileSystem_->readFile(filename.toStdString(), data)) {
-            auto endTime = std::chrono::high_resolution_clock::now();
-            double latencyMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
             
-            logOutput_->append(QString("[SUCCESS] Read file: %1 (%2 bytes, %3 blocks)")
-                             .arg(filename).arg(data.size()).arg(blocksToRead));
-            // Show first 200 bytes as preview
-            QString preview = QString::fromUtf8(reinterpret_cast<const char*>(data.data()), 
-                                               std::min(200, (int)data.size()));
-            logOutput_->append(QString("Preview: %1...").arg(preview));
+            // Actual read
+            auto startTime = std::chrono::high_resolution_clock::now();
+            bool success = fs->readFile(path, *data);
+            auto endTime = std::chrono::high_resolution_clock::now();
+            *latencyMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+            return success;
+        }, [this, filename, blocksToRead, data, latencyMs](bool success, bool cancelled) {
+            if (success) {
+                logOutput_->append(QString("[SUCCESS] Read file: %1 (%2 bytes, %3 blocks)")
+                                 .arg(filename).arg(data->size()).arg(blocksToRead));
+                // Show first 200 bytes as preview
+                QString preview = QString::fromUtf8(reinterpret_cast<const char*>(data->data()), 
+                                                   std::min(200, (int)data->size()));
+                logOutput_->append(QString("Preview: %1...").arg(preview));
+                
+                // Record read latency for graph
+                performanceWidget_->recordReadOperation(*latencyMs);
+            } else if (cancelled) {
+                logOutput_->append(QString("[INFO] Read cancelled: %1").arg(filename));
+            } else {
+                logOutput_->append(QString("[ERROR] Failed to read file: %1").arg(filename));
+            }
             
-            // Record read latency for graph
-            performanceWidget_->recordReadOperation(latencyMs);
-        } else {
-            logOutput_->append(QString("[ERROR] Failed to read file: %1").arg(filename));
-        }
-        
-        // Reset progress
-        writeProgressBar_->setValue(0);
-        writeProgressBar_->setFormat("Ready");
+            // Reset progress
+            writeProgressBar_->setValue(0);
+            writeProgressBar_->setFormat("Ready");
+        });
     });
     
     // Create file button → incremental block-by-block write with random data
@@ -450,13 +485,10 @@ void MainWindow::connectSignals() {
                          .arg(sizeKB).arg(filename).arg(blocksNeeded));
         
         // Configure progress bar
-        writeProgressBar_->setMaximum(blocksNeeded);
+        writeProgressBar_->setMaximum(100);
         writeProgressBar_->setValue(0);
         writeProgressBar_->setFormat(QString("Writing %1: %p%").arg(filename));
-        
-        // Disable buttons
-        createFileBtn_->setEnabled(false);
-        writeRandomBtn_->setEnabled(false);
+        activeProgressBar_ = writeProgressBar_;
         
         // Generate random alphanumeric data
         std::vector<uint8_t> allData(sizeKB * 1024);
@@ -465,56 +497,56 @@ void MainWindow::connectSignals() {
             allData[i] = alphanumeric[rand() % (sizeof(alphanumeric) - 1)];
         }
         
-        auto startTime = std::chrono::high_resolution_clock::now();
+        FileSystem* fs = fileSystem_.get();
+        std::string path = filename.toStdString();
+        auto elapsedMs = std::make_shared<double>(0.0);
         
-        // Write data block by block (1 block = 4KB/sec)
-        const int BLOCK_SIZE = 4096;
-        
-        for (int i = 0; i < blocksNeeded; ++i) {
-            writeProgressBar_->setValue(i + 1);
-            
-            // Write incrementally
-            int startByte = 0;
-            int endByte = std::min(startByte + (i + 1) * BLOCK_SIZE, (int)allData.size());
-            std::vector<uint8_t> incrementalData(allData.begin(), 
-                                                 allData.begin() + endByte);
-            
-            fileSystem_->writeFile(filename.toStdString(), incrementalData);
-            
-            // Rebuild ownership and refresh
-            fileSystem_->rebuildBlockOwnership();
-            blockMapWidget_->refresh();
-            fileBrowserWidget_->refresh();
+        // Write data block by block (1 block = 4KB/sec); the refresh timer shows each block land
+        runner_->start("Create", [fs, path, allData, blocksNeeded, elapsedMs](
+                const OperationRunner::ProgressCallback& progress, const CancellationToken& cancelled) {
+            const int BLOCK_SIZE = 4096;
+            auto startTime = std::chrono::high_resolution_clock::now();
             
-            QApplication::processEvents();
+            for (int i = 0; i < blocksNeeded; ++i) {
+                // Write incrementally
+                int endByte = std::min((i + 1) * BLOCK_SIZE, (int)allData.size());
+                std::vector<uint8_t> incrementalData(allData.begin(), 
+                                                     allData.begin() + endByte);
+                
+                if (!fs->writeFile(path, incrementalData)) {
+                    return false;
+                }
+                progress((i + 1) * 100 / blocksNeeded, "");
+                
+                if (i < blocksNeeded - 1 && !OperationRunner::pause(cancelled, 1000)) {
+                    return false;  // 1 sec = 4KB/sec
+                }
+            }
             
-            if (i < blocksNeeded - 1) {
-                QThread::msleep(1000);  // 1 sec = 4KB/sec
+            auto endTime = std::chrono::high_resolution_clock::now();
+            *elapsedMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+            return true;
+        }, [this, filename, sizeKB, blocksNeeded, elapsedMs](bool success, bool cancelled) {
+            if (success) {
+                double speedKBps = (sizeKB / (*elapsedMs / 1000.0));
+                logOutput_->append(QString("[SUCCESS] Created %1 (%2 KB, %3 blocks) at %4 KB/s")
+                                 .arg(filename).arg(sizeKB).arg(blocksNeeded).arg(speedKBps, 0, 'f', 1));
+                filenameInput_->clear();
+                
+                // Update graphs
+                performanceWidget_->updateMetrics();
+                performanceWidget_->recordOperation();  // Track fragmentation
+                performanceWidget_->recordWriteOperation(*elapsedMs / blocksNeeded);  // Avg per block
+            } else if (cancelled) {
+                logOutput_->append(QString("[INFO] Write cancelled: %1").arg(filename));
+            } else {
+                logOutput_->append(QString("[ERROR] Failed to write file: %1").arg(filename));
             }
-        }
-        
-        auto endTime = std::chrono::high_resolution_clock::now();
-        double elapsedMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
-        double speedKBps = (sizeKB / (elapsedMs / 1000.0));
-        
-        logOutput_->append(QString("[SUCCESS] Created %1 (%2 KB, %3 blocks) at %4 KB/s")
-                         .arg(filename).arg(sizeKB).arg(blocksNeeded).arg(speedKBps, 0, 'f', 1));
-        filenameInput_->clear();
-        
-        // Reset progress
-        writeProgressBar_->setValue(0);
-        writeProgressBar_->setFormat("Ready");
-        
-        // Re-enable buttons
-        createFileBtn_->setEnabled(true);
-        writeRandomBtn_->setEnabled(true);
-        
-        // Update widgets and graphs
-        performanceWidget_->updateMetrics();
-        performanceWidget_->recordOperation();  // Track fragmentation
-        performanceWidget_->recordWriteOperation(elapsedMs / blocksNeeded);  // Avg per block
-        
-        updateAllWidgets();
+            
+            // Reset progress
+            writeProgressBar_->setValue(0);
+            writeProgressBar_->setFormat("Ready");
+        });
     });
     
     // Write random files button → create multiple 4KB files with incremental animation
@@ -527,49 +559,34 @@ void MainWindow::connectSignals() {
         int numFiles = numFilesCombo_->currentText().toInt();
         logOutput_->append(QString("[INFO] Creating %1 random files (4KB each)...").arg(numFiles));
         
-        // Disable buttons
-        writeRandomBtn_->setEnabled(false);
-        createFileBtn_->setEnabled(false);
-        
-        std::vector<uint8_t> fileData(4096, 0xBB);  // 4KB file with pattern
-        
         // Use timestamp to ensure unique filenames on multiple clicks
         qint64 timestamp = QDateTime::currentMSecsSinceEpoch() / 1000;  // Unix timestamp
         
+        std::vector<BatchFile> files(numFiles);
         for (int i = 0; i < numFiles; ++i) {
-            QString filename = QString("/random_%1_%2.dat").arg(timestamp).arg(i + 1);
-            
-            // Create and write file
-            if (fileSystem_->createFile(filename.toStdString()) &&
-                fileSystem_->writeFile(filename.toStdString(), fileData)) {
-                
-                // Update ownership and display
-                fileSystem_->rebuildBlockOwnership();
-                blockMapWidget_->refresh();
-                
-                // Update progress
-                writeProgressBar_->setMaximum(numFiles);
-                writeProgressBar_->setValue(i + 1);
-                writeProgressBar_->setFormat(QString("Creating files: %1/%2").arg(i + 1).arg(numFiles));
-                
-                QApplication::processEvents();
-                QThread::msleep(100);  // Small delay for visibility
-            } else {
-                logOutput_->append(QString("[ERROR] Failed to create file: %1").arg(filename));
-            }
+            files[i].path = QString("/random_%1_%2.dat").arg(timestamp).arg(i + 1).toStdString();
+            files[i].data.assign(4096, 0xBB);  // 4KB file with pattern
         }
         
-        logOutput_->append(QString("[SUCCESS] Created %1 files (4KB each)").arg(numFiles));
-        
-        // Reset progress bar
+        writeProgressBar_->setMaximum(100);
         writeProgressBar_->setValue(0);
-        writeProgressBar_->setFormat("Ready");
-        
-        // Re-enable buttons
-        writeRandomBtn_->setEnabled(true);
-        createFileBtn_->setEnabled(true);
-        
-        updateAllWidgets();
+        writeProgressBar_->setFormat(QString("Creating %1 files: %p%").arg(numFiles));
+        activeProgressBar_ = writeProgressBar_;
+        
+        // One file per batch with a small delay, so the block map fills visibly
+        runner_->startImport(fileSystem_.get(), std::move(files), [this, numFiles](bool success, bool cancelled) {
+            if (success) {
+                logOutput_->append(QString("[SUCCESS] Created %1 files (4KB each)").arg(numFiles));
+            } else if (cancelled) {
+                logOutput_->append("[INFO] Creating random files cancelled");
+            } else {
+                logOutput_->append("[ERROR] Failed to create some random files");
+            }
+            
+            // Reset progress bar
+            writeProgressBar_->setValue(0);
+            writeProgressBar_->setFormat("Ready");
+        }, 1, 100);
     });
     
     // Power Cut Button Handler - New Interactive Flow
@@ -678,37 +695,61 @@ void MainWindow::connectSignals() {
         logOutput_->append("====================================");
         logOutput_->append("[🔧 RECOVERY] Starting recovery process...");
         
-        // Run recovery
-        if (fileSystem_->runRecovery()) {
-            int freeBlocks = fileSystem_->getDisk()->getFreeBlocks();
-            int totalBlocks = fileSystem_->getDisk()->getTotalBlocks();
-            int usedBlocks = totalBlocks - freeBlocks;
-            
-            logOutput_->append("[SUCCESS] File system recovered successfully!");
-            logOutput_->append(QString("[STATUS] Free blocks: %1, Used blocks: %2").arg(freeBlocks).arg(usedBlocks));
-            
-            // Update health chart: After Recovery state (no orphaned blocks)
-            performanceWidget_->updateHealthChart(freeBlocks, usedBlocks, 0);
+        progressBar_->setVisible(true);
+        progressBar_->setRange(0, 0);  // No phases to report; busy indicator
+        
+        // Run recovery (holds the file system exclusively; the widgets keep their last snapshot)
+        FileSystem* fs = fileSystem_.get();
+        runner_->start("Recovery", [fs](const OperationRunner::ProgressCallback&, const CancellationToken&) {
+            return fs->runRecovery();
+        }, [this](bool success, bool) {
+            progressBar_->setRange(0, 100);
+            progressBar_->setVisible(false);
             
-            // Re-enable all operations
-            writeRandomBtn_->setEnabled(true);
-            createFileBtn_->setEnabled(true);
-            deleteFileBtn_->setEnabled(true);
-            readFileBtn_->setEnabled(true);
-            defragBtn_->setEnabled(true);
-            crashBtn_->setEnabled(true);
-            recoveryBtn_->setEnabled(false);
+            if (success) {
+                int freeBlocks = fileSystem_->getDisk()->getFreeBlocks();
+                int totalBlocks = fileSystem_->getDisk()->getTotalBlocks();
+                int usedBlocks = totalBlocks - freeBlocks;
+                
+                logOutput_->append("[SUCCESS] File system recovered successfully!");
+                logOutput_->append(QString("[STATUS] Free blocks: %1, Used blocks: %2").arg(freeBlocks).arg(usedBlocks));
+                
+                // Update health chart: After Recovery state (no orphaned blocks)
+                performanceWidget_->updateHealthChart(freeBlocks, usedBlocks, 0);
+                performanceWidget_->recordOperation();  // Track fragmentation over time
+            } else {
+                logOutput_->append("[ERROR] Recovery failed");
+            }
             
-            // Refresh UI
-            blockMapWidget_->refresh();
-            fileBrowserWidget_->refresh();
-            performanceWidget_->updateMetrics();
-            performanceWidget_->recordOperation();  // Track fragmentation over time
-        } else {
-            logOutput_->append("[ERROR] Recovery failed");
+            // Operations are re-enabled (and the widgets refreshed) when the runner finishes
+            logOutput_->append("====================================");
+        });
+    });
+    
+    connect(benchmarkBtn_, &QPushButton::clicked, this, [this]() {
+        if (!fileSystem_ || !fileSystem_->isMounted()) {
+            logOutput_->append("[ERROR] No disk mounted");
+            return;
         }
         
-        logOutput_->append("====================================");
+        logOutput_->append("[INFO] Running benchmark...");
+        progressBar_->setVisible(true);
+        progressBar_->setRange(0, 100);
+        progressBar_->setValue(0);
+        activeProgressBar_ = progressBar_;
+        
+        runner_->startBenchmark(defragMgr_.get(), BENCHMARK_FILES, [this](bool success, const BenchmarkResults& results) {
+            progressBar_->setVisible(false);
+            if (success) {
+                logOutput_->append(QString("[BENCHMARK] Read: %1 ms | Write: %2 ms | Seek: %3 ms (%4 ops)")
+                                 .arg(results.avgReadTimeMs, 0, 'f', 3)
+                                 .arg(results.avgWriteTimeMs, 0, 'f', 3)
+                                 .arg(results.avgSeekTimeMs, 0, 'f', 3)
+                                 .arg(results.totalOperations));
+            } else {
+                logOutput_->append("[ERROR] Benchmark failed");
+            }
+        });
     });
     
     connect(defragBtn_, &QPushButton::clicked, this, [this]() {
@@ -717,24 +758,29 @@ void MainWindow::connectSignals() {
             return;
         }
         
+        // The control panel starts the defrag on the runner, or cancels the running one
+        bool wasRunning = runner_->isRunning();
+        controlPanel_->runDefrag();
+        if (wasRunning || !runner_->isRunning()) {
+            return;
+        }
+        
         logOutput_->append("[INFO] Running defragmentation...");
+        defragBtn_->setText("Cancel Defragmentation");
         progressBar_->setVisible(true);
         progressBar_->setValue(0);
         progressBar_->setMaximum(100);
-        
-        // Run defragmentation
-        bool cancelled = false;
-        controlPanel_->runDefrag();
+        activeProgressBar_ = progressBar_;
+    });
+    
+    connect(controlPanel_, &ControlPanel::defragCompleted, this, [this](bool success) {
+        defragBtn_->setText("Run Defragmentation");
         
         // CRITICAL: Rebuild ownership map from new block locations
         fileSystem_->rebuildBlockOwnership();
         
-        // Force complete refresh of ALL widgets
-        blockMapWidget_->setFileSystem(fileSystem_.get());
-        blockMapWidget_->refresh();
-        
-        fileBrowserWidget_->setFileSystem(fileSystem_.get());
-        performanceWidget_->setFileSystem(fileSystem_.get());
+        // Blocks moved all over the disk: redraw every widget from scratch
+        refreshBus_->postReset();
         performanceWidget_->setDefragManager(defragMgr_.get());
         performanceWidget_->updateMetrics();
         
@@ -747,14 +793,43 @@ void MainWindow::connectSignals() {
             performanceWidget_->updateHealthChart(freeBlocks, usedBlocks, 0);
         }
         
-        updateAllWidgets();
         progressBar_->setValue(100);
-        logOutput_->append("[SUCCESS] Defragmentation complete - check bitmap and file fragments");
-        
-        QThread::msleep(500);
-        progressBar_->setVisible(false);
+        if (success) {
+            logOutput_->append("[SUCCESS] Defragmentation complete - check bitmap and file fragments");
+        } else {
+            logOutput_->append("[INFO] Defragmentation stopped - files moved so far stay defragmented");
+        }
         
+        QTimer::singleShot(500, progressBar_, [this]() { progressBar_->setVisible(false); });
+    });
+    
+    // Long operations: progress, button states and periodic refresh while one runs
+    connect(runner_, &OperationRunner::progress, this, [this](int percent, const QString&) {
+        if (activeProgressBar_) {
+            activeProgressBar_->setValue(percent);
+        }
+    });
+    connect(runner_, &OperationRunner::started, this, [this]() {
+        updateOperationButtons();
+        refreshTimer_->start(OPERATION_REFRESH_MS);
+    });
+    connect(runner_, &OperationRunner::finished, this, [this]() {
+        refreshTimer_->stop();
+        activeProgressBar_ = nullptr;
+        fileBrowserWidget_->refresh();  // Its bus updates were skipped while the operation ran
         updateAllWidgets();
+        updateStatusBar();
+    });
+    connect(refreshTimer_, &QTimer::timeout, this, &MainWindow::refreshDuringOperation);
+    
+    // Every widget refresh goes through the bus, at most once per frame
+    connect(refreshBus_, &RefreshBus::changed, this, [this](const ChangeSet& changes) {
+        blockMapWidget_->applyChanges(changes);
+        performanceWidget_->applyChanges(changes);
+        // listDir would wait for a running operation; the browser catches up when it ends
+        if (!runner_->isRunning()) {
+            fileBrowserWidget_->applyChanges(changes);
+        }
     });
 }
 
@@ -780,8 +855,19 @@ void MainWindow::onNewDisk() {
     
     std::cout << "Creating file system..." << std::endl;
     
+    // Nothing may still be running against (or refresh from) the old file system
+    runner_->cancel();
+    runner_->wait();
+    refreshBus_->setFileSystem(nullptr);
+    
+    // The managers (and the scrub thread) must not outlive the old file system
+    recoveryMgr_.reset();
+    defragMgr_.reset();
+    
     // Create new file system using constructor
     fileSystem_ = std::make_unique<FileSystem>(diskPath.toStdString());
+    fileSystem_->getMetrics().setEnabled(true);  // Percentiles for the performance panel
+    recordTraceAction_->setChecked(false);
     
     if (!fileSystem_->createFileSystem()) {
         QMessageBox::critical(this, "Error", "Failed to create file system");
@@ -800,10 +886,10 @@ void MainWindow::onNewDisk() {
     performanceWidget_->setFileSystem(fileSystem_.get());
     fileBrowserWidget_->setFileSystem(fileSystem_.get());
     controlPanel_->setFileSystem(fileSystem_.get());
+    refreshBus_->setFileSystem(fileSystem_.get());
     controlPanel_->setRecoveryManager(recoveryMgr_.get());
     controlPanel_->setDefragManager(defragMgr_.get());
     
-    // DON'T rebuild ownership on empty disk!
     // Refresh all widgets
     updateAllWidgets();
     updateStatusBar();
@@ -824,8 +910,16 @@ void MainWindow::onOpenDisk() {
     
     if (diskPath.isEmpty()) return;
     
+    runner_->cancel();
+    runner_->wait();
+    refreshBus_->setFileSystem(nullptr);
+    recoveryMgr_.reset();
+    defragMgr_.reset();
+    
     // Mount existing disk using constructor
     fileSystem_ = std::make_unique<FileSystem>(diskPath.toStdString());
+    fileSystem_->getMetrics().setEnabled(true);
+    recordTraceAction_->setChecked(false);
     if (!fileSystem_->mountFileSystem()) {
         QMessageBox::critical(this, "Error", "Failed to mount disk");
         fileSystem_.reset();
@@ -841,11 +935,22 @@ void MainWindow::onOpenDisk() {
     performanceWidget_->setFileSystem(fileSystem_.get());
     fileBrowserWidget_->setFileSystem(fileSystem_.get());
     controlPanel_->setFileSystem(fileSystem_.get());
+    refreshBus_->setFileSystem(fileSystem_.get());
     controlPanel_->setRecoveryManager(recoveryMgr_.get());
     controlPanel_->setDefragManager(defragMgr_.get());
     
-    // DON'T rebuild ownership automatically - it will rebuild on demand when files are accessed
-    // This prevents crashes from reading uninitialized blocks
+    // After a crash only the regions marked dirty need checking; the scrub covers the rest
+    if (fileSystem_->wasUncleanMount()) {
+        ConsistencyReport report = recoveryMgr_->checkDirtyRegions();
+        if (report.isConsistent) {
+            logOutput_->append("[INFO] Unclean shutdown: dirty regions verified consistent");
+        } else {
+            logOutput_->append("[ERROR] Unclean shutdown: dirty regions are inconsistent - run recovery");
+        }
+    }
+    recoveryMgr_->startScrub();
+    
+    // Block ownership was rebuilt by mountFileSystem
     
     // Refresh all widgets
     updateAllWidgets();
@@ -860,16 +965,57 @@ void MainWindow::onCloseDisk() {
             return;
         }
         
+        runner_->cancel();
+        runner_->wait();
+        refreshBus_->setFileSystem(nullptr);
+        recoveryMgr_.reset();  // Stops the scrub first
+        defragMgr_.reset();
         fileSystem_->unmountFileSystem();
         fileSystem_.reset();
-        recoveryMgr_.reset();
-        defragMgr_.reset();
+        recordTraceAction_->setChecked(false);
         
+        blockMapWidget_->setFileSystem(nullptr);
+        performanceWidget_->setFileSystem(nullptr);
+        fileBrowserWidget_->setFileSystem(nullptr);
+        controlPanel_->setFileSystem(nullptr);
         updateAllWidgets();
         updateStatusBar();
     }
 }
 
+void MainWindow::onRecordTrace(bool checked) {
+    if (!fileSystem_) {
+        recordTraceAction_->setChecked(false);
+        return;
+    }
+    
+    Metrics& metrics = fileSystem_->getMetrics();
+    if (checked) {
+        metrics.clearTrace();
+        metrics.setTracing(true);
+        logOutput_->append("[INFO] Recording trace");
+        return;
+    }
+    
+    metrics.setTracing(false);
+    QString tracePath = QFileDialog::getSaveFileName(
+        this,
+        "Save Trace",
+        QDir::homePath() + "/trace.json",
+        "Trace Files (*.json)",
+        nullptr,
+        QFileDialog::DontUseNativeDialog
+    );
+    if (tracePath.isEmpty()) {
+        logOutput_->append("[INFO] Trace discarded");
+    } else if (metrics.writeChromeTrace(tracePath.toStdString())) {
+        logOutput_->append("[SUCCESS] Saved trace: " + tracePath);
+    } else {
+        logOutput_->append("[ERROR] Could not save trace: " + tracePath);
+    }
+    metrics.clearTrace();
+}
+
 void MainWindow::onExit() {
     close();
 }
@@ -902,14 +1048,39 @@ void MainWindow::updateStatusBar() {
 }
 
 void MainWindow::updateAllWidgets() {
+    // The bus works out what changed; a burst of calls costs one refresh
+    refreshBus_->post();
+    controlPanel_->setDiskMounted(fileSystem_ && fileSystem_->isMounted());
+    updateOperationButtons();
+}
+
+void MainWindow::refreshDuringOperation() {
+    // The bus holds off while the operation has the file system exclusively
     if (fileSystem_ && fileSystem_->isMounted()) {
-        blockMapWidget_->refresh();
-        performanceWidget_->updateMetrics();
-        fileBrowserWidget_->refresh();
-        controlPanel_->setDiskMounted(true);
-    } else {
-        controlPanel_->setDiskMounted(false);
+        refreshBus_->post();
     }
+    updateStatusBar();
+}
+
+void MainWindow::updateOperationButtons() {
+    if (writeTimer_->isActive()) {
+        return;  // The power cut animation owns the buttons until it crashes
+    }
+    
+    // After a power cut only recovery is allowed; while an operation runs only
+    // the defrag button stays live, to cancel it
+    bool busy = runner_->isRunning();
+    bool corrupted = !busy && fileSystem_ && fileSystem_->isMounted() && fileSystem_->hasCorruption();
+    bool idle = !busy && !corrupted;
+    
+    writeRandomBtn_->setEnabled(idle);
+    createFileBtn_->setEnabled(idle);
+    deleteFileBtn_->setEnabled(idle);
+    readFileBtn_->setEnabled(idle);
+    crashBtn_->setEnabled(idle);
+    benchmarkBtn_->setEnabled(idle);
+    defragBtn_->setEnabled(idle || (busy && runner_->getCurrentName() == "Defragmentation"));
+    recoveryBtn_->setEnabled(corrupted);
 }
 
 bool MainWindow::confirmDiskClose() {
@@ -922,6 +1093,8 @@ bool MainWindow::confirmDiskClose() {
 void MainWindow::closeEvent(QCloseEvent *event) {
     if (fileSystem_ && fileSystem_->isMounted()) {
         if (confirmDiskClose()) {
+            runner_->cancel();
+            runner_->wait();
             fileSystem_->unmountFileSystem();
             event->accept();
         } else {
@@ -944,10 +1117,10 @@ void MainWindow::animatedBlockWrite() {
         fileSystem_->setCorruptionState(writtenBlocks_, pendingInodeNum_);
         
         // Write bitmap to persist the allocations
-        fileSystem_->getDisk()->writeBitmap();
+        fileSystem_->getDisk()->flushBitmap();
         
-        // Refresh to show BLACK blocks
-        blockMapWidget_->refresh();
+        // Show the BLACK blocks before the modal below
+        refreshBus_->flushNow();
         
         // Update health chart
         int totalBlocks = fileSystem_->getDisk()->getTotalBlocks();
@@ -990,6 +1163,7 @@ void MainWindow::animatedBlockWrite() {
     size_t bytesToWrite = std::min(static_cast<size_t>(4096), pendingFileData_.size() - offset);
     
     // Allocate and write block
+    std::lock_guard<ReentrantSharedMutex> lock(fileSystem_->getMutex());
     int32_t blockNum = fileSystem_->getDisk()->allocateBlock();
     if (blockNum >= 0) {
         // Write data to block
@@ -1009,7 +1183,7 @@ void MainWindow::animatedBlockWrite() {
         writeProgressBar_->setFormat(QString("Writing: %1/%2 blocks").arg(blocksWritten_).arg(totalBlocksToWrite_));
         
         // Refresh bitmap to show GREEN block
-        blockMapWidget_->refresh();
+        refreshBus_->post();
         
         logOutput_->append(QString("[WRITE] Block %1/%2 written → GREEN (block #%3)")
                           .arg(blocksWritten_).arg(totalBlocksToWrite_).arg(blockNum));
@@ -0,0 +1,236 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace FileSystemTool {
+
+namespace {
+
+// Small stable ids for trace rows, in order of first use
+uint32_t currentThreadId() {
+    static std::atomic<uint32_t> nextId(1);
+    thread_local uint32_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+// floor(log2(value)) for value > 0, without compiler builtins
+uint32_t highestBit(uint64_t value) {
+    uint32_t bit = 0;
+    for (uint32_t shift = 32; shift > 0; shift >>= 1) {
+        if (value >> (bit + shift)) {
+            bit += shift;
+        }
+    }
+    return bit;
+}
+
+} // namespace
+
+const char* metricOpName(MetricOp op) {
+    switch (op) {
+        case MetricOp::CREATE: return "create";
+        case MetricOp::REMOVE: return "delete";
+        case MetricOp::READ: return "read";
+        case MetricOp::WRITE: return "write";
+        case MetricOp::LOOKUP: return "lookup";
+        default: return "unknown";
+    }
+}
+
+const char* metricCounterName(MetricCounter counter) {
+    switch (counter) {
+        case MetricCounter::BLOCK_READS: return "block_reads";
+        case MetricCounter::BLOCK_WRITES: return "block_writes";
+        case MetricCounter::DEVICE_READS: return "device_reads";
+        case MetricCounter::DEVICE_WRITES: return "device_writes";
+        case MetricCounter::BITMAP_WRITES: return "bitmap_writes";
+        case MetricCounter::INODE_READS: return "inode_reads";
+        case MetricCounter::INODE_WRITES: return "inode_writes";
+        case MetricCounter::JOURNAL_RECORDS: return "journal_records";
+        case MetricCounter::JOURNAL_STAGED_BLOCKS: return "journal_staged_blocks";
+        case MetricCounter::JOURNAL_SLOT_SCANS: return "journal_slot_scans";
+        default: return "unknown";
+    }
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+uint32_t LatencyHistogram::bucketOf(uint64_t ns) {
+    constexpr uint64_t subBuckets = 1ull << SUB_BUCKET_BITS;
+    if (ns < subBuckets) {
+        return static_cast<uint32_t>(ns);
+    }
+    
+    uint32_t exponent = highestBit(ns);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    uint32_t sub = static_cast<uint32_t>(ns >> (exponent - SUB_BUCKET_BITS)) & (subBuckets - 1);
+    return ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub;
+}
+
+uint64_t LatencyHistogram::bucketMidpoint(uint32_t bucket) {
+    constexpr uint32_t subBuckets = 1u << SUB_BUCKET_BITS;
+    if (bucket < subBuckets) {
+        return bucket;
+    }
+    
+    uint32_t exponent = (bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+    uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+    uint64_t low = static_cast<uint64_t>(subBuckets + (bucket & (subBuckets - 1))) * width;
+    return low + width / 2;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    buckets_[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    sumNs_.fetch_add(ns, std::memory_order_relaxed);
+    
+    uint64_t max = maxNs_.load(std::memory_order_relaxed);
+    while (ns > max && !maxNs_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    sumNs_.store(0, std::memory_order_relaxed);
+    maxNs_.store(0, std::memory_order_relaxed);
+}
+
+LatencySummary LatencyHistogram::summarize() const {
+    // Concurrent records may land between these loads; the summary is then off
+    // by those few samples, which is fine for monitoring
+    std::array<uint64_t, BUCKET_COUNT> counts;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    
+    LatencySummary summary{};
+    summary.count = total;
+    if (total == 0) {
+        return summary;
+    }
+    double maxNs = static_cast<double>(maxNs_.load(std::memory_order_relaxed));
+    summary.meanUs = static_cast<double>(sumNs_.load(std::memory_order_relaxed)) / total / 1000.0;
+    summary.maxUs = maxNs / 1000.0;
+    
+    // Nearest rank, walking the buckets once for all four percentiles
+    const double percents[] = {50.0, 90.0, 99.0, 99.9};
+    double* outputs[] = {&summary.p50Us, &summary.p90Us, &summary.p99Us, &summary.p999Us};
+    uint64_t seen = 0;
+    size_t next = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT && next < 4; ++i) {
+        seen += counts[i];
+        while (next < 4 && seen > 0 && seen >= static_cast<uint64_t>(percents[next] / 100.0 * total + 0.5)) {
+            *outputs[next] = std::min(static_cast<double>(bucketMidpoint(i)), maxNs) / 1000.0;
+            ++next;
+        }
+    }
+    return summary;
+}
+
+Metrics::Metrics() : enabled_(false), tracing_(false), epoch_(std::chrono::steady_clock::now()), droppedEvents_(0) {
+    for (auto& counter : counters_) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void Metrics::setTracing(bool tracing) {
+    tracing_.store(tracing, std::memory_order_relaxed);
+}
+
+void Metrics::reset() {
+    for (auto& histogram : histograms_) {
+        histogram.reset();
+    }
+    for (auto& counter : counters_) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    clearTrace();
+}
+
+void Metrics::clearTrace() {
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    trace_.clear();
+    droppedEvents_ = 0;
+    epoch_ = std::chrono::steady_clock::now();
+}
+
+void Metrics::record(MetricOp op, uint64_t durationNs) {
+    if (!isEnabled()) {
+        return;
+    }
+    histograms_[static_cast<size_t>(op)].record(durationNs);
+    if (!isTracing()) {
+        return;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    if (trace_.size() >= MAX_TRACE_EVENTS) {
+        droppedEvents_++;
+        return;
+    }
+    uint64_t endNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - epoch_).count();
+    trace_.push_back({op, currentThreadId(), endNs > durationNs ? endNs - durationNs : 0, durationNs});
+}
+
+MetricsReport Metrics::getReport() const {
+    MetricsReport report{};
+    report.enabled = isEnabled();
+    for (size_t i = 0; i < METRIC_OP_COUNT; ++i) {
+        report.ops[i] = histograms_[i].summarize();
+    }
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        report.counters[i] = counters_[i].load(std::memory_order_relaxed);
+    }
+    
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    report.traceEvents = trace_.size();
+    report.droppedTraceEvents = droppedEvents_;
+    return report;
+}
+
+bool Metrics::writeChromeTrace(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    
+    // Trace Event Format: complete ("X") events with microsecond timestamps
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    for (size_t i = 0; i < trace_.size(); ++i) {
+        const auto& event = trace_[i];
+        out << "{\"name\": \"" << metricOpName(event.op) << "\", \"cat\": \"fs\", \"ph\": \"X\", \"pid\": 1"
+            << ", \"tid\": " << event.thread
+            << ", \"ts\": " << event.startNs / 1000.0
+            << ", \"dur\": " << event.durationNs / 1000.0 << "}"
+            << (i + 1 < trace_.size() ? ",\n" : "\n");
+    }
+    out << "], \"otherData\": {\"dropped_events\": " << droppedEvents_ << "}}" << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+    return static_cast<bool>(out);
+}
+
+bool Metrics::writeChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write trace: " << path << std::endl;
+        return false;
+    }
+    return writeChromeTrace(out);
+}
+
+} // namespace FileSystemTool
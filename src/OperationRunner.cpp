@@ -0,0 +1,187 @@
+#include "OperationRunner.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace FileSystemTool {
+
+OperationRunner::OperationRunner(QObject *parent)
+    : QObject(parent), thread_(nullptr), generation_(0), cancelled_(false), success_(false) {}
+
+OperationRunner::~OperationRunner() {
+    // Too late for completions: whatever they would touch is being torn down
+    if (thread_) {
+        cancel();
+        thread_->wait();
+        delete thread_;
+    }
+}
+
+bool OperationRunner::start(const QString& name, Task task, Completion done,
+                            std::function<void()> onCancel) {
+    if (thread_) {
+        return false;
+    }
+    
+    name_ = name;
+    cancelled_ = false;
+    success_ = false;
+    done_ = std::move(done);
+    onCancel_ = std::move(onCancel);
+    uint64_t generation = ++generation_;
+    
+    thread_ = QThread::create([this, task = std::move(task)]() {
+        ProgressCallback report = [this](int percent, const std::string& message) {
+            emit progress(percent, QString::fromStdString(message));
+        };
+        success_ = task(report, cancelled_);
+    });
+    
+    // finished() is emitted on the worker, so this runs queued on our thread;
+    // wait() may already have finished the run by then
+    connect(thread_, &QThread::finished, this, [this, generation]() {
+        if (thread_ && generation == generation_) {
+            finish();
+        }
+    });
+    
+    emit started(name_);
+    thread_->start();
+    return true;
+}
+
+void OperationRunner::cancel() {
+    if (!thread_) {
+        return;
+    }
+    cancelled_ = true;
+    if (onCancel_) {
+        onCancel_();
+    }
+}
+
+void OperationRunner::wait() {
+    if (!thread_) {
+        return;
+    }
+    thread_->wait();
+    finish();
+}
+
+void OperationRunner::finish() {
+    thread_->wait();  // Past finished() already; only the thread's exit remains
+    thread_->deleteLater();
+    thread_ = nullptr;
+    
+    // Clear the state first so a completion may start the next operation
+    QString name = name_;
+    bool success = success_;
+    bool cancelled = cancelled_;
+    Completion done = std::move(done_);
+    done_ = nullptr;
+    onCancel_ = nullptr;
+    
+    if (done) {
+        done(success, cancelled);
+    }
+    emit finished(name, success, cancelled);
+}
+
+bool OperationRunner::startDefrag(DefragManager* defragMgr, Completion done) {
+    Task task = [defragMgr](const ProgressCallback& progress, const CancellationToken& cancelled) {
+        if (cancelled) {
+            return false;
+        }
+        defragMgr->setProgressCallback(progress);
+        bool stop = false;  // Cancellation arrives through requestCancel()
+        bool success = defragMgr->defragmentFileSystem(stop);
+        defragMgr->setProgressCallback(nullptr);
+        return success && !cancelled;
+    };
+    return start("Defragmentation", std::move(task), std::move(done),
+                 [defragMgr]() { defragMgr->requestCancel(); });
+}
+
+bool OperationRunner::startRecovery(RecoveryManager* recoveryMgr, Completion done) {
+    Task task = [recoveryMgr](const ProgressCallback& progress, const CancellationToken& cancelled) {
+        if (cancelled) {
+            return false;
+        }
+        recoveryMgr->setProgressCallback(progress);
+        bool success = recoveryMgr->performRecovery();
+        recoveryMgr->setProgressCallback(nullptr);
+        return success;
+    };
+    return start("Recovery", std::move(task), std::move(done));
+}
+
+bool OperationRunner::startBenchmark(DefragManager* defragMgr, uint32_t numFiles,
+                                     std::function<void(bool success, const BenchmarkResults& results)> done) {
+    auto results = std::make_shared<BenchmarkResults>();
+    Task task = [defragMgr, numFiles, results](const ProgressCallback& progress,
+                                               const CancellationToken& cancelled) {
+        if (cancelled) {
+            return false;
+        }
+        progress(0, "Benchmarking with " + std::to_string(numFiles) + " files");
+        *results = defragMgr->runBenchmark(numFiles);
+        progress(100, "");
+        return results->totalOperations > 0;
+    };
+    return start("Benchmark", std::move(task), [done, results](bool success, bool) {
+        if (done) {
+            done(success, *results);
+        }
+    });
+}
+
+bool OperationRunner::startImport(FileSystem* fs, std::vector<BatchFile> files, Completion done,
+                                  uint32_t filesPerBatch, uint32_t pauseMs) {
+    Task task = [fs, files = std::move(files), filesPerBatch, pauseMs](const ProgressCallback& progress,
+                                                                       const CancellationToken& cancelled) mutable {
+        size_t step = std::max<uint32_t>(1, filesPerBatch);
+        size_t written = 0;
+        size_t failed = 0;
+        
+        for (size_t first = 0; first < files.size() && !cancelled; first += step) {
+            if (first > 0 && pauseMs > 0 && !pause(cancelled, pauseMs)) {
+                break;
+            }
+            
+            size_t last = std::min(files.size(), first + step);
+            std::vector<BatchFile> batch(std::make_move_iterator(files.begin() + first),
+                                         std::make_move_iterator(files.begin() + last));
+            if (fs->writeBatch(batch)) {
+                written += batch.size();
+            } else {
+                failed += batch.size();
+            }
+            progress(static_cast<int>(last * 100 / files.size()), "");
+        }
+        
+        std::string summary = "Imported " + std::to_string(written) + " of " +
+                              std::to_string(files.size()) + " files";
+        if (failed > 0) {
+            summary += " (" + std::to_string(failed) + " failed)";
+        }
+        progress(100, summary);
+        return written == files.size();
+    };
+    return start("Import", std::move(task), std::move(done));
+}
+
+bool OperationRunner::pause(const CancellationToken& cancelled, uint32_t ms) {
+    // Short slices, so a cancel is noticed within a few tens of milliseconds
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (!cancelled) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            until - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            return true;
+        }
+        QThread::msleep(static_cast<unsigned long>(std::min<long long>(left, 20)));
+    }
+    return false;
+}
+
+} // namespace FileSystemTool
@@ -13,13 +13,15 @@
 #include <QLineSeries>
 #include <QDialog>
 #include <QPushButton>
+#include <QPen>
 #include <algorithm>
 #include <iostream>
 
 namespace FileSystemTool {
 
 PerformanceWidget::PerformanceWidget(QWidget *parent) 
-    : QWidget(parent), fileSystem_(nullptr), defragMgr_(nullptr), operationCount_(0) {
+    : QWidget(parent), fileSystem_(nullptr), defragMgr_(nullptr), showingPercentiles_(false),
+      operationCount_(0), percentileSamples_(0) {
     setupUI();
 }
 
@@ -43,11 +45,14 @@ void PerformanceWidget::setupUI() {
     avgWriteLabel_ = new QLabel("Avg Write: 0 ms", this);
     totalOpsLabel_ = new QLabel("Total Ops: 0", this);
     fragmentationLabel_ = new QLabel("Fragmentation: 0%", this);
+    percentileLabel_ = new QLabel(this);
+    percentileLabel_->hide();  // Shown once metrics are on
     
     metricsLayout->addWidget(avgReadLabel_);
     metricsLayout->addWidget(avgWriteLabel_);
     metricsLayout->addWidget(totalOpsLabel_);
     metricsLayout->addWidget(fragmentationLabel_);
+    metricsLayout->addWidget(percentileLabel_);
     
     // Latency chart
     setupLatencyChart();
@@ -103,8 +108,18 @@ void PerformanceWidget::setupLatencyChart() {
     writeLatencySeries_->setName("Write Latency");  
     writeLatencySeries_->setColor(QColor(46, 204, 113));  // Green
     
+    readTailSeries_ = new QLineSeries();
+    readTailSeries_->setName("Read p99");
+    readTailSeries_->setPen(QPen(QColor(52, 152, 219), 1, Qt::DashLine));
+    
+    writeTailSeries_ = new QLineSeries();
+    writeTailSeries_->setName("Write p99");
+    writeTailSeries_->setPen(QPen(QColor(46, 204, 113), 1, Qt::DashLine));
+    
     latencyChart_->addSeries(readLatencySeries_);
     latencyChart_->addSeries(writeLatencySeries_);
+    latencyChart_->addSeries(readTailSeries_);
+    latencyChart_->addSeries(writeTailSeries_);
     latencyChart_->createDefaultAxes();
     latencyChart_->legend()->setVisible(true);
     latencyChart_->legend()->setAlignment(Qt::AlignBottom);
@@ -120,7 +135,22 @@ void PerformanceWidget::updateMetrics() {
         return;
     }
     
-    const auto& stats = fileSystem_->getStats();
+    // Skipped while an operation holds the file system; the labels keep the last values
+    FileSystem::Snapshot snapshot;
+    if (!fileSystem_->trySnapshot(snapshot)) {
+        return;
+    }
+    showMetrics(snapshot);
+}
+
+void PerformanceWidget::applyChanges(const ChangeSet& changes) {
+    if (fileSystem_ && fileSystem_->isMounted()) {
+        showMetrics(changes.snapshot);
+    }
+}
+
+void PerformanceWidget::showMetrics(const FileSystem::Snapshot& snapshot) {
+    const auto& stats = snapshot.stats;
     
     double avgRead = stats.totalReads > 0 ? 
                      stats.lastReadTimeMs : 0;
@@ -134,9 +164,13 @@ void PerformanceWidget::updateMetrics() {
                            .arg(stats.totalWrites));
     
     // Get REAL fragmentation score from FileSystem
-    double fragScore = fileSystem_->getFragmentationScore();
+    double fragScore = snapshot.fragmentationScore;
     fragmentationLabel_->setText(QString("Fragmentation: %1%").arg(fragScore, 0, 'f', 1));
     
+    if (stats.metrics.enabled) {
+        plotPercentiles(stats.metrics);
+    }
+    
     // Record chart data if we have new operations
     if (avgRead > 0 && (readLatencies_.empty() || readLatencies_.back() != avgRead)) {
         readLatencies_.push_back(avgRead);
@@ -157,6 +191,70 @@ void PerformanceWidget::updateMetrics() {
     }
 }
 
+void PerformanceWidget::plotPercentiles(const MetricsReport& report) {
+    const LatencySummary& reads = report.ops[static_cast<size_t>(MetricOp::READ)];
+    const LatencySummary& writes = report.ops[static_cast<size_t>(MetricOp::WRITE)];
+    const LatencySummary& lookups = report.ops[static_cast<size_t>(MetricOp::LOOKUP)];
+    
+    auto describe = [](const char* name, const LatencySummary& op) {
+        return QString("%1 p50/p99/p99.9: %2 / %3 / %4 ms")
+            .arg(name)
+            .arg(op.p50Us / 1000.0, 0, 'f', 3)
+            .arg(op.p99Us / 1000.0, 0, 'f', 3)
+            .arg(op.p999Us / 1000.0, 0, 'f', 3);
+    };
+    percentileLabel_->setText(describe("Read", reads) + "\n" + describe("Write", writes) + "\n" +
+                              describe("Lookup", lookups));
+    percentileLabel_->show();
+    
+    if (!showingPercentiles_) {
+        // The per-operation samples give way to the percentile lines
+        showingPercentiles_ = true;
+        readLatencySeries_->setName("Read p50");
+        writeLatencySeries_->setName("Write p50");
+        latencyChart_->setTitle("Read/Write Latency (p50 / p99)");
+        readLatencySeries_->clear();
+        writeLatencySeries_->clear();
+    }
+    
+    // One point per refresh that saw new samples (a reset starts the lines over)
+    uint64_t samples = reads.count + writes.count;
+    if (samples < percentileSamples_) {
+        percentiles_.clear();
+    }
+    if (samples == percentileSamples_ || samples == 0) {
+        percentileSamples_ = samples;
+        return;
+    }
+    percentileSamples_ = samples;
+    percentiles_.push_back({reads.p50Us / 1000.0, reads.p99Us / 1000.0,
+                            writes.p50Us / 1000.0, writes.p99Us / 1000.0});
+    if (percentiles_.size() > MAX_DATA_POINTS) {
+        percentiles_.pop_front();
+    }
+    
+    QList<QPointF> readP50, readP99, writeP50, writeP99;
+    double maxLatency = 0.001;
+    for (size_t i = 0; i < percentiles_.size(); ++i) {
+        const auto& point = percentiles_[i];
+        readP50.append(QPointF(i, point.readP50));
+        readP99.append(QPointF(i, point.readP99));
+        writeP50.append(QPointF(i, point.writeP50));
+        writeP99.append(QPointF(i, point.writeP99));
+        maxLatency = std::max({maxLatency, point.readP99, point.writeP99});
+    }
+    readLatencySeries_->replace(readP50);
+    readTailSeries_->replace(readP99);
+    writeLatencySeries_->replace(writeP50);
+    writeTailSeries_->replace(writeP99);
+    
+    if (!latencyChart_->axes(Qt::Horizontal).isEmpty() && !latencyChart_->axes(Qt::Vertical).isEmpty()) {
+        latencyChart_->axes(Qt::Horizontal).first()->setRange(0, std::max(10.0, (double)percentiles_.size()));
+        latencyChart_->axes(Qt::Vertical).first()->setRange(0, maxLatency * 1.2);
+    }
+    latencyChartView_->update();
+}
+
 void PerformanceWidget::recordReadOperation(double latencyMs) {
     readLatencies_.push_back(latencyMs);
     timestamps_.push_back(QDateTime::currentMSecsSinceEpoch());
@@ -165,6 +263,10 @@ void PerformanceWidget::recordReadOperation(double latencyMs) {
         readLatencies_.pop_front();
         timestamps_.pop_front();
     }
+    if (showingPercentiles_) {
+        updateMetrics();
+        return;
+    }
     
     // Update chart
     readLatencySeries_->clear();
@@ -193,6 +295,10 @@ void PerformanceWidget::recordWriteOperation(double latencyMs) {
     if (writeLatencies_.size() > MAX_DATA_POINTS) {
         writeLatencies_.pop_front();
     }
+    if (showingPercentiles_) {
+        updateMetrics();
+        return;
+    }
     
     // Update the chart series  
     writeLatencySeries_->clear();
@@ -231,7 +337,12 @@ void PerformanceWidget::reset() {
     readLatencies_.clear();
     writeLatencies_.clear();
     timestamps_.clear();
+    percentiles_.clear();
+    percentileSamples_ = 0;
     readLatencySeries_->clear();
+    writeLatencySeries_->clear();
+    readTailSeries_->clear();
+    writeTailSeries_->clear();
     throughputChart_->update();
     latencyChartView_->update();
 }
@@ -1,54 +1,172 @@
 #include "RecoveryManager.h"
+#include "BlockBuffer.h"
 #include <iostream>
 #include <algorithm>
-#include <set>
 #include <cstdlib>
+#include <thread>
+#include <chrono>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace FileSystemTool {
 
-RecoveryManager::RecoveryManager(FileSystem* fs) : fs_(fs) {
-    journal_ = std::make_unique<Journal>(fs_->getDisk());
-    journal_->openJournal();
+namespace {
+
+constexpr uint32_t MAX_SCAN_WORKERS = 8;
+
+inline uint32_t popcount64(uint64_t value) {
+#if defined(_MSC_VER)
+    return static_cast<uint32_t>(__popcnt64(value));
+#else
+    return static_cast<uint32_t>(__builtin_popcountll(value));
+#endif
+}
+
+inline uint32_t ctz64(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+// Mask of the bits in word w that fall in [first, last)
+inline uint64_t rangeMask(size_t w, uint32_t first, uint32_t last) {
+    uint64_t lo = static_cast<uint64_t>(w) * 64;
+    uint64_t mask = ~0ULL;
+    if (first > lo) mask &= (first - lo >= 64) ? 0 : ~0ULL << (first - lo);
+    if (last < lo + 64) mask &= (last <= lo) ? 0 : (1ULL << (last - lo)) - 1;
+    return mask;
+}
+
+bool isDotEntry(const DirectoryEntry& entry) {
+    return (entry.nameLength == 1 && entry.filename[0] == '.') ||
+           (entry.nameLength == 2 && entry.filename[0] == '.' && entry.filename[1] == '.');
+}
+
+bool isClean(const ConsistencyReport& report) {
+    return report.orphanBlocks == 0 &&
+           report.invalidInodes == 0 &&
+           report.brokenDirectories == 0 &&
+           report.duplicateBlocks == 0 &&
+           report.unallocatedBlocks == 0 &&
+           report.unreachableInodes == 0;
 }
 
-RecoveryManager::~RecoveryManager() {}
+} // namespace
+
+RecoveryManager::RecoveryManager(FileSystem* fs) : fs_(fs) {}
+
+RecoveryManager::~RecoveryManager() {
+    stopScrub();
+}
 
 bool RecoveryManager::performRecovery() {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     std::cout << "Starting file system recovery..." << std::endl;
     
     // First, replay journal
+    reportProgress(0, "Replaying journal");
     if (!replayJournal()) {
         std::cerr << "Journal replay failed" << std::endl;
     }
     
     // Then check consistency
+    reportProgress(20, "Checking consistency");
     auto report = checkConsistency();
     lastReport_ = report;
     
     if (!report.isConsistent) {
         std::cout << "Inconsistencies found. Attempting repair..." << std::endl;
-        return repairFileSystem(report);
+        reportProgress(60, "Repairing " + std::to_string(report.errors.size()) + " problems");
+        bool repaired = repairFileSystem(report);
+        reportProgress(100, repaired ? "Repair complete" : "Repair failed");
+        return repaired;
     }
     
     std::cout << "File system is consistent" << std::endl;
+    reportProgress(100, "File system is consistent");
     return true;
 }
 
+void RecoveryManager::reportProgress(int progress, const std::string& message) {
+    if (progressCallback_) {
+        progressCallback_(progress, message);
+    }
+}
+
 ConsistencyReport RecoveryManager::checkConsistency() {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+    ConsistencyReport report;
+    
+    // One pass feeds every check
+    ScanResult scan = scanFileSystem();
+    reportBitmap(scan, report);
+    reportInodes(scan, report);
+    reportDirectories(scan, report);
+    
+    report.isConsistent = isClean(report);
+    return report;
+}
+
+ConsistencyReport RecoveryManager::checkDirtyRegions() {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     ConsistencyReport report;
+    VirtualDisk* disk = fs_->getDisk();
+    if (!fs_->isMounted() || !disk->hasDirtyRegions()) {
+        return report;
+    }
+    
+    // Expand the region bits into per-inode flags and a block mask
+    const auto& sb = disk->getSuperblock();
+    size_t words = (static_cast<size_t>(sb.totalBlocks) + 63) / 64;
+    ScanFilter filter;
+    filter.inodes.assign(sb.inodeCount, 0);
+    filter.blocks.assign(words, 0);
+    
+    uint32_t inodesPerRegion = disk->getInodesPerRegion();
+    uint32_t wordsPerRegion = disk->getBitmapWordsPerRegion();
+    uint32_t dirtyInodes = 0;
+    uint32_t dirtyWords = 0;
+    for (uint32_t r = 0; r < DIRTY_REGION_COUNT; ++r) {
+        if (disk->isInodeRegionDirty(r)) {
+            uint32_t first = std::min(sb.inodeCount, r * inodesPerRegion);
+            uint32_t last = std::min(sb.inodeCount, first + inodesPerRegion);
+            std::fill(filter.inodes.begin() + first, filter.inodes.begin() + last, 1);
+            dirtyInodes += last - first;
+        }
+        if (disk->isBitmapRegionDirty(r)) {
+            size_t first = std::min(words, static_cast<size_t>(r) * wordsPerRegion);
+            size_t last = std::min(words, first + wordsPerRegion);
+            std::fill(filter.blocks.begin() + first, filter.blocks.begin() + last, ~0ULL);
+            dirtyWords += static_cast<uint32_t>(last - first);
+            filter.trackBlocks = filter.trackBlocks || last > first;
+        }
+    }
     
-    checkBitmapConsistency(report);
-    checkInodeConsistency(report);
-    checkDirectoryConsistency(report);
+    std::cout << "Checking " << dirtyInodes << " dirty inodes and " << dirtyWords
+              << " dirty bitmap words" << std::endl;
     
-    report.isConsistent = (report.orphanBlocks == 0 && 
-                          report.invalidInodes == 0 && 
-                          report.brokenDirectories == 0);
+    // Reachability needs every directory, so it is left to the full check and the scrub
+    ScanResult scan = scanFileSystem(&filter);
+    reportBitmap(scan, report, &filter.blocks);
+    reportInodes(scan, report);
+    reportDirectories(scan, report);
     
+    report.isConsistent = isClean(report);
+    if (report.isConsistent) {
+        disk->clearDirtyRegions();
+    }
+    lastReport_ = report;
     return report;
 }
 
 bool RecoveryManager::repairFileSystem(const ConsistencyReport& report) {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     bool success = true;
     
     // Fix orphan blocks
@@ -74,7 +192,13 @@ bool RecoveryManager::repairFileSystem(const ConsistencyReport& report) {
 }
 
 bool RecoveryManager::replayJournal() {
-    auto uncommitted = journal_->getUncommittedTransactions();
+    // The journal belongs to the mounted file system
+    Journal* journal = fs_->getJournal();
+    if (!journal) {
+        return false;
+    }
+    
+    auto uncommitted = journal->getUncommittedTransactions();
     
     if (uncommitted.empty()) {
         std::cout << "No uncommitted transactions found" << std::endl;
@@ -87,79 +211,402 @@ bool RecoveryManager::replayJournal() {
         std::cout << "Rolling back transaction " << entry.transactionId << std::endl;
         // For simplicity, we abort all uncommitted transactions
         // In a real implementation, you might try to complete them
-        journal_->abortTransaction(entry.transactionId);
+        journal->abortTransaction(entry.transactionId);
     }
     
-    journal_->clearJournal();
+    journal->clearJournal();
     return true;
 }
 
 bool RecoveryManager::checkBitmapConsistency(ConsistencyReport& report) {
-    auto allocated = getAllAllocatedBlocks();
-    auto bitmap = fs_->getDisk()->getBitmap();
-    
-    uint32_t orphans = 0;
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+    reportBitmap(scanFileSystem(), report);
+    return report.orphanBlocks == 0 && report.duplicateBlocks == 0 && report.unallocatedBlocks == 0;
+}
+
+bool RecoveryManager::checkInodeConsistency(ConsistencyReport& report) {
+    reportInodes(scanFileSystem(), report);
+    return report.invalidInodes == 0;
+}
+
+bool RecoveryManager::checkDirectoryConsistency(ConsistencyReport& report) {
+    reportDirectories(scanFileSystem(), report);
+    return report.brokenDirectories == 0 && report.unreachableInodes == 0;
+}
+
+RecoveryManager::ScanResult RecoveryManager::scanFileSystem(const ScanFilter* filter) {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     const auto& sb = fs_->getDisk()->getSuperblock();
+    size_t words = (static_cast<size_t>(sb.totalBlocks) + 63) / 64;
+    
+    // Workers read through the image, so it must hold what the cache has
+    fs_->getDisk()->flushCache();
     
-    // Check for blocks marked used but not referenced
-    for (uint32_t i = sb.dataBlocksStart; i < bitmap.size(); ++i) {
-        bool inBitmap = !bitmap[i];  // false = used
-        bool inInodes = std::find(allocated.begin(), allocated.end(), i) != allocated.end();
+    uint32_t inodeCount = sb.inodeCount;
+    std::vector<uint8_t> inUse(inodeCount, 0);  // Disjoint ranges per worker
+    
+    uint32_t workers = std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_SCAN_WORKERS));
+    workers = std::max(1u, std::min(workers, inodeCount / 64));
+    std::vector<ScanPartial> partials(workers);
+    for (auto& part : partials) {
+        part.referenced.assign(words, 0);
+        part.duplicates.assign(words, 0);
+    }
+    
+    // Partition the inode table into contiguous ranges
+    std::vector<std::thread> threads;
+    uint32_t chunk = (inodeCount + workers - 1) / workers;
+    for (uint32_t w = 1; w < workers; ++w) {
+        uint32_t first = std::min(inodeCount, w * chunk);
+        uint32_t last = std::min(inodeCount, first + chunk);
+        threads.emplace_back(&RecoveryManager::scanInodes, this, std::ref(partials[w]),
+                             first, last, filter, std::ref(inUse));
+    }
+    scanInodes(partials[0], 0, std::min(inodeCount, chunk), filter, inUse);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    return mergeScan(partials, inUse, filter == nullptr);
+}
+
+void RecoveryManager::scanInodes(ScanPartial& part, uint32_t first, uint32_t last,
+                                 const ScanFilter* filter, std::vector<uint8_t>& inUse) {
+    VirtualDisk* disk = fs_->getDisk();
+    InodeManager* inodeMgr = fs_->getInodeManager();
+    std::vector<uint32_t> dataBlocks, metaBlocks;
+    BlockBuffer scratch;
+    
+    for (uint32_t i = first; i < last; ++i) {
+        Inode inode;
+        if (!inodeMgr->readInode(i, inode) || !inode.isValid()) {
+            continue;
+        }
+        inUse[i] = 1;
         
-        if (inBitmap && !inInodes) {
-            orphans++;
+        // Clean inodes only matter for who claims blocks in a dirty bitmap region
+        bool full = !filter || filter->inodes[i];
+        if (!full && !filter->trackBlocks) {
+            continue;
+        }
+        
+        inodeMgr->collectBlocks(inode, dataBlocks, metaBlocks, scratch.data());
+        for (const auto* list : {&dataBlocks, &metaBlocks}) {
+            for (uint32_t blockNum : *list) {
+                if (full || ((filter->blocks[blockNum >> 6] >> (blockNum & 63)) & 1)) {
+                    part.claim(blockNum);
+                }
+            }
+        }
+        if (!full) {
+            continue;
+        }
+        
+        if (inode.fileType == FileType::REGULAR_FILE) {
+            // Check if file size matches block count; inline data has to fit the inode
+            uint32_t expectedBlocks = (inode.fileSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            bool consistent = inode.hasInlineData() ? inode.fileSize <= INLINE_DATA_SIZE && inode.blockCount == 0
+                                                    : inode.blockCount == expectedBlocks;
+            if (!consistent) {
+                part.invalidInodes.push_back(i);
+            }
+        } else if (inode.fileType == FileType::DIRECTORY) {
+            // Record the edges for the dangling-entry and reachability checks
+            for (uint32_t blockNum : dataBlocks) {
+                if (!disk->readBlockShared(blockNum, scratch.data())) continue;
+                const auto* entries = reinterpret_cast<const DirectoryEntry*>(scratch.data());
+                for (uint32_t e = 0; e < ENTRIES_PER_BLOCK; ++e) {
+                    if (entries[e].isValid() && !isDotEntry(entries[e])) {
+                        part.edges.emplace_back(i, entries[e].inodeNumber);
+                    }
+                }
+            }
         }
     }
+}
+
+RecoveryManager::ScanResult RecoveryManager::mergeScan(std::vector<ScanPartial>& partials,
+                                                       const std::vector<uint8_t>& inUse,
+                                                       bool reachability) {
+    ScanResult result;
+    size_t words = partials.empty() ? 0 : partials[0].referenced.size();
+    uint32_t inodeCount = static_cast<uint32_t>(inUse.size());
+    
+    // A block set in two partials is a duplicate too
+    result.referenced.assign(words, 0);
+    result.duplicates.assign(words, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (auto& part : partials) {
+        for (size_t w = 0; w < words; ++w) {
+            result.duplicates[w] |= part.duplicates[w] | (result.referenced[w] & part.referenced[w]);
+            result.referenced[w] |= part.referenced[w];
+        }
+        result.invalidInodes.insert(result.invalidInodes.end(), part.invalidInodes.begin(), part.invalidInodes.end());
+        edges.insert(edges.end(), part.edges.begin(), part.edges.end());
+    }
     
-    report.orphanBlocks = orphans;
-    if (orphans > 0) {
-        report.errors.push_back("Found " + std::to_string(orphans) + " orphan blocks");
+    // Group metadata is spread through the disk; an inode pointing into it
+    // shares the block with the filesystem itself
+    result.metadata.assign(words, 0);
+    for (const auto& extent : fs_->getDisk()->getMetadataExtents()) {
+        uint32_t end = extent.start + extent.length;
+        for (size_t w = extent.start / 64; w < words && w * 64 < end; ++w) {
+            result.metadata[w] |= rangeMask(w, extent.start, end);
+        }
+    }
+    for (size_t w = 0; w < words; ++w) {
+        result.duplicates[w] |= result.referenced[w] & result.metadata[w];
+    }
+    
+    Inode rootInode;
+    result.rootValid = fs_->getInodeManager()->readInode(0, rootInode) &&
+                       rootInode.fileType == FileType::DIRECTORY;
+    
+    // Entries naming free inodes; sorted edges group each directory together
+    std::sort(edges.begin(), edges.end());
+    uint32_t lastBroken = UINT32_MAX;
+    for (const auto& edge : edges) {
+        if ((edge.second >= inodeCount || !inUse[edge.second]) && lastBroken != edge.first) {
+            result.brokenDirectories++;  // Count each directory once
+            lastBroken = edge.first;
+        }
+    }
+    
+    if (!reachability) {
+        return result;
+    }
+    
+    // Reachability from the root over the collected edges
+    std::vector<uint8_t> reached(inodeCount, 0);
+    std::vector<uint32_t> pending;
+    if (result.rootValid) {
+        reached[0] = 1;
+        pending.push_back(0);
+    }
+    
+    while (!pending.empty()) {
+        uint32_t dir = pending.back();
+        pending.pop_back();
+        
+        auto it = std::lower_bound(edges.begin(), edges.end(), std::make_pair(dir, 0u));
+        for (; it != edges.end() && it->first == dir; ++it) {
+            uint32_t child = it->second;
+            if (child < inodeCount && inUse[child] && !reached[child]) {
+                reached[child] = 1;
+                pending.push_back(child);
+            }
+        }
     }
     
-    return orphans == 0;
+    for (uint32_t i = 1; i < inodeCount; ++i) {
+        if (inUse[i] && !reached[i]) {
+            result.unreachableInodes++;
+        }
+    }
+    
+    return result;
 }
 
-bool RecoveryManager::checkInodeConsistency(ConsistencyReport& report) {
-    const auto& sb = fs_->getDisk()->getSuperblock();
-    uint32_t invalidCount = 0;
+void RecoveryManager::startScrub(uint32_t inodesPerStep, uint32_t pauseMs, uint32_t passIntervalMs) {
+    if (scrubThread_.joinable()) {
+        return;
+    }
     
-    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
-        Inode inode;
-        if (!fs_->getInodeManager()->readInode(i, inode)) {
+    {
+        std::lock_guard<std::mutex> lock(scrubMutex_);
+        scrubStopping_ = false;
+    }
+    scrubThread_ = std::thread(&RecoveryManager::scrubLoop, this,
+                               std::max(1u, inodesPerStep), pauseMs, passIntervalMs);
+}
+
+void RecoveryManager::stopScrub() {
+    if (!scrubThread_.joinable()) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(scrubMutex_);
+        scrubStopping_ = true;
+    }
+    scrubCv_.notify_all();
+    scrubThread_.join();
+}
+
+ScrubStatus RecoveryManager::getScrubStatus() {
+    std::lock_guard<std::mutex> lock(scrubMutex_);
+    return scrubStatus_;
+}
+
+bool RecoveryManager::scrubWait(uint32_t ms) {
+    std::unique_lock<std::mutex> lock(scrubMutex_);
+    scrubCv_.wait_for(lock, std::chrono::milliseconds(ms), [this] { return scrubStopping_; });
+    return !scrubStopping_;
+}
+
+void RecoveryManager::scrubLoop(uint32_t inodesPerStep, uint32_t pauseMs, uint32_t passIntervalMs) {
+    while (true) {
+        // Pass setup; the disk object identifies the mount the pass belongs to
+        std::vector<ScanPartial> partials(1);
+        std::vector<uint8_t> inUse;
+        VirtualDisk* disk = nullptr;
+        uint64_t startChanges = 0;
+        {
+            std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+            if (fs_->isMounted()) {
+                disk = fs_->getDisk();
+                const auto& sb = disk->getSuperblock();
+                size_t words = (static_cast<size_t>(sb.totalBlocks) + 63) / 64;
+                partials[0].referenced.assign(words, 0);
+                partials[0].duplicates.assign(words, 0);
+                inUse.assign(sb.inodeCount, 0);
+                startChanges = disk->getChangeCount();
+            }
+        }
+        if (!disk) {
+            if (!scrubWait(passIntervalMs)) return;
             continue;
         }
         
-        if (inode.isValid()) {
-            // Check if file size matches block count
-            uint32_t expectedBlocks = (inode.fileSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
-            if (inode.blockCount != expectedBlocks && inode.fileType == FileType::REGULAR_FILE) {
-                invalidCount++;
+        uint32_t inodeCount = static_cast<uint32_t>(inUse.size());
+        bool aborted = false;
+        for (uint32_t first = 0; first < inodeCount && !aborted; first += inodesPerStep) {
+            {
+                std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+                if (!fs_->isMounted() || fs_->getDisk() != disk) {
+                    aborted = true;
+                    break;
+                }
+                disk->flushCache();
+                scanInodes(partials[0], first, std::min(inodeCount, first + inodesPerStep), nullptr, inUse);
             }
+            
+            {
+                std::lock_guard<std::mutex> lock(scrubMutex_);
+                scrubStatus_.inodesScanned = std::min(inodeCount, first + inodesPerStep);
+                scrubStatus_.inodeCount = inodeCount;
+            }
+            if (!scrubWait(pauseMs)) return;
+        }
+        if (aborted) {
+            continue;
+        }
+        
+        // Per-inode findings hold step by step; block and reachability checks
+        // only mean something if nothing changed while the pass ran
+        ConsistencyReport report;
+        bool quiet = false;
+        {
+            std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+            if (!fs_->isMounted() || fs_->getDisk() != disk) {
+                continue;
+            }
+            quiet = disk->getChangeCount() == startChanges;
+            ScanResult scan = mergeScan(partials, inUse, quiet);
+            reportInodes(scan, report);
+            if (quiet) {
+                reportBitmap(scan, report);
+                reportDirectories(scan, report);
+            }
+            report.isConsistent = isClean(report);
+            if (quiet && report.isConsistent && disk->hasDirtyRegions()) {
+                disk->clearDirtyRegions();
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(scrubMutex_);
+            scrubStatus_.passes++;
+            if (!quiet) {
+                scrubStatus_.interruptedPasses++;
+            }
+            scrubStatus_.lastReport = report;
+        }
+        if (!report.isConsistent) {
+            std::cerr << "Scrub found inconsistencies: " << report.errors.front() << std::endl;
         }
+        
+        if (!scrubWait(passIntervalMs)) return;
     }
+}
+
+void RecoveryManager::reportBitmap(const ScanResult& scan, ConsistencyReport& report,
+                                   const std::vector<uint64_t>* mask) {
+    const auto& bitmap = fs_->getDisk()->getBitmap();
+    const auto& free = bitmap.words();
     
+    // used XOR referenced leaves exactly the disagreements (bitmap bit set = free)
+    uint32_t orphans = 0;
+    uint32_t unallocated = 0;
+    uint32_t duplicates = 0;
+    for (size_t w = 0; w < free.size(); ++w) {
+        uint64_t blocks = rangeMask(w, 0, bitmap.size()) & (mask ? (*mask)[w] : ~0ULL);
+        uint64_t bits = blocks & ~scan.metadata[w];
+        uint64_t used = ~free[w] & bits;
+        uint64_t diff = (used ^ scan.referenced[w]) & bits;
+        orphans += popcount64(diff & used);
+        unallocated += popcount64(diff & scan.referenced[w]);
+        duplicates += popcount64(scan.duplicates[w] & blocks);
+    }
+    
+    report.orphanBlocks = orphans;
+    report.unallocatedBlocks = unallocated;
+    report.duplicateBlocks = duplicates;
+    if (orphans > 0) {
+        report.errors.push_back("Found " + std::to_string(orphans) + " orphan blocks");
+    }
+    if (unallocated > 0) {
+        report.errors.push_back("Found " + std::to_string(unallocated) + " referenced blocks marked free");
+    }
+    if (duplicates > 0) {
+        report.errors.push_back("Found " + std::to_string(duplicates) + " blocks claimed by more than one owner");
+    }
+}
+
+void RecoveryManager::reportInodes(const ScanResult& scan, ConsistencyReport& report) {
+    uint32_t invalidCount = static_cast<uint32_t>(scan.invalidInodes.size());
     report.invalidInodes = invalidCount;
     if (invalidCount > 0) {
         report.errors.push_back("Found " + std::to_string(invalidCount) + " invalid inodes");
     }
-    
-    return invalidCount == 0;
 }
 
-bool RecoveryManager::checkDirectoryConsistency(ConsistencyReport& report) {
-    // Basic check: ensure root directory exists
-    Inode rootInode;
-    if (!fs_->getInodeManager()->readInode(0, rootInode) || 
-        rootInode.fileType != FileType::DIRECTORY) {
+void RecoveryManager::reportDirectories(const ScanResult& scan, ConsistencyReport& report) {
+    if (!scan.rootValid) {
         report.brokenDirectories = 1;
         report.errors.push_back("Root directory is corrupted");
-        return false;
+        return;
     }
     
-    return true;
+    report.brokenDirectories = scan.brokenDirectories;
+    report.unreachableInodes = scan.unreachableInodes;
+    if (scan.brokenDirectories > 0) {
+        report.errors.push_back("Found " + std::to_string(scan.brokenDirectories) +
+                                " directories with entries for free inodes");
+    }
+    if (scan.unreachableInodes > 0) {
+        report.errors.push_back("Found " + std::to_string(scan.unreachableInodes) +
+                                " inodes not reachable from the root");
+    }
+}
+
+std::vector<uint32_t> RecoveryManager::collectOrphans(const ScanResult& scan) {
+    const auto& bitmap = fs_->getDisk()->getBitmap();
+    const auto& free = bitmap.words();
+    
+    std::vector<uint32_t> orphans;
+    for (size_t w = 0; w < free.size(); ++w) {
+        uint64_t bits = ~free[w] & ~scan.referenced[w] & ~scan.metadata[w] & rangeMask(w, 0, bitmap.size());
+        while (bits) {
+            orphans.push_back(static_cast<uint32_t>(w * 64 + ctz64(bits)));
+            bits &= bits - 1;
+        }
+    }
+    return orphans;
 }
 
 bool RecoveryManager::fixOrphanBlocks(std::vector<uint32_t>& orphanBlocks) {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     std::cout << "Freeing " << orphanBlocks.size() << " orphan blocks..." << std::endl;
     
     for (uint32_t blockNum : orphanBlocks) {
@@ -171,6 +618,7 @@ bool RecoveryManager::fixOrphanBlocks(std::vector<uint32_t>& orphanBlocks) {
 }
 
 bool RecoveryManager::fixInvalidInodes(std::vector<uint32_t>& invalidInodes) {
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
     std::cout << "Fixing " << invalidInodes.size() << " invalid inodes..." << std::endl;
     
     for (uint32_t inodeNum : invalidInodes) {
@@ -212,64 +660,26 @@ void RecoveryManager::simulateCrashDuringDelete(const std::string& filename) {
 }
 
 std::vector<uint32_t> RecoveryManager::findOrphanBlocks() {
-    auto allocated = getAllAllocatedBlocks();
-    auto bitmap = fs_->getDisk()->getBitmap();
-    const auto& sb = fs_->getDisk()->getSuperblock();
-    
-    std::vector<uint32_t> orphans;
-    
-    for (uint32_t i = sb.dataBlocksStart; i < bitmap.size(); ++i) {
-        bool inBitmap = !bitmap[i];  // false = used
-        bool inInodes = std::find(allocated.begin(), allocated.end(), i) != allocated.end();
-        
-        if (inBitmap && !inInodes) {
-            orphans.push_back(i);
-        }
-    }
-    
-    return orphans;
+    std::lock_guard<ReentrantSharedMutex> lock(fs_->getMutex());
+    return collectOrphans(scanFileSystem());
 }
 
 std::vector<uint32_t> RecoveryManager::getAllAllocatedBlocks() {
-    std::set<uint32_t> blocks;
-    const auto& sb = fs_->getDisk()->getSuperblock();
+    ScanResult scan = scanFileSystem();
     
-    // Scan all inodes
-    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
-        Inode inode;
-        if (fs_->getInodeManager()->readInode(i, inode) && inode.isValid()) {
-            auto inodeBlocks = fs_->getInodeManager()->getInodeBlocks(inode);
-            blocks.insert(inodeBlocks.begin(), inodeBlocks.end());
-            
-            // Also include indirect block itself
-            if (inode.indirectBlock != 0) {
-                blocks.insert(inode.indirectBlock);
-            }
+    std::vector<uint32_t> blocks;
+    for (size_t w = 0; w < scan.referenced.size(); ++w) {
+        for (uint64_t bits = scan.referenced[w]; bits; bits &= bits - 1) {
+            blocks.push_back(static_cast<uint32_t>(w * 64 + ctz64(bits)));
         }
     }
-    
-    return std::vector<uint32_t>(blocks.begin(), blocks.end());
+    return blocks;
 }
 
 std::vector<uint32_t> RecoveryManager::findInvalidInodes() {
-    std::vector<uint32_t> invalid;
-    const auto& sb = fs_->getDisk()->getSuperblock();
-    
-    for (uint32_t i = 0; i < sb.inodeCount; ++i) {
-        Inode inode;
-        if (!fs_->getInodeManager()->readInode(i, inode)) {
-            continue;
-        }
-        
-        if (inode.isValid()) {
-            uint32_t expectedBlocks = (inode.fileSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
-            if (inode.blockCount != expectedBlocks && inode.fileType == FileType::REGULAR_FILE) {
-                invalid.push_back(i);
-            }
-        }
-    }
-    
-    return invalid;
+    ScanResult scan = scanFileSystem();
+    std::sort(scan.invalidInodes.begin(), scan.invalidInodes.end());
+    return scan.invalidInodes;
 }
 
 } // namespace FileSystemTool
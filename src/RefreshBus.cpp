@@ -0,0 +1,76 @@
+#include "RefreshBus.h"
+#include <algorithm>
+
+namespace FileSystemTool {
+
+RefreshBus::RefreshBus(QObject *parent)
+    : QObject(parent), fileSystem_(nullptr), timer_(new QTimer(this)),
+      frameBudgetMs_(REFRESH_FRAME_BUDGET_MS), lastFlushMs_(0), resetPending_(false) {
+    timer_->setSingleShot(true);
+    connect(timer_, &QTimer::timeout, this, &RefreshBus::flush);
+}
+
+void RefreshBus::setFileSystem(FileSystem* fs) {
+    fileSystem_ = fs;
+    if (fs) {
+        postReset();
+        return;
+    }
+    
+    // Detached before the file system goes away; the widgets are cleared directly
+    timer_->stop();
+    resetPending_ = false;
+}
+
+void RefreshBus::setFrameBudget(int ms) {
+    frameBudgetMs_ = std::max(1, ms);
+}
+
+void RefreshBus::post() {
+    if (timer_->isActive()) {
+        return;  // Already due this frame
+    }
+    
+    // Receivers that take longer than a frame get as long again before the next
+    // flush, so a slow refresh cannot take over the event loop
+    int interval = std::max(frameBudgetMs_, lastFlushMs_);
+    int waited = sinceFlush_.isValid() ? static_cast<int>(sinceFlush_.elapsed()) : interval;
+    timer_->start(std::max(0, interval - waited));
+}
+
+void RefreshBus::postReset() {
+    resetPending_ = true;
+    post();
+}
+
+void RefreshBus::flushNow() {
+    timer_->stop();
+    flush();
+}
+
+void RefreshBus::flush() {
+    ChangeSet changes;
+    changes.reset = resetPending_;
+    
+    if (fileSystem_ && fileSystem_->isMounted()) {
+        // Leave the change logs alone until the snapshot succeeds, so nothing
+        // drained is lost while an operation holds the file system
+        if (!fileSystem_->trySnapshot(changes.snapshot)) {
+            timer_->start(frameBudgetMs_);
+            return;
+        }
+        fileSystem_->getDisk()->takeChangedRanges(changes.blocks);
+        changes.allInodes = fileSystem_->getInodeManager()->takeChangedInodes(changes.inodes);
+    } else {
+        changes.reset = true;
+    }
+    resetPending_ = false;
+    
+    QElapsedTimer cost;
+    cost.start();
+    emit changed(changes);
+    lastFlushMs_ = static_cast<int>(cost.elapsed());
+    sinceFlush_.start();
+}
+
+} // namespace FileSystemTool
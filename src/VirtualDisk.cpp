@@ -1,13 +1,69 @@
 #include "VirtualDisk.h"
+#include "BlockBuffer.h"
+#include "Journal.h"
 #include <iostream>
 #include <cstring>
 #include <algorithm>
 
 namespace FileSystemTool {
 
-VirtualDisk::VirtualDisk(const std::string& diskPath)
-    : diskPath_(diskPath) {
+namespace {
+
+// On-disk bitmap bytes are LSB-first, i.e. little-endian 64-bit words
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+void decodeBitmapWords(const uint8_t* bytes, uint64_t* words, size_t count) {
+    for (size_t w = 0; w < count; ++w) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; ++b) {
+            word |= static_cast<uint64_t>(bytes[w * 8 + b]) << (8 * b);
+        }
+        words[w] = word;
+    }
+}
+
+void encodeBitmapWords(const uint64_t* words, size_t count, uint8_t* bytes) {
+    for (size_t w = 0; w < count; ++w) {
+        for (int b = 0; b < 8; ++b) {
+            bytes[w * 8 + b] = static_cast<uint8_t>(words[w] >> (8 * b));
+        }
+    }
+}
+#else
+void decodeBitmapWords(const uint8_t* bytes, uint64_t* words, size_t count) {
+    memcpy(words, bytes, count * sizeof(uint64_t));
+}
+
+void encodeBitmapWords(const uint64_t* words, size_t count, uint8_t* bytes) {
+    memcpy(bytes, words, count * sizeof(uint64_t));
+}
+#endif
+
+constexpr uint32_t INODES_PER_TABLE_BLOCK = BLOCK_SIZE / 128;  // INODE_SIZE = 128
+constexpr uint32_t MAX_IO_RUN_BLOCKS = 256;  // Largest merged request (1MB)
+
+} // namespace
+
+VirtualDisk::VirtualDisk(const std::string& diskPath, DiskBackend backend, size_t cacheBlocks)
+    : diskPath_(diskPath),
+      storage_(makeDiskStorage(backend)),
+      dirtyBitmapCount_(0),
+      nextFitBlock_(0),
+      cache_(BLOCK_SIZE, 0, [this](uint32_t blockNum, const uint8_t* data) {
+          return writeBlockRaw(blockNum, data);
+      }),
+      journal_(nullptr),
+      metrics_(nullptr),
+      changeCount_(0),
+      freePolicy_(FreePolicy::DISCARD),
+      allChanged_(true) {
     memset(&superblock_, 0, sizeof(Superblock));
+    bitmap_.setRunTracking(true);  // Fragmentation stats read the run histogram
+    
+    // The mapping already sits in the page cache; a second cache would only add copies
+    backend_ = storage_->getBackend();
+    if (backend_ != DiskBackend::MMAP) {
+        cache_.setCapacity(cacheBlocks);
+    }
 }
 
 VirtualDisk::~VirtualDisk() {
@@ -15,28 +71,15 @@ VirtualDisk::~VirtualDisk() {
 }
 
 bool VirtualDisk::createDisk(uint32_t sizeInBytes) {
-    // Create a new disk file
-    diskFile_.open(diskPath_, std::ios::out | std::ios::binary | std::ios::trunc);
-    if (!diskFile_.is_open()) {
+    // Size the file up front instead of writing zeros; unwritten blocks stay sparse
+    uint32_t numBlocks = sizeInBytes / BLOCK_SIZE;
+    if (!storage_->create(diskPath_, static_cast<uint64_t>(numBlocks) * BLOCK_SIZE)) {
         std::cerr << "Failed to create disk file: " << diskPath_ << std::endl;
         return false;
     }
     
-    // Write zeros to create the file of specified size
-    std::vector<uint8_t> zeros(BLOCK_SIZE, 0);
-    uint32_t numBlocks = sizeInBytes / BLOCK_SIZE;
-    
-    for (uint32_t i = 0; i < numBlocks; ++i) {
-        diskFile_.write(reinterpret_cast<const char*>(zeros.data()), BLOCK_SIZE);
-    }
-    
-    diskFile_.close();
-    
-    // Open for read/write (don't validate yet - we haven't written superblock)
-    diskFile_.open(diskPath_, std::ios::in | std::ios::out | std::ios::binary);
-    if (!diskFile_.is_open()) {
-        std::cerr << "Failed to reopen disk file: " << diskPath_ << std::endl;
-        return false;
+    if (backend_ == DiskBackend::STREAM) {
+        asyncIO_ = makeAsyncIO(storage_.get());
     }
     
     // Initialize the superblock structure in memory
@@ -44,14 +87,14 @@ bool VirtualDisk::createDisk(uint32_t sizeInBytes) {
     
     // Format the disk (writes superblock, bitmap, etc.)
     if (!formatDisk()) {
-        diskFile_.close();
+        storage_->close();
         return false;
     }
     
     // Now read bitmap into memory for normal operations
     if (!readBitmap()) {
         std::cerr << "Failed to read bitmap after format" << std::endl;
-        diskFile_.close();
+        storage_->close();
         return false;
     }
     
@@ -59,30 +102,38 @@ bool VirtualDisk::createDisk(uint32_t sizeInBytes) {
 }
 
 bool VirtualDisk::openDisk() {
-    diskFile_.open(diskPath_, std::ios::in | std::ios::out | std::ios::binary);
-    if (!diskFile_.is_open()) {
+    if (!storage_->open(diskPath_)) {
         std::cerr << "Failed to open disk file: " << diskPath_ << std::endl;
         return false;
     }
+    if (backend_ == DiskBackend::STREAM) {
+        asyncIO_ = makeAsyncIO(storage_.get());
+    }
     
     // Read superblock
     if (!readSuperblock()) {
         std::cerr << "Failed to read superblock" << std::endl;
-        diskFile_.close();
+        storage_->close();
         return false;
     }
     
     // Validate magic number
     if (superblock_.magic != MAGIC_NUMBER) {
         std::cerr << "Invalid magic number in superblock" << std::endl;
-        diskFile_.close();
+        storage_->close();
+        return false;
+    }
+    
+    if (!readGroupTable()) {
+        std::cerr << "Failed to read group descriptors" << std::endl;
+        storage_->close();
         return false;
     }
     
     // Read bitmap into memory
     if (!readBitmap()) {
         std::cerr << "Failed to read bitmap" << std::endl;
-        diskFile_.close();
+        storage_->close();
         return false;
     }
     
@@ -90,39 +141,48 @@ bool VirtualDisk::openDisk() {
 }
 
 void VirtualDisk::closeDisk() {
-    if (diskFile_.is_open()) {
-        writeBitmap();
+    if (isOpen()) {
+        sync();
         writeSuperblock();
-        diskFile_.close();
+        asyncIO_.reset();
+        storage_->close();
+        cache_.clear();
     }
 }
 
 bool VirtualDisk::formatDisk() {
     // Initialize bitmap (all blocks free except system blocks)
-    bitmap_.clear();
-    bitmap_.resize(superblock_.totalBlocks, true);  // All free initially
+    bitmap_.reset(superblock_.totalBlocks, true);  // All free initially
     
-    // Mark system blocks as used
-    uint32_t systemBlocks = superblock_.dataBlocksStart;
-    for (uint32_t i = 0; i < systemBlocks; ++i) {
-        bitmap_[i] = false;  // Mark as used
+    // Mark system blocks as used: each group's bitmap and inode table slice, plus
+    // the superblock, descriptor table and journal at the front of group 0
+    for (const auto& group : groups_) {
+        bitmap_.setRange(group.firstBlock, group.dataStart - group.firstBlock, false);
     }
     
-    // Update superblock
-    superblock_.freeBlocks = superblock_.totalBlocks - systemBlocks;
+    // Update superblock and descriptors
+    superblock_.freeBlocks = bitmap_.countFree();
+    superblock_.freeInodes = superblock_.inodeCount;
     superblock_.cleanShutdown = 1;
+    recountGroupBlocks();
+    uint32_t inodesPerGroup = getInodesPerGroup();
+    for (uint32_t g = 0; g < groups_.size(); ++g) {
+        groups_[g].freeInodes = std::min(inodesPerGroup, superblock_.inodeCount - g * inodesPerGroup);
+        groups_[g].directories = 0;
+    }
     
-    // Write superblock and bitmap
-    if (!writeSuperblock() || !writeBitmap()) {
+    // Write superblock, descriptors and bitmap
+    if (!writeSuperblock() || !writeGroupTable(false) || !writeBitmap()) {
         return false;
     }
     
     // Initialize inode table (all inodes free)
-    std::vector<uint8_t> zeros(BLOCK_SIZE, 0);
-    uint32_t inodeBlocks = superblock_.dataBlocksStart - superblock_.inodeTableStart;
+    BlockBuffer zeros;
+    zeros.zero();
+    uint32_t inodeBlocks = calculateInodeBlocks();
     
     for (uint32_t i = 0; i < inodeBlocks; ++i) {
-        if (!writeBlock(superblock_.inodeTableStart + i, zeros.data())) {
+        if (!writeBlock(inodeTableBlock(i), zeros.data())) {
             return false;
         }
     }
@@ -143,11 +203,26 @@ bool VirtualDisk::readBlock(uint32_t blockNum, uint8_t* buffer) {
         std::cerr << "Block number out of range: " << blockNum << std::endl;
         return false;
     }
+    countMetric(MetricCounter::BLOCK_READS);
+    
+    // Staged metadata is newer than the home location
+    if (journal_ && journal_->readPendingImage(blockNum, buffer)) {
+        return true;
+    }
+    
+    if (!cache_.isEnabled()) {
+        return readBlockRaw(blockNum, buffer);
+    }
     
-    diskFile_.seekg(blockNum * BLOCK_SIZE, std::ios::beg);
-    diskFile_.read(reinterpret_cast<char*>(buffer), BLOCK_SIZE);
+    if (cache_.read(blockNum, buffer)) {
+        return true;
+    }
     
-    return diskFile_.good();
+    if (!readBlockRaw(blockNum, buffer)) {
+        return false;
+    }
+    cache_.insert(blockNum, buffer, false);
+    return true;
 }
 
 bool VirtualDisk::writeBlock(uint32_t blockNum, const uint8_t* buffer) {
@@ -155,23 +230,216 @@ bool VirtualDisk::writeBlock(uint32_t blockNum, const uint8_t* buffer) {
         std::cerr << "Block number out of range: " << blockNum << std::endl;
         return false;
     }
+    countMetric(MetricCounter::BLOCK_WRITES);
     
-    diskFile_.seekp(blockNum * BLOCK_SIZE, std::ios::beg);
-    diskFile_.write(reinterpret_cast<const char*>(buffer), BLOCK_SIZE);
-    diskFile_.flush();
+    // A journaled image of this block must reach home before it is reused in place
+    if (journal_ && !journal_->revokeBlock(blockNum)) {
+        return false;
+    }
     
-    return diskFile_.good();
+    // Write-back: the block reaches the image on eviction or sync()
+    if (cache_.isEnabled() && cache_.insert(blockNum, buffer, true)) {
+        return true;
+    }
+    
+    return writeBlockRaw(blockNum, buffer);
+}
+
+bool VirtualDisk::sync() {
+    if (!isOpen()) {
+        return false;
+    }
+    
+    bool success = flushBitmap();
+    success = cache_.flush() && success;
+    return storage_->sync() && success;
+}
+
+bool VirtualDisk::readBlockShared(uint32_t blockNum, uint8_t* buffer) {
+    if (blockNum >= superblock_.totalBlocks) {
+        return false;
+    }
+    if (journal_ && journal_->readPendingImage(blockNum, buffer)) {
+        return true;
+    }
+    return readBlockRaw(blockNum, buffer);
+}
+
+bool VirtualDisk::writeBlockThrough(uint32_t blockNum, const uint8_t* buffer) {
+    if (blockNum >= superblock_.totalBlocks) {
+        std::cerr << "Block number out of range: " << blockNum << std::endl;
+        return false;
+    }
+    
+    // Drop any cached copy so a later write-back cannot overwrite this block
+    countMetric(MetricCounter::BLOCK_WRITES);
+    cache_.invalidate(blockNum);
+    return writeBlockRaw(blockNum, buffer);
+}
+
+bool VirtualDisk::writeBlockDirect(uint32_t blockNum, const uint8_t* buffer) {
+    if (blockNum >= superblock_.totalBlocks) {
+        return false;
+    }
+    countMetric(MetricCounter::BLOCK_WRITES);
+    return writeBlockRaw(blockNum, buffer);
+}
+
+bool VirtualDisk::prepareDirectWrite(uint32_t start, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        cache_.invalidate(start + i);
+        if (journal_ && !journal_->revokeBlock(start + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VirtualDisk::writeMetadataBlock(uint32_t blockNum, const uint8_t* buffer) {
+    if (!journal_) {
+        return writeBlock(blockNum, buffer);
+    }
+    if (blockNum >= superblock_.totalBlocks) {
+        std::cerr << "Block number out of range: " << blockNum << std::endl;
+        return false;
+    }
+    
+    // The journal copy supersedes any cached one, and reads are served from it
+    cache_.invalidate(blockNum);
+    return journal_->stageBlock(blockNum, buffer);
+}
+
+bool VirtualDisk::readBlocks(const uint32_t* blockNums, uint32_t count, uint8_t* buffer) {
+    std::vector<IORequest> requests;
+    std::vector<uint32_t> missed;  // Indices of the blocks the engine reads
+    
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t blockNum = blockNums[i];
+        uint8_t* target = buffer + static_cast<size_t>(i) * BLOCK_SIZE;
+        if (blockNum >= superblock_.totalBlocks) {
+            std::cerr << "Block number out of range: " << blockNum << std::endl;
+            return false;
+        }
+        if (!asyncIO_) {
+            if (!readBlock(blockNum, target)) {
+                return false;
+            }
+            continue;
+        }
+        countMetric(MetricCounter::BLOCK_READS);
+        if ((journal_ && journal_->readPendingImage(blockNum, target)) ||
+            (cache_.isEnabled() && cache_.read(blockNum, target))) {
+            continue;
+        }
+        
+        // Extend the previous request when this block follows it on disk and in the buffer
+        bool extend = !missed.empty() && missed.back() == i - 1 && blockNums[i - 1] + 1 == blockNum &&
+                      requests.back().length < MAX_IO_RUN_BLOCKS * BLOCK_SIZE;
+        if (extend) {
+            requests.back().length += BLOCK_SIZE;
+        } else {
+            requests.push_back({static_cast<uint64_t>(blockNum) * BLOCK_SIZE, target, BLOCK_SIZE, false, 0});
+        }
+        missed.push_back(i);
+    }
+    
+    if (requests.empty()) {
+        return true;
+    }
+    if (!runIOBatch(requests)) {
+        return false;
+    }
+    
+    for (uint32_t i : missed) {
+        cache_.insert(blockNums[i], buffer + static_cast<size_t>(i) * BLOCK_SIZE, false);
+    }
+    return true;
+}
+
+bool VirtualDisk::writeBlocksDirect(const std::vector<std::pair<uint32_t, const uint8_t*>>& blocks) {
+    if (!asyncIO_) {
+        bool success = true;
+        for (const auto& [blockNum, data] : blocks) {
+            success = writeBlockDirect(blockNum, data) && success;
+        }
+        return success;
+    }
+    
+    countMetric(MetricCounter::BLOCK_WRITES, blocks.size());
+    std::vector<IORequest> requests;
+    requests.reserve(blocks.size());
+    for (const auto& [blockNum, data] : blocks) {
+        if (blockNum >= superblock_.totalBlocks) {
+            return false;
+        }
+        requests.push_back({static_cast<uint64_t>(blockNum) * BLOCK_SIZE, const_cast<uint8_t*>(data),
+                            BLOCK_SIZE, true, 0});
+    }
+    return runIOBatch(requests);
+}
+
+bool VirtualDisk::runIOBatch(std::vector<IORequest>& requests) {
+    for (const auto& request : requests) {
+        countMetric(request.write ? MetricCounter::DEVICE_WRITES : MetricCounter::DEVICE_READS);
+    }
+    
+    // A single request gains nothing from the engine and need not wait for its lock
+    if (requests.size() == 1) {
+        IORequest& request = requests.front();
+        return request.write ? storage_->write(request.offset, request.buffer, request.length)
+                             : storage_->read(request.offset, request.buffer, request.length);
+    }
+    
+    std::lock_guard<std::mutex> lock(ioMutex_);
+    return asyncIO_->runBatch(requests);
+}
+
+bool VirtualDisk::flushCache() {
+    return cache_.flush();
+}
+
+bool VirtualDisk::flushStorage() {
+    return isOpen() && storage_->sync();
+}
+
+const uint8_t* VirtualDisk::blockPtr(uint32_t blockNum) const {
+    if (blockNum >= superblock_.totalBlocks) {
+        return nullptr;
+    }
+    
+    const uint8_t* base = storage_->mappedData();
+    if (!base || (journal_ && journal_->hasPendingImage(blockNum))) {
+        return nullptr;
+    }
+    return base + static_cast<size_t>(blockNum) * BLOCK_SIZE;
+}
+
+void VirtualDisk::setCacheCapacity(size_t blocks) {
+    if (backend_ == DiskBackend::MMAP) {
+        return;
+    }
+    cache_.setCapacity(blocks);
+}
+
+bool VirtualDisk::readBlockRaw(uint32_t blockNum, uint8_t* buffer) {
+    countMetric(MetricCounter::DEVICE_READS);
+    return storage_->read(static_cast<uint64_t>(blockNum) * BLOCK_SIZE, buffer, BLOCK_SIZE);
+}
+
+bool VirtualDisk::writeBlockRaw(uint32_t blockNum, const uint8_t* buffer) {
+    countMetric(MetricCounter::DEVICE_WRITES);
+    return storage_->write(static_cast<uint64_t>(blockNum) * BLOCK_SIZE, buffer, BLOCK_SIZE);
 }
 
 int32_t VirtualDisk::allocateBlock() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
     // Find first free block in data region (fast first-fit)
-    for (uint32_t i = superblock_.dataBlocksStart; i < superblock_.totalBlocks; ++i) {
-        if (bitmap_[i]) {  // Block is free
-            bitmap_[i] = false;  // Mark as used
-            superblock_.freeBlocks--;
-            writeBitmap();  // Keep disk in sync
-            return static_cast<int32_t>(i);
-        }
+    uint32_t i = bitmap_.findFirstFree(superblock_.dataBlocksStart);
+    if (i != FreeBitmap::NPOS) {
+        bitmap_.setUsed(i);
+        accountBlocks(i, 1, true);
+        markBitmapDirty(i);  // Persisted by flushBitmap() when the operation completes
+        return static_cast<int32_t>(i);
     }
     
     std::cerr << "No free blocks available" << std::endl;
@@ -179,40 +447,147 @@ int32_t VirtualDisk::allocateBlock() {
 }
 
 int32_t VirtualDisk::allocateBlockCompact() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
     // Allocate from LOWEST available block (left-to-right compaction)
     // Start searching from data blocks area
-    for (uint32_t i = superblock_.dataBlocksStart; i < superblock_.totalBlocks; ++i) {
-        if (bitmap_[i]) {  // bitmap_[i] == true means FREE
-            bitmap_[i] = false;  // Mark as allocated
-            superblock_.freeBlocks--;
-            return static_cast<int32_t>(i);
-        }
+    uint32_t i = bitmap_.findFirstFree(superblock_.dataBlocksStart);
+    if (i != FreeBitmap::NPOS) {
+        bitmap_.setUsed(i);
+        accountBlocks(i, 1, true);
+        markBitmapDirty(i);
+        return static_cast<int32_t>(i);
     }
     
     std::cerr << "No free blocks available for compact allocation" << std::endl;
     return -1;
 }
 
+bool VirtualDisk::allocateBlockRange(uint32_t start, uint32_t count) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    if (start < superblock_.dataBlocksStart ||
+        static_cast<uint64_t>(start) + count > superblock_.totalBlocks) {
+        return false;
+    }
+    
+    // Every block in the range must still be free
+    if (bitmap_.findFirstUsed(start) < start + count) {
+        return false;
+    }
+    
+    bitmap_.setRange(start, count, false);
+    accountBlocks(start, count, true);
+    markBitmapDirty(start, count);
+    return true;
+}
+
+std::vector<Extent> VirtualDisk::allocateExtent(uint32_t count, uint32_t hint) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    if (count == 0) {
+        return {};
+    }
+    
+    if (count > superblock_.freeBlocks) {
+        std::cerr << "Not enough free blocks for extent of " << count << std::endl;
+        return {};
+    }
+    
+    uint32_t dataStart = superblock_.dataBlocksStart;
+    uint32_t goal = hint != 0 ? hint : nextFitBlock_;
+    if (goal < dataStart || goal >= superblock_.totalBlocks) {
+        goal = dataStart;
+    }
+    
+    std::vector<Extent> extents;
+    
+    // One run that fits: next-fit from the goal within its group, then each later
+    // group in turn (full groups are skipped on their counts), wrapping back
+    // around to the start of the goal's group
+    uint32_t goalGroup = groupOfBlock(goal);
+    uint32_t groupCount = static_cast<uint32_t>(groups_.size());
+    uint32_t start = findRunInGroup(goalGroup, count, goal);
+    for (uint32_t i = 1; start == FreeBitmap::NPOS && i <= groupCount; ++i) {
+        start = findRunInGroup((goalGroup + i) % groupCount, count, 0);
+    }
+    
+    if (start != FreeBitmap::NPOS) {
+        bitmap_.setRange(start, count, false);
+        extents.push_back({start, count});
+    } else {
+        // Nothing large enough: take the largest runs first to keep the piece count low
+        uint32_t remaining = count;
+        while (remaining > 0) {
+            uint32_t runStart;
+            uint32_t length = bitmap_.largestRun(&runStart);  // System blocks are never free
+            if (length == 0) {
+                break;
+            }
+            
+            uint32_t take = std::min(length, remaining);
+            bitmap_.setRange(runStart, take, false);
+            extents.push_back({runStart, take});
+            remaining -= take;
+        }
+        
+        if (remaining > 0) {
+            for (const auto& extent : extents) {
+                bitmap_.setRange(extent.start, extent.length, true);
+            }
+            std::cerr << "No free blocks available" << std::endl;
+            return {};
+        }
+        
+        std::sort(extents.begin(), extents.end(), [](const Extent& a, const Extent& b) {
+            return a.start < b.start;
+        });
+    }
+    
+    for (const auto& extent : extents) {
+        markBitmapDirty(extent.start, extent.length);
+        accountBlocks(extent.start, extent.length, true);
+    }
+    nextFitBlock_ = extents.back().start + extents.back().length;
+    
+    return extents;
+}
+
 bool VirtualDisk::freeBlock(uint32_t blockNum) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
     if (blockNum >= superblock_.totalBlocks) {
         return false;
     }
     
-    if (blockNum < superblock_.dataBlocksStart) {
+    if (isMetadataBlock(blockNum)) {
         std::cerr << "Cannot free system block: " << blockNum << std::endl;
         return false;
     }
     
-    if (!bitmap_[blockNum]) {  // Block is used
-        bitmap_[blockNum] = true;  // Mark as free
-        superblock_.freeBlocks++;
+    if (!bitmap_.isFree(blockNum)) {  // Block is used
+        bitmap_.setFree(blockNum);  // Mark as free
+        accountBlocks(blockNum, 1, false);
+        markBitmapDirty(blockNum);
         
-        // Zero out the block for security
-        std::vector<uint8_t> zeros(BLOCK_SIZE, 0);
-        writeBlock(blockNum, zeros.data());
-        
-        writeBitmap();  // Keep disk in sync
+        if (freePolicy_ == FreePolicy::SECURE_ERASE) {
+            BlockBuffer zeros;
+            zeros.zero();
+            return writeBlock(blockNum, zeros.data());
+        }
         
+        // Nothing will read the old contents, so a dirty cached copy need not be written back
+        cache_.invalidate(blockNum);
+        if (freePolicy_ == FreePolicy::DISCARD) {
+            // Callers stage the metadata that dropped the block first, so the mark covers it
+            uint64_t mark = journal_ ? journal_->getStagedGroupMark() : 0;
+            FreedExtent* last = freedExtents_.empty() || freedExtents_.back().groupMark != mark ?
+                nullptr : &freedExtents_.back();
+            if (last && last->start + last->length == blockNum) {
+                last->length++;
+            } else if (last && blockNum + 1 == last->start) {
+                last->start--;
+                last->length++;
+            } else {
+                freedExtents_.push_back({blockNum, 1, mark});
+            }
+        }
         return true;
     }
     
@@ -220,100 +595,627 @@ bool VirtualDisk::freeBlock(uint32_t blockNum) {
 }
 
 bool VirtualDisk::isBlockFree(uint32_t blockNum) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
     if (blockNum >= superblock_.totalBlocks) {
         return false;
     }
-    return bitmap_[blockNum];
+    return bitmap_.isFree(blockNum);
+}
+
+bool VirtualDisk::hasDirtyBitmap() const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    return dirtyBitmapCount_ > 0;
+}
+
+uint32_t VirtualDisk::getFreeBlocks() const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    return superblock_.freeBlocks;
 }
 
 bool VirtualDisk::readSuperblock() {
-    diskFile_.seekg(0, std::ios::beg);
-    diskFile_.read(reinterpret_cast<char*>(&superblock_), sizeof(Superblock));
-    return diskFile_.good();
+    return storage_->read(0, &superblock_, sizeof(Superblock));
 }
 
 bool VirtualDisk::writeSuperblock() {
-    diskFile_.seekp(0, std::ios::beg);
-    diskFile_.write(reinterpret_cast<const char*>(&superblock_), sizeof(Superblock));
-    diskFile_.flush();
-    return diskFile_.good();
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    // Superblock is written in place; drop any cached copy of block 0
+    cache_.invalidate(0);
+    return storage_->write(0, &superblock_, sizeof(Superblock));
 }
 
 bool VirtualDisk::readBitmap() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
     uint32_t bitmapBlocks = calculateBitmapBlocks();
-    std::vector<uint8_t> buffer(BLOCK_SIZE);
+    BlockBuffer buffer;
     
-    bitmap_.clear();
-    bitmap_.reserve(superblock_.totalBlocks);
+    bitmap_.reset(superblock_.totalBlocks, false);
+    uint64_t* words = bitmap_.wordData();
+    size_t wordCount = bitmap_.wordCount();
+    constexpr size_t wordsPerBlock = BLOCK_SIZE / sizeof(uint64_t);
     
     for (uint32_t i = 0; i < bitmapBlocks; ++i) {
-        if (!readBlock(superblock_.bitmapStart + i, buffer.data())) {
+        if (!readBlock(bitmapBlockFor(i), buffer.data())) {
             return false;
         }
         
-        // Convert bytes to bits
-        for (uint32_t j = 0; j < BLOCK_SIZE && bitmap_.size() < superblock_.totalBlocks; ++j) {
-            for (int bit = 0; bit < 8 && bitmap_.size() < superblock_.totalBlocks; ++bit) {
-                bitmap_.push_back((buffer[j] & (1 << bit)) != 0);
-            }
-        }
+        size_t first = static_cast<size_t>(i) * wordsPerBlock;
+        size_t count = std::min(wordsPerBlock, wordCount - first);
+        decodeBitmapWords(buffer.data(), words + first, count);
     }
     
+    bitmap_.rebuildSummary();
+    superblock_.freeBlocks = bitmap_.countFree();  // The counters may lag the bitmap after a crash
+    recountGroupBlocks();
+    dirtyBitmapBlocks_.assign(bitmapBlocks, 0);
+    dirtyBitmapCount_ = 0;
+    
+    size_t chunks = (static_cast<size_t>(superblock_.totalBlocks) + CHANGE_CHUNK_BLOCKS - 1) / CHANGE_CHUNK_BLOCKS;
+    changedChunks_.assign((chunks + 63) / 64, 0);
+    allChanged_ = true;
     return true;
 }
 
+void VirtualDisk::countUsedBlocks(uint32_t start, uint32_t cellBlocks, uint32_t cells, uint32_t* used) const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    for (uint32_t c = 0; c < cells; ++c) {
+        uint64_t first = static_cast<uint64_t>(start) + static_cast<uint64_t>(c) * cellBlocks;
+        uint32_t begin = static_cast<uint32_t>(std::min<uint64_t>(first, superblock_.totalBlocks));
+        uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(first + cellBlocks, superblock_.totalBlocks));
+        used[c] = (end - begin) - bitmap_.countFree(begin, end - begin);
+    }
+}
+
+void VirtualDisk::takeChangedRanges(std::vector<Extent>& ranges) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    ranges.clear();
+    if (allChanged_) {
+        allChanged_ = false;
+        std::fill(changedChunks_.begin(), changedChunks_.end(), 0);
+        if (superblock_.totalBlocks > 0) {
+            ranges.push_back({0, superblock_.totalBlocks});
+        }
+        return;
+    }
+    
+    // Consecutive chunks become one range
+    for (size_t w = 0; w < changedChunks_.size(); ++w) {
+        uint64_t bits = changedChunks_[w];
+        for (uint32_t b = 0; bits && b < 64; ++b) {
+            if (!((bits >> b) & 1)) {
+                continue;
+            }
+            uint32_t start = static_cast<uint32_t>(w * 64 + b) * CHANGE_CHUNK_BLOCKS;
+            uint32_t length = std::min(CHANGE_CHUNK_BLOCKS, superblock_.totalBlocks - start);
+            if (!ranges.empty() && ranges.back().start + ranges.back().length == start) {
+                ranges.back().length += length;
+            } else {
+                ranges.push_back({start, length});
+            }
+        }
+        changedChunks_[w] = 0;
+    }
+}
+
 bool VirtualDisk::writeBitmap() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
     uint32_t bitmapBlocks = calculateBitmapBlocks();
-    std::vector<uint8_t> buffer(BLOCK_SIZE, 0);
+    BlockBuffer buffer;
     
-    size_t bitIndex = 0;
     for (uint32_t i = 0; i < bitmapBlocks; ++i) {
-        buffer.assign(BLOCK_SIZE, 0);
+        if (!writeBitmapBlock(i, buffer.data())) {
+            return false;
+        }
+    }
+    
+    dirtyBitmapBlocks_.assign(bitmapBlocks, 0);
+    dirtyBitmapCount_ = 0;
+    return true;
+}
+
+bool VirtualDisk::flushBitmap() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    bool groupsDirty = std::find(dirtyGroupBlocks_.begin(), dirtyGroupBlocks_.end(), 1) != dirtyGroupBlocks_.end();
+    if (dirtyBitmapCount_ == 0 && freedExtents_.empty() && !groupsDirty) {
+        return true;
+    }
+    
+    BlockBuffer buffer;
+    for (uint32_t i = 0; i < dirtyBitmapBlocks_.size(); ++i) {
+        if (!dirtyBitmapBlocks_[i]) {
+            continue;
+        }
+        if (!writeBitmapBlock(i, buffer.data())) {
+            return false;
+        }
+        dirtyBitmapBlocks_[i] = 0;
+        dirtyBitmapCount_--;
+    }
+    
+    // Free counts travel with the bitmap blocks they summarize
+    if (groupsDirty && !writeGroupTable(true)) {
+        return false;
+    }
+    
+    return releaseFreedExtents();
+}
+
+bool VirtualDisk::releaseFreedExtents() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    
+    // Until the group that unlinked an extent is durable, a replay can bring the
+    // old pointers back, so the contents must survive. Marks grow in free order.
+    size_t ready = 0;
+    while (ready < freedExtents_.size() &&
+           (!journal_ || journal_->isGroupMarkDurable(freedExtents_[ready].groupMark))) {
+        ready++;
+    }
+    if (ready == 0) {
+        return true;
+    }
+    
+    bool success = true;
+    std::vector<FreedExtent> kept;
+    for (size_t i = 0; i < ready; ++i) {
+        const FreedExtent& extent = freedExtents_[i];
+        uint32_t end = extent.start + extent.length;
         
-        // Convert bits to bytes
-        for (uint32_t j = 0; j < BLOCK_SIZE && bitIndex < bitmap_.size(); ++j) {
-            uint8_t byte = 0;
-            for (int bit = 0; bit < 8 && bitIndex < bitmap_.size(); ++bit) {
-                if (bitmap_[bitIndex]) {
-                    byte |= (1 << bit);
-                }
-                bitIndex++;
-            }
-            buffer[j] = byte;
+        // Reused and freed again by a group not yet durable: wait for that one too
+        bool refreed = std::any_of(freedExtents_.begin() + ready, freedExtents_.end(),
+                                   [&](const FreedExtent& later) {
+                                       return later.start < end && extent.start < later.start + later.length;
+                                   });
+        if (refreed) {
+            kept.push_back(extent);
+            continue;
         }
         
-        if (!writeBlock(superblock_.bitmapStart + i, buffer.data())) {
+        // Skip blocks reallocated since they were freed; their new contents stay
+        uint32_t pos = bitmap_.findFirstFree(extent.start);
+        while (pos < end) {
+            uint32_t runEnd = std::min(bitmap_.findFirstUsed(pos), end);
+            success = discardRange(pos, runEnd - pos) && success;
+            pos = runEnd < end ? bitmap_.findFirstFree(runEnd) : end;
+        }
+    }
+    kept.insert(kept.end(), freedExtents_.begin() + ready, freedExtents_.end());
+    freedExtents_.swap(kept);
+    return success;
+}
+
+bool VirtualDisk::discardRange(uint32_t start, uint32_t count) {
+    uint64_t offset = static_cast<uint64_t>(start) * BLOCK_SIZE;
+    if (storage_->discard(offset, static_cast<uint64_t>(count) * BLOCK_SIZE)) {
+        return true;
+    }
+    
+    // No hole punching here: zero the range in large writes instead of a block at a time
+    constexpr uint32_t chunkBlocks = 64;
+    BlockBuffer zeros(std::min(count, chunkBlocks));
+    zeros.zero();
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t n = std::min(count - done, chunkBlocks);
+        if (!storage_->write(offset + static_cast<uint64_t>(done) * BLOCK_SIZE, zeros.data(),
+                             static_cast<size_t>(n) * BLOCK_SIZE)) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+void VirtualDisk::markBitmapDirty(uint32_t blockNum, uint32_t count) {
+    constexpr uint32_t bitsPerBlock = BLOCK_SIZE * 8;
+    if (count == 0) {
+        return;
+    }
+    
+    uint32_t first = blockNum / bitsPerBlock;
+    uint32_t last = (blockNum + count - 1) / bitsPerBlock;
+    for (uint32_t i = first; i <= last && i < dirtyBitmapBlocks_.size(); ++i) {
+        if (!dirtyBitmapBlocks_[i]) {
+            dirtyBitmapBlocks_[i] = 1;
+            dirtyBitmapCount_++;
+        }
+    }
+    
+    uint32_t wordsPerRegion = getBitmapWordsPerRegion();
+    uint32_t firstRegion = (blockNum / 64) / wordsPerRegion;
+    uint32_t lastRegion = ((blockNum + count - 1) / 64) / wordsPerRegion;
+    for (uint32_t r = firstRegion; r <= lastRegion; ++r) {
+        markRegion(superblock_.dirtyBitmapRegions, r);
+    }
+    
+    uint32_t lastChunk = (blockNum + count - 1) / CHANGE_CHUNK_BLOCKS;
+    for (uint32_t c = blockNum / CHANGE_CHUNK_BLOCKS; c <= lastChunk && c / 64 < changedChunks_.size(); ++c) {
+        changedChunks_[c / 64] |= 1ULL << (c % 64);
+    }
+    changeCount_++;
+}
+
+void VirtualDisk::markInodeRegionDirty(uint32_t inodeNum) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    markRegion(superblock_.dirtyInodeRegions, inodeNum / getInodesPerRegion());
+    changeCount_++;
+}
+
+void VirtualDisk::markRegion(uint8_t* map, uint32_t region) {
+    if (region >= DIRTY_REGION_COUNT) {
+        return;
+    }
+    
+    uint8_t bit = static_cast<uint8_t>(1u << (region & 7));
+    if (!(map[region >> 3] & bit)) {
+        // Only the first change to a region costs a superblock write
+        map[region >> 3] |= bit;
+        writeSuperblock();
+    }
+}
+
+bool VirtualDisk::isInodeRegionDirty(uint32_t region) const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    return region < DIRTY_REGION_COUNT && ((superblock_.dirtyInodeRegions[region >> 3] >> (region & 7)) & 1);
+}
+
+bool VirtualDisk::isBitmapRegionDirty(uint32_t region) const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    return region < DIRTY_REGION_COUNT && ((superblock_.dirtyBitmapRegions[region >> 3] >> (region & 7)) & 1);
+}
+
+bool VirtualDisk::hasDirtyRegions() const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    for (uint32_t i = 0; i < DIRTY_REGION_COUNT / 8; ++i) {
+        if (superblock_.dirtyInodeRegions[i] || superblock_.dirtyBitmapRegions[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void VirtualDisk::clearDirtyRegions() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    memset(superblock_.dirtyInodeRegions, 0, sizeof(superblock_.dirtyInodeRegions));
+    memset(superblock_.dirtyBitmapRegions, 0, sizeof(superblock_.dirtyBitmapRegions));
+    writeSuperblock();
+}
+
+uint32_t VirtualDisk::getInodesPerRegion() const {
+    return std::max(1u, (superblock_.inodeCount + DIRTY_REGION_COUNT - 1) / DIRTY_REGION_COUNT);
+}
+
+uint32_t VirtualDisk::getBitmapWordsPerRegion() const {
+    uint32_t words = (superblock_.totalBlocks + 63) / 64;
+    return std::max(1u, (words + DIRTY_REGION_COUNT - 1) / DIRTY_REGION_COUNT);
+}
+
+bool VirtualDisk::writeBitmapBlock(uint32_t index, uint8_t* buffer) {
+    constexpr size_t wordsPerBlock = BLOCK_SIZE / sizeof(uint64_t);
+    const auto& words = bitmap_.words();
+    
+    size_t first = static_cast<size_t>(index) * wordsPerBlock;
+    size_t count = first < words.size() ? std::min(wordsPerBlock, words.size() - first) : 0;
+    
+    memset(buffer, 0, BLOCK_SIZE);
+    encodeBitmapWords(words.data() + first, count, buffer);
+    countMetric(MetricCounter::BITMAP_WRITES);
+    return writeMetadataBlock(bitmapBlockFor(index), buffer);
+}
+
+uint32_t VirtualDisk::bitmapBlockFor(uint32_t index) const {
+    // Grouped layout: bitmap block i covers exactly group i
+    if (superblock_.blocksPerGroup == 0) {
+        return superblock_.bitmapStart + index;
+    }
+    return groups_[index].bitmapBlock;
+}
+
+GroupDescriptor VirtualDisk::getGroup(uint32_t group) const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    return group < groups_.size() ? groups_[group] : GroupDescriptor();
+}
+
+uint32_t VirtualDisk::getInodesPerGroup() const {
+    return superblock_.blocksPerGroup == 0 ? superblock_.inodeCount : superblock_.inodesPerGroup;
+}
+
+uint32_t VirtualDisk::groupOfBlock(uint32_t blockNum) const {
+    if (superblock_.blocksPerGroup == 0 || groups_.empty()) {
+        return 0;
+    }
+    return std::min(blockNum / superblock_.blocksPerGroup, static_cast<uint32_t>(groups_.size()) - 1);
+}
+
+uint32_t VirtualDisk::groupOfInode(uint32_t inodeNum) const {
+    uint32_t inodesPerGroup = getInodesPerGroup();
+    if (inodesPerGroup == 0 || groups_.empty()) {
+        return 0;
+    }
+    return std::min(inodeNum / inodesPerGroup, static_cast<uint32_t>(groups_.size()) - 1);
+}
+
+uint32_t VirtualDisk::inodeTableBlock(uint32_t index) const {
+    if (superblock_.blocksPerGroup == 0) {
+        return superblock_.inodeTableStart + index;
+    }
+    uint32_t blocksPerSlice = superblock_.inodesPerGroup / INODES_PER_TABLE_BLOCK;
+    return groups_[index / blocksPerSlice].inodeTableBlock + index % blocksPerSlice;
+}
+
+bool VirtualDisk::isMetadataBlock(uint32_t blockNum) const {
+    // Each group's metadata is the prefix before its first data block
+    if (groups_.empty()) {
+        return blockNum < superblock_.dataBlocksStart;
+    }
+    return blockNum < groups_[groupOfBlock(blockNum)].dataStart;
+}
+
+std::vector<Extent> VirtualDisk::getMetadataExtents() const {
+    std::vector<Extent> extents;
+    for (const auto& group : groups_) {
+        extents.push_back({group.firstBlock, group.dataStart - group.firstBlock});
+    }
+    return extents;
+}
+
+uint32_t VirtualDisk::allocationGoal(uint32_t group) const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    if (group >= groups_.size()) {
+        return superblock_.dataBlocksStart;
+    }
+    const GroupDescriptor& desc = groups_[group];
+    if (nextFitBlock_ >= desc.dataStart && nextFitBlock_ < desc.firstBlock + desc.blockCount) {
+        return nextFitBlock_;
+    }
+    return desc.dataStart;
+}
+
+uint32_t VirtualDisk::pickDirectoryGroup() const {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    // Spread directories out so each one's files have room to stay local
+    uint32_t best = 0;
+    for (uint32_t g = 1; g < groups_.size(); ++g) {
+        const GroupDescriptor& desc = groups_[g];
+        const GroupDescriptor& current = groups_[best];
+        if (desc.freeInodes == 0) {
+            continue;
+        }
+        if (current.freeInodes == 0 || desc.freeBlocks > current.freeBlocks ||
+            (desc.freeBlocks == current.freeBlocks && desc.directories < current.directories)) {
+            best = g;
+        }
+    }
+    return best;
+}
+
+void VirtualDisk::accountInode(uint32_t inodeNum, bool directory, bool allocated) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    if (groups_.empty()) {
+        return;
+    }
+    
+    uint32_t group = groupOfInode(inodeNum);
+    GroupDescriptor& desc = groups_[group];
+    if (allocated) {
+        desc.freeInodes--;
+        superblock_.freeInodes--;
+        desc.directories += directory ? 1 : 0;
+    } else {
+        desc.freeInodes++;
+        superblock_.freeInodes++;
+        desc.directories -= directory ? 1 : 0;
+    }
+    markGroupDirty(group);
+}
+
+void VirtualDisk::setGroupInodeCounts(uint32_t group, uint32_t freeInodes, uint32_t directories) {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    if (group >= groups_.size()) {
+        return;
+    }
+    
+    GroupDescriptor& desc = groups_[group];
+    if (desc.freeInodes != freeInodes || desc.directories != directories) {
+        desc.freeInodes = freeInodes;
+        desc.directories = directories;
+        markGroupDirty(group);
+    }
+    
+    superblock_.freeInodes = 0;
+    for (const auto& g : groups_) {
+        superblock_.freeInodes += g.freeInodes;
+    }
+}
+
+void VirtualDisk::accountBlocks(uint32_t start, uint32_t count, bool used) {
+    superblock_.freeBlocks = used ? superblock_.freeBlocks - count : superblock_.freeBlocks + count;
+    
+    uint32_t end = start + count;
+    while (start < end && !groups_.empty()) {
+        uint32_t group = groupOfBlock(start);
+        GroupDescriptor& desc = groups_[group];
+        uint32_t n = std::min(end, desc.firstBlock + desc.blockCount) - start;
+        desc.freeBlocks = used ? desc.freeBlocks - n : desc.freeBlocks + n;
+        markGroupDirty(group);
+        start += n;
+    }
+}
+
+void VirtualDisk::recountGroupBlocks() {
+    for (uint32_t g = 0; g < groups_.size(); ++g) {
+        GroupDescriptor& desc = groups_[g];
+        uint32_t end = desc.firstBlock + desc.blockCount;
+        uint32_t free = 0;
+        for (uint32_t pos = bitmap_.findFirstFree(desc.firstBlock); pos < end; ) {
+            uint32_t runEnd = std::min(bitmap_.findFirstUsed(pos), end);
+            free += runEnd - pos;
+            pos = runEnd < end ? bitmap_.findFirstFree(runEnd) : end;
+        }
+        if (desc.freeBlocks != free) {
+            desc.freeBlocks = free;
+            markGroupDirty(g);
+        }
+    }
+}
+
+uint32_t VirtualDisk::findRunInGroup(uint32_t group, uint32_t count, uint32_t from) const {
+    const GroupDescriptor& desc = groups_[group];
+    if (desc.freeBlocks < count) {
+        return FreeBitmap::NPOS;
+    }
+    
+    // Runs never cross groups (the next group starts with its bitmap block)
+    uint32_t end = desc.firstBlock + desc.blockCount;
+    uint32_t pos = std::max(from, desc.dataStart);
+    while (pos < end) {
+        uint32_t start = bitmap_.findFirstFree(pos);
+        if (start == FreeBitmap::NPOS || start >= end || end - start < count) {
+            return FreeBitmap::NPOS;
+        }
+        uint32_t runEnd = std::min(bitmap_.findFirstUsed(start), end);
+        if (runEnd - start >= count) {
+            return start;
+        }
+        pos = runEnd;
+    }
+    return FreeBitmap::NPOS;
+}
+
+void VirtualDisk::markGroupDirty(uint32_t group) {
+    uint32_t index = group / GROUP_DESCRIPTORS_PER_BLOCK;
+    if (index < dirtyGroupBlocks_.size()) {
+        dirtyGroupBlocks_[index] = 1;
+    }
+}
+
+uint32_t VirtualDisk::groupTableBlocks() const {
+    if (superblock_.groupTableStart == 0) {
+        return 0;
+    }
+    return (superblock_.groupCount + GROUP_DESCRIPTORS_PER_BLOCK - 1) / GROUP_DESCRIPTORS_PER_BLOCK;
+}
+
+bool VirtualDisk::readGroupTable() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    groups_.clear();
+    
+    if (superblock_.blocksPerGroup == 0) {
+        // Flat layout: one group over the whole disk, nothing stored for it
+        GroupDescriptor flat{};
+        flat.blockCount = superblock_.totalBlocks;
+        flat.bitmapBlock = superblock_.bitmapStart;
+        flat.inodeTableBlock = superblock_.inodeTableStart;
+        flat.dataStart = superblock_.dataBlocksStart;
+        flat.freeInodes = superblock_.inodeCount;
+        groups_.push_back(flat);
+        dirtyGroupBlocks_.clear();
+        return true;
+    }
+    
+    if (superblock_.groupCount == 0 || superblock_.inodesPerGroup % INODES_PER_TABLE_BLOCK != 0) {
+        return false;
+    }
+    
+    uint32_t tableBlocks = groupTableBlocks();
+    BlockBuffer buffer;
+    groups_.resize(superblock_.groupCount);
+    for (uint32_t b = 0; b < tableBlocks; ++b) {
+        if (!readBlock(superblock_.groupTableStart + b, buffer.data())) {
+            groups_.clear();
             return false;
         }
+        uint32_t first = b * GROUP_DESCRIPTORS_PER_BLOCK;
+        uint32_t count = std::min(GROUP_DESCRIPTORS_PER_BLOCK, superblock_.groupCount - first);
+        memcpy(&groups_[first], buffer.data(), count * sizeof(GroupDescriptor));
     }
     
+    for (const auto& group : groups_) {
+        if (group.dataStart < group.firstBlock ||
+            static_cast<uint64_t>(group.firstBlock) + group.blockCount > superblock_.totalBlocks) {
+            groups_.clear();
+            return false;
+        }
+    }
+    dirtyGroupBlocks_.assign(tableBlocks, 0);
+    return true;
+}
+
+bool VirtualDisk::writeGroupTable(bool dirtyOnly) {
+    BlockBuffer buffer;
+    for (uint32_t b = 0; b < dirtyGroupBlocks_.size(); ++b) {
+        if (dirtyOnly && !dirtyGroupBlocks_[b]) {
+            continue;
+        }
+        
+        uint32_t first = b * GROUP_DESCRIPTORS_PER_BLOCK;
+        uint32_t count = std::min(GROUP_DESCRIPTORS_PER_BLOCK, static_cast<uint32_t>(groups_.size()) - first);
+        buffer.zero();
+        memcpy(buffer.data(), &groups_[first], count * sizeof(GroupDescriptor));
+        if (!writeMetadataBlock(superblock_.groupTableStart + b, buffer.data())) {
+            return false;
+        }
+        dirtyGroupBlocks_[b] = 0;
+    }
     return true;
 }
 
 void VirtualDisk::markClean() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
+    // A clean unmount is the point the dirty maps are relative to
     superblock_.cleanShutdown = 1;
+    memset(superblock_.dirtyInodeRegions, 0, sizeof(superblock_.dirtyInodeRegions));
+    memset(superblock_.dirtyBitmapRegions, 0, sizeof(superblock_.dirtyBitmapRegions));
     writeSuperblock();
 }
 
 void VirtualDisk::markDirty() {
+    std::lock_guard<std::recursive_mutex> lock(metaMutex_);
     superblock_.cleanShutdown = 0;
     writeSuperblock();
 }
 
 void VirtualDisk::initializeSuperblock(uint32_t diskSize) {
+    uint32_t totalBlocks = diskSize / BLOCK_SIZE;
+    uint32_t groupCount = std::max(1u, (totalBlocks + BLOCKS_PER_GROUP - 1) / BLOCKS_PER_GROUP);
+    if (groupCount > 1 && totalBlocks - (groupCount - 1) * BLOCKS_PER_GROUP < MIN_GROUP_BLOCKS) {
+        groupCount--;  // Too short to hold a group's metadata and some data
+        totalBlocks = groupCount * BLOCKS_PER_GROUP;
+    }
+    uint32_t lastGroupBlocks = totalBlocks - (groupCount - 1) * BLOCKS_PER_GROUP;
+    uint32_t lastGroupInodes = (lastGroupBlocks / 8 + INODES_PER_TABLE_BLOCK - 1) /
+                               INODES_PER_TABLE_BLOCK * INODES_PER_TABLE_BLOCK;
+    
     superblock_.magic = MAGIC_NUMBER;
-    superblock_.totalBlocks = diskSize / BLOCK_SIZE;
+    superblock_.totalBlocks = totalBlocks;
     superblock_.blockSize = BLOCK_SIZE;
-    superblock_.inodeCount = superblock_.totalBlocks / 8;  // ~12.5% for inodes
+    superblock_.inodeCount = (groupCount - 1) * INODES_PER_GROUP + lastGroupInodes;  // ~12.5% for inodes
     superblock_.freeInodes = superblock_.inodeCount;
-    
-    // Calculate layout
-    superblock_.bitmapStart = 1;  // Block 0 is superblock
-    superblock_.inodeTableStart = superblock_.bitmapStart + calculateBitmapBlocks();
-    superblock_.journalStart = superblock_.inodeTableStart + calculateInodeBlocks();
+    superblock_.blocksPerGroup = BLOCKS_PER_GROUP;
+    superblock_.inodesPerGroup = INODES_PER_GROUP;
+    superblock_.groupCount = groupCount;
+    superblock_.groupTableStart = 1;  // Block 0 is superblock
     superblock_.journalSize = 64;  // 64 blocks for journal (~256KB)
-    superblock_.dataBlocksStart = superblock_.journalStart + superblock_.journalSize;
     
+    // Calculate layout: every group leads with its bitmap block and inode table
+    // slice; group 0 has the superblock and descriptors before them, the journal after
+    groups_.assign(groupCount, GroupDescriptor());
+    for (uint32_t g = 0; g < groupCount; ++g) {
+        GroupDescriptor& group = groups_[g];
+        group.firstBlock = g * BLOCKS_PER_GROUP;
+        group.blockCount = std::min(BLOCKS_PER_GROUP, totalBlocks - group.firstBlock);
+        uint32_t inodes = std::min(INODES_PER_GROUP, superblock_.inodeCount - g * INODES_PER_GROUP);
+        
+        group.bitmapBlock = g == 0 ? superblock_.groupTableStart + groupTableBlocks() : group.firstBlock;
+        group.inodeTableBlock = group.bitmapBlock + 1;
+        group.dataStart = group.inodeTableBlock + inodes / INODES_PER_TABLE_BLOCK;
+        if (g == 0) {
+            superblock_.journalStart = group.dataStart;
+            group.dataStart += superblock_.journalSize;
+        }
+    }
+    dirtyGroupBlocks_.assign(groupTableBlocks(), 0);
+    
+    superblock_.bitmapStart = groups_[0].bitmapBlock;
+    superblock_.inodeTableStart = groups_[0].inodeTableBlock;
+    superblock_.dataBlocksStart = groups_[0].dataStart;
     superblock_.freeBlocks = superblock_.totalBlocks - superblock_.dataBlocksStart;
     superblock_.cleanShutdown = 1;
 }